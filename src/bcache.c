@@ -0,0 +1,347 @@
+/*
+ Copyright (c) 2010 Fizians SAS. <http://www.fizians.com>
+ This file is part of Rozofs.
+
+ Rozofs is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 3 of the License,
+ or (at your option) any later version.
+
+ Rozofs is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see
+ <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include "xmalloc.h"
+#include "log.h"
+#include "list.h"
+#include "htable.h"
+#include "bcache.h"
+
+// hash buckets per bytes of budget
+#define BCACHE_BUCKET_BYTES 2048
+#define BCACHE_BUCKETS_MIN 64
+
+// projection file with resident blocks
+typedef struct bcfile {
+    fid_t fid;
+    tid_t pid;
+    list_t blocks;
+} bcfile_t;
+
+typedef struct bcblock {
+    fid_t fid;
+    tid_t pid;
+    bid_t bid;
+    size_t size;                // of bins, 0: ghost
+    uint32_t crc;
+    void *bins;
+    bcfile_t *file;             // resident ones
+    list_t list;                // in the lru or the ghosts fifo
+    list_t flist;               // in the blocks of their file
+} bcblock_t;
+
+typedef struct bcshard {
+    pthread_mutex_t lock;
+    uint64_t max;
+    uint64_t size;
+    uint64_t gen;               // of the blocks, bumped on invalidations
+    uint64_t nghosts;
+    htable_t blocks;            // resident and ghosts
+    htable_t files;
+    list_t lru;
+    list_t ghosts;              // newest first
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} bcshard_t;
+
+static uint32_t bcfile_hash(void *key) {
+    bcfile_t *f = (bcfile_t *) key;
+    uint32_t hash = 0;
+    uint8_t *c;
+
+    for (c = f->fid; c != f->fid + 16; c++)
+        hash = *c + (hash << 6) + (hash << 16) - hash;
+    hash = f->pid + (hash << 6) + (hash << 16) - hash;
+    return hash;
+}
+
+static int bcfile_cmp(void *k1, void *k2) {
+    bcfile_t *f1 = (bcfile_t *) k1;
+    bcfile_t *f2 = (bcfile_t *) k2;
+
+    return uuid_compare(f1->fid, f2->fid) != 0 || f1->pid != f2->pid;
+}
+
+static uint32_t bcblock_hash(void *key) {
+    bcblock_t *b = (bcblock_t *) key;
+    uint32_t hash = 0;
+    uint8_t *c;
+
+    for (c = b->fid; c != b->fid + 16; c++)
+        hash = *c + (hash << 6) + (hash << 16) - hash;
+    hash = b->pid + (hash << 6) + (hash << 16) - hash;
+    for (c = (uint8_t *) & b->bid; c != (uint8_t *) (&b->bid + 1); c++)
+        hash = *c + (hash << 6) + (hash << 16) - hash;
+    return hash;
+}
+
+static int bcblock_cmp(void *k1, void *k2) {
+    bcblock_t *b1 = (bcblock_t *) k1;
+    bcblock_t *b2 = (bcblock_t *) k2;
+
+    return b1->bid != b2->bid || b1->pid != b2->pid ||
+        uuid_compare(b1->fid, b2->fid) != 0;
+}
+
+static bcshard_t *bcache_shard(bcache_t * bc, fid_t fid, tid_t pid) {
+    bcfile_t key;
+
+    uuid_copy(key.fid, fid);
+    key.pid = pid;
+    // the buckets use the low bits of the hash
+    return bc->shards + (bcfile_hash(&key) >> 16) % bc->nshards;
+}
+
+static bcblock_t *bcache_lookup(bcshard_t * sh, fid_t fid, tid_t pid,
+                                bid_t bid) {
+    bcblock_t key;
+
+    uuid_copy(key.fid, fid);
+    key.pid = pid;
+    key.bid = bid;
+    return htable_get(&sh->blocks, &key);
+}
+
+/* Must be called with sh->lock held, as the functions below. */
+static void bcache_forget(bcshard_t * sh, bcblock_t * b) {
+    htable_del(&sh->blocks, b);
+    list_remove(&b->list);
+    if (b->size) {
+        list_remove(&b->flist);
+        if (list_empty(&b->file->blocks)) {
+            htable_del(&sh->files, b->file);
+            free(b->file);
+        }
+        sh->size -= b->size + sizeof (bcblock_t);
+        free(b->bins);
+    } else {
+        sh->nghosts--;
+    }
+    free(b);
+}
+
+static void bcache_remember(bcshard_t * sh, fid_t fid, tid_t pid, bid_t bid,
+                            size_t bsize) {
+    bcblock_t *b = xcalloc(1, sizeof (bcblock_t));
+
+    uuid_copy(b->fid, fid);
+    b->pid = pid;
+    b->bid = bid;
+    htable_put(&sh->blocks, b, b);
+    list_push_front(&sh->ghosts, &b->list);
+    sh->nghosts++;
+    while (sh->nghosts > sh->max / (bsize ? bsize : 1))
+        bcache_forget(sh, list_entry(sh->ghosts.prev, bcblock_t, list));
+}
+
+static void bcache_admit(bcshard_t * sh, bcblock_t * b, size_t bsize,
+                         const void *bins, uint32_t crc) {
+    bcfile_t key;
+    bcfile_t *f;
+
+    if (bsize + sizeof (bcblock_t) > sh->max)
+        return;
+    uuid_copy(key.fid, b->fid);
+    key.pid = b->pid;
+    if (!(f = htable_get(&sh->files, &key))) {
+        f = xmalloc(sizeof (bcfile_t));
+        uuid_copy(f->fid, b->fid);
+        f->pid = b->pid;
+        list_init(&f->blocks);
+        htable_put(&sh->files, f, f);
+    }
+    list_remove(&b->list);
+    sh->nghosts--;
+    b->bins = xmalloc(bsize);
+    memcpy(b->bins, bins, bsize);
+    b->size = bsize;
+    b->crc = crc;
+    b->file = f;
+    list_push_back(&f->blocks, &b->flist);
+    list_push_front(&sh->lru, &b->list);
+    sh->size += bsize + sizeof (bcblock_t);
+    while (sh->size > sh->max) {
+        bcache_forget(sh, list_entry(sh->lru.prev, bcblock_t, list));
+        sh->evictions++;
+    }
+}
+
+void bcache_initialize(bcache_t * bc, uint64_t max, uint32_t nshards) {
+    uint32_t i, buckets;
+    DEBUG_FUNCTION;
+
+    bc->nshards = nshards;
+    bc->shards = xcalloc(nshards, sizeof (bcshard_t));
+    for (i = 0; i < nshards; i++) {
+        bcshard_t *sh = bc->shards + i;
+        sh->max = max / nshards;
+        buckets = sh->max / BCACHE_BUCKET_BYTES;
+        if (buckets < BCACHE_BUCKETS_MIN)
+            buckets = BCACHE_BUCKETS_MIN;
+        pthread_mutex_init(&sh->lock, NULL);
+        htable_initialize(&sh->blocks, buckets, bcblock_hash, bcblock_cmp);
+        htable_initialize(&sh->files, buckets / 8, bcfile_hash, bcfile_cmp);
+        list_init(&sh->lru);
+        list_init(&sh->ghosts);
+    }
+}
+
+void bcache_release(bcache_t * bc) {
+    list_t *p, *q;
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    for (i = 0; i < bc->nshards; i++) {
+        bcshard_t *sh = bc->shards + i;
+        list_for_each_forward_safe(p, q, &sh->lru)
+            bcache_forget(sh, list_entry(p, bcblock_t, list));
+        list_for_each_forward_safe(p, q, &sh->ghosts)
+            bcache_forget(sh, list_entry(p, bcblock_t, list));
+        htable_release(&sh->files);
+        htable_release(&sh->blocks);
+        pthread_mutex_destroy(&sh->lock);
+    }
+    free(bc->shards);
+    bc->shards = 0;
+    bc->nshards = 0;
+}
+
+int bcache_get(bcache_t * bc, fid_t fid, tid_t pid, bid_t bid, uint32_t n,
+               size_t bsize, void *bins, uint32_t * crcs) {
+    bcshard_t *sh = bcache_shard(bc, fid, pid);
+    bcblock_t *b;
+    uint32_t i;
+    int status = 0;
+    DEBUG_FUNCTION;
+
+    pthread_mutex_lock(&sh->lock);
+    for (i = 0; i < n; i++) {
+        b = bcache_lookup(sh, fid, pid, bid + i);
+        if (!b || b->size != bsize) {
+            sh->misses += n;
+            goto out;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        b = bcache_lookup(sh, fid, pid, bid + i);
+        memcpy((char *) bins + i * bsize, b->bins, bsize);
+        crcs[i] = b->crc;
+        list_remove(&b->list);
+        list_push_front(&sh->lru, &b->list);
+    }
+    sh->hits += n;
+    status = 1;
+out:
+    pthread_mutex_unlock(&sh->lock);
+    return status;
+}
+
+int bcache_wanted(bcache_t * bc, fid_t fid, tid_t pid, bid_t bid,
+                  uint32_t n, size_t bsize) {
+    bcshard_t *sh = bcache_shard(bc, fid, pid);
+    uint32_t i;
+    int status = 1;
+    DEBUG_FUNCTION;
+
+    pthread_mutex_lock(&sh->lock);
+    for (i = 0; i < n; i++)
+        if (bcache_lookup(sh, fid, pid, bid + i))
+            goto out;
+    for (i = 0; i < n; i++)
+        bcache_remember(sh, fid, pid, bid + i, bsize);
+    sh->misses += n;
+    status = 0;
+out:
+    pthread_mutex_unlock(&sh->lock);
+    return status;
+}
+
+uint64_t bcache_gen(bcache_t * bc, fid_t fid, tid_t pid) {
+    return __atomic_load_n(&bcache_shard(bc, fid, pid)->gen,
+                           __ATOMIC_ACQUIRE);
+}
+
+void bcache_put(bcache_t * bc, fid_t fid, tid_t pid, bid_t bid, uint32_t n,
+                size_t bsize, const void *bins, const uint32_t * crcs,
+                uint64_t gen) {
+    bcshard_t *sh = bcache_shard(bc, fid, pid);
+    bcblock_t *b;
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    pthread_mutex_lock(&sh->lock);
+    if (sh->gen != gen)
+        goto out;
+    for (i = 0; i < n; i++) {
+        // resident ones were put by a concurrent read
+        if (!(b = bcache_lookup(sh, fid, pid, bid + i)))
+            bcache_remember(sh, fid, pid, bid + i, bsize);
+        else if (!b->size)
+            bcache_admit(sh, b, bsize, (const char *) bins + i * bsize,
+                         crcs[i]);
+    }
+out:
+    pthread_mutex_unlock(&sh->lock);
+}
+
+void bcache_invalidate(bcache_t * bc, fid_t fid, tid_t pid, bid_t bid,
+                       uint32_t n) {
+    bcshard_t *sh = bcache_shard(bc, fid, pid);
+    bcfile_t key;
+    bcfile_t *f;
+    bcblock_t *b;
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    pthread_mutex_lock(&sh->lock);
+    __atomic_add_fetch(&sh->gen, 1, __ATOMIC_RELEASE);
+    if (n == 0) {
+        uuid_copy(key.fid, fid);
+        key.pid = pid;
+        // the file goes with its last block
+        while ((f = htable_get(&sh->files, &key)))
+            bcache_forget(sh, list_first_entry(&f->blocks, bcblock_t, flist));
+    } else {
+        for (i = 0; i < n; i++)
+            if ((b = bcache_lookup(sh, fid, pid, bid + i)))
+                bcache_forget(sh, b);
+    }
+    pthread_mutex_unlock(&sh->lock);
+}
+
+void bcache_stat(bcache_t * bc, bcstat_t * stat) {
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    memset(stat, 0, sizeof (bcstat_t));
+    for (i = 0; i < bc->nshards; i++) {
+        bcshard_t *sh = bc->shards + i;
+        pthread_mutex_lock(&sh->lock);
+        stat->size += sh->size;
+        stat->max += sh->max;
+        stat->hits += sh->hits;
+        stat->misses += sh->misses;
+        stat->evictions += sh->evictions;
+        pthread_mutex_unlock(&sh->lock);
+    }
+}
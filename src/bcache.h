@@ -0,0 +1,90 @@
+/*
+ Copyright (c) 2010 Fizians SAS. <http://www.fizians.com>
+ This file is part of Rozofs.
+
+ Rozofs is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 3 of the License,
+ or (at your option) any later version.
+
+ Rozofs is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see
+ <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BCACHE_H
+#define _BCACHE_H
+
+#include <stdint.h>
+#include "rozofs.h"
+
+/*
+ * Cache of projection blocks (bins and crc) within a memory budget, with
+ * a 2Q admission: blocks read once are only remembered, their keys kept in
+ * a fifo of ghosts; read again while remembered they are kept in an lru of
+ * resident blocks. A scan of cold files thus never evicts the hot blocks.
+ * Ghosts are bounded to as many blocks as the budget holds.
+ *
+ * Blocks are spread in independently locked shards by (fid, pid).
+ */
+
+struct bcshard;
+
+typedef struct bcache {
+    uint32_t nshards;
+    struct bcshard *shards;
+} bcache_t;
+
+typedef struct bcstat {
+    uint64_t size;              // of the resident blocks, in bytes
+    uint64_t max;
+    uint64_t hits;              // blocks
+    uint64_t misses;
+    uint64_t evictions;
+} bcstat_t;
+
+void bcache_initialize(bcache_t * bc, uint64_t max, uint32_t nshards);
+
+void bcache_release(bcache_t * bc);
+
+/*
+ * Copy the n blocks of bsize bytes from bid of (fid, pid) into bins and
+ * their crcs when they are all resident: returns 1 then, 0 otherwise.
+ */
+int bcache_get(bcache_t * bc, fid_t fid, tid_t pid, bid_t bid, uint32_t n,
+               size_t bsize, void *bins, uint32_t * crcs);
+
+/*
+ * Whether some of the n blocks are resident or remembered: their read is
+ * to go through the cache. When none is, they are remembered.
+ */
+int bcache_wanted(bcache_t * bc, fid_t fid, tid_t pid, bid_t bid,
+                  uint32_t n, size_t bsize);
+
+/*
+ * Generation of the blocks of (fid, pid), to be taken before they are read
+ * for bcache_put.
+ */
+uint64_t bcache_gen(bcache_t * bc, fid_t fid, tid_t pid);
+
+/*
+ * Offer n blocks read: remembered ones become resident, others are
+ * remembered. Ignored when blocks of (fid, pid) may have been invalidated
+ * since gen was taken.
+ */
+void bcache_put(bcache_t * bc, fid_t fid, tid_t pid, bid_t bid, uint32_t n,
+                size_t bsize, const void *bins, const uint32_t * crcs,
+                uint64_t gen);
+
+/* Forget n blocks from bid of (fid, pid), all of them when n is 0. */
+void bcache_invalidate(bcache_t * bc, fid_t fid, tid_t pid, bid_t bid,
+                       uint32_t n);
+
+void bcache_stat(bcache_t * bc, bcstat_t * stat);
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ Copyright (c) 2010 Fizians SAS. <http://www.fizians.com>
+ This file is part of Rozofs.
+
+ Rozofs is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 3 of the License,
+ or (at your option) any later version.
+
+ Rozofs is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see
+ <http://www.gnu.org/licenses/>.
+ */
+
+
+#define _XOPEN_SOURCE 700
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "log.h"
+#include "bufpool.h"
+
+// size class of size, BUFPOOL_CLASSES when too large
+static int bufpool_class(bufpool_t * p, size_t size) {
+    int c = 0;
+
+    while (c < BUFPOOL_CLASSES && (p->align << c) < size)
+        c++;
+    return c;
+}
+
+void bufpool_initialize(bufpool_t * p, size_t align, uint32_t max) {
+    DEBUG_FUNCTION;
+
+    pthread_mutex_init(&p->lock, NULL);
+    p->align = align;
+    p->max = max;
+    memset(p->free, 0, sizeof (p->free));
+    memset(p->nfree, 0, sizeof (p->nfree));
+}
+
+void bufpool_release(bufpool_t * p) {
+    void *buf;
+    int c;
+    DEBUG_FUNCTION;
+
+    for (c = 0; c < BUFPOOL_CLASSES; c++) {
+        while ((buf = p->free[c])) {
+            p->free[c] = *(void **) buf;
+            free(buf);
+        }
+        p->nfree[c] = 0;
+    }
+    pthread_mutex_destroy(&p->lock);
+}
+
+void *bufpool_get(bufpool_t * p, size_t size) {
+    void *buf = 0;
+    int c = bufpool_class(p, size);
+    DEBUG_FUNCTION;
+
+    if (c < BUFPOOL_CLASSES) {
+        pthread_mutex_lock(&p->lock);
+        if ((buf = p->free[c])) {
+            p->free[c] = *(void **) buf;
+            p->nfree[c]--;
+        }
+        pthread_mutex_unlock(&p->lock);
+        if (buf)
+            return buf;
+        size = p->align << c;
+    }
+    if ((errno = posix_memalign(&buf, p->align, size)) != 0) {
+        fatal("memory allocation failed -- exiting.");
+        exit(-1);
+    }
+    return buf;
+}
+
+void bufpool_put(bufpool_t * p, void *buf, size_t size) {
+    int c = bufpool_class(p, size);
+    DEBUG_FUNCTION;
+
+    if (c < BUFPOOL_CLASSES) {
+        pthread_mutex_lock(&p->lock);
+        if (p->nfree[c] < p->max) {
+            *(void **) buf = p->free[c];
+            p->free[c] = buf;
+            p->nfree[c]++;
+            buf = 0;
+        }
+        pthread_mutex_unlock(&p->lock);
+    }
+    if (buf)
+        free(buf);
+}
@@ -0,0 +1,52 @@
+/*
+ Copyright (c) 2010 Fizians SAS. <http://www.fizians.com>
+ This file is part of Rozofs.
+
+ Rozofs is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 3 of the License,
+ or (at your option) any later version.
+
+ Rozofs is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see
+ <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _BUFPOOL_H
+#define _BUFPOOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Aligned buffers (for O_DIRECT) kept for reuse: sizes are rounded up to
+ * align times a power of two, and up to max buffers of each size are kept
+ * when they are put back. Larger buffers are freed.
+ */
+#define BUFPOOL_CLASSES 16
+
+typedef struct bufpool {
+    pthread_mutex_t lock;
+    size_t align;
+    uint32_t max;
+    void *free[BUFPOOL_CLASSES];    // linked through their first bytes
+    uint32_t nfree[BUFPOOL_CLASSES];
+} bufpool_t;
+
+void bufpool_initialize(bufpool_t * p, size_t align, uint32_t max);
+
+void bufpool_release(bufpool_t * p);
+
+/* A buffer of at least size bytes aligned on p->align. */
+void *bufpool_get(bufpool_t * p, size_t size);
+
+/* Give back buf got for size bytes. */
+void bufpool_put(bufpool_t * p, void *buf, size_t size);
+
+#endif
@@ -0,0 +1,1081 @@
+/*
+ Copyright (c) 2010 Fizians SAS. <http://www.fizians.com>
+ This file is part of Rozofs.
+
+ Rozofs is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 3 of the License,
+ or (at your option) any later version.
+
+ Rozofs is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see
+ <http://www.gnu.org/licenses/>.
+ */
+
+
+#define _XOPEN_SOURCE 700
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "log.h"
+#include "xmalloc.h"
+#include "crc32c.h"
+#include "container.h"
+
+#define CONTAINER_MAGIC 0x52435452
+#define CONTAINER_BUCKETS (1 << 16)
+// compaction check period (s)
+#define CONTAINER_COMPACT_PERIOD 10
+
+/*
+ * Segment record, followed by size bins bytes and ncrcs crcs unless it
+ * records a removal.
+ */
+typedef struct ctrecord {
+    uint32_t magic;
+    uint32_t crc;               // crc32c of the record, this field being 0
+    fid_t fid;
+    tid_t pid;
+    uint8_t removed;
+    uint16_t pad;
+    uint32_t ncrcs;
+    uint64_t size;
+} ctrecord_t;
+
+/*
+ * Index file: a header, the segments then the projections as they were
+ * at close, and the crc32c of all that.
+ */
+typedef struct ctindex {
+    uint32_t magic;
+    uint32_t nsegments;
+    uint64_t nentries;
+} ctindex_t;
+
+typedef struct ctindex_segment {
+    uint32_t id;
+    uint32_t pad;
+    uint64_t size;
+    uint64_t dead;
+    uint64_t tombs;
+} ctindex_segment_t;
+
+typedef struct ctindex_entry {
+    fid_t fid;
+    tid_t pid;
+    uint8_t pad[3];
+    uint32_t seg;
+    uint64_t off;
+    uint64_t size;
+    uint32_t ncrcs;
+    uint32_t pad2;
+} ctindex_entry_t;
+
+static uint32_t ctentry_hash(void *key) {
+    ctentry_t *e = (ctentry_t *) key;
+    uint32_t hash = 0;
+    uint8_t *c;
+
+    for (c = e->fid; c != e->fid + 16; c++)
+        hash = *c + (hash << 6) + (hash << 16) - hash;
+    hash = e->pid + (hash << 6) + (hash << 16) - hash;
+    return hash;
+}
+
+static int ctentry_cmp(void *k1, void *k2) {
+    ctentry_t *e1 = (ctentry_t *) k1;
+    ctentry_t *e2 = (ctentry_t *) k2;
+
+    return uuid_compare(e1->fid, e2->fid) != 0 || e1->pid != e2->pid;
+}
+
+static inline uint64_t ctrecord_len(uint64_t size, uint32_t ncrcs) {
+    return sizeof (ctrecord_t) + size + ncrcs * sizeof (uint32_t);
+}
+
+static inline uint64_t ctentry_len(ctentry_t * e) {
+    return ctrecord_len(e->size, e->ncrcs);
+}
+
+static inline uint64_t ctrecord_total(ctrecord_t * r) {
+    return r->removed ? sizeof (ctrecord_t) : ctrecord_len(r->size, r->ncrcs);
+}
+
+static uint32_t ctrecord_crc(ctrecord_t * r) {
+    uint32_t crc = r->crc;
+    uint32_t c;
+
+    r->crc = 0;
+    c = crc32c(0, r, ctrecord_total(r));
+    r->crc = crc;
+    return c;
+}
+
+// short reads are errors
+static int ct_pread(int fd, void *buf, size_t len, uint64_t off) {
+    ssize_t n;
+
+    if ((n = pread(fd, buf, len, off)) == len)
+        return 0;
+    if (n >= 0)
+        errno = EIO;
+    return -1;
+}
+
+static ctentry_t *ct_get(container_t * ct, fid_t fid, tid_t pid) {
+    ctentry_t key;
+
+    uuid_copy(key.fid, fid);
+    key.pid = pid;
+    return htable_get(&ct->htable, &key);
+}
+
+static ctentry_t *ct_add(container_t * ct, fid_t fid, tid_t pid) {
+    ctentry_t *e = xcalloc(1, sizeof (ctentry_t));
+
+    uuid_copy(e->fid, fid);
+    e->pid = pid;
+    list_init(&e->list);
+    list_push_back(&ct->entries, &e->list);
+    htable_put(&ct->htable, e, e);
+    ct->nentries++;
+    return e;
+}
+
+static void ct_del(container_t * ct, ctentry_t * e) {
+    htable_del(&ct->htable, e);
+    list_remove(&e->list);
+    ct->nentries--;
+    free(e);
+}
+
+static int ct_first(container_t * ct, ctsegment_t * seg) {
+    return ct->segments.next == &seg->list;
+}
+
+static int ct_last(container_t * ct, ctsegment_t * seg) {
+    return ct->segments.prev == &seg->list;
+}
+
+// removal records are only needed while older segments remain
+static int ct_compactable(container_t * ct, ctsegment_t * seg) {
+    uint64_t dead = seg->dead + (ct_first(ct, seg) ? seg->tombs : 0);
+
+    return !ct_last(ct, seg) && dead * 2 >= seg->size;
+}
+
+static void ct_dead(container_t * ct, ctentry_t * e) {
+    e->seg->dead += ctentry_len(e);
+    if (ct->started && ct_compactable(ct, e->seg)) {
+        pthread_mutex_lock(&ct->clock);
+        pthread_cond_signal(&ct->cond);
+        pthread_mutex_unlock(&ct->clock);
+    }
+}
+
+static ctsegment_t *ct_segment_open(container_t * ct, uint32_t id) {
+    ctsegment_t *seg = 0;
+    char name[16];
+    struct stat s;
+    int fd;
+
+    sprintf(name, "%08x", id);
+    if ((fd = openat(ct->dirfd, name, O_RDWR | O_CREAT,
+                     S_IRUSR | S_IWUSR)) < 0)
+        goto out;
+    if (fstat(fd, &s) != 0) {
+        close(fd);
+        goto out;
+    }
+    seg = xcalloc(1, sizeof (ctsegment_t));
+    seg->id = id;
+    seg->fd = fd;
+    seg->size = s.st_size;
+    seg->synced = s.st_size;
+    list_init(&seg->list);
+    list_push_back(&ct->segments, &seg->list);
+out:
+    return seg;
+}
+
+// the segment records are appended to
+static ctsegment_t *ct_active(container_t * ct) {
+    ctsegment_t *seg = 0;
+
+    if (!list_empty(&ct->segments)) {
+        seg = list_entry(ct->segments.prev, ctsegment_t, list);
+        if (seg->size < CONTAINER_SEGMENT_SIZE)
+            return seg;
+    }
+    if (!(seg = ct_segment_open(ct, seg ? seg->id + 1 : 1))) {
+        severe("can't create container segment: %s", strerror(errno));
+    }
+    return seg;
+}
+
+static int ct_append(container_t * ct, ctrecord_t * r, ctsegment_t ** seg,
+                     uint64_t * off) {
+    int status = -1;
+    uint64_t len = ctrecord_total(r);
+    ssize_t n;
+
+    if (!(*seg = ct_active(ct)))
+        goto out;
+    r->magic = CONTAINER_MAGIC;
+    r->crc = 0;
+    r->crc = ctrecord_crc(r);
+    if ((n = pwrite((*seg)->fd, r, len, (*seg)->size)) != len) {
+        if (n >= 0)
+            errno = EIO;
+        severe("can't write container segment %08x: %s", (*seg)->id,
+               strerror(errno));
+        if (ftruncate((*seg)->fd, (*seg)->size) != 0) {
+            // later records would be lost at open
+            (*seg)->size = CONTAINER_SEGMENT_SIZE;
+        }
+        goto out;
+    }
+    *off = (*seg)->size;
+    (*seg)->size += len;
+    status = 0;
+out:
+    return status;
+}
+
+/*
+ * Record of e (zeros if null) resized to size bins bytes and ncrcs, with
+ * the crcs moved after the bins.
+ */
+static ctrecord_t *ct_load(container_t * ct, ctentry_t * e, uint64_t size,
+                           uint32_t ncrcs) {
+    ctrecord_t *r;
+    char *bins;
+    uint64_t bsize, csize;
+
+    r = xcalloc(1, ctrecord_len(size, ncrcs));
+    r->size = size;
+    r->ncrcs = ncrcs;
+    if (!e)
+        return r;
+    uuid_copy(r->fid, e->fid);
+    r->pid = e->pid;
+    bins = (char *) (r + 1);
+    bsize = e->size < size ? e->size : size;
+    csize = (e->ncrcs < ncrcs ? e->ncrcs : ncrcs) * sizeof (uint32_t);
+    if (ct_pread(e->seg->fd, bins, bsize, e->off + sizeof (ctrecord_t)) != 0
+        || ct_pread(e->seg->fd, bins + size, csize,
+                    e->off + sizeof (ctrecord_t) + e->size) != 0) {
+        severe("can't read container segment %08x: %s", e->seg->id,
+               strerror(errno));
+        free(r);
+        r = 0;
+    }
+    return r;
+}
+
+// append r as the content of e (created if null)
+static int ct_commit(container_t * ct, ctentry_t * e, ctrecord_t * r,
+                     fid_t fid, tid_t pid) {
+    int status = -1;
+    ctsegment_t *seg;
+    uint64_t off;
+
+    uuid_copy(r->fid, fid);
+    r->pid = pid;
+    r->removed = 0;
+    if (ct_append(ct, r, &seg, &off) != 0)
+        goto out;
+    if (e)
+        ct_dead(ct, e);
+    else
+        e = ct_add(ct, fid, pid);
+    e->seg = seg;
+    e->off = off;
+    e->size = r->size;
+    e->ncrcs = r->ncrcs;
+    status = 0;
+out:
+    return status;
+}
+
+static int ct_remove(container_t * ct, ctentry_t * e) {
+    int status = -1;
+    ctrecord_t r;
+    ctsegment_t *seg;
+    uint64_t off;
+
+    memset(&r, 0, sizeof (ctrecord_t));
+    uuid_copy(r.fid, e->fid);
+    r.pid = e->pid;
+    r.removed = 1;
+    if (ct_append(ct, &r, &seg, &off) != 0)
+        goto out;
+    seg->tombs += sizeof (ctrecord_t);
+    ct_dead(ct, e);
+    ct_del(ct, e);
+    status = 0;
+out:
+    return status;
+}
+
+// move the projection of e to its file
+static int ct_move(container_t * ct, ctentry_t * e, ctput_t put, void *arg) {
+    int status = -1;
+    ctrecord_t *r;
+    char *bins;
+
+    if (!(r = ct_load(ct, e, e->size, e->ncrcs)))
+        goto out;
+    bins = (char *) (r + 1);
+    if (put(arg, bins, r->size, (uint32_t *) (bins + r->size), r->ncrcs) != 0)
+        goto out;
+    // the file is used once the projection is removed from the container
+    status = ct_remove(ct, e);
+out:
+    if (r)
+        free(r);
+    return status;
+}
+
+/*
+ * Where the projection of e (null if not in the container) resized to size
+ * is to be: returns 1 for the container, 0 for its file (moved there if
+ * needed) and -1 on error.
+ */
+static int ct_place(container_t * ct, ctentry_t * e, uint64_t size,
+                    ctfile_t file, ctput_t put, void *arg) {
+    int exists;
+
+    if (e) {
+        if (size <= CONTAINER_MAX)
+            return 1;
+        return ct_move(ct, e, put, arg) == 0 ? 0 : -1;
+    }
+    if (size > CONTAINER_MAX)
+        return file(arg, 1) < 0 ? -1 : 0;
+    // projections written before the container was used stay in files
+    if ((exists = file(arg, 0)) != 0)
+        return exists < 0 ? -1 : 0;
+    return 1;
+}
+
+int container_read(container_t * ct, fid_t fid, tid_t pid, uint64_t off,
+                   size_t count, void *bins, uint64_t cidx, uint32_t ccount,
+                   uint32_t * crcs) {
+    int status = -1;
+    ctentry_t *e;
+    uint64_t base;
+    uint32_t n = 0;
+    DEBUG_FUNCTION;
+
+    pthread_rwlock_rdlock(&ct->lock);
+    if (!(e = ct_get(ct, fid, pid))) {
+        status = 0;
+        goto out;
+    }
+    base = e->off + sizeof (ctrecord_t);
+    // as reads of files, reads beyond the bins fail
+    if (off + count > e->size) {
+        errno = EIO;
+        goto out;
+    }
+    if (ct_pread(e->seg->fd, bins, count, base + off) != 0)
+        goto error;
+    if (cidx < e->ncrcs) {
+        n = e->ncrcs - cidx < ccount ? e->ncrcs - cidx : ccount;
+        if (ct_pread(e->seg->fd, crcs, n * sizeof (uint32_t),
+                     base + e->size + cidx * sizeof (uint32_t)) != 0)
+            goto error;
+    }
+    memset(crcs + n, 0, (ccount - n) * sizeof (uint32_t));
+    status = 1;
+    goto out;
+error:
+    severe("can't read container segment %08x: %s", e->seg->id,
+           strerror(errno));
+out:
+    pthread_rwlock_unlock(&ct->lock);
+    return status;
+}
+
+int container_write(container_t * ct, fid_t fid, tid_t pid, uint64_t off,
+                    size_t len, const void *bins, uint64_t cidx,
+                    uint32_t ccount, const uint32_t * crcs, ctfile_t file,
+                    ctput_t put, void *arg) {
+    int status = -1;
+    ctentry_t *e;
+    ctrecord_t *r = 0;
+    uint64_t size = off + len;
+    uint32_t ncrcs = cidx + ccount;
+    char *p;
+    DEBUG_FUNCTION;
+
+    pthread_rwlock_wrlock(&ct->lock);
+    if ((e = ct_get(ct, fid, pid))) {
+        if (e->size > size)
+            size = e->size;
+        if (e->ncrcs > ncrcs)
+            ncrcs = e->ncrcs;
+    }
+    if ((status = ct_place(ct, e, size, file, put, arg)) != 1)
+        goto out;
+    status = -1;
+    if (!(r = ct_load(ct, e, size, ncrcs)))
+        goto out;
+    p = (char *) (r + 1);
+    memcpy(p + off, bins, len);
+    p += size + cidx * sizeof (uint32_t);
+    if (crcs)
+        memcpy(p, crcs, ccount * sizeof (uint32_t));
+    else
+        memset(p, 0, ccount * sizeof (uint32_t));
+    if (ct_commit(ct, e, r, fid, pid) != 0)
+        goto out;
+    status = 1;
+out:
+    if (r)
+        free(r);
+    pthread_rwlock_unlock(&ct->lock);
+    return status;
+}
+
+int container_truncate(container_t * ct, fid_t fid, tid_t pid,
+                       uint64_t size, uint32_t ncrcs, ctfile_t file,
+                       ctput_t put, void *arg) {
+    int status = -1;
+    ctentry_t *e;
+    ctrecord_t *r = 0;
+    DEBUG_FUNCTION;
+
+    pthread_rwlock_wrlock(&ct->lock);
+    e = ct_get(ct, fid, pid);
+    if ((status = ct_place(ct, e, size, file, put, arg)) != 1)
+        goto out;
+    status = -1;
+    if (!(r = ct_load(ct, e, size, ncrcs)))
+        goto out;
+    if (ct_commit(ct, e, r, fid, pid) != 0)
+        goto out;
+    status = 1;
+out:
+    if (r)
+        free(r);
+    pthread_rwlock_unlock(&ct->lock);
+    return status;
+}
+
+int container_remove(container_t * ct, fid_t fid, tid_t pid) {
+    int status = 0;
+    ctentry_t *e;
+    DEBUG_FUNCTION;
+
+    pthread_rwlock_wrlock(&ct->lock);
+    if ((e = ct_get(ct, fid, pid)))
+        status = ct_remove(ct, e) == 0 ? 1 : -1;
+    pthread_rwlock_unlock(&ct->lock);
+    return status;
+}
+
+uint64_t container_list(container_t * ct, ctkey_t ** keys) {
+    uint64_t n = 0;
+    list_t *p;
+    DEBUG_FUNCTION;
+
+    pthread_rwlock_rdlock(&ct->lock);
+    *keys = xmalloc((ct->nentries + 1) * sizeof (ctkey_t));
+    list_for_each_forward(p, &ct->entries) {
+        ctentry_t *e = list_entry(p, ctentry_t, list);
+        uuid_copy((*keys)[n].fid, e->fid);
+        (*keys)[n++].pid = e->pid;
+    }
+    pthread_rwlock_unlock(&ct->lock);
+    return n;
+}
+
+int container_verify(container_t * ct, fid_t fid, tid_t pid,
+                     uint64_t * size, uint32_t * ncrcs) {
+    int status = -1;
+    ctentry_t *e;
+    ctrecord_t *r = 0;
+    uint64_t len;
+    DEBUG_FUNCTION;
+
+    pthread_rwlock_rdlock(&ct->lock);
+    if (!(e = ct_get(ct, fid, pid))) {
+        errno = ENOENT;
+        goto out;
+    }
+    *size = e->size;
+    *ncrcs = e->ncrcs;
+    len = ctentry_len(e);
+    r = xmalloc(len);
+    if (ct_pread(e->seg->fd, r, len, e->off) != 0) {
+        severe("can't read container segment %08x: %s", e->seg->id,
+               strerror(errno));
+        goto out;
+    }
+    status = r->magic == CONTAINER_MAGIC && !r->removed &&
+        r->size == e->size && r->ncrcs == e->ncrcs &&
+        ctrecord_crc(r) == r->crc;
+out:
+    pthread_rwlock_unlock(&ct->lock);
+    if (r)
+        free(r);
+    return status;
+}
+
+int container_sync(container_t * ct) {
+    int status = -1;
+    uint32_t *ids = 0;
+    uint64_t *sizes = 0;
+    int *fds = 0;
+    uint32_t n = 0, i;
+    list_t *p;
+    DEBUG_FUNCTION;
+
+    // segments may be compacted meanwhile: sync copies of their fds
+    pthread_rwlock_rdlock(&ct->lock);
+    list_for_each_forward(p, &ct->segments) {
+        ctsegment_t *seg = list_entry(p, ctsegment_t, list);
+        if (seg->synced == seg->size)
+            continue;
+        ids = xrealloc(ids, (n + 1) * sizeof (uint32_t));
+        sizes = xrealloc(sizes, (n + 1) * sizeof (uint64_t));
+        fds = xrealloc(fds, (n + 1) * sizeof (int));
+        if ((fds[n] = dup(seg->fd)) < 0) {
+            pthread_rwlock_unlock(&ct->lock);
+            goto out;
+        }
+        ids[n] = seg->id;
+        sizes[n++] = seg->size;
+    }
+    pthread_rwlock_unlock(&ct->lock);
+
+    for (i = 0; i < n; i++) {
+        if (fdatasync(fds[i]) != 0) {
+            severe("can't sync container segment %08x: %s", ids[i],
+                   strerror(errno));
+            goto out;
+        }
+    }
+
+    pthread_rwlock_wrlock(&ct->lock);
+    list_for_each_forward(p, &ct->segments) {
+        ctsegment_t *seg = list_entry(p, ctsegment_t, list);
+        for (i = 0; i < n; i++)
+            if (seg->id == ids[i] && seg->synced < sizes[i])
+                seg->synced = sizes[i];
+    }
+    pthread_rwlock_unlock(&ct->lock);
+    status = 0;
+out:
+    for (i = 0; i < n; i++)
+        close(fds[i]);
+    if (ids)
+        free(ids);
+    if (sizes)
+        free(sizes);
+    if (fds)
+        free(fds);
+    return status;
+}
+
+void container_stat(container_t * ct, ctstat_t * stat) {
+    list_t *p;
+
+    memset(stat, 0, sizeof (ctstat_t));
+    pthread_rwlock_rdlock(&ct->lock);
+    stat->projections = ct->nentries;
+    list_for_each_forward(p, &ct->segments) {
+        ctsegment_t *seg = list_entry(p, ctsegment_t, list);
+        stat->segments++;
+        stat->size += seg->size;
+        stat->dead += seg->dead + seg->tombs;
+    }
+    stat->compacted = ct->compacted;
+    pthread_rwlock_unlock(&ct->lock);
+}
+
+// apply the records of seg from off
+static int ct_scan(container_t * ct, ctsegment_t * seg, uint64_t off) {
+    int status = -1;
+    ctrecord_t h;
+    ctrecord_t *r = 0;
+    uint64_t len;
+    ctentry_t *e;
+
+    while (off + sizeof (ctrecord_t) <= seg->size) {
+        if (ct_pread(seg->fd, &h, sizeof (ctrecord_t), off) != 0)
+            goto out;
+        if (h.magic != CONTAINER_MAGIC)
+            break;
+        len = ctrecord_total(&h);
+        if (h.size > CONTAINER_MAX || off + len > seg->size)
+            break;
+        r = xrealloc(r, len);
+        if (ct_pread(seg->fd, r, len, off) != 0)
+            goto out;
+        if (ctrecord_crc(r) != r->crc)
+            break;
+        e = ct_get(ct, r->fid, r->pid);
+        if (r->removed) {
+            seg->tombs += len;
+            if (e) {
+                ct_dead(ct, e);
+                ct_del(ct, e);
+            }
+        } else {
+            if (e)
+                ct_dead(ct, e);
+            else
+                e = ct_add(ct, r->fid, r->pid);
+            e->seg = seg;
+            e->off = off;
+            e->size = r->size;
+            e->ncrcs = r->ncrcs;
+        }
+        off += len;
+    }
+    // a crash may have left a partial record (at the end of the last one)
+    if (off != seg->size) {
+        warning("container segment %08x: %" PRIu64 " bytes dropped at %"
+                PRIu64, seg->id, seg->size - off, off);
+        if (ftruncate(seg->fd, off) != 0)
+            goto out;
+        seg->size = off;
+    }
+    status = 0;
+out:
+    if (r)
+        free(r);
+    return status;
+}
+
+static ctsegment_t *ct_segment(container_t * ct, uint32_t id) {
+    list_t *p;
+
+    list_for_each_forward(p, &ct->segments) {
+        ctsegment_t *seg = list_entry(p, ctsegment_t, list);
+        if (seg->id == id)
+            return seg;
+    }
+    return 0;
+}
+
+/*
+ * Load the index file: it is valid if all its segments are still there,
+ * with at least their size of then, and the segments it has not are newer.
+ * The scan of the segments (in order) is to start at from, their size in
+ * the index.
+ */
+static int ct_load_index(container_t * ct, uint64_t * from) {
+    int status = -1;
+    int fd = -1;
+    struct stat s;
+    char *buf = 0;
+    ctindex_t *h;
+    ctindex_segment_t *is;
+    ctindex_entry_t *ie;
+    uint32_t crc, i, k, max = 0;
+    uint64_t j;
+    list_t *p;
+
+    if ((fd = openat(ct->dirfd, CONTAINER_INDEX, O_RDONLY)) < 0)
+        goto out;
+    if (fstat(fd, &s) != 0 || s.st_size < sizeof (ctindex_t) + 4)
+        goto out;
+    buf = xmalloc(s.st_size);
+    if (ct_pread(fd, buf, s.st_size, 0) != 0)
+        goto out;
+    memcpy(&crc, buf + s.st_size - 4, 4);
+    h = (ctindex_t *) buf;
+    is = (ctindex_segment_t *) (h + 1);
+    ie = (ctindex_entry_t *) (is + h->nsegments);
+    if (h->magic != CONTAINER_MAGIC || crc32c(0, buf, s.st_size - 4) != crc
+        || (char *) (ie + h->nentries) + 4 != buf + s.st_size)
+        goto out;
+
+    for (i = 0; i < h->nsegments; i++) {
+        ctsegment_t *seg = ct_segment(ct, is[i].id);
+        if (!seg || seg->size < is[i].size)
+            goto out;
+        if (is[i].id > max)
+            max = is[i].id;
+    }
+    i = 0;
+    list_for_each_forward(p, &ct->segments) {
+        ctsegment_t *seg = list_entry(p, ctsegment_t, list);
+        if (seg->id <= max)
+            i++;
+    }
+    if (i != h->nsegments)
+        goto out;
+
+    for (j = 0; j < h->nentries; j++) {
+        ctsegment_t *seg = ct_segment(ct, ie[j].seg);
+        ctentry_t *e;
+        if (!seg || ie[j].size > CONTAINER_MAX ||
+            ie[j].off + ctrecord_len(ie[j].size, ie[j].ncrcs) > seg->size)
+            goto out;
+        e = ct_add(ct, ie[j].fid, ie[j].pid);
+        e->seg = seg;
+        e->off = ie[j].off;
+        e->size = ie[j].size;
+        e->ncrcs = ie[j].ncrcs;
+    }
+    k = 0;
+    list_for_each_forward(p, &ct->segments) {
+        ctsegment_t *seg = list_entry(p, ctsegment_t, list);
+        from[k] = 0;
+        for (i = 0; i < h->nsegments; i++) {
+            if (is[i].id == seg->id) {
+                seg->dead = is[i].dead;
+                seg->tombs = is[i].tombs;
+                from[k] = is[i].size;
+            }
+        }
+        k++;
+    }
+    status = 0;
+out:
+    if (fd >= 0)
+        close(fd);
+    if (buf)
+        free(buf);
+    return status;
+}
+
+static void ct_reset(container_t * ct) {
+    list_t *p, *q;
+
+    list_for_each_forward_safe(p, q, &ct->entries) {
+        ct_del(ct, list_entry(p, ctentry_t, list));
+    }
+    list_for_each_forward(p, &ct->segments) {
+        ctsegment_t *seg = list_entry(p, ctsegment_t, list);
+        seg->dead = 0;
+        seg->tombs = 0;
+    }
+}
+
+static int ct_save_index(container_t * ct) {
+    int status = -1;
+    int fd = -1;
+    size_t len;
+    ssize_t n;
+    char *buf = 0;
+    ctindex_t *h;
+    ctindex_segment_t *is;
+    ctindex_entry_t *ie;
+    uint32_t crc;
+    list_t *p;
+
+    // the index must not refer to records not on disk
+    list_for_each_forward(p, &ct->segments) {
+        ctsegment_t *seg = list_entry(p, ctsegment_t, list);
+        if (fdatasync(seg->fd) != 0)
+            goto out;
+    }
+
+    len = sizeof (ctindex_t) + list_size(&ct->segments) *
+        sizeof (ctindex_segment_t) + ct->nentries * sizeof (ctindex_entry_t) +
+        sizeof (uint32_t);
+    buf = xcalloc(1, len);
+    h = (ctindex_t *) buf;
+    h->magic = CONTAINER_MAGIC;
+    h->nsegments = list_size(&ct->segments);
+    h->nentries = ct->nentries;
+    is = (ctindex_segment_t *) (h + 1);
+    list_for_each_forward(p, &ct->segments) {
+        ctsegment_t *seg = list_entry(p, ctsegment_t, list);
+        is->id = seg->id;
+        is->size = seg->size;
+        is->dead = seg->dead;
+        is->tombs = seg->tombs;
+        is++;
+    }
+    ie = (ctindex_entry_t *) is;
+    list_for_each_forward(p, &ct->entries) {
+        ctentry_t *e = list_entry(p, ctentry_t, list);
+        uuid_copy(ie->fid, e->fid);
+        ie->pid = e->pid;
+        ie->seg = e->seg->id;
+        ie->off = e->off;
+        ie->size = e->size;
+        ie->ncrcs = e->ncrcs;
+        ie++;
+    }
+    crc = crc32c(0, buf, len - sizeof (uint32_t));
+    memcpy(ie, &crc, sizeof (uint32_t));
+
+    if ((fd = openat(ct->dirfd, CONTAINER_INDEX ".tmp",
+                     O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) < 0)
+        goto out;
+    if ((n = write(fd, buf, len)) != len) {
+        if (n >= 0)
+            errno = EIO;
+        goto out;
+    }
+    if (fsync(fd) != 0 || renameat(ct->dirfd, CONTAINER_INDEX ".tmp",
+                                   ct->dirfd, CONTAINER_INDEX) != 0)
+        goto out;
+    fsync(ct->dirfd);
+    status = 0;
+out:
+    if (fd >= 0)
+        close(fd);
+    if (buf)
+        free(buf);
+    return status;
+}
+
+/*
+ * Move the live records of seg to the last segment and remove it. Records
+ * are moved one at a time so that reads and writes go on meanwhile.
+ */
+static int ct_compact(container_t * ct, ctsegment_t * seg) {
+    int status = -1;
+    ctrecord_t h;
+    ctrecord_t *r = 0;
+    ctentry_t *e;
+    ctsegment_t *to;
+    uint64_t off = 0, to_off, len;
+    char name[16];
+    list_t *p;
+
+    // seg is no longer appended to
+    while (off < seg->size) {
+        if (ct_pread(seg->fd, &h, sizeof (ctrecord_t), off) != 0)
+            goto out;
+        len = ctrecord_total(&h);
+        r = xrealloc(r, len);
+        if (ct_pread(seg->fd, r, len, off) != 0)
+            goto out;
+        pthread_rwlock_wrlock(&ct->lock);
+        if (r->removed) {
+            if (!ct_first(ct, seg)) {
+                if (ct_append(ct, r, &to, &to_off) != 0) {
+                    pthread_rwlock_unlock(&ct->lock);
+                    goto out;
+                }
+                to->tombs += len;
+            }
+        } else if ((e = ct_get(ct, r->fid, r->pid)) && e->seg == seg &&
+                   e->off == off) {
+            if (ct_append(ct, r, &to, &to_off) != 0) {
+                pthread_rwlock_unlock(&ct->lock);
+                goto out;
+            }
+            e->seg = to;
+            e->off = to_off;
+        }
+        pthread_rwlock_unlock(&ct->lock);
+        off += len;
+    }
+
+    pthread_rwlock_wrlock(&ct->lock);
+    // the moved records must be on disk before seg goes
+    for (p = seg->list.next; p != &ct->segments; p = p->next) {
+        if (fdatasync(list_entry(p, ctsegment_t, list)->fd) != 0) {
+            pthread_rwlock_unlock(&ct->lock);
+            goto out;
+        }
+    }
+    // the index file refers to it
+    if (unlinkat(ct->dirfd, CONTAINER_INDEX, 0) != 0 && errno != ENOENT) {
+        pthread_rwlock_unlock(&ct->lock);
+        goto out;
+    }
+    sprintf(name, "%08x", seg->id);
+    unlinkat(ct->dirfd, name, 0);
+    close(seg->fd);
+    list_remove(&seg->list);
+    free(seg);
+    ct->compacted++;
+    pthread_rwlock_unlock(&ct->lock);
+    status = 0;
+out:
+    if (r)
+        free(r);
+    return status;
+}
+
+static void *ct_compactor(void *v) {
+    container_t *ct = (container_t *) v;
+    ctsegment_t *seg;
+    struct timespec ts;
+    list_t *p;
+    int failed;
+
+    pthread_mutex_lock(&ct->clock);
+    while (!ct->stop) {
+        pthread_mutex_unlock(&ct->clock);
+        seg = 0;
+        failed = 0;
+        pthread_rwlock_rdlock(&ct->lock);
+        list_for_each_forward(p, &ct->segments) {
+            if (ct_compactable(ct, list_entry(p, ctsegment_t, list))) {
+                seg = list_entry(p, ctsegment_t, list);
+                break;
+            }
+        }
+        pthread_rwlock_unlock(&ct->lock);
+        if (seg && ct_compact(ct, seg) != 0) {
+            severe("can't compact container segment %08x: %s", seg->id,
+                   strerror(errno));
+            failed = 1;
+        }
+        pthread_mutex_lock(&ct->clock);
+        if (!ct->stop && (!seg || failed)) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += CONTAINER_COMPACT_PERIOD;
+            pthread_cond_timedwait(&ct->cond, &ct->clock, &ts);
+        }
+    }
+    pthread_mutex_unlock(&ct->clock);
+    return 0;
+}
+
+static int ct_idcmp(const void *a, const void *b) {
+    uint32_t ia = *(const uint32_t *) a;
+    uint32_t ib = *(const uint32_t *) b;
+
+    return ia < ib ? -1 : ia > ib;
+}
+
+static void ct_release(container_t * ct) {
+    list_t *p, *q;
+
+    ct_reset(ct);
+    list_for_each_forward_safe(p, q, &ct->segments) {
+        ctsegment_t *seg = list_entry(p, ctsegment_t, list);
+        close(seg->fd);
+        list_remove(&seg->list);
+        free(seg);
+    }
+    htable_release(&ct->htable);
+    if (ct->dirfd >= 0)
+        close(ct->dirfd);
+    pthread_cond_destroy(&ct->cond);
+    pthread_mutex_destroy(&ct->clock);
+    pthread_rwlock_destroy(&ct->lock);
+}
+
+int container_open(container_t * ct, int rootfd) {
+    int status = -1;
+    int fd;
+    DIR *dir = 0;
+    struct dirent *d;
+    uint32_t *ids = 0;
+    uint64_t *from = 0;
+    uint32_t n = 0, i;
+    list_t *p;
+    DEBUG_FUNCTION;
+
+    memset(ct, 0, sizeof (container_t));
+    ct->dirfd = -1;
+    pthread_rwlock_init(&ct->lock, NULL);
+    pthread_mutex_init(&ct->clock, NULL);
+    pthread_cond_init(&ct->cond, NULL);
+    htable_initialize(&ct->htable, CONTAINER_BUCKETS, ctentry_hash,
+                      ctentry_cmp);
+    list_init(&ct->entries);
+    list_init(&ct->segments);
+
+    if (mkdirat(rootfd, CONTAINER_DIR, S_IRWXU) != 0 && errno != EEXIST)
+        goto out;
+    if ((ct->dirfd = openat(rootfd, CONTAINER_DIR, O_RDONLY | O_DIRECTORY))
+        < 0)
+        goto out;
+    if ((fd = dup(ct->dirfd)) < 0)
+        goto out;
+    if (!(dir = fdopendir(fd))) {
+        close(fd);
+        goto out;
+    }
+    while ((d = readdir(dir))) {
+        char *end;
+        unsigned long id;
+        if (strlen(d->d_name) != 8)
+            continue;
+        id = strtoul(d->d_name, &end, 16);
+        if (*end)
+            continue;
+        ids = xrealloc(ids, (n + 1) * sizeof (uint32_t));
+        ids[n++] = id;
+    }
+    if (n > 0)
+        qsort(ids, n, sizeof (uint32_t), ct_idcmp);
+    for (i = 0; i < n; i++) {
+        if (!ct_segment_open(ct, ids[i]))
+            goto out;
+    }
+
+    from = xcalloc(n + 1, sizeof (uint64_t));
+    if (ct_load_index(ct, from) != 0) {
+        ct_reset(ct);
+        memset(from, 0, (n + 1) * sizeof (uint64_t));
+    }
+    i = 0;
+    list_for_each_forward(p, &ct->segments) {
+        if (ct_scan(ct, list_entry(p, ctsegment_t, list), from[i++]) != 0)
+            goto out;
+    }
+    status = 0;
+out:
+    if (status != 0) {
+        int xerrno = errno;
+        ct_release(ct);
+        errno = xerrno;
+    }
+    if (dir)
+        closedir(dir);
+    if (ids)
+        free(ids);
+    if (from)
+        free(from);
+    return status;
+}
+
+int container_start(container_t * ct) {
+    int status = -1;
+    DEBUG_FUNCTION;
+
+    if ((errno = pthread_create(&ct->thread, NULL, ct_compactor, ct)) != 0)
+        goto out;
+    ct->started = 1;
+    status = 0;
+out:
+    return status;
+}
+
+void container_close(container_t * ct) {
+    DEBUG_FUNCTION;
+
+    if (ct->started) {
+        pthread_mutex_lock(&ct->clock);
+        ct->stop = 1;
+        pthread_cond_signal(&ct->cond);
+        pthread_mutex_unlock(&ct->clock);
+        pthread_join(ct->thread, NULL);
+        ct->started = 0;
+    }
+    if (ct_save_index(ct) != 0) {
+        severe("can't save container index: %s", strerror(errno));
+    }
+    ct_release(ct);
+}
@@ -0,0 +1,163 @@
+/*
+ Copyright (c) 2010 Fizians SAS. <http://www.fizians.com>
+ This file is part of Rozofs.
+
+ Rozofs is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 3 of the License,
+ or (at your option) any later version.
+
+ Rozofs is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see
+ <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _CONTAINER_H
+#define _CONTAINER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "rozofs.h"
+#include "list.h"
+#include "htable.h"
+
+/*
+ * Small projections packed in a container: they are stored as records
+ * (the bins then the crcs of the projection) appended to segment files of
+ * the CONTAINER_DIR directory of a storage root. A new record is appended
+ * for each change, the index keeps the last one of each projection and
+ * removes append removal records. Segments mostly made of superseded
+ * records are compacted in the background.
+ *
+ * The index is rebuilt at open from the segments, starting from the
+ * CONTAINER_INDEX file written at close when it is still valid.
+ */
+#define CONTAINER_DIR ".containers"
+#define CONTAINER_INDEX "index"
+#define CONTAINER_SEGMENT_SIZE (16 << 20)
+
+// largest projection (bins bytes) kept in a container
+#define CONTAINER_MAX (64 << 10)
+
+typedef struct ctsegment {
+    uint32_t id;
+    int fd;
+    uint64_t size;
+    uint64_t synced;            // bytes known to be on disk
+    uint64_t dead;              // superseded records bytes
+    uint64_t tombs;             // removal records bytes
+    list_t list;
+} ctsegment_t;
+
+typedef struct ctentry {
+    fid_t fid;
+    tid_t pid;
+    ctsegment_t *seg;
+    uint64_t off;               // of the record in seg
+    uint64_t size;              // bins bytes
+    uint32_t ncrcs;
+    list_t list;
+} ctentry_t;
+
+typedef struct container {
+    int dirfd;
+    pthread_rwlock_t lock;      // read to read records
+    htable_t htable;
+    list_t entries;
+    uint64_t nentries;
+    list_t segments;            // oldest first, records are appended to the last
+    uint64_t compacted;         // segments
+    // compaction thread
+    pthread_mutex_t clock;
+    pthread_cond_t cond;
+    int stop;
+    int started;
+    pthread_t thread;
+} container_t;
+
+// projection of a container
+typedef struct ctkey {
+    fid_t fid;
+    tid_t pid;
+} ctkey_t;
+
+// container statistics
+typedef struct ctstat {
+    uint64_t projections;
+    uint32_t segments;
+    uint64_t size;
+    uint64_t dead;
+    uint64_t compacted;
+} ctstat_t;
+
+/*
+ * Callback to the projection file of the projection being looked for in a
+ * container: returns 1 if the file exists, 0 if not, -1 on error, creating
+ * it first if create.
+ */
+typedef int (*ctfile_t) (void *arg, int create);
+
+/* Callback replacing the content of the projection file by the given one. */
+typedef int (*ctput_t) (void *arg, const void *bins, uint64_t size,
+                        const uint32_t * crcs, uint32_t ncrcs);
+
+/* Load the container of the root rootfd (created if needed). */
+int container_open(container_t * ct, int rootfd);
+
+/* Start the compaction thread. */
+int container_start(container_t * ct);
+
+void container_close(container_t * ct);
+
+/*
+ * Read count bins bytes at off and ccount crcs at cidx (0 beyond the
+ * crcs of the projection). Returns 1 when the projection is in the
+ * container, 0 if not (file is not called) and -1 on error.
+ */
+int container_read(container_t * ct, fid_t fid, tid_t pid, uint64_t off,
+                   size_t count, void *bins, uint64_t cidx, uint32_t ccount,
+                   uint32_t * crcs);
+
+/*
+ * Write len bins bytes at off and ccount crcs at cidx (crcs may be null
+ * for zeros). Returns 1 when done in the container, 0 when the projection
+ * file is to be used and -1 on error. Projections not in the container are
+ * created in it if they stay small and have no file, the file is created
+ * otherwise. Projections growing too large are moved to their file (put).
+ */
+int container_write(container_t * ct, fid_t fid, tid_t pid, uint64_t off,
+                    size_t len, const void *bins, uint64_t cidx,
+                    uint32_t ccount, const uint32_t * crcs, ctfile_t file,
+                    ctput_t put, void *arg);
+
+/* Same as container_write for a resize to size bins bytes and ncrcs crcs. */
+int container_truncate(container_t * ct, fid_t fid, tid_t pid,
+                       uint64_t size, uint32_t ncrcs, ctfile_t file,
+                       ctput_t put, void *arg);
+
+/* Remove a projection, returns 0 if it was not in the container. */
+int container_remove(container_t * ct, fid_t fid, tid_t pid);
+
+/* The projections of the container, in keys (to be freed). */
+uint64_t container_list(container_t * ct, ctkey_t ** keys);
+
+/*
+ * Check the record of a projection against its crc32c, giving its bins
+ * bytes and crcs. Returns 1 when it is intact, 0 when it is corrupted and
+ * -1 on error (ENOENT: not in the container).
+ */
+int container_verify(container_t * ct, fid_t fid, tid_t pid,
+                     uint64_t * size, uint32_t * ncrcs);
+
+/* Sync the records appended since the last sync. */
+int container_sync(container_t * ct);
+
+void container_stat(container_t * ct, ctstat_t * stat);
+
+#endif
@@ -0,0 +1,101 @@
+/*
+  Copyright (c) 2010 Fizians SAS. <http://www.fizians.com>
+  This file is part of Rozofs.
+
+  Rozofs is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3 of the License,
+  or (at your option) any later version.
+
+  Rozofs is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+
+#include "crc32c.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32C_X86
+#include <immintrin.h>
+#endif
+
+#define CRC32C_POLY 0x82f63b78  // reflected Castagnoli polynomial
+
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+static int crc32c_hw = 0;
+// slice by 8: table[k][b] is the crc of byte b followed by k zero bytes
+static uint32_t crc32c_table[8][256];
+
+static void crc32c_initialize() {
+    uint32_t crc;
+    int b, k;
+
+#ifdef CRC32C_X86
+    if ((crc32c_hw = __builtin_cpu_supports("sse4.2")))
+        return;
+#endif
+    for (b = 0; b < 256; b++) {
+        crc = b;
+        for (k = 0; k < 8; k++)
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        crc32c_table[0][b] = crc;
+    }
+    for (b = 0; b < 256; b++) {
+        crc = crc32c_table[0][b];
+        for (k = 1; k < 8; k++) {
+            crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+            crc32c_table[k][b] = crc;
+        }
+    }
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t * p, size_t len) {
+    for (; len && ((uintptr_t) p & 7); len--)
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    for (; len >= 8; len -= 8, p += 8) {
+        uint64_t w = *(const uint64_t *) p ^ crc;
+        crc = crc32c_table[7][w & 0xff] ^
+            crc32c_table[6][(w >> 8) & 0xff] ^
+            crc32c_table[5][(w >> 16) & 0xff] ^
+            crc32c_table[4][(w >> 24) & 0xff] ^
+            crc32c_table[3][(w >> 32) & 0xff] ^
+            crc32c_table[2][(w >> 40) & 0xff] ^
+            crc32c_table[1][(w >> 48) & 0xff] ^
+            crc32c_table[0][w >> 56];
+    }
+    for (; len; len--)
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef CRC32C_X86
+__attribute__ ((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t * p, size_t len) {
+    uint64_t c = crc;
+
+    for (; len && ((uintptr_t) p & 7); len--)
+        c = _mm_crc32_u8(c, *p++);
+    for (; len >= 8; len -= 8, p += 8)
+        c = _mm_crc32_u64(c, *(const uint64_t *) p);
+    for (; len; len--)
+        c = _mm_crc32_u8(c, *p++);
+    return c;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    pthread_once(&crc32c_once, crc32c_initialize);
+    crc = ~crc;
+#ifdef CRC32C_X86
+    if (crc32c_hw)
+        return ~crc32c_sse42(crc, data, len);
+#endif
+    return ~crc32c_sw(crc, data, len);
+}
@@ -94,6 +94,8 @@ ep_mount_ret_t *ep_mount_1_svc(ep_path_t * arg, struct svc_req * req) {
     ret.ep_mount_ret_t_u.volume.eid = *eid;
     memcpy(ret.ep_mount_ret_t_u.volume.md5, exp->md5, ROZOFS_MD5_SIZE);
     ret.ep_mount_ret_t_u.volume.rl = layout;
+    ret.ep_mount_ret_t_u.volume.rm = exp->mode;
+    ret.ep_mount_ret_t_u.volume.bs = exp->bsize;
     memcpy(ret.ep_mount_ret_t_u.volume.rfid, exp->rfid, sizeof (fid_t));
 
     ret.status = EP_SUCCESS;
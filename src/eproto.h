@@ -59,6 +59,8 @@ struct ep_volume_t {
 	ep_md5_t md5;
 	ep_uuid_t rfid;
 	int rl;
+	int rm;
+	uint32_t bs;
 	uint8_t clusters_nb;
 	ep_cluster_t clusters[ROZOFS_CLUSTERS_MAX];
 };
@@ -111,7 +113,7 @@ struct ep_mfile_arg_t {
 typedef struct ep_mfile_arg_t ep_mfile_arg_t;
 
 struct ep_statfs_t {
-	uint16_t bsize;
+	uint32_t bsize;
 	uint64_t blocks;
 	uint64_t bfree;
 	uint64_t files;
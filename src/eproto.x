@@ -55,6 +55,8 @@ struct ep_volume_t {
     ep_md5_t        md5;
     ep_uuid_t       rfid;   /*root fid*/
     int             rl;     /* rozofs layout */
+    int             rm;     /* rozofs mode */
+    uint32_t        bs;     /* block size */
     uint8_t         clusters_nb;
     ep_cluster_t    clusters[ROZOFS_CLUSTERS_MAX];
 };
@@ -97,7 +99,7 @@ struct ep_mfile_arg_t {
 };
 
 struct ep_statfs_t {
-    uint16_t bsize;
+    uint32_t bsize;
     uint64_t blocks;
     uint64_t bfree;
     uint64_t files;
@@ -139,6 +139,10 @@ xdr_ep_volume_t (XDR *xdrs, ep_volume_t *objp)
 		 return FALSE;
 	 if (!xdr_int (xdrs, &objp->rl))
 		 return FALSE;
+	 if (!xdr_int (xdrs, &objp->rm))
+		 return FALSE;
+	 if (!xdr_uint32_t (xdrs, &objp->bs))
+		 return FALSE;
 	 if (!xdr_uint8_t (xdrs, &objp->clusters_nb))
 		 return FALSE;
 	 if (!xdr_vector (xdrs, (char *)objp->clusters, ROZOFS_CLUSTERS_MAX,
@@ -254,7 +258,7 @@ xdr_ep_statfs_t (XDR *xdrs, ep_statfs_t *objp)
 {
 	//register int32_t *buf;
 
-	 if (!xdr_uint16_t (xdrs, &objp->bsize))
+	 if (!xdr_uint32_t (xdrs, &objp->bsize))
 		 return FALSE;
 	 if (!xdr_uint64_t (xdrs, &objp->blocks))
 		 return FALSE;
@@ -50,6 +50,8 @@
 #define EFILESKEY	"user.rozofs.export.files"
 #define EVERSIONKEY	"user.rozofs.export.version"
 #define EATTRSTKEY	"user.rozofs.export.file.attrs"
+#define EMODEKEY	"user.rozofs.export.mode"
+#define EBSIZEKEY	"user.rozofs.export.bsize"
 
 static inline char *export_map(export_t * e, const char *vpath, char *path) {
     strcpy(path, e->root);
@@ -343,12 +345,13 @@ out:
     return status;
 }
 
-int export_create(const char *root) {
+int export_create(const char *root, rozofs_mode_t mode, uint32_t bsize) {
     int status = -1;
     const char *version = VERSION;
     char path[PATH_MAX];
     mattr_t attrs;
     uint64_t zero = 0;
+    uint32_t smode = mode;
     char trash_path[PATH_MAX + FILENAME_MAX + 1];
     uuid_t trash_uuid;
     char trash_str[37];
@@ -365,6 +368,10 @@ int export_create(const char *root) {
     if (setxattr(path, EVERSIONKEY, &version, 
                 sizeof (char) * strlen(version) + 1, XATTR_CREATE) != 0)
         goto out;
+    if (setxattr(path, EMODEKEY, &smode, sizeof (smode), XATTR_CREATE) != 0)
+        goto out;
+    if (setxattr(path, EBSIZEKEY, &bsize, sizeof (bsize), XATTR_CREATE) != 0)
+        goto out;
 
     memset(&attrs, 0, sizeof (mattr_t));
     uuid_generate(attrs.fid);
@@ -403,9 +410,12 @@ out:
 }
 
 int export_initialize(export_t * e, uint32_t eid, const char *root,
-        const char *md5, uint64_t quota, uint16_t vid) {
+        const char *md5, uint64_t quota, uint16_t vid, rozofs_mode_t mode,
+        uint32_t bsize) {
     int status = -1;
     mfentry_t *mfe;
+    uint32_t smode;
+    uint32_t sbsize;
     uuid_t trash_uuid;
     char trash_str[37];
     DEBUG_FUNCTION;
@@ -415,13 +425,41 @@ int export_initialize(export_t * e, uint32_t eid, const char *root,
     if (export_check_root(e->root) != 0)
         goto out;
     if (export_check_setup(e->root) != 0) {
-        if (export_create(root) != 0) {
+        if (export_create(root, mode, bsize) != 0) {
             goto out;
         }
     }
 
+    // bins already stored can't be read in another mode
+    // (exports created without mode are mojette ones)
+    if (getxattr(e->root, EMODEKEY, &smode, sizeof (smode)) == -1) {
+        if (errno != ENOATTR)
+            goto out;
+        smode = MODE_MOJETTE;
+    }
+    if (smode != mode) {
+        severe("export_initialize failed: export %s was created in mode %u",
+                e->root, smode);
+        errno = EINVAL;
+        goto out;
+    }
+    // likewise for the block size (ROZOFS_BSIZE for exports without it)
+    if (getxattr(e->root, EBSIZEKEY, &sbsize, sizeof (sbsize)) == -1) {
+        if (errno != ENOATTR)
+            goto out;
+        sbsize = ROZOFS_BSIZE;
+    }
+    if (sbsize != bsize) {
+        severe("export_initialize failed: export %s was created with"
+                " bsize %u", e->root, sbsize);
+        errno = EINVAL;
+        goto out;
+    }
+
     e->eid = eid;
     e->vid = vid;
+    e->mode = mode;
+    e->bsize = bsize;
 
     if (strlen(md5) == 0) {
         memcpy(e->md5, ROZOFS_MD5_NONE, ROZOFS_MD5_SIZE);
@@ -506,7 +544,7 @@ int export_stat(export_t * e, estat_t * st) {
     volume_stat_t vstat;
     DEBUG_FUNCTION;
 
-    st->bsize = ROZOFS_BSIZE;
+    st->bsize = e->bsize;
     if (statfs(e->root, &stfs) != 0)
         goto out;
     st->namemax = stfs.f_namelen;
@@ -514,7 +552,8 @@ int export_stat(export_t * e, estat_t * st) {
     if (getxattr(e->root, EBLOCKSKEY, &(st->blocks), sizeof (uint64_t)) == -1)
         goto out;
     volume_stat(&vstat, e->vid);
-    st->bfree = vstat.bfree;
+    // volumes count blocks of vstat.bsize
+    st->bfree = vstat.bfree * vstat.bsize / e->bsize;
     // blocks store in EBLOCKSKEY is the number of currently stored blocks
     // blocks in estat_t is the total number of blocks (see struct statvfs)
     // rozofs does not have a constant total number of blocks
@@ -655,9 +694,8 @@ int export_setattr(export_t * e, fid_t fid, mattr_t * attrs) {
             goto out;
         }
 
-        uint64_t nrb_new = ((attrs->size + ROZOFS_BSIZE - 1) / ROZOFS_BSIZE);
-        uint64_t nrb_old = ((mfe->attrs.size + ROZOFS_BSIZE - 1) / 
-                ROZOFS_BSIZE);
+        uint64_t nrb_new = ((attrs->size + e->bsize - 1) / e->bsize);
+        uint64_t nrb_old = ((mfe->attrs.size + e->bsize - 1) / e->bsize);
 
         // Open the file descriptor
         if ((fd = open(mfe->path, O_RDWR)) < 0) {
@@ -927,7 +965,7 @@ int export_unlink(export_t * e, uuid_t fid) {
 
     if (!S_ISLNK(mode))
         if (export_update_blocks
-                (e, -(((int64_t) size + ROZOFS_BSIZE - 1) / ROZOFS_BSIZE)) != 0)
+                (e, -(((int64_t) size + e->bsize - 1) / e->bsize)) != 0)
             goto out;
 
     status = 0;
@@ -1190,7 +1228,7 @@ int export_rename(export_t * e, uuid_t from, uuid_t parent, const char *name) {
         if (!S_ISLNK(mode) && !S_ISDIR(mode))
             if (export_update_blocks
                     (e,
-                    -(((int64_t) size + ROZOFS_BSIZE - 1) / ROZOFS_BSIZE)) != 0)
+                    -(((int64_t) size + e->bsize - 1) / e->bsize)) != 0)
                 goto out;
     }
 
@@ -1308,8 +1346,8 @@ int64_t export_write(export_t * e, uuid_t fid, uint64_t off, uint32_t len) {
 
     if (off + len > mfe->attrs.size) {
         /* don't skip intermediate computation to keep ceil rounded */
-        uint64_t nbold = (mfe->attrs.size + ROZOFS_BSIZE - 1) / ROZOFS_BSIZE;
-        uint64_t nbnew = (off + len + ROZOFS_BSIZE - 1) / ROZOFS_BSIZE;
+        uint64_t nbold = (mfe->attrs.size + e->bsize - 1) / e->bsize;
+        uint64_t nbnew = (off + len + e->bsize - 1) / e->bsize;
 
         if (export_update_blocks (e,  nbnew - nbold) != 0)
             goto out;
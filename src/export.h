@@ -34,6 +34,8 @@ typedef struct export {
     char root[PATH_MAX]; // absolute path
     char md5[ROZOFS_MD5_SIZE]; //passwd
     uint64_t quota; // quota in blocks
+    rozofs_mode_t mode; // how blocks are stored
+    uint32_t bsize; // block size
     fid_t rfid; // root fid
     char trashname[NAME_MAX]; // trash directory
     list_t mfiles;
@@ -43,10 +45,11 @@ typedef struct export {
     htable_t h_pfids; // parent fid indexed
 } export_t;
 
-int export_create(const char *root);
+int export_create(const char *root, rozofs_mode_t mode, uint32_t bsize);
 
 int export_initialize(export_t * e, eid_t eid, const char *root,
-        const char *md5, uint64_t quota, uint16_t vid);
+        const char *md5, uint64_t quota, uint16_t vid, rozofs_mode_t mode,
+        uint32_t bsize);
 
 void export_release(export_t * e);
 
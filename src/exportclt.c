@@ -78,6 +78,8 @@ int exportclt_initialize(exportclt_t * clt, const char *host, char *root,
 
     clt->eid = ret->ep_mount_ret_t_u.volume.eid;
     clt->rl = ret->ep_mount_ret_t_u.volume.rl;
+    clt->rm = ret->ep_mount_ret_t_u.volume.rm;
+    clt->bsize = ret->ep_mount_ret_t_u.volume.bs;
     memcpy(clt->rfid, ret->ep_mount_ret_t_u.volume.rfid, sizeof (fid_t));
 
     // Initialize the list of clusters
@@ -119,7 +121,7 @@ int exportclt_initialize(exportclt_t * clt, const char *host, char *root,
     }
 
     // Initialize rozofs
-    if (rozofs_initialize(clt->rl) != 0) {
+    if (rozofs_initialize(clt->rl, clt->bsize) != 0) {
         fatal("can't initialise rozofs %s", strerror(errno));
         goto out;
     }
@@ -173,6 +175,8 @@ int exportclt_reload(exportclt_t * clt) {
 
     clt->eid = ret->ep_mount_ret_t_u.volume.eid;
     clt->rl = ret->ep_mount_ret_t_u.volume.rl;
+    clt->rm = ret->ep_mount_ret_t_u.volume.rm;
+    clt->bsize = ret->ep_mount_ret_t_u.volume.bs;
     memcpy(clt->rfid, ret->ep_mount_ret_t_u.volume.rfid, sizeof (fid_t));
 
     // Initialize the list of clusters
@@ -209,7 +213,7 @@ int exportclt_reload(exportclt_t * clt) {
     }
 
     // Initialize rozofs
-    if (rozofs_initialize(clt->rl) != 0) {
+    if (rozofs_initialize(clt->rl, clt->bsize) != 0) {
         fatal("can't initialise rozofs %s", strerror(errno));
         goto out;
     }
@@ -40,6 +40,8 @@ typedef struct exportclt {
     eid_t eid;
     list_t mcs;
     rozofs_layout_t rl;
+    rozofs_mode_t rm;
+    uint32_t bsize;
     fid_t rfid;
     uint32_t bufsize;
     uint32_t retries;
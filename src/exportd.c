@@ -165,7 +165,8 @@ static int load_layout_conf(struct config_t *config) {
         goto out;
     }
 
-    if (rozofs_initialize(layout) != 0) {
+    // block sizes are set per export, only the layout matters here
+    if (rozofs_initialize(layout, ROZOFS_BSIZE) != 0) {
         fprintf(stderr, "can't initialise rozofs layout: %s\n",
                 strerror(errno));
         goto out;
@@ -381,9 +382,10 @@ out:
 }
 
 /*
- * convert string to number of block of ROZOFS_BSIZE 
+ * convert string to number of block of bsize
  */
-static int strquota_to_nbblocks(const char *str, uint64_t *blocks) {
+static int strquota_to_nbblocks(const char *str, uint32_t bsize,
+        uint64_t *blocks) {
     int status = -1;
     char *unit;
     uint64_t value;
@@ -404,13 +406,13 @@ static int strquota_to_nbblocks(const char *str, uint64_t *blocks) {
 
     switch(*unit) {
         case 'K':
-            *blocks = 1024 * value / ROZOFS_BSIZE;
+            *blocks = 1024 * value / bsize;
             break;
         case 'M':
-            *blocks = 1024 * 1024 * value / ROZOFS_BSIZE;
+            *blocks = 1024 * 1024 * value / bsize;
             break;
         case 'G':
-            *blocks = 1024 * 1024 * 1024 * value / ROZOFS_BSIZE;
+            *blocks = 1024 * 1024 * 1024 * value / bsize;
             break;
         default : // no unit user set directly nb blocks
             *blocks = value;
@@ -423,6 +425,47 @@ out:
     return status;
 }
 
+/*
+ * look up the optional block size of an export (ROZOFS_BSIZE by default)
+ */
+static int lookup_bsize(struct config_setting_t *setting, uint32_t *bsize) {
+    int status = -1;
+    long int value;
+
+    if (config_setting_lookup_int(setting, "bsize", &value) == CONFIG_FALSE)
+        value = ROZOFS_BSIZE;
+    if (value < ROZOFS_BSIZE_MIN || value > ROZOFS_BSIZE_MAX ||
+            value % ROZOFS_BSIZE_MIN != 0) {
+        errno = EINVAL;
+        goto out;
+    }
+    *bsize = value;
+
+    status = 0;
+out:
+    return status;
+}
+
+/*
+ * convert the optional mode setting of an export (mojette by default)
+ */
+static int strmode_to_mode(const char *str, rozofs_mode_t *mode) {
+    int status = -1;
+
+    if (str == NULL || strcmp(str, "mojette") == 0) {
+        *mode = MODE_MOJETTE;
+    } else if (strcmp(str, "systematic") == 0) {
+        *mode = MODE_SYSTEMATIC;
+    } else {
+        errno = EINVAL;
+        goto out;
+    }
+
+    status = 0;
+out:
+    return status;
+}
+
 static int load_exports_conf(struct config_t *config) {
     int status = -1, i;
     struct config_setting_t *export_set = NULL;
@@ -447,6 +490,8 @@ static int load_exports_conf(struct config_t *config) {
         const char *str;
         uint64_t quota;
         long int vid; // Volume identifier
+        rozofs_mode_t mode;
+        uint32_t bsize;
 
         if ((mfs_setting = config_setting_get_elem(export_set, i)) == NULL) {
             errno = EIO; //XXX
@@ -485,6 +530,14 @@ static int load_exports_conf(struct config_t *config) {
             goto out;
         }
 
+        // Lookup block size (optional)
+        if (lookup_bsize(mfs_setting, &bsize) != 0) {
+            fprintf(stderr, "invalid bsize for export (idx=%d): must be a"
+                    " multiple of %d up to %d\n", i, ROZOFS_BSIZE_MIN,
+                    ROZOFS_BSIZE_MAX);
+            goto out;
+        }
+
         if (config_setting_lookup_string(mfs_setting, "quota", &str) ==
                 CONFIG_FALSE) {
             errno = ENOKEY;
@@ -492,7 +545,7 @@ static int load_exports_conf(struct config_t *config) {
             goto out;
         }
 
-        if (strquota_to_nbblocks(str, &quota) != 0) {
+        if (strquota_to_nbblocks(str, bsize, &quota) != 0) {
             fprintf(stderr, "%s: can't convert to quota)\n", str);
             goto out;
         }
@@ -517,9 +570,17 @@ static int load_exports_conf(struct config_t *config) {
             goto out;
         }
 
+        // Lookup storage mode (optional)
+        str = NULL;
+        config_setting_lookup_string(mfs_setting, "mode", &str);
+        if (strmode_to_mode(str, &mode) != 0) {
+            fprintf(stderr, "%s: unknown mode for export (idx=%d)\n", str, i);
+            goto out;
+        }
+
         // Initialize export
         if (export_initialize(&export_entry->export, eid, root, md5, quota,
-                vid) != 0) {
+                vid, mode, bsize) != 0) {
             fprintf(stderr, "can't initialize export with path %s: %s\n",
                     root, strerror(errno));
             goto out;
@@ -563,6 +624,8 @@ static int reload_exports_conf(struct config_t *config) {
         uint64_t quota;
         uint32_t eid; // Export identifier
         long int vid; // Volume identifier
+        rozofs_mode_t mode;
+        uint32_t bsize;
         export_t *current;
 
         if ((mfs_setting = config_setting_get_elem(export_set, i)) == NULL) {
@@ -589,7 +652,8 @@ static int reload_exports_conf(struct config_t *config) {
                 goto out;
             }
 
-            if (strquota_to_nbblocks(str, &current->quota) != 0) {
+            if (strquota_to_nbblocks(str, current->bsize, &current->quota)
+                    != 0) {
                 fprintf(stderr, "%s: can't convert to quota)\n", str);
                 goto out;
             }
@@ -610,6 +674,13 @@ static int reload_exports_conf(struct config_t *config) {
             goto out;
         }
 
+        // Lookup block size (optional)
+        if (lookup_bsize(mfs_setting, &bsize) != 0) {
+            severe("invalid bsize for export (idx=%d): must be a multiple"
+                    " of %d up to %d", i, ROZOFS_BSIZE_MIN, ROZOFS_BSIZE_MAX);
+            goto out;
+        }
+
         if (config_setting_lookup_string(mfs_setting, "quota", &str) ==
                 CONFIG_FALSE) {
             errno = ENOKEY;
@@ -617,7 +688,7 @@ static int reload_exports_conf(struct config_t *config) {
             goto out;
         }
 
-        if (strquota_to_nbblocks(str, &quota) != 0) {
+        if (strquota_to_nbblocks(str, bsize, &quota) != 0) {
             fprintf(stderr, "%s: can't convert to quota)\n", str);
             goto out;
         }
@@ -641,8 +712,17 @@ static int reload_exports_conf(struct config_t *config) {
             goto out;
         }
 
+        // Lookup storage mode (optional)
+        str = NULL;
+        config_setting_lookup_string(mfs_setting, "mode", &str);
+        if (strmode_to_mode(str, &mode) != 0) {
+            severe("%s: unknown mode for export (idx=%d)", str, i);
+            goto out;
+        }
+
         // Initialize export
-        if (export_initialize(&export_entry->export, eid, root, md5, quota, vid) != 0) {
+        if (export_initialize(&export_entry->export, eid, root, md5, quota, vid,
+                mode, bsize) != 0) {
             severe("can't initialize export with path %s: %s", root,
                     strerror(errno));
             goto out;
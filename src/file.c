@@ -23,6 +23,8 @@
 #include "xmalloc.h"
 #include "sproto.h"
 #include "profile.h"
+#include "tpool.h"
+#include "crc32c.h"
 
 static storageclt_t *lookup_mstorage(exportclt_t * e, cid_t cid, sid_t sid) {
     list_t *iterator;
@@ -90,76 +92,250 @@ static int file_connect(file_t * f) {
     return 0;
 }
 
+/*
+ * Systematic mode: the first rozofs_inverse projections (data chunks) are
+ * the rows of the blocks and the others (parity chunks) projections of them.
+ * bins[k] holds the n consecutive chunks of tid tids[k]: rows are copied
+ * back and, when some are missing, rebuilt from the parity chunks received
+ * instead.
+ */
+static int systematic_inverse(pxl_t * support, uint32_t bsize, uint32_t n,
+                              const tid_t * tids, bin_t ** bins,
+                              const projection_t * projections) {
+    int cols = bsize / rozofs_inverse / sizeof (pxl_t);
+    int lost[rozofs_inverse];
+    int received[rozofs_inverse];
+    projection_t parity[rozofs_inverse];
+    int nlost = 0, np = 0;
+    int k, j;
+    DEBUG_FUNCTION;
+
+    memset(received, 0, sizeof (received));
+    for (k = 0; k < rozofs_inverse; k++) {
+        if (tids[k] >= rozofs_inverse) {
+            parity[np++] = projections[k];
+            continue;
+        }
+        received[tids[k]] = 1;
+        for (j = 0; j < n; j++)
+            memcpy(support + (j * rozofs_inverse + tids[k]) * cols,
+                   bins[k] + j * cols, cols * sizeof (pxl_t));
+    }
+    // all data chunks answered: nothing to decode
+    if (np == 0)
+        return 0;
+
+    for (k = 0; k < rozofs_inverse; k++)
+        if (!received[k])
+            lost[nlost++] = k;
+    return transform_inverse_rows_n(support, rozofs_inverse, cols, nlost, lost,
+                                    parity, n);
+}
+
+/*
+ * Check the n projection blocks of psize bins against their crc32c, 0
+ * meaning the block was stored without one. Returns the index of the first
+ * corrupted block or -1.
+ */
+static int check_crcs(const bin_t * bins, uint32_t psize, uint32_t n,
+                      const uint32_t * crcs) {
+    int j;
+
+    for (j = 0; j < n; j++)
+        if (crcs[j] && crc32c(0, bins + j * psize, psize * sizeof (bin_t))
+            != crcs[j])
+            return j;
+    return -1;
+}
+
+/* Index of the storage holding projection mp of blocks distributed on dist. */
+static int dist_storage(dist_t dist, uint8_t mp) {
+    int mps;
+    int j = 0;
+
+    for (mps = 0; mps < rozofs_safe; mps++) {
+        if (dist_is_set(dist, mps) && j == mp)
+            break;
+        j += dist_is_set(dist, mps);
+    }
+    return mps;
+}
+
+/*
+ * Read the first rozofs_inverse projections of the nruns runs of blocks
+ * (counts[r] blocks from bid + starts[r] distributed on dists[r]) with one
+ * call per storage holding several of them. pre[r * rozofs_inverse + mp]
+ * gets the bins of projection mp of run r when they are read and checked,
+ * the others are left to be read one run at a time.
+ */
+static void read_runs(file_t * f, bid_t bid, uint32_t nruns,
+                      const uint32_t * starts, const uint32_t * counts,
+                      const dist_t * dists, bin_t ** pre) {
+    storageclt_extent_t *extents;
+    uint32_t *ids;
+    int systematic = f->export->rm == MODE_SYSTEMATIC;
+    uint32_t *psizes = systematic ? rozofs_spsizes : rozofs_psizes;
+    uint32_t r, n, k;
+    uint8_t mp;
+    int ps, bad;
+    DEBUG_FUNCTION;
+
+    extents = xmalloc(nruns * sizeof (storageclt_extent_t));
+    ids = xmalloc(nruns * sizeof (uint32_t));
+    for (ps = 0; ps < rozofs_safe; ps++) {
+        if (!f->storages[ps]->rpcclt.client)
+            continue;
+        // a storage holds one projection of a run at most
+        n = 0;
+        for (r = 0; r < nruns; r++) {
+            for (mp = 0; mp < rozofs_inverse; mp++) {
+                if (dist_storage(dists[r], mp) != ps)
+                    continue;
+                memcpy(extents[n].fid, f->fid, sizeof (fid_t));
+                extents[n].tid = mp;
+                extents[n].psize = psizes[mp];
+                extents[n].bid = bid + starts[r];
+                extents[n].nrb = counts[r];
+                ids[n++] = r * rozofs_inverse + mp;
+            }
+        }
+        if (n < 2)
+            continue;
+        for (k = 0; k < n; k++) {
+            extents[k].bins = xmalloc(extents[k].nrb * extents[k].psize *
+                                      sizeof (bin_t));
+            extents[k].crcs = xmalloc(extents[k].nrb * sizeof (uint32_t));
+        }
+        if (storageclt_readv(f->storages[ps], extents, n) == 0) {
+            for (k = 0; k < n; k++) {
+                if (extents[k].error)
+                    continue;
+                // A corrupted projection is dropped, the next one is used
+                if ((bad = check_crcs(extents[k].bins, extents[k].psize,
+                                      extents[k].nrb, extents[k].crcs)) >= 0) {
+                    warning("read_blocks: checksum mismatch on projection %u"
+                            " of block %lu from storage server: %s",
+                            extents[k].tid, extents[k].bid + bad,
+                            f->storages[ps]->host);
+                    continue;
+                }
+                pre[ids[k]] = extents[k].bins;
+                extents[k].bins = 0;
+            }
+        }
+        for (k = 0; k < n; k++) {
+            if (extents[k].bins)
+                free(extents[k].bins);
+            free(extents[k].crcs);
+        }
+    }
+    free(ids);
+    free(extents);
+}
+
 static int read_blocks(file_t * f, bid_t bid, uint32_t nmbs, char *data) {
-    int status = -1, i, j;
+    int status = -1, i;
     dist_t *dist;               // Pointer to memory area where the block distribution will be stored
-    dist_t *dist_iterator;
+    uint32_t *starts;           // runs of blocks with identical distributions
+    uint32_t *counts;
+    dist_t *dists;
+    bin_t **pre = 0;            // projections of the runs read at once
+    uint32_t nruns = 0, r;
     uint8_t mp;
     bin_t **bins;
     projection_t *projections;
-    angle_t *angles;
-    uint16_t *psizes;
+    tid_t *tids;                // tid of bins[connected]
+    uint32_t *crcs;             // checksums of the blocks read
+    int systematic = f->export->rm == MODE_SYSTEMATIC;
+    angle_t *angles = systematic ? rozofs_sangles : rozofs_angles;
+    uint32_t *psizes = systematic ? rozofs_spsizes : rozofs_psizes;
+    uint32_t bsize = f->export->bsize;
     DEBUG_FUNCTION;
 
     bins = xcalloc(rozofs_inverse, sizeof (bin_t *));
     projections = xmalloc(rozofs_inverse * sizeof (projection_t));
-    angles = xmalloc(rozofs_inverse * sizeof (angle_t));
-    psizes = xmalloc(rozofs_inverse * sizeof (uint16_t));
-    memset(data, 0, nmbs * ROZOFS_BSIZE);
+    tids = xmalloc(rozofs_inverse * sizeof (tid_t));
+    crcs = xmalloc(nmbs * sizeof (uint32_t));
+    memset(data, 0, nmbs * bsize);
     dist = xmalloc(nmbs * sizeof (dist_t));
+    starts = xmalloc(nmbs * sizeof (uint32_t));
+    counts = xmalloc(nmbs * sizeof (uint32_t));
+    dists = xmalloc(nmbs * sizeof (dist_t));
 
     if (exportclt_read_block(f->export, f->fid, bid, nmbs, dist) != 0)
         goto out;
 
-    /* Until we don't decode all data blocks (nmbs blocks) */
-    i = 0;                      // Nb. of blocks decoded (at begin = 0)
-    dist_iterator = dist;
-    while (i < nmbs) {
-        if (*dist_iterator == 0) {
-            i++;
-            dist_iterator++;
+    /* We calculate the runs of blocks with identical distributions,
+     * blocks never written (distribution 0) are left to 0 */
+    for (i = 0; i < nmbs; i++) {
+        if (dist[i] == 0)
+            continue;
+        if (nruns > 0 && dists[nruns - 1] == dist[i] &&
+            starts[nruns - 1] + counts[nruns - 1] == i) {
+            counts[nruns - 1]++;
             continue;
         }
+        starts[nruns] = i;
+        counts[nruns] = 1;
+        dists[nruns++] = dist[i];
+    }
 
-        /* We calculate the number blocks with identical distributions */
-        uint32_t n = 1;
-        while ((i + n) < nmbs && *dist_iterator == *(dist_iterator + 1)) {
-            n++;
-            dist_iterator++;
-        }
-        // I don't know if it 's possible
-        if (i + n > nmbs)
-            goto out;
+    // Several runs (a file written in degraded mode): their projections
+    // are asked to each storage at once
+    if (nruns > 1) {
+        pre = xcalloc(nruns * rozofs_inverse, sizeof (bin_t *));
+        PROFILE_STORAGE_START;
+        read_runs(f, bid, nruns, starts, counts, dists, pre);
+        PROFILE_STORAGE_STOP;
+    }
+
+    /* Until we don't decode all runs */
+    for (r = 0; r < nruns; r++) {
+        uint32_t n = counts[r];
+        i = starts[r];
         // Nb. of received requests (at begin=0)
         int connected = 0;
-        // For each projection
+        // For each projection (in systematic mode, data chunks come first
+        // so that a healthy read needs no decoding)
         PROFILE_STORAGE_START;
         for (mp = 0; mp < rozofs_forward; mp++) {
             int mps = 0;
-            int j = 0;
+            int bad;
             bin_t *b;
-            // Find the host for projection mp
-            for (mps = 0; mps < rozofs_safe; mps++) {
-                if (dist_is_set(*dist_iterator, mps) && j == mp) {
-                    break;
-                } else {        // Try with the next storage server
-                    j += dist_is_set(*dist_iterator, mps);
-                }
+
+            // Already read with the other runs
+            if (pre && mp < rozofs_inverse && pre[r * rozofs_inverse + mp]) {
+                b = pre[r * rozofs_inverse + mp];
+                pre[r * rozofs_inverse + mp] = 0;
+                goto received;
             }
+            // Find the host for projection mp
+            if ((mps = dist_storage(dists[r], mp)) == rozofs_safe)
+                continue;
 
             if (!f->storages[mps]->rpcclt.client)
                 continue;
 
-            b = xmalloc(n * rozofs_psizes[mp] * sizeof (bin_t));
-            if (storageclt_read(f->storages[mps], f->fid, mp, bid + i, n, b)
-                != 0) {
+            b = xmalloc(n * psizes[mp] * sizeof (bin_t));
+            if (storageclt_read(f->storages[mps], f->fid, mp, psizes[mp],
+                                bid + i, n, b, crcs) != 0) {
                 free(b);
                 continue;
             }
+            // A corrupted projection is dropped, the next one is used
+            if ((bad = check_crcs(b, psizes[mp], n, crcs)) >= 0) {
+                warning("read_blocks: checksum mismatch on projection %u of"
+                        " block %lu from storage server: %s", mp,
+                        bid + i + bad, f->storages[mps]->host);
+                free(b);
+                continue;
+            }
+received:
             bins[connected] = b;
-            angles[connected].p = rozofs_angles[mp].p;
-            angles[connected].q = rozofs_angles[mp].q;
-            psizes[connected] = rozofs_psizes[mp];
+            tids[connected] = mp;
+            projections[connected].angle.p = angles[mp].p;
+            projections[connected].angle.q = angles[mp].q;
+            projections[connected].size = psizes[mp];
 
             // Increment the number of received requests
             if (++connected == rozofs_inverse)
@@ -173,24 +349,21 @@ static int read_blocks(file_t * f, bid_t bid, uint32_t nmbs, char *data) {
         }
 
         PROFILE_TRANSFORM_START;
-        // Proceed the inverse data transform for the n blocks.
-        for (j = 0; j < n; j++) {
-            // Fill the table of projections for the block j
-            // For each meta-projection
-            for (mp = 0; mp < rozofs_inverse; mp++) {
-                // It's really important to specify the angles and sizes here
-                // because the data inverse function sorts the projections.
-                projections[mp].angle.p = angles[mp].p;
-                projections[mp].angle.q = angles[mp].q;
-                projections[mp].size = psizes[mp];
-                projections[mp].bins = bins[mp] + (psizes[mp] * j);
+        // Proceed the inverse data transform for the n blocks at once
+        // (split across the transform threads):
+        // bins[mp] holds the n consecutive projections of angle mp.
+        for (mp = 0; mp < rozofs_inverse; mp++)
+            projections[mp].bins = bins[mp];
+        if (systematic) {
+            if (systematic_inverse((pxl_t *) (data + (bsize * i)), bsize, n,
+                                   tids, bins, projections) != 0) {
+                errno = EIO;
+                goto out;
             }
-
-            // Inverse data for the block j
-            transform_inverse((pxl_t *) (data + (ROZOFS_BSIZE * (i + j))),
-                              rozofs_inverse,
-                              ROZOFS_BSIZE / rozofs_inverse / sizeof (pxl_t),
-                              rozofs_inverse, projections);
+        } else {
+            tpool_inverse((pxl_t *) (data + (bsize * i)), rozofs_inverse,
+                          bsize / rozofs_inverse / sizeof (pxl_t),
+                          rozofs_inverse, projections, n);
         }
         PROFILE_TRANSFORM_INV_STOP;
         // Free the memory area where are stored the bins.
@@ -199,10 +372,6 @@ static int read_blocks(file_t * f, bid_t bid, uint32_t nmbs, char *data) {
                 free(bins[mp]);
             bins[mp] = 0;
         }
-        // Increment the nb. of blocks decoded
-        i += n;
-        // Shift to the next distribution
-        dist_iterator++;
     }
     // If everything is OK, the status is set to 0
     status = 0;
@@ -214,59 +383,135 @@ out:
                 free(bins[mp]);
         free(bins);
     }
+    if (pre) {
+        for (r = 0; r < nruns * rozofs_inverse; r++)
+            if (pre[r])
+                free(pre[r]);
+        free(pre);
+    }
     if (projections)
         free(projections);
-    if (angles)
-        free(angles);
-    if (psizes)
-        free(psizes);
+    if (tids)
+        free(tids);
+    if (crcs)
+        free(crcs);
     if (dist)
         free(dist);
+    free(starts);
+    free(counts);
+    free(dists);
     return status;
 }
 
-static int write_blocks(file_t * f, bid_t bid, uint32_t nmbs,
-                        const char *data) {
+/*
+ * Write projection mp of the n ranges of blocks (nmbs[k] blocks from
+ * bids[k], their bins and crcs following each other) to storage s in one
+ * call.
+ */
+static int write_projection(file_t * f, storageclt_t * s, uint8_t mp,
+                            uint32_t psize, uint32_t n, const bid_t * bids,
+                            const uint32_t * nmbs, bin_t * bins,
+                            uint32_t * crcs) {
+    int status = -1;
+    storageclt_extent_t *extents;
+    uint32_t k;
+    DEBUG_FUNCTION;
+
+    if (n == 1)
+        return storageclt_write(s, f->fid, mp, psize, bids[0], nmbs[0], bins,
+                                crcs);
+    extents = xmalloc(n * sizeof (storageclt_extent_t));
+    for (k = 0; k < n; k++) {
+        memcpy(extents[k].fid, f->fid, sizeof (fid_t));
+        extents[k].tid = mp;
+        extents[k].psize = psize;
+        extents[k].bid = bids[k];
+        extents[k].nrb = nmbs[k];
+        extents[k].bins = bins;
+        extents[k].crcs = crcs;
+        bins += nmbs[k] * psize;
+        crcs += nmbs[k];
+    }
+    if ((status = storageclt_writev(s, extents, n)) == 0) {
+        for (k = 0; k < n; k++) {
+            if (extents[k].error) {
+                errno = extents[k].error;
+                status = -1;
+            }
+        }
+    }
+    free(extents);
+    return status;
+}
+
+/*
+ * Write the n ranges of nmbs[k] blocks of data[k] from bids[k], with the
+ * same distribution: each storage gets its projection of all of them.
+ */
+static int write_ranges(file_t * f, uint32_t n, const bid_t * bids,
+                        const uint32_t * nmbs, const char **data) {
     int status = -1;
     projection_t *projections;  // Table of projections used to transform data
     bin_t **bins;
-    angle_t *angles;
-    uint16_t *psizes;
+    uint32_t **crcs;            // crcs[mp][j]: checksum of block j of bins[mp]
+    uint32_t **rcrcs;           // those of the range transformed
+    int systematic = f->export->rm == MODE_SYSTEMATIC;
+    angle_t *angles = systematic ? rozofs_sangles : rozofs_angles;
+    uint32_t *psizes = systematic ? rozofs_spsizes : rozofs_psizes;
+    int cols = f->export->bsize / rozofs_inverse / sizeof (pxl_t);
     dist_t dist = 0;            // Important
     uint16_t mp = 0;
     uint16_t ps = 0;
-    uint32_t i = 0;
+    uint32_t k, off, total = 0;
     int retry = 0;
     int send = 0;
     DEBUG_FUNCTION;
 
+    for (k = 0; k < n; k++)
+        total += nmbs[k];
     projections = xmalloc(rozofs_forward * sizeof (projection_t));
     bins = xcalloc(rozofs_forward, sizeof (bin_t *));
-    angles = xmalloc(rozofs_forward * sizeof (angle_t));
-    psizes = xmalloc(rozofs_forward * sizeof (uint16_t));
+    crcs = xcalloc(rozofs_forward, sizeof (uint32_t *));
+    rcrcs = xcalloc(rozofs_forward, sizeof (uint32_t *));
 
     // For each projection
     for (mp = 0; mp < rozofs_forward; mp++) {
-        bins[mp] = xmalloc(rozofs_psizes[mp] * nmbs * sizeof (bin_t));
-        projections[mp].angle.p = rozofs_angles[mp].p;
-        projections[mp].angle.q = rozofs_angles[mp].q;
-        projections[mp].size = rozofs_psizes[mp];
+        bins[mp] = xmalloc(psizes[mp] * total * sizeof (bin_t));
+        crcs[mp] = xmalloc(total * sizeof (uint32_t));
+        projections[mp].angle.p = angles[mp].p;
+        projections[mp].angle.q = angles[mp].q;
+        projections[mp].size = psizes[mp];
     }
 
     PROFILE_TRANSFORM_START;
     /* Transform the data */
-    // For each block to send
-    for (i = 0; i < nmbs; i++) {
-        // seek bins for each projection
+    // bins[mp] receives the consecutive projections of angle mp of all the
+    // ranges, checksummed block by block as they are computed
+    for (k = 0, off = 0; k < n; off += nmbs[k++]) {
         for (mp = 0; mp < rozofs_forward; mp++) {
-            // Indicates the memory area where the transformed data must be stored
-            projections[mp].bins = bins[mp] + (rozofs_psizes[mp] * i);
-        }
-        // Apply the erasure code transform for the block i
-        transform_forward((pxl_t *) (data + (i * ROZOFS_BSIZE)),
-                          rozofs_inverse,
-                          ROZOFS_BSIZE / rozofs_inverse / sizeof (pxl_t),
-                          rozofs_forward, projections);
+            projections[mp].bins = bins[mp] + off * psizes[mp];
+            rcrcs[mp] = crcs[mp] + off;
+        }
+        if (systematic) {
+            // data chunks are the rows of the blocks, only the parity chunks
+            // are projections
+            int j;
+            for (mp = 0; mp < rozofs_inverse; mp++)
+                for (j = 0; j < nmbs[k]; j++) {
+                    memcpy(projections[mp].bins + j * cols,
+                           (pxl_t *) data[k] + (j * rozofs_inverse + mp) * cols,
+                           cols * sizeof (pxl_t));
+                    rcrcs[mp][j] = crc32c(0, projections[mp].bins + j * cols,
+                                          cols * sizeof (pxl_t));
+                }
+            tpool_forward((pxl_t *) data[k], rozofs_inverse, cols,
+                          rozofs_forward - rozofs_inverse,
+                          projections + rozofs_inverse, rcrcs + rozofs_inverse,
+                          nmbs[k]);
+        } else {
+            tpool_forward((pxl_t *) data[k], rozofs_inverse, cols,
+                          rozofs_forward, projections, rcrcs, nmbs[k]);
+        }
     }
     PROFILE_TRANSFORM_FRWD_STOP;
     do {
@@ -282,8 +527,8 @@ static int write_blocks(file_t * f, bid_t bid, uint32_t nmbs,
             if (!(f->storages[ps]->rpcclt.client))
                 continue;
 
-            if (storageclt_write
-                (f->storages[ps], f->fid, mp, bid, nmbs, bins[mp]) != 0)
+            if (write_projection(f, f->storages[ps], mp, psizes[mp], n, bids,
+                                 nmbs, bins[mp], crcs[mp]) != 0)
                 continue;
 
             dist_set_true(dist, ps);
@@ -310,9 +555,12 @@ static int write_blocks(file_t * f, bid_t bid, uint32_t nmbs,
         goto out;
     }
 
-    if (exportclt_write_block(f->export, f->fid, bid, nmbs, dist) != 0) {
-        errno = EIO;
-        goto out;
+    for (k = 0; k < n; k++) {
+        if (exportclt_write_block(f->export, f->fid, bids[k], nmbs[k], dist)
+            != 0) {
+            errno = EIO;
+            goto out;
+        }
     }
 
     status = 0;
@@ -323,46 +571,47 @@ out:
                 free(bins[mp]);
         free(bins);
     }
+    if (crcs) {
+        for (mp = 0; mp < rozofs_forward; mp++)
+            if (crcs[mp])
+                free(crcs[mp]);
+        free(crcs);
+    }
+    if (rcrcs)
+        free(rcrcs);
     if (projections)
         free(projections);
-    if (angles)
-        free(angles);
-    if (psizes)
-        free(psizes);
     return status;
 }
 
-// XXX : in each while (read_blocks(...))
-// it's possible to do the file_connect() indefinitely
-// EXAMPLE : WE HAVE 16 (0->16) STORAGE SERVERS
-// AND I HAVE STORE A FILE IN STORAGE SERVER 0 to 11
-// STORAGE SERVERS 0, 1, 2, 3 ARE OFFLINE BUT
-// STORAGE SERVERS 12, 13, 14, 15 ARE ONLINE
-// THEN CONNECT_FILE() IS GOOD BUT IT'S IMPOSSIBLE TO RETRIEVE THE FILE
+static int write_blocks(file_t * f, bid_t bid, uint32_t nmbs,
+                        const char *data) {
+    return write_ranges(f, 1, &bid, &nmbs, &data);
+}
 
 static int64_t read_buf(file_t * f, uint64_t off, char *buf, uint32_t len) {
     int64_t length;
     uint64_t first;
-    uint16_t foffset;
+    uint32_t foffset;
     uint64_t last;
-    uint16_t loffset;
+    uint32_t loffset;
     int retry = 0;
+    uint32_t bsize = f->export->bsize;
+    char *block = 0;
     DEBUG_FUNCTION;
 
     if ((length = exportclt_read(f->export, f->fid, off, len)) < 0)
         goto out;
+    block = xmalloc(bsize);
 
-    first = off / ROZOFS_BSIZE;
-    foffset = off % ROZOFS_BSIZE;
-    last =
-        (off + length) / ROZOFS_BSIZE + ((off + length) % ROZOFS_BSIZE ==
-                                         0 ? -1 : 0);
-    loffset = (off + length) - last * ROZOFS_BSIZE;
+    first = off / bsize;
+    foffset = off % bsize;
+    last = (off + length) / bsize + ((off + length) % bsize == 0 ? -1 : 0);
+    loffset = (off + length) - last * bsize;
 
     // if our read is one block only
     if (first == last) {
-        char block[ROZOFS_BSIZE];
-        memset(block, 0, ROZOFS_BSIZE);
+        memset(block, 0, bsize);
         retry = 0;
         while (read_blocks(f, first, 1, block) != 0 &&
                retry++ < f->export->retries) {
@@ -374,8 +623,7 @@ static int64_t read_buf(file_t * f, uint64_t off, char *buf, uint32_t len) {
         memcpy(buf, &block[foffset], length);
     } else {
         char *bufp;
-        char block[ROZOFS_BSIZE];
-        memset(block, 0, ROZOFS_BSIZE);
+        memset(block, 0, bsize);
         bufp = buf;
         if (foffset != 0) {
             retry = 0;
@@ -386,11 +634,11 @@ static int64_t read_buf(file_t * f, uint64_t off, char *buf, uint32_t len) {
                     goto out;
                 }
             }
-            memcpy(buf, &block[foffset], ROZOFS_BSIZE - foffset);
+            memcpy(buf, &block[foffset], bsize - foffset);
             first++;
-            bufp += ROZOFS_BSIZE - foffset;
+            bufp += bsize - foffset;
         }
-        if (loffset != ROZOFS_BSIZE) {
+        if (loffset != bsize) {
             retry = 0;
             while (read_blocks(f, last, 1, block) != 0 &&
                    retry++ < f->export->retries) {
@@ -399,7 +647,7 @@ static int64_t read_buf(file_t * f, uint64_t off, char *buf, uint32_t len) {
                     goto out;
                 }
             }
-            memcpy(bufp + ROZOFS_BSIZE * (last - first), block, loffset);
+            memcpy(bufp + bsize * (last - first), block, loffset);
             last--;
         }
         // Read the others
@@ -416,6 +664,8 @@ static int64_t read_buf(file_t * f, uint64_t off, char *buf, uint32_t len) {
     }
 
 out:
+    if (block)
+        free(block);
     return length;
 }
 
@@ -423,43 +673,45 @@ static int64_t write_buf(file_t * f, uint64_t off, const char *buf,
                          uint32_t len) {
     int64_t length = -1;
     uint64_t first;
-    uint16_t foffset;
+    uint32_t foffset;
     int fread;
     uint64_t last;
-    uint16_t loffset;
+    uint32_t loffset;
     int lread;
     int retry = 0;
+    uint32_t bsize = f->export->bsize;
+    char *block = 0;
+    char *lblock = 0;           // the last one, written with the first
 
     if (exportclt_getattr(f->export, f->attrs.fid, &f->attrs) != 0)
         goto out;
+    block = xmalloc(bsize);
 
     length = len;
     // Nb. of the first block to write
-    first = off / ROZOFS_BSIZE;
+    first = off / bsize;
     // Offset (in bytes) for the first block
-    foffset = off % ROZOFS_BSIZE;
+    foffset = off % bsize;
     // Nb. of the last block to write
-    last = (off + length) / ROZOFS_BSIZE + ((off + length) % ROZOFS_BSIZE ==
-                                         0 ? -1 : 0);
+    last = (off + length) / bsize + ((off + length) % bsize == 0 ? -1 : 0);
     // Offset (in bytes) for the last block
-    loffset = (off + length) - last * ROZOFS_BSIZE;
+    loffset = (off + length) - last * bsize;
 
     // Is it neccesary to read the first block ?
-    if (first <= (f->attrs.size / ROZOFS_BSIZE) && foffset != 0)
+    if (first <= (f->attrs.size / bsize) && foffset != 0)
         fread = 1;
     else
         fread = 0;
 
     // Is it necesary to read the last block ?
-    if (last < (f->attrs.size / ROZOFS_BSIZE) && loffset != ROZOFS_BSIZE)
+    if (last < (f->attrs.size / bsize) && loffset != bsize)
         lread = 1;
     else
         lread = 0;
 
     // If we must write only one block
     if (first == last) {
-        char block[ROZOFS_BSIZE];
-        memset(block, 0, ROZOFS_BSIZE);
+        memset(block, 0, bsize);
 
         // If it's neccesary to read this block (first == last)
         if (fread == 1 || lread == 1) {
@@ -480,9 +732,13 @@ static int64_t write_buf(file_t * f, uint64_t off, const char *buf,
         }
     } else {                    // If we must write more than one block
         const char *bufp;
-        char block[ROZOFS_BSIZE];
+        // the first, last and other blocks are written at once
+        bid_t bids[3];
+        uint32_t nmbs[3];
+        const char *datas[3];
+        uint32_t n = 0;
 
-        memset(block, 0, ROZOFS_BSIZE);
+        memset(block, 0, bsize);
         bufp = buf;
         // Manage the first and last blocks if needed
         if (foffset != 0) {
@@ -497,20 +753,20 @@ static int64_t write_buf(file_t * f, uint64_t off, const char *buf,
                     }
                 }
             }
-            memcpy(&block[foffset], buf, ROZOFS_BSIZE - foffset);
-            if (write_blocks(f, first, 1, block) != 0) {
-                length = -1;
-                goto out;
-            }
+            memcpy(&block[foffset], buf, bsize - foffset);
+            bids[n] = first;
+            nmbs[n] = 1;
+            datas[n++] = block;
             first++;
-            bufp += ROZOFS_BSIZE - foffset;
+            bufp += bsize - foffset;
         }
 
-        if (loffset != ROZOFS_BSIZE) {
+        if (loffset != bsize) {
+            lblock = xcalloc(bsize, sizeof (char));
             // If we need to read the last block
             if (lread == 1) {
                 retry = 0;
-                while (read_blocks(f, last, 1, block) != 0 &&
+                while (read_blocks(f, last, 1, lblock) != 0 &&
                        retry++ < f->export->retries) {
                     if (file_connect(f) != 0) {
                         length = -1;
@@ -518,20 +774,21 @@ static int64_t write_buf(file_t * f, uint64_t off, const char *buf,
                     }
                 }
             }
-            memcpy(block, bufp + ROZOFS_BSIZE * (last - first), loffset);
-            if (write_blocks(f, last, 1, block) != 0) {
-                length = -1;
-                goto out;
-            }
+            memcpy(lblock, bufp + bsize * (last - first), loffset);
+            bids[n] = last;
+            nmbs[n] = 1;
+            datas[n++] = lblock;
             last--;
         }
-        // Write the other blocks
+        // The other blocks
         if ((last - first) + 1 != 0) {
-            retry = 0;
-            if (write_blocks(f, first, (last - first) + 1, bufp) != 0) {
-                length = -1;
-                goto out;
-            }
+            bids[n] = first;
+            nmbs[n] = (last - first) + 1;
+            datas[n++] = bufp;
+        }
+        if (write_ranges(f, n, bids, nmbs, datas) != 0) {
+            length = -1;
+            goto out;
         }
     }
 
@@ -540,6 +797,10 @@ static int64_t write_buf(file_t * f, uint64_t off, const char *buf,
         goto out;
     }
 out:
+    if (block)
+        free(block);
+    if (lblock)
+        free(lblock);
     return length;
 }
 
@@ -0,0 +1,480 @@
+/*
+ Copyright (c) 2010 Fizians SAS. <http://www.fizians.com>
+ This file is part of Rozofs.
+
+ Rozofs is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 3 of the License,
+ or (at your option) any later version.
+
+ Rozofs is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see
+ <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "config.h"
+#include "log.h"
+#include "xmalloc.h"
+#include "ioring.h"
+
+void ioring_prep(iorw_t * rw, int fd, int slot, int write, void *buf,
+                 size_t len, off_t off) {
+    rw->fd = fd;
+    rw->slot = slot;
+    rw->write = write;
+    rw->buf = buf;
+    rw->len = len;
+    rw->off = off;
+    rw->res = -1;
+    rw->err = 0;
+    rw->done = 0;
+}
+
+#ifdef HAVE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+/*
+ * Operations are submitted and reaped by a thread of the ring: io_uring
+ * runs the blocking ones in workers of the submitting thread, which are
+ * cancelled when it exits. The thread waits for completions with a read
+ * of an eventfd in flight, written to wake it up when operations are
+ * queued.
+ */
+struct ioring {
+    int fd;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        // operations done
+    // submission queue
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    // completion queue
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+    unsigned queued;            // not yet submitted
+    unsigned inflight;          // queued or submitted, not reaped
+    int failed;                 // errno of a ring failure
+    // thread
+    int efd;
+    uint64_t ebuf;
+    int armed;                  // eventfd read in flight
+    int sleeping;               // waiting for completions
+    int stop;
+    pthread_t thread;
+    // registered fds
+    uint32_t nfiles;
+    int *slots;                 // free ones
+    uint32_t nslots;
+};
+
+static int ioring_setup(unsigned entries, struct io_uring_params *p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int ioring_enter(int fd, unsigned submit, unsigned min,
+                        unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, submit, min, flags, NULL, 0);
+}
+
+static int ioring_register_call(int fd, unsigned op, void *arg,
+                                unsigned n) {
+    return syscall(__NR_io_uring_register, fd, op, arg, n);
+}
+
+/* Whether the kernel knows the read and write operations (5.6). */
+static int ioring_probe(int fd) {
+    struct io_uring_probe *probe;
+    size_t len = sizeof (*probe) + 256 * sizeof (struct io_uring_probe_op);
+    int ok = 0;
+
+    probe = xcalloc(1, len);
+    if (ioring_register_call(fd, IORING_REGISTER_PROBE, probe, 256) == 0)
+        ok = probe->last_op >= IORING_OP_WRITE &&
+            (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+            (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    if (!ok)
+        errno = ENOSYS;
+    return ok;
+}
+
+static void ioring_unmap(struct ioring *r) {
+    if (r->sqes && r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqes_len);
+    if (r->cq_ptr && r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr, r->cq_len);
+    if (r->sq_ptr && r->sq_ptr != MAP_FAILED)
+        munmap(r->sq_ptr, r->sq_len);
+}
+
+static int ioring_map(struct ioring *r, struct io_uring_params *p) {
+    int status = -1;
+    char *sq, *cq;
+
+    r->sq_len = p->sq_off.array + p->sq_entries * sizeof (unsigned);
+    r->cq_len = p->cq_off.cqes + p->cq_entries * sizeof (struct io_uring_cqe);
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_len > r->sq_len)
+            r->sq_len = r->cq_len;
+        r->cq_len = r->sq_len;
+    }
+    r->sq_ptr = mmap(0, r->sq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED)
+        goto out;
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(0, r->cq_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, r->fd,
+                         IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED)
+            goto out;
+    }
+    r->sqes_len = p->sq_entries * sizeof (struct io_uring_sqe);
+    r->sqes = mmap(0, r->sqes_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+        goto out;
+
+    sq = r->sq_ptr;
+    r->sq_head = (unsigned *) (sq + p->sq_off.head);
+    r->sq_tail = (unsigned *) (sq + p->sq_off.tail);
+    r->sq_mask = *(unsigned *) (sq + p->sq_off.ring_mask);
+    r->sq_entries = p->sq_entries;
+    r->sq_array = (unsigned *) (sq + p->sq_off.array);
+    cq = r->cq_ptr;
+    r->cq_head = (unsigned *) (cq + p->cq_off.head);
+    r->cq_tail = (unsigned *) (cq + p->cq_off.tail);
+    r->cq_mask = *(unsigned *) (cq + p->cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *) (cq + p->cq_off.cqes);
+    status = 0;
+out:
+    return status;
+}
+
+/* Sparse table of nfiles registered fds, none registered if it fails. */
+static void ioring_files(struct ioring *r, uint32_t nfiles) {
+    int *fds;
+    uint32_t i;
+
+    r->nfiles = 0;
+    r->nslots = 0;
+    r->slots = 0;
+    if (nfiles == 0)
+        return;
+    fds = xmalloc(nfiles * sizeof (int));
+    for (i = 0; i < nfiles; i++)
+        fds[i] = -1;
+    if (ioring_register_call(r->fd, IORING_REGISTER_FILES, fds, nfiles) != 0) {
+        warning("can't register %u files to io_uring: %s", nfiles,
+                strerror(errno));
+        free(fds);
+        return;
+    }
+    // slots are given lowest first
+    for (i = 0; i < nfiles; i++)
+        fds[i] = nfiles - 1 - i;
+    r->nfiles = nfiles;
+    r->slots = fds;
+    r->nslots = nfiles;
+}
+
+// called with the lock held
+static struct io_uring_sqe *ioring_sqe(struct ioring *r) {
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & r->sq_mask;
+    struct io_uring_sqe *sqe = r->sqes + idx;
+
+    memset(sqe, 0, sizeof (*sqe));
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->queued++;
+    return sqe;
+}
+
+// called with the lock held
+static void ioring_reap(struct ioring *r) {
+    unsigned head = *r->cq_head;
+    int done = 0;
+
+    while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = r->cqes + (head & r->cq_mask);
+        iorw_t *rw = (iorw_t *) (uintptr_t) cqe->user_data;
+        head++;
+        // the eventfd read
+        if (!rw) {
+            r->armed = 0;
+            continue;
+        }
+        if (cqe->res < 0) {
+            rw->res = -1;
+            rw->err = -cqe->res;
+        } else {
+            rw->res = cqe->res;
+        }
+        rw->done = 1;
+        r->inflight--;
+        done = 1;
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    if (done)
+        pthread_cond_broadcast(&r->cond);
+}
+
+static void *ioring_thread(void *v) {
+    struct ioring *r = (struct ioring *) v;
+    struct io_uring_sqe *sqe;
+    unsigned submit;
+    int ret;
+
+    pthread_mutex_lock(&r->lock);
+    while (!r->stop) {
+        if (!r->armed) {
+            sqe = ioring_sqe(r);
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = r->efd;
+            sqe->addr = (uint64_t) (uintptr_t) & r->ebuf;
+            sqe->len = sizeof (r->ebuf);
+            sqe->user_data = 0;
+            r->armed = 1;
+        }
+        // submit what all threads queued meanwhile
+        submit = r->queued;
+        r->queued = 0;
+        r->sleeping = 1;
+        pthread_mutex_unlock(&r->lock);
+        ret = ioring_enter(r->fd, submit, 1, IORING_ENTER_GETEVENTS);
+        pthread_mutex_lock(&r->lock);
+        r->sleeping = 0;
+        if (ret < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                // operations in flight are lost, the ring is not used
+                // anymore
+                severe("io_uring_enter failed: %s", strerror(errno));
+                r->failed = errno;
+                pthread_cond_broadcast(&r->cond);
+                break;
+            }
+            ret = 0;
+        }
+        r->queued += submit - ret;
+        ioring_reap(r);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return 0;
+}
+
+static void ioring_wake(struct ioring *r) {
+    uint64_t one = 1;
+
+    if (write(r->efd, &one, sizeof (one)) != sizeof (one)) {
+        severe("can't wake io_uring thread up: %s", strerror(errno));
+    }
+}
+
+struct ioring *ioring_create(uint32_t entries, uint32_t nfiles) {
+    struct ioring *r = 0;
+    struct io_uring_params p;
+    int xerrno;
+    DEBUG_FUNCTION;
+
+    r = xcalloc(1, sizeof (struct ioring));
+    r->efd = -1;
+    memset(&p, 0, sizeof (p));
+    if ((r->fd = ioring_setup(entries, &p)) < 0)
+        goto error;
+    if (!ioring_probe(r->fd) || ioring_map(r, &p) != 0)
+        goto error;
+    if ((r->efd = eventfd(0, 0)) < 0)
+        goto error;
+    ioring_files(r, nfiles);
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    if ((errno = pthread_create(&r->thread, NULL, ioring_thread, r)) != 0) {
+        pthread_cond_destroy(&r->cond);
+        pthread_mutex_destroy(&r->lock);
+        free(r->slots);
+        goto error;
+    }
+    goto out;
+error:
+    xerrno = errno;
+    ioring_unmap(r);
+    if (r->efd >= 0)
+        close(r->efd);
+    if (r->fd >= 0)
+        close(r->fd);
+    free(r);
+    r = 0;
+    errno = xerrno;
+out:
+    return r;
+}
+
+void ioring_destroy(struct ioring *r) {
+    DEBUG_FUNCTION;
+
+    pthread_mutex_lock(&r->lock);
+    r->stop = 1;
+    pthread_mutex_unlock(&r->lock);
+    ioring_wake(r);
+    pthread_join(r->thread, NULL);
+    ioring_unmap(r);
+    close(r->fd);
+    close(r->efd);
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+    if (r->slots)
+        free(r->slots);
+    free(r);
+}
+
+static int ioring_update(struct ioring *r, int slot, int fd) {
+    struct io_uring_files_update up;
+
+    memset(&up, 0, sizeof (up));
+    up.offset = slot;
+    up.fds = (uint64_t) (uintptr_t) & fd;
+    return ioring_register_call(r->fd, IORING_REGISTER_FILES_UPDATE, &up,
+                                1) == 1 ? 0 : -1;
+}
+
+int ioring_register(struct ioring *r, int fd) {
+    int slot = -1;
+    DEBUG_FUNCTION;
+
+    pthread_mutex_lock(&r->lock);
+    if (r->nslots > 0)
+        slot = r->slots[--r->nslots];
+    pthread_mutex_unlock(&r->lock);
+    if (slot >= 0 && ioring_update(r, slot, fd) != 0) {
+        ioring_unregister(r, slot);
+        slot = -1;
+    }
+    return slot;
+}
+
+void ioring_unregister(struct ioring *r, int slot) {
+    DEBUG_FUNCTION;
+
+    if (slot < 0)
+        return;
+    // the ring holds a reference to the file until then
+    ioring_update(r, slot, -1);
+    pthread_mutex_lock(&r->lock);
+    r->slots[r->nslots++] = slot;
+    pthread_mutex_unlock(&r->lock);
+}
+
+static int ioring_done(iorw_t * rws, int n) {
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (!rws[i].done)
+            return 0;
+    return 1;
+}
+
+int ioring_rw(struct ioring *r, iorw_t * rws, int n) {
+    int status = -1;
+    struct io_uring_sqe *sqe;
+    int wake, i;
+    DEBUG_FUNCTION;
+
+    // the eventfd read takes an entry, the completion queue (twice as
+    // large) can't overflow
+    if (n >= r->sq_entries) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&r->lock);
+    while (!r->failed && r->inflight + n >= r->sq_entries)
+        pthread_cond_wait(&r->cond, &r->lock);
+    if (r->failed)
+        goto out;
+    for (i = 0; i < n; i++) {
+        iorw_t *rw = rws + i;
+        sqe = ioring_sqe(r);
+        sqe->opcode = rw->write ? IORING_OP_WRITE : IORING_OP_READ;
+        if (rw->slot >= 0) {
+            sqe->fd = rw->slot;
+            sqe->flags = IOSQE_FIXED_FILE;
+        } else {
+            sqe->fd = rw->fd;
+        }
+        sqe->off = rw->off;
+        sqe->addr = (uint64_t) (uintptr_t) rw->buf;
+        sqe->len = rw->len;
+        sqe->user_data = (uint64_t) (uintptr_t) rw;
+    }
+    r->inflight += n;
+    // the thread submits them when it is back, unless it waits
+    wake = r->sleeping;
+    r->sleeping = 0;
+    if (wake) {
+        pthread_mutex_unlock(&r->lock);
+        ioring_wake(r);
+        pthread_mutex_lock(&r->lock);
+    }
+    while (!r->failed && !ioring_done(rws, n))
+        pthread_cond_wait(&r->cond, &r->lock);
+    if (r->failed)
+        goto out;
+    status = 0;
+out:
+    if (status != 0)
+        errno = r->failed;
+    pthread_mutex_unlock(&r->lock);
+    return status;
+}
+
+#else
+
+struct ioring *ioring_create(uint32_t entries, uint32_t nfiles) {
+    errno = ENOSYS;
+    return 0;
+}
+
+void ioring_destroy(struct ioring *r) {
+}
+
+int ioring_register(struct ioring *r, int fd) {
+    return -1;
+}
+
+void ioring_unregister(struct ioring *r, int slot) {
+}
+
+int ioring_rw(struct ioring *r, iorw_t * rws, int n) {
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ Copyright (c) 2010 Fizians SAS. <http://www.fizians.com>
+ This file is part of Rozofs.
+
+ Rozofs is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 3 of the License,
+ or (at your option) any later version.
+
+ Rozofs is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see
+ <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _IORING_H
+#define _IORING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Reads and writes submitted to an io_uring shared by the threads of a
+ * storage: operations queued by concurrent requests are submitted
+ * together by a thread of the ring, which reaps their completions.
+ * Descriptors may be registered to the ring to save their lookup on each
+ * operation. Without io_uring support (see HAVE_IO_URING) rings can't be
+ * created and callers use pread and pwrite.
+ */
+struct ioring;
+
+typedef struct iorw {
+    int fd;
+    int slot;                   // registered fd, -1 if not
+    int write;
+    void *buf;
+    size_t len;
+    off_t off;
+    ssize_t res;                // as pread or pwrite, errno in err
+    int err;
+    int done;
+} iorw_t;
+
+/* Ring of entries operations in flight, up to nfiles registered fds. */
+struct ioring *ioring_create(uint32_t entries, uint32_t nfiles);
+
+/* No operation must be in flight. */
+void ioring_destroy(struct ioring *r);
+
+/* Register fd, returns its slot or -1 when there is no slot left. */
+int ioring_register(struct ioring *r, int fd);
+
+void ioring_unregister(struct ioring *r, int slot);
+
+void ioring_prep(iorw_t * rw, int fd, int slot, int write, void *buf,
+                 size_t len, off_t off);
+
+/*
+ * Run the n operations and wait for them: returns 0 when they were done
+ * (each one with its own result), -1 if the ring failed.
+ */
+int ioring_rw(struct ioring *r, iorw_t * rws, int n);
+
+#endif
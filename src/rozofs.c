@@ -27,9 +27,12 @@ uint8_t rozofs_safe;
 uint8_t rozofs_forward;
 uint8_t rozofs_inverse;
 angle_t *rozofs_angles;
-uint16_t *rozofs_psizes;
+uint32_t *rozofs_psizes;
+angle_t *rozofs_sangles;
+uint32_t *rozofs_spsizes;
+const transform_ops_t *rozofs_transform;
 
-int rozofs_initialize(rozofs_layout_t layout) {
+int rozofs_initialize(rozofs_layout_t layout, uint32_t bsize) {
     int status = -1;
     int i;
     DEBUG_FUNCTION;
@@ -54,18 +57,39 @@ int rozofs_initialize(rozofs_layout_t layout) {
         errno = EINVAL;
         goto out;
     }
+    if (bsize < ROZOFS_BSIZE_MIN || bsize > ROZOFS_BSIZE_MAX ||
+        bsize % ROZOFS_BSIZE_MIN != 0) {
+        errno = EINVAL;
+        goto out;
+    }
 
-    DEBUG("initialize rozofs with inverse: %u, forward: %u, safe: %u",
-          rozofs_inverse, rozofs_forward, rozofs_safe);
+    DEBUG("initialize rozofs with inverse: %u, forward: %u, safe: %u,"
+          " bsize: %u", rozofs_inverse, rozofs_forward, rozofs_safe, bsize);
 
     rozofs_angles = xmalloc(sizeof (angle_t) * rozofs_forward);
-    rozofs_psizes = xmalloc(sizeof (uint16_t) * rozofs_forward);
+    rozofs_psizes = xmalloc(sizeof (uint32_t) * rozofs_forward);
     for (i = 0; i < rozofs_forward; i++) {
         rozofs_angles[i].p = i - rozofs_forward / 2;
         rozofs_angles[i].q = 1;
         rozofs_psizes[i] = abs(i - rozofs_forward / 2) * (rozofs_inverse - 1)
-            + (ROZOFS_BSIZE / sizeof (pxl_t) / rozofs_inverse - 1) + 1;
+            + (bsize / sizeof (pxl_t) / rozofs_inverse - 1) + 1;
+    }
+    rozofs_sangles = xmalloc(sizeof (angle_t) * rozofs_forward);
+    rozofs_spsizes = xmalloc(sizeof (uint32_t) * rozofs_forward);
+    for (i = 0; i < rozofs_forward; i++) {
+        int p = i - rozofs_inverse - (rozofs_forward - rozofs_inverse) / 2;
+        if (i < rozofs_inverse) {
+            rozofs_sangles[i].p = 0;
+            rozofs_sangles[i].q = 0;
+            rozofs_spsizes[i] = bsize / sizeof (pxl_t) / rozofs_inverse;
+        } else {
+            rozofs_sangles[i].p = p;
+            rozofs_sangles[i].q = 1;
+            rozofs_spsizes[i] = abs(p) * (rozofs_inverse - 1)
+                + bsize / sizeof (pxl_t) / rozofs_inverse;
+        }
     }
+    rozofs_transform = transform_get_ops(rozofs_inverse, rozofs_forward);
     status = 0;
 out:
     return status;
@@ -77,4 +101,6 @@ void rozofs_release() {
 
     free(rozofs_angles);
     free(rozofs_psizes);
+    free(rozofs_sangles);
+    free(rozofs_spsizes);
 }
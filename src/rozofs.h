@@ -26,8 +26,13 @@
 
 #define ROZOFS_UUID_SIZE 16
 #define ROZOFS_HOSTNAME_MAX 128
-#define ROZOFS_BSIZE 8192       // could it be export specific ?
+#define ROZOFS_BSIZE 8192       // default block size (exports without bsize)
+#define ROZOFS_BSIZE_MIN 4096
+#define ROZOFS_BSIZE_MAX (1024 * 1024)
 #define ROZOFS_SAFE_MAX 16
+// bound of the projection sizes (in bins) of all layouts and block sizes
+#define ROZOFS_PSIZE_MAX \
+    (ROZOFS_BSIZE_MAX / sizeof (pxl_t) / 2 + ROZOFS_SAFE_MAX * ROZOFS_SAFE_MAX)
 #define ROZOFS_DIR_SIZE 4096
 #define ROZOFS_PATH_MAX 1024
 #define ROZOFS_FILENAME_MAX 255
@@ -42,6 +47,12 @@ typedef enum {
     LAYOUT_2_3_4, LAYOUT_4_6_8, LAYOUT_8_12_16
 } rozofs_layout_t;
 
+// how blocks are stored: as projections only, or as their rows (data
+// chunks) followed by projections (parity chunks)
+typedef enum {
+    MODE_MOJETTE, MODE_SYSTEMATIC
+} rozofs_mode_t;
+
 typedef uint8_t tid_t;          // projection id
 typedef uint64_t bid_t;         // block id
 typedef uuid_t fid_t;           // file id
@@ -74,7 +85,7 @@ typedef struct mattr {
 } mattr_t;
 
 typedef struct estat {
-    uint16_t bsize;
+    uint32_t bsize;
     uint64_t blocks;
     uint64_t bfree;
     uint64_t files;
@@ -93,9 +104,20 @@ extern uint8_t rozofs_safe;
 extern uint8_t rozofs_forward;
 extern uint8_t rozofs_inverse;
 extern angle_t *rozofs_angles;
-extern uint16_t *rozofs_psizes;
+extern uint32_t *rozofs_psizes;
+// systematic mode: tid < rozofs_inverse is a row of the blocks, tid >=
+// rozofs_inverse a projection of angle rozofs_sangles[tid]
+extern angle_t *rozofs_sangles;
+extern uint32_t *rozofs_spsizes;
+// transform kernels unrolled for the layout
+extern const transform_ops_t *rozofs_transform;
 
-int rozofs_initialize(rozofs_layout_t layout);
+/*
+ * Sizes projections for blocks of bsize bytes, a multiple of
+ * ROZOFS_BSIZE_MIN up to ROZOFS_BSIZE_MAX (ROZOFS_BSIZE unless the export
+ * says otherwise).
+ */
+int rozofs_initialize(rozofs_layout_t layout, uint32_t bsize);
 
 void rozofs_release();
 
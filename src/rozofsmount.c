@@ -36,6 +36,7 @@
 #include "htable.h"
 #include "xmalloc.h"
 #include "profile.h"
+#include "tpool.h"
 
 #define hash_xor8(n)    (((n) ^ ((n)>>8) ^ ((n)>>16) ^ ((n)>>24)) & 0xff)
 #define INODE_HSIZE 256
@@ -62,6 +63,8 @@ static void usage(const char *progname) {
             "\t-o rozofsbufsize=N\tdefine size of I/O buffer in KiB (default: 256)\n");
     fprintf(stderr,
             "\t-o rozofsmaxretry=N\tdefine number of retries before I/O error is returned (default: 5)\n");
+    fprintf(stderr,
+            "\t-o rozofsthreads=N\tdefine number of threads used to transform data (default: number of cpus)\n");
 }
 
 typedef struct rozofsmnt_conf {
@@ -70,6 +73,7 @@ typedef struct rozofsmnt_conf {
     char *passwd;
     unsigned buf_size;
     unsigned max_retry;
+    unsigned nb_threads;
 } rozofsmnt_conf_t;
 
 static rozofsmnt_conf_t conf;
@@ -90,6 +94,7 @@ static struct fuse_opt rozofs_opts[] = {
     MYFS_OPT("exportpasswd=%s", passwd, 0),
     MYFS_OPT("rozofsbufsize=%u", buf_size, 0),
     MYFS_OPT("rozofsmaxretry=%u", max_retry, 0),
+    MYFS_OPT("rozofsthreads=%u", nb_threads, 0),
 
     FUSE_OPT_KEY("-H ", KEY_EXPORT_HOST),
     FUSE_OPT_KEY("-E ", KEY_EXPORT_PATH),
@@ -214,7 +219,7 @@ static struct stat *mattr_to_stat(mattr_t * attr, struct stat *st) {
     st->st_ctime = attr->ctime;
     st->st_atime = attr->atime;
     st->st_mtime = attr->mtime;
-    st->st_blksize = ROZOFS_BSIZE;
+    st->st_blksize = exportclt.bsize;
     st->st_blocks = ((attr->size + 512 - 1) / 512);
     st->st_dev = 0;
     st->st_uid = attr->uid;
@@ -1125,6 +1130,13 @@ int fuseloop(struct fuse_args *args, const char *mountpoint, int fg) {
         return 1;
     }
 
+    // buffers smaller than a block would read and rewrite it at each flush
+    if (exportclt.bufsize < exportclt.bsize) {
+        info("I/O buffer raised to the export block size: %u KiB",
+                exportclt.bsize / 1024);
+        exportclt.bufsize = exportclt.bsize;
+    }
+
     list_init(&inode_entries);
     htable_initialize(&htable_inode, INODE_HSIZE, fuse_ino_hash,
             fuse_ino_cmp);
@@ -1216,6 +1228,22 @@ int fuseloop(struct fuse_args *args, const char *mountpoint, int fg) {
         }
     }
 
+    // threads do not survive the fork, start them now
+    if (tpool_initialize(conf.nb_threads) != 0) {
+        severe("can't start transform threads: %s", strerror(errno));
+        fuse_remove_signal_handlers(se);
+        fuse_session_remove_chan(ch);
+        fuse_session_destroy(se);
+        fuse_unmount(mountpoint, ch);
+        if (piped[1] >= 0) {
+            if (write(piped[1], &s, 1) != 1) {
+                syslog(LOG_ERR, "pipe write error: %s", strerror(errno));
+            }
+            close(piped[1]);
+        }
+        return 1;
+    }
+
     err = fuse_session_loop(se);
 
     if (err) {
@@ -1230,6 +1258,7 @@ int fuseloop(struct fuse_args *args, const char *mountpoint, int fg) {
     fuse_session_remove_chan(ch);
     fuse_session_destroy(se);
     fuse_unmount(mountpoint, ch);
+    tpool_release();
     exportclt_release(&exportclt);
     ientries_release();
     rozofs_release();
@@ -1282,6 +1311,17 @@ int main(int argc, char *argv[]) {
         conf.buf_size = 8192;
     }
 
+    if (conf.nb_threads == 0) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        conf.nb_threads = ncpus > 0 ? ncpus : 1;
+    }
+    if (conf.nb_threads > TPOOL_MAX_THREADS) {
+        fprintf(stderr,
+                "too many transform threads (%u) - decreased to %d\n",
+                conf.nb_threads, TPOOL_MAX_THREADS);
+        conf.nb_threads = TPOOL_MAX_THREADS;
+    }
+
     if (fuse_opt_add_arg(&args, "-o" FUSE_DEFAULT_OPTIONS) == -1) {
         fprintf(stderr, "fuse_opt_add_arg failed\n");
         return 1;
@@ -19,6 +19,12 @@
 
 #include <limits.h>
 #include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 
 #include "log.h"
 #include "storage.h"
@@ -26,13 +32,30 @@
 #include "sproto.h"
 #include "xmalloc.h"
 
-void *sp_null_1_svc(void *args, struct svc_req *req) {
+/*
+ * Replies holding buffers, freed when the thread serves its next call of
+ * the procedure or by sp_release.
+ */
+static __thread sp_read_ret_t read_ret;
+static __thread sp_writev_ret_t writev_ret;
+static __thread sp_readv_ret_t readv_ret;
+
+void *sp_null_2_svc(void *args, struct svc_req *req) {
     DEBUG_FUNCTION;
     return 0;
 }
 
-sp_status_ret_t *sp_remove_1_svc(sp_remove_arg_t * args, struct svc_req * req) {
-    static sp_status_ret_t ret;
+/*
+ * Whether nrb blocks of projections of psize bins, as the client says,
+ * can be read or written in a call.
+ */
+static int sp_bins_valid(uint32_t psize, uint32_t nrb) {
+    return psize != 0 && psize <= ROZOFS_PSIZE_MAX &&
+        (uint64_t) nrb * psize * sizeof (bin_t) <= STORAGED_BINS_MAX;
+}
+
+sp_status_ret_t *sp_remove_2_svc(sp_remove_arg_t * args, struct svc_req * req) {
+    static __thread sp_status_ret_t ret;
     storage_t *st = 0;
     DEBUG_FUNCTION;
 
@@ -41,7 +64,7 @@ sp_status_ret_t *sp_remove_1_svc(sp_remove_arg_t * args, struct svc_req * req) {
         ret.sp_status_ret_t_u.error = errno;
         goto out;
     }
-    if (storage_rm_file(st, args->fid) != 0 && errno != ENOENT) {
+    if (storage_rm_queue(st, args->fid) != 0 && errno != ENOENT) {
         ret.sp_status_ret_t_u.error = errno;
         goto out;
     }
@@ -51,8 +74,8 @@ out:
     return &ret;
 }
 
-sp_status_ret_t *sp_write_1_svc(sp_write_arg_t * args, struct svc_req * req) {
-    static sp_status_ret_t ret;
+sp_status_ret_t *sp_write_2_svc(sp_write_arg_t * args, struct svc_req * req) {
+    static __thread sp_status_ret_t ret;
     storage_t *st = 0;
     DEBUG_FUNCTION;
 
@@ -61,9 +84,14 @@ sp_status_ret_t *sp_write_1_svc(sp_write_arg_t * args, struct svc_req * req) {
         ret.sp_status_ret_t_u.error = errno;
         goto out;
     }
+    if (!sp_bins_valid(args->psize, args->nrb)) {
+        ret.sp_status_ret_t_u.error = EINVAL;
+        goto out;
+    }
     if (storage_write
-        (st, args->fid, args->tid, args->bid, args->nrb, args->bins.bins_len,
-         (bin_t *) args->bins.bins_val) != 0) {
+        (st, args->fid, args->tid, args->psize, args->bid, args->nrb,
+         args->bins.bins_len, (bin_t *) args->bins.bins_val,
+         args->crcs.crcs_len == args->nrb ? args->crcs.crcs_val : 0) != 0) {
         ret.sp_status_ret_t_u.error = errno;
         goto out;
     }
@@ -72,37 +100,203 @@ out:
     return &ret;
 }
 
-sp_read_ret_t *sp_read_1_svc(sp_read_arg_t * args, struct svc_req * req) {
-    static sp_read_ret_t ret;
+sp_read_ret_t *sp_read_2_svc(sp_read_arg_t * args, struct svc_req * req) {
     uint32_t psize;
+    size_t len;
     storage_t *st = 0;
     DEBUG_FUNCTION;
 
-    xdr_free((xdrproc_t) xdr_sp_read_ret_t, (char *) &ret);
-    ret.status = SP_FAILURE;
+    xdr_free((xdrproc_t) xdr_sp_read_ret_t, (char *) &read_ret);
+    read_ret.status = SP_FAILURE;
 
     if ((st = storaged_lookup(args->sid)) == 0) {
-        ret.sp_read_ret_t_u.error = errno;
+        read_ret.sp_read_ret_t_u.error = errno;
+        goto out;
+    }
+    if (!sp_bins_valid(args->psize, args->nrb)) {
+        read_ret.sp_read_ret_t_u.error = EINVAL;
         goto out;
     }
-    psize = rozofs_psizes[args->tid];
-    ret.sp_read_ret_t_u.bins.bins_len = args->nrb * psize * sizeof (bin_t);
-    ret.sp_read_ret_t_u.bins.bins_val =
-        (char *) xmalloc(args->nrb * psize * sizeof (bin_t));
+    psize = args->psize;
+    len = (size_t) args->nrb * psize * sizeof (bin_t);
+    read_ret.sp_read_ret_t_u.rsp.bins.bins_len = len;
+    read_ret.sp_read_ret_t_u.rsp.bins.bins_val = (char *) xmalloc(len);
+    read_ret.sp_read_ret_t_u.rsp.crcs.crcs_len = args->nrb;
+    read_ret.sp_read_ret_t_u.rsp.crcs.crcs_val =
+        xmalloc(args->nrb * sizeof (uint32_t));
     if (storage_read
-        (st, args->fid, args->tid, args->bid, args->nrb,
-         (bin_t *) ret.sp_read_ret_t_u.bins.bins_val) != 0) {
+        (st, args->fid, args->tid, psize, args->bid, args->nrb,
+         (bin_t *) read_ret.sp_read_ret_t_u.rsp.bins.bins_val,
+         read_ret.sp_read_ret_t_u.rsp.crcs.crcs_val) != 0) {
+        int error = errno;
+        // the error overwrites the buffers: xdr_free won't see them
+        free(read_ret.sp_read_ret_t_u.rsp.bins.bins_val);
+        free(read_ret.sp_read_ret_t_u.rsp.crcs.crcs_val);
+        memset(&read_ret.sp_read_ret_t_u.rsp, 0, sizeof (sp_read_rsp_t));
+        read_ret.sp_read_ret_t_u.error = error;
+        goto out;
+    }
+    read_ret.status = SP_SUCCESS;
+out:
+    return &read_ret;
+}
+
+static int sp_send(int sock, const void *buf, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = send(sock, buf, len, MSG_NOSIGNAL)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf = (const char *) buf + n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * Send the reply of a successful SP_READ as svc_sendreply would encode it
+ * with xdr_sp_read_ret_t: the record mark and the rpc reply header, then
+ * the count bins bytes sent from their file fd at off, then the n crcs.
+ */
+static int sp_read_send(SVCXPRT * xprt, struct rpc_msg *msg, int fd,
+                        off_t off, size_t count, const uint32_t * crcs,
+                        uint32_t n) {
+    int status = -1;
+    char head[64 + MAX_AUTH_BYTES];
+    uint32_t *tail;
+    struct rpc_msg reply;
+    sp_status_t ret = SP_SUCCESS;
+    u_int len = count;
+    size_t hlen, tlen;
+    ssize_t sent;
+    int sock = xprt->xp_sock;
+    int cork = 1;
+    XDR xdrs;
+    uint32_t i;
+
+    reply.rm_xid = msg->rm_xid;
+    reply.rm_direction = REPLY;
+    reply.rm_reply.rp_stat = MSG_ACCEPTED;
+    reply.acpted_rply.ar_verf = xprt->xp_verf;
+    reply.acpted_rply.ar_stat = SUCCESS;
+    reply.acpted_rply.ar_results.where = NULL;
+    reply.acpted_rply.ar_results.proc = (xdrproc_t) xdr_void;
+    xdrmem_create(&xdrs, head + 4, sizeof (head) - 4, XDR_ENCODE);
+    if (!xdr_replymsg(&xdrs, &reply) || !xdr_sp_status_t(&xdrs, &ret) ||
+        !xdr_u_int(&xdrs, &len)) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    hlen = 4 + xdr_getpos(&xdrs);
+    xdr_destroy(&xdrs);
+
+    // bins are a multiple of 8 bytes: no opaque padding
+    tlen = (n + 1) * sizeof (uint32_t);
+    tail = xmalloc(tlen);
+    tail[0] = htonl(n);
+    for (i = 0; i < n; i++)
+        tail[i + 1] = htonl(crcs[i]);
+    // a single last fragment
+    *(uint32_t *) head = htonl(0x80000000 | (hlen - 4 + count + tlen));
+
+    // in as few segments as possible
+    setsockopt(sock, IPPROTO_TCP, TCP_CORK, &cork, sizeof (cork));
+    if (sp_send(sock, head, hlen) != 0)
+        goto out;
+    while (count > 0) {
+        if ((sent = sendfile(sock, fd, &off, count)) < 0) {
+            if (errno == EINTR)
+                continue;
+            goto out;
+        }
+        // truncated meanwhile
+        if (sent == 0) {
+            errno = EIO;
+            goto out;
+        }
+        count -= sent;
+    }
+    if (sp_send(sock, tail, tlen) != 0)
+        goto out;
+    status = 0;
+out:
+    cork = 0;
+    setsockopt(sock, IPPROTO_TCP, TCP_CORK, &cork, sizeof (cork));
+    free(tail);
+    return status;
+}
+
+/*
+ * Serve an SP_READ request with its bins sent from their file without
+ * copy, or as storage_program_2 does when they can't be. Returns -1 when
+ * the reply could not be sent whole: the connection is to be closed.
+ */
+int sp_read_2_sendfile(SVCXPRT * xprt, struct svc_req *req,
+                       struct rpc_msg *msg) {
+    int status = 0;
+    sp_read_arg_t args;
+    sp_read_ret_t ret;
+    storage_t *st;
+    uint32_t *crcs = 0;
+    void *file = 0;
+    off_t off;
+    int fd, in;
+    DEBUG_FUNCTION;
+
+    memset(&args, 0, sizeof (args));
+    if (!svc_getargs(xprt, (xdrproc_t) xdr_sp_read_arg_t, (caddr_t) & args)) {
+        svcerr_decode(xprt);
+        return 0;
+    }
+
+    ret.status = SP_FAILURE;
+    if ((st = storaged_lookup(args.sid)) == 0) {
+        ret.sp_read_ret_t_u.error = errno;
+        goto reply;
+    }
+    if (!sp_bins_valid(args.psize, args.nrb)) {
+        ret.sp_read_ret_t_u.error = EINVAL;
+        goto reply;
+    }
+    crcs = xmalloc(args.nrb * sizeof (uint32_t));
+    if ((in = storage_read_file(st, args.fid, args.tid, args.psize, args.bid,
+                                args.nrb, crcs, &fd, &off, &file)) < 0) {
         ret.sp_read_ret_t_u.error = errno;
+        goto reply;
+    }
+    if (in == 0) {
+        if (!svc_sendreply(xprt, (xdrproc_t) xdr_sp_read_ret_t,
+                           (char *) sp_read_2_svc(&args, req)))
+            svcerr_systemerr(xprt);
         goto out;
     }
-    ret.status = SP_SUCCESS;
+    if (sp_read_send(xprt, msg, fd, off,
+                     (size_t) args.nrb * args.psize * sizeof (bin_t), crcs,
+                     args.nrb) != 0) {
+        severe("sp_read_2_sendfile failed: can't send reply: %s",
+               strerror(errno));
+        status = -1;
+    }
+    storage_read_done(file);
+    goto out;
+reply:
+    if (!svc_sendreply(xprt, (xdrproc_t) xdr_sp_read_ret_t, (char *) &ret))
+        svcerr_systemerr(xprt);
 out:
-    return &ret;
+    if (crcs)
+        free(crcs);
+    if (!svc_freeargs(xprt, (xdrproc_t) xdr_sp_read_arg_t, (caddr_t) & args)) {
+        severe("unable to free arguments");
+    }
+    return status;
 }
 
-sp_status_ret_t *sp_truncate_1_svc(sp_truncate_arg_t * args,
+sp_status_ret_t *sp_truncate_2_svc(sp_truncate_arg_t * args,
                                    struct svc_req * req) {
-    static sp_status_ret_t ret;
+    static __thread sp_status_ret_t ret;
     storage_t *st = 0;
     DEBUG_FUNCTION;
 
@@ -111,7 +305,8 @@ sp_status_ret_t *sp_truncate_1_svc(sp_truncate_arg_t * args,
         ret.sp_status_ret_t_u.error = errno;
         goto out;
     }
-    if (storage_truncate(st, args->fid, args->tid, args->bid) != 0) {
+    if (storage_truncate(st, args->fid, args->tid, args->psize, args->bid)
+        != 0) {
         ret.sp_status_ret_t_u.error = errno;
         goto out;
     }
@@ -120,8 +315,8 @@ out:
     return &ret;
 }
 
-sp_stat_ret_t *sp_stat_1_svc(uint16_t * sid, struct svc_req * req) {
-    static sp_stat_ret_t ret;
+sp_stat_ret_t *sp_stat_2_svc(uint16_t * sid, struct svc_req * req) {
+    static __thread sp_stat_ret_t ret;
     storage_t *st = 0;
     sstat_t sstat;
     DEBUG_FUNCTION;
@@ -141,3 +336,170 @@ sp_stat_ret_t *sp_stat_1_svc(uint16_t * sid, struct svc_req * req) {
 out:
     return &ret;
 }
+
+uint32_t sp_extents_run(const sp_extent_t * e, uint32_t n) {
+    uint32_t k = 1;
+
+    while (k < n && e[k].tid == e[0].tid && e[k].psize == e[0].psize &&
+           memcmp(e[k].fid, e[0].fid, sizeof (sp_uuid_t)) == 0 &&
+           e[k].bid == e[k - 1].bid + e[k - 1].nrb)
+        k++;
+    return k;
+}
+
+static uint32_t sp_extents_nrb(const sp_extent_t * e, uint32_t k) {
+    uint32_t j, nrb = 0;
+
+    for (j = 0; j < k; j++)
+        nrb += e[j].nrb;
+    return nrb;
+}
+
+/* Write the k extents of a run from bins and crcs (may be null). */
+static int sp_writev_run(storage_t * st, const sp_extent_t * e, uint32_t k,
+                         const char *bins, uint32_t * crcs) {
+    uint32_t nrb = sp_extents_nrb(e, k);
+
+    if (!sp_bins_valid(e->psize, nrb)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return storage_write(st, (unsigned char *) e->fid, e->tid, e->psize,
+                         e->bid, nrb, (size_t) nrb * e->psize *
+                         sizeof (bin_t), (bin_t *) bins, crcs);
+}
+
+/* Read the k extents of a run after the bins and crcs of the reply. */
+static int sp_readv_run(storage_t * st, const sp_extent_t * e, uint32_t k,
+                        sp_readv_rsp_t * rsp) {
+    uint32_t nrb = sp_extents_nrb(e, k);
+
+    if (!sp_bins_valid(e->psize, nrb)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (storage_read(st, (unsigned char *) e->fid, e->tid, e->psize, e->bid,
+                     nrb, (bin_t *) (rsp->bins.bins_val + rsp->bins.bins_len),
+                     rsp->crcs.crcs_val + rsp->crcs.crcs_len) != 0)
+        return -1;
+    rsp->bins.bins_len += nrb * e->psize * sizeof (bin_t);
+    rsp->crcs.crcs_len += nrb;
+    return 0;
+}
+
+sp_writev_ret_t *sp_writev_2_svc(sp_writev_arg_t * args,
+                                 struct svc_req * req) {
+    sp_extent_t *e = args->extents.extents_val;
+    uint32_t n = args->extents.extents_len;
+    char *bins = args->bins.bins_val;
+    uint32_t *crcs = 0;
+    storage_t *st = 0;
+    uint64_t len = 0, nrb = 0;
+    uint32_t i, j, k;
+    int *errors;
+    DEBUG_FUNCTION;
+
+    xdr_free((xdrproc_t) xdr_sp_writev_ret_t, (char *) &writev_ret);
+    memset(&writev_ret, 0, sizeof (writev_ret));
+    writev_ret.status = SP_FAILURE;
+    if ((st = storaged_lookup(args->sid)) == 0) {
+        writev_ret.sp_writev_ret_t_u.error = errno;
+        goto out;
+    }
+    // each extent valid, so that their sizes add up without overflowing
+    for (i = 0; i < n && sp_bins_valid(e[i].psize, e[i].nrb); i++) {
+        len += (uint64_t) e[i].nrb * e[i].psize * sizeof (bin_t);
+        nrb += e[i].nrb;
+    }
+    // the bins of all the extents, with the crcs of all their blocks or none
+    if (n == 0 || i < n || len > STORAGED_BINS_MAX ||
+        len != args->bins.bins_len ||
+        (args->crcs.crcs_len != 0 && args->crcs.crcs_len != nrb)) {
+        writev_ret.sp_writev_ret_t_u.error = EINVAL;
+        goto out;
+    }
+    if (args->crcs.crcs_len)
+        crcs = args->crcs.crcs_val;
+
+    errors = xcalloc(n, sizeof (int));
+    for (i = 0; i < n; i += k) {
+        k = sp_extents_run(e + i, n - i);
+        if (sp_writev_run(st, e + i, k, bins, crcs) != 0) {
+            // extent by extent: only the failing ones fail
+            for (j = i; j < i + k; j++) {
+                if (k == 1 || sp_writev_run(st, e + j, 1, bins, crcs) != 0)
+                    errors[j] = errno;
+                bins += (size_t) e[j].nrb * e[j].psize * sizeof (bin_t);
+                if (crcs)
+                    crcs += e[j].nrb;
+            }
+            continue;
+        }
+        bins += (size_t) sp_extents_nrb(e + i, k) * e[i].psize *
+            sizeof (bin_t);
+        if (crcs)
+            crcs += sp_extents_nrb(e + i, k);
+    }
+    writev_ret.sp_writev_ret_t_u.errors.errors_len = n;
+    writev_ret.sp_writev_ret_t_u.errors.errors_val = errors;
+    writev_ret.status = SP_SUCCESS;
+out:
+    return &writev_ret;
+}
+
+sp_readv_ret_t *sp_readv_2_svc(sp_readv_arg_t * args, struct svc_req * req) {
+    sp_readv_rsp_t *rsp = &readv_ret.sp_readv_ret_t_u.rsp;
+    sp_extent_t *e = args->extents.extents_val;
+    uint32_t n = args->extents.extents_len;
+    storage_t *st = 0;
+    uint64_t len = 0, nrb = 0;
+    uint32_t i, j, k;
+    DEBUG_FUNCTION;
+
+    xdr_free((xdrproc_t) xdr_sp_readv_ret_t, (char *) &readv_ret);
+    memset(&readv_ret, 0, sizeof (readv_ret));
+    readv_ret.status = SP_FAILURE;
+    if ((st = storaged_lookup(args->sid)) == 0) {
+        readv_ret.sp_readv_ret_t_u.error = errno;
+        goto out;
+    }
+    // each extent valid, so that their sizes add up without overflowing
+    for (i = 0; i < n && sp_bins_valid(e[i].psize, e[i].nrb); i++) {
+        len += (uint64_t) e[i].nrb * e[i].psize * sizeof (bin_t);
+        nrb += e[i].nrb;
+    }
+    if (n == 0 || i < n || len > STORAGED_BINS_MAX) {
+        readv_ret.sp_readv_ret_t_u.error = EINVAL;
+        goto out;
+    }
+
+    // the bins and crcs of the extents read follow each other, those of
+    // the failed ones are left out
+    rsp->errors.errors_val = xcalloc(n, sizeof (int));
+    rsp->errors.errors_len = n;
+    rsp->bins.bins_val = xmalloc(len);
+    rsp->crcs.crcs_val = xmalloc(nrb * sizeof (uint32_t));
+    for (i = 0; i < n; i += k) {
+        k = sp_extents_run(e + i, n - i);
+        if (sp_readv_run(st, e + i, k, rsp) == 0)
+            continue;
+        // extent by extent: only the failing ones fail
+        for (j = i; j < i + k; j++)
+            if (k == 1 || sp_readv_run(st, e + j, 1, rsp) != 0)
+                rsp->errors.errors_val[j] = errno;
+    }
+    readv_ret.status = SP_SUCCESS;
+out:
+    return &readv_ret;
+}
+
+void sp_release() {
+    DEBUG_FUNCTION;
+
+    xdr_free((xdrproc_t) xdr_sp_read_ret_t, (char *) &read_ret);
+    memset(&read_ret, 0, sizeof (read_ret));
+    xdr_free((xdrproc_t) xdr_sp_writev_ret_t, (char *) &writev_ret);
+    memset(&writev_ret, 0, sizeof (writev_ret));
+    xdr_free((xdrproc_t) xdr_sp_readv_ret_t, (char *) &readv_ret);
+    memset(&readv_ret, 0, sizeof (readv_ret));
+}
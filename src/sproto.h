@@ -41,12 +41,17 @@ extern "C" {
         uint16_t sid;
         sp_uuid_t fid;
         uint8_t tid;
+        uint32_t psize;
         uint64_t bid;
         uint32_t nrb;
         struct {
             u_int bins_len;
             char *bins_val;
         } bins;
+        struct {
+            u_int crcs_len;
+            uint32_t *crcs_val;
+        } crcs;
     };
     typedef struct sp_write_arg_t sp_write_arg_t;
 
@@ -54,6 +59,7 @@ extern "C" {
         uint16_t sid;
         sp_uuid_t fid;
         uint8_t tid;
+        uint32_t psize;
         uint64_t bid;
         uint32_t nrb;
     };
@@ -63,22 +69,104 @@ extern "C" {
         uint16_t sid;
         sp_uuid_t fid;
         uint8_t tid;
+        uint32_t psize;
         uint64_t bid;
     };
     typedef struct sp_truncate_arg_t sp_truncate_arg_t;
 
+    struct sp_read_rsp_t {
+        struct {
+            u_int bins_len;
+            char *bins_val;
+        } bins;
+        struct {
+            u_int crcs_len;
+            uint32_t *crcs_val;
+        } crcs;
+    };
+    typedef struct sp_read_rsp_t sp_read_rsp_t;
+
     struct sp_read_ret_t {
         sp_status_t status;
         union {
-            struct {
-                u_int bins_len;
-                char *bins_val;
-            } bins;
+            sp_read_rsp_t rsp;
             int error;
         } sp_read_ret_t_u;
     };
     typedef struct sp_read_ret_t sp_read_ret_t;
 
+    struct sp_extent_t {
+        sp_uuid_t fid;
+        uint8_t tid;
+        uint32_t psize;
+        uint64_t bid;
+        uint32_t nrb;
+    };
+    typedef struct sp_extent_t sp_extent_t;
+
+    struct sp_writev_arg_t {
+        uint16_t sid;
+        struct {
+            u_int extents_len;
+            sp_extent_t *extents_val;
+        } extents;
+        struct {
+            u_int bins_len;
+            char *bins_val;
+        } bins;
+        struct {
+            u_int crcs_len;
+            uint32_t *crcs_val;
+        } crcs;
+    };
+    typedef struct sp_writev_arg_t sp_writev_arg_t;
+
+    struct sp_writev_ret_t {
+        sp_status_t status;
+        union {
+            struct {
+                u_int errors_len;
+                int *errors_val;
+            } errors;
+            int error;
+        } sp_writev_ret_t_u;
+    };
+    typedef struct sp_writev_ret_t sp_writev_ret_t;
+
+    struct sp_readv_arg_t {
+        uint16_t sid;
+        struct {
+            u_int extents_len;
+            sp_extent_t *extents_val;
+        } extents;
+    };
+    typedef struct sp_readv_arg_t sp_readv_arg_t;
+
+    struct sp_readv_rsp_t {
+        struct {
+            u_int errors_len;
+            int *errors_val;
+        } errors;
+        struct {
+            u_int bins_len;
+            char *bins_val;
+        } bins;
+        struct {
+            u_int crcs_len;
+            uint32_t *crcs_val;
+        } crcs;
+    };
+    typedef struct sp_readv_rsp_t sp_readv_rsp_t;
+
+    struct sp_readv_ret_t {
+        sp_status_t status;
+        union {
+            sp_readv_rsp_t rsp;
+            int error;
+        } sp_readv_ret_t_u;
+    };
+    typedef struct sp_readv_ret_t sp_readv_ret_t;
+
     struct sp_sstat_t {
         uint64_t size;
         uint64_t free;
@@ -95,52 +183,66 @@ extern "C" {
     typedef struct sp_stat_ret_t sp_stat_ret_t;
 
 #define STORAGE_PROGRAM 0x20000002
-#define STORAGE_VERSION 1
+#define STORAGE_VERSION 2
 
 #if defined(__STDC__) || defined(__cplusplus)
 #define SP_NULL 0
-    extern void *sp_null_1(void *, CLIENT *);
-    extern void *sp_null_1_svc(void *, struct svc_req *);
+    extern void *sp_null_2(void *, CLIENT *);
+    extern void *sp_null_2_svc(void *, struct svc_req *);
 #define SP_REMOVE 1
-    extern sp_status_ret_t *sp_remove_1(sp_remove_arg_t *, CLIENT *);
-    extern sp_status_ret_t *sp_remove_1_svc(sp_remove_arg_t *,
+    extern sp_status_ret_t *sp_remove_2(sp_remove_arg_t *, CLIENT *);
+    extern sp_status_ret_t *sp_remove_2_svc(sp_remove_arg_t *,
                                             struct svc_req *);
 #define SP_WRITE 2
-    extern sp_status_ret_t *sp_write_1(sp_write_arg_t *, CLIENT *);
-    extern sp_status_ret_t *sp_write_1_svc(sp_write_arg_t *,
+    extern sp_status_ret_t *sp_write_2(sp_write_arg_t *, CLIENT *);
+    extern sp_status_ret_t *sp_write_2_svc(sp_write_arg_t *,
                                            struct svc_req *);
 #define SP_READ 3
-    extern sp_read_ret_t *sp_read_1(sp_read_arg_t *, CLIENT *);
-    extern sp_read_ret_t *sp_read_1_svc(sp_read_arg_t *, struct svc_req *);
+    extern sp_read_ret_t *sp_read_2(sp_read_arg_t *, CLIENT *);
+    extern sp_read_ret_t *sp_read_2_svc(sp_read_arg_t *, struct svc_req *);
 #define SP_TRUNCATE 4
-    extern sp_status_ret_t *sp_truncate_1(sp_truncate_arg_t *, CLIENT *);
-    extern sp_status_ret_t *sp_truncate_1_svc(sp_truncate_arg_t *,
+    extern sp_status_ret_t *sp_truncate_2(sp_truncate_arg_t *, CLIENT *);
+    extern sp_status_ret_t *sp_truncate_2_svc(sp_truncate_arg_t *,
                                               struct svc_req *);
 #define SP_STAT 5
-    extern sp_stat_ret_t *sp_stat_1(uint16_t *, CLIENT *);
-    extern sp_stat_ret_t *sp_stat_1_svc(uint16_t *, struct svc_req *);
-    extern int storage_program_1_freeresult(SVCXPRT *, xdrproc_t, caddr_t);
+    extern sp_stat_ret_t *sp_stat_2(uint16_t *, CLIENT *);
+    extern sp_stat_ret_t *sp_stat_2_svc(uint16_t *, struct svc_req *);
+#define SP_WRITEV 6
+    extern sp_writev_ret_t *sp_writev_2(sp_writev_arg_t *, CLIENT *);
+    extern sp_writev_ret_t *sp_writev_2_svc(sp_writev_arg_t *,
+                                            struct svc_req *);
+#define SP_READV 7
+    extern sp_readv_ret_t *sp_readv_2(sp_readv_arg_t *, CLIENT *);
+    extern sp_readv_ret_t *sp_readv_2_svc(sp_readv_arg_t *,
+                                          struct svc_req *);
+    extern int storage_program_2_freeresult(SVCXPRT *, xdrproc_t, caddr_t);
 
 #else                           /* K&R C */
 #define SP_NULL 0
-    extern void *sp_null_1();
-    extern void *sp_null_1_svc();
+    extern void *sp_null_2();
+    extern void *sp_null_2_svc();
 #define SP_REMOVE 1
-    extern sp_status_ret_t *sp_remove_1();
-    extern sp_status_ret_t *sp_remove_1_svc();
+    extern sp_status_ret_t *sp_remove_2();
+    extern sp_status_ret_t *sp_remove_2_svc();
 #define SP_WRITE 2
-    extern sp_status_ret_t *sp_write_1();
-    extern sp_status_ret_t *sp_write_1_svc();
+    extern sp_status_ret_t *sp_write_2();
+    extern sp_status_ret_t *sp_write_2_svc();
 #define SP_READ 3
-    extern sp_read_ret_t *sp_read_1();
-    extern sp_read_ret_t *sp_read_1_svc();
+    extern sp_read_ret_t *sp_read_2();
+    extern sp_read_ret_t *sp_read_2_svc();
 #define SP_TRUNCATE 4
-    extern sp_status_ret_t *sp_truncate_1();
-    extern sp_status_ret_t *sp_truncate_1_svc();
+    extern sp_status_ret_t *sp_truncate_2();
+    extern sp_status_ret_t *sp_truncate_2_svc();
 #define SP_STAT 5
-    extern sp_stat_ret_t *sp_stat_1();
-    extern sp_stat_ret_t *sp_stat_1_svc();
-    extern int storage_program_1_freeresult();
+    extern sp_stat_ret_t *sp_stat_2();
+    extern sp_stat_ret_t *sp_stat_2_svc();
+#define SP_WRITEV 6
+    extern sp_writev_ret_t *sp_writev_2();
+    extern sp_writev_ret_t *sp_writev_2_svc();
+#define SP_READV 7
+    extern sp_readv_ret_t *sp_readv_2();
+    extern sp_readv_ret_t *sp_readv_2_svc();
+    extern int storage_program_2_freeresult();
 #endif                          /* K&R C */
 
 /* the xdr functions */
@@ -153,7 +255,14 @@ extern "C" {
     extern bool_t xdr_sp_write_arg_t(XDR *, sp_write_arg_t *);
     extern bool_t xdr_sp_read_arg_t(XDR *, sp_read_arg_t *);
     extern bool_t xdr_sp_truncate_arg_t(XDR *, sp_truncate_arg_t *);
+    extern bool_t xdr_sp_read_rsp_t(XDR *, sp_read_rsp_t *);
     extern bool_t xdr_sp_read_ret_t(XDR *, sp_read_ret_t *);
+    extern bool_t xdr_sp_extent_t(XDR *, sp_extent_t *);
+    extern bool_t xdr_sp_writev_arg_t(XDR *, sp_writev_arg_t *);
+    extern bool_t xdr_sp_writev_ret_t(XDR *, sp_writev_ret_t *);
+    extern bool_t xdr_sp_readv_arg_t(XDR *, sp_readv_arg_t *);
+    extern bool_t xdr_sp_readv_rsp_t(XDR *, sp_readv_rsp_t *);
+    extern bool_t xdr_sp_readv_ret_t(XDR *, sp_readv_ret_t *);
     extern bool_t xdr_sp_sstat_t(XDR *, sp_sstat_t *);
     extern bool_t xdr_sp_stat_ret_t(XDR *, sp_stat_ret_t *);
 
@@ -165,7 +274,14 @@ extern "C" {
     extern bool_t xdr_sp_write_arg_t();
     extern bool_t xdr_sp_read_arg_t();
     extern bool_t xdr_sp_truncate_arg_t();
+    extern bool_t xdr_sp_read_rsp_t();
     extern bool_t xdr_sp_read_ret_t();
+    extern bool_t xdr_sp_extent_t();
+    extern bool_t xdr_sp_writev_arg_t();
+    extern bool_t xdr_sp_writev_ret_t();
+    extern bool_t xdr_sp_readv_arg_t();
+    extern bool_t xdr_sp_readv_rsp_t();
+    extern bool_t xdr_sp_readv_ret_t();
     extern bool_t xdr_sp_sstat_t();
     extern bool_t xdr_sp_stat_ret_t();
 
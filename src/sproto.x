@@ -40,15 +40,18 @@ struct sp_write_arg_t {
     uint16_t    sid;
     sp_uuid_t   fid; 
     uint8_t     tid; 
+    uint32_t    psize;
     uint64_t    bid; 
     uint32_t    nrb; 
     opaque      bins<>;
+    uint32_t    crcs<>;
 };
 
 struct sp_read_arg_t {
     uint16_t    sid;
     sp_uuid_t   fid; 
     uint8_t     tid; 
+    uint32_t    psize;
     uint64_t    bid;
     uint32_t    nrb;
 };
@@ -57,12 +60,56 @@ struct sp_truncate_arg_t {
     uint16_t    sid;
     sp_uuid_t   fid; 
     uint8_t     tid; 
+    uint32_t    psize;
     uint64_t    bid; 
 };
 
+struct sp_read_rsp_t {
+    opaque      bins<>;
+    uint32_t    crcs<>;
+};
+
 union sp_read_ret_t switch (sp_status_t status) {
-    case SP_SUCCESS:    opaque  bins<>;
-    case SP_FAILURE:    int     error;
+    case SP_SUCCESS:    sp_read_rsp_t   rsp;
+    case SP_FAILURE:    int             error;
+    default:            void;
+};
+
+struct sp_extent_t {
+    sp_uuid_t   fid;
+    uint8_t     tid;
+    uint32_t    psize;
+    uint64_t    bid;
+    uint32_t    nrb;
+};
+
+struct sp_writev_arg_t {
+    uint16_t    sid;
+    sp_extent_t extents<>;
+    opaque      bins<>;
+    uint32_t    crcs<>;
+};
+
+union sp_writev_ret_t switch (sp_status_t status) {
+    case SP_SUCCESS:    int             errors<>;
+    case SP_FAILURE:    int             error;
+    default:            void;
+};
+
+struct sp_readv_arg_t {
+    uint16_t    sid;
+    sp_extent_t extents<>;
+};
+
+struct sp_readv_rsp_t {
+    int         errors<>;
+    opaque      bins<>;
+    uint32_t    crcs<>;
+};
+
+union sp_readv_ret_t switch (sp_status_t status) {
+    case SP_SUCCESS:    sp_readv_rsp_t  rsp;
+    case SP_FAILURE:    int             error;
     default:            void;
 };
 
@@ -97,6 +144,12 @@ program STORAGE_PROGRAM {
         sp_stat_ret_t
         SP_STAT(uint16_t)               = 5;
 
-    }=1;
+        sp_writev_ret_t
+        SP_WRITEV(sp_writev_arg_t)      = 6;
+
+        sp_readv_ret_t
+        SP_READV(sp_readv_arg_t)        = 7;
+
+    }=2;
 } = 0x20000002;
 
@@ -10,7 +10,7 @@
 /* Default timeout can be changed using clnt_control() */
 static struct timeval TIMEOUT = { 25, 0 };
 
-void *sp_null_1(void *argp, CLIENT * clnt) {
+void *sp_null_2(void *argp, CLIENT * clnt) {
     static char clnt_res;
 
     memset((char *) &clnt_res, 0, sizeof (clnt_res));
@@ -23,7 +23,7 @@ void *sp_null_1(void *argp, CLIENT * clnt) {
     return ((void *) &clnt_res);
 }
 
-sp_status_ret_t *sp_remove_1(sp_remove_arg_t * argp, CLIENT * clnt) {
+sp_status_ret_t *sp_remove_2(sp_remove_arg_t * argp, CLIENT * clnt) {
     static sp_status_ret_t clnt_res;
 
     memset((char *) &clnt_res, 0, sizeof (clnt_res));
@@ -36,7 +36,7 @@ sp_status_ret_t *sp_remove_1(sp_remove_arg_t * argp, CLIENT * clnt) {
     return (&clnt_res);
 }
 
-sp_status_ret_t *sp_write_1(sp_write_arg_t * argp, CLIENT * clnt) {
+sp_status_ret_t *sp_write_2(sp_write_arg_t * argp, CLIENT * clnt) {
     static sp_status_ret_t clnt_res;
 
     memset((char *) &clnt_res, 0, sizeof (clnt_res));
@@ -49,7 +49,7 @@ sp_status_ret_t *sp_write_1(sp_write_arg_t * argp, CLIENT * clnt) {
     return (&clnt_res);
 }
 
-sp_read_ret_t *sp_read_1(sp_read_arg_t * argp, CLIENT * clnt) {
+sp_read_ret_t *sp_read_2(sp_read_arg_t * argp, CLIENT * clnt) {
     static sp_read_ret_t clnt_res;
 
     memset((char *) &clnt_res, 0, sizeof (clnt_res));
@@ -62,7 +62,7 @@ sp_read_ret_t *sp_read_1(sp_read_arg_t * argp, CLIENT * clnt) {
     return (&clnt_res);
 }
 
-sp_status_ret_t *sp_truncate_1(sp_truncate_arg_t * argp, CLIENT * clnt) {
+sp_status_ret_t *sp_truncate_2(sp_truncate_arg_t * argp, CLIENT * clnt) {
     static sp_status_ret_t clnt_res;
 
     memset((char *) &clnt_res, 0, sizeof (clnt_res));
@@ -75,7 +75,7 @@ sp_status_ret_t *sp_truncate_1(sp_truncate_arg_t * argp, CLIENT * clnt) {
     return (&clnt_res);
 }
 
-sp_stat_ret_t *sp_stat_1(uint16_t * argp, CLIENT * clnt) {
+sp_stat_ret_t *sp_stat_2(uint16_t * argp, CLIENT * clnt) {
     static sp_stat_ret_t clnt_res;
 
     memset((char *) &clnt_res, 0, sizeof (clnt_res));
@@ -87,3 +87,29 @@ sp_stat_ret_t *sp_stat_1(uint16_t * argp, CLIENT * clnt) {
     }
     return (&clnt_res);
 }
+
+sp_writev_ret_t *sp_writev_2(sp_writev_arg_t * argp, CLIENT * clnt) {
+    static sp_writev_ret_t clnt_res;
+
+    memset((char *) &clnt_res, 0, sizeof (clnt_res));
+    if (clnt_call
+        (clnt, SP_WRITEV, (xdrproc_t) xdr_sp_writev_arg_t, (caddr_t) argp,
+         (xdrproc_t) xdr_sp_writev_ret_t, (caddr_t) & clnt_res,
+         TIMEOUT) != RPC_SUCCESS) {
+        return (NULL);
+    }
+    return (&clnt_res);
+}
+
+sp_readv_ret_t *sp_readv_2(sp_readv_arg_t * argp, CLIENT * clnt) {
+    static sp_readv_ret_t clnt_res;
+
+    memset((char *) &clnt_res, 0, sizeof (clnt_res));
+    if (clnt_call
+        (clnt, SP_READV, (xdrproc_t) xdr_sp_readv_arg_t, (caddr_t) argp,
+         (xdrproc_t) xdr_sp_readv_ret_t, (caddr_t) & clnt_res,
+         TIMEOUT) != RPC_SUCCESS) {
+        return (NULL);
+    }
+    return (&clnt_res);
+}
@@ -17,13 +17,15 @@
 #endif
 #include "rozofs.h"
 
-void storage_program_1(struct svc_req *rqstp, register SVCXPRT * transp) {
+void storage_program_2(struct svc_req *rqstp, register SVCXPRT * transp) {
     union {
-        sp_remove_arg_t sp_remove_1_arg;
-        sp_write_arg_t sp_write_1_arg;
-        sp_read_arg_t sp_read_1_arg;
-        sp_truncate_arg_t sp_truncate_1_arg;
-        uint16_t sp_stat_1_arg;
+        sp_remove_arg_t sp_remove_2_arg;
+        sp_write_arg_t sp_write_2_arg;
+        sp_read_arg_t sp_read_2_arg;
+        sp_truncate_arg_t sp_truncate_2_arg;
+        uint16_t sp_stat_2_arg;
+        sp_writev_arg_t sp_writev_2_arg;
+        sp_readv_arg_t sp_readv_2_arg;
     } argument;
     char *result;
     xdrproc_t _xdr_argument, _xdr_result;
@@ -33,37 +35,49 @@ void storage_program_1(struct svc_req *rqstp, register SVCXPRT * transp) {
     case SP_NULL:
         _xdr_argument = (xdrproc_t) xdr_void;
         _xdr_result = (xdrproc_t) xdr_void;
-        local = (char *(*)(char *, struct svc_req *)) sp_null_1_svc;
+        local = (char *(*)(char *, struct svc_req *)) sp_null_2_svc;
         break;
 
     case SP_REMOVE:
         _xdr_argument = (xdrproc_t) xdr_sp_remove_arg_t;
         _xdr_result = (xdrproc_t) xdr_sp_status_ret_t;
-        local = (char *(*)(char *, struct svc_req *)) sp_remove_1_svc;
+        local = (char *(*)(char *, struct svc_req *)) sp_remove_2_svc;
         break;
 
     case SP_WRITE:
         _xdr_argument = (xdrproc_t) xdr_sp_write_arg_t;
         _xdr_result = (xdrproc_t) xdr_sp_status_ret_t;
-        local = (char *(*)(char *, struct svc_req *)) sp_write_1_svc;
+        local = (char *(*)(char *, struct svc_req *)) sp_write_2_svc;
         break;
 
     case SP_READ:
         _xdr_argument = (xdrproc_t) xdr_sp_read_arg_t;
         _xdr_result = (xdrproc_t) xdr_sp_read_ret_t;
-        local = (char *(*)(char *, struct svc_req *)) sp_read_1_svc;
+        local = (char *(*)(char *, struct svc_req *)) sp_read_2_svc;
         break;
 
     case SP_TRUNCATE:
         _xdr_argument = (xdrproc_t) xdr_sp_truncate_arg_t;
         _xdr_result = (xdrproc_t) xdr_sp_status_ret_t;
-        local = (char *(*)(char *, struct svc_req *)) sp_truncate_1_svc;
+        local = (char *(*)(char *, struct svc_req *)) sp_truncate_2_svc;
         break;
 
     case SP_STAT:
         _xdr_argument = (xdrproc_t) xdr_uint16_t;
         _xdr_result = (xdrproc_t) xdr_sp_stat_ret_t;
-        local = (char *(*)(char *, struct svc_req *)) sp_stat_1_svc;
+        local = (char *(*)(char *, struct svc_req *)) sp_stat_2_svc;
+        break;
+
+    case SP_WRITEV:
+        _xdr_argument = (xdrproc_t) xdr_sp_writev_arg_t;
+        _xdr_result = (xdrproc_t) xdr_sp_writev_ret_t;
+        local = (char *(*)(char *, struct svc_req *)) sp_writev_2_svc;
+        break;
+
+    case SP_READV:
+        _xdr_argument = (xdrproc_t) xdr_sp_readv_arg_t;
+        _xdr_result = (xdrproc_t) xdr_sp_readv_ret_t;
+        local = (char *(*)(char *, struct svc_req *)) sp_readv_2_svc;
         break;
 
     default:
@@ -59,6 +59,8 @@ bool_t xdr_sp_write_arg_t(XDR * xdrs, sp_write_arg_t * objp) {
         return FALSE;
     if (!xdr_uint8_t(xdrs, &objp->tid))
         return FALSE;
+    if (!xdr_uint32_t(xdrs, &objp->psize))
+        return FALSE;
     if (!xdr_uint64_t(xdrs, &objp->bid))
         return FALSE;
     if (!xdr_uint32_t(xdrs, &objp->nrb))
@@ -67,6 +69,11 @@ bool_t xdr_sp_write_arg_t(XDR * xdrs, sp_write_arg_t * objp) {
         (xdrs, (char **) &objp->bins.bins_val,
          (u_int *) & objp->bins.bins_len, ~0))
         return FALSE;
+    if (!xdr_array
+        (xdrs, (char **) &objp->crcs.crcs_val,
+         (u_int *) & objp->crcs.crcs_len, ~0, sizeof (uint32_t),
+         (xdrproc_t) xdr_uint32_t))
+        return FALSE;
     return TRUE;
 }
 
@@ -79,6 +86,8 @@ bool_t xdr_sp_read_arg_t(XDR * xdrs, sp_read_arg_t * objp) {
         return FALSE;
     if (!xdr_uint8_t(xdrs, &objp->tid))
         return FALSE;
+    if (!xdr_uint32_t(xdrs, &objp->psize))
+        return FALSE;
     if (!xdr_uint64_t(xdrs, &objp->bid))
         return FALSE;
     if (!xdr_uint32_t(xdrs, &objp->nrb))
@@ -95,11 +104,28 @@ bool_t xdr_sp_truncate_arg_t(XDR * xdrs, sp_truncate_arg_t * objp) {
         return FALSE;
     if (!xdr_uint8_t(xdrs, &objp->tid))
         return FALSE;
+    if (!xdr_uint32_t(xdrs, &objp->psize))
+        return FALSE;
     if (!xdr_uint64_t(xdrs, &objp->bid))
         return FALSE;
     return TRUE;
 }
 
+bool_t xdr_sp_read_rsp_t(XDR * xdrs, sp_read_rsp_t * objp) {
+    //register int32_t *buf;
+
+    if (!xdr_bytes
+        (xdrs, (char **) &objp->bins.bins_val,
+         (u_int *) & objp->bins.bins_len, ~0))
+        return FALSE;
+    if (!xdr_array
+        (xdrs, (char **) &objp->crcs.crcs_val,
+         (u_int *) & objp->crcs.crcs_len, ~0, sizeof (uint32_t),
+         (xdrproc_t) xdr_uint32_t))
+        return FALSE;
+    return TRUE;
+}
+
 bool_t xdr_sp_read_ret_t(XDR * xdrs, sp_read_ret_t * objp) {
     //register int32_t *buf;
 
@@ -107,9 +133,7 @@ bool_t xdr_sp_read_ret_t(XDR * xdrs, sp_read_ret_t * objp) {
         return FALSE;
     switch (objp->status) {
     case SP_SUCCESS:
-        if (!xdr_bytes
-            (xdrs, (char **) &objp->sp_read_ret_t_u.bins.bins_val,
-             (u_int *) & objp->sp_read_ret_t_u.bins.bins_len, ~0))
+        if (!xdr_sp_read_rsp_t(xdrs, &objp->sp_read_ret_t_u.rsp))
             return FALSE;
         break;
     case SP_FAILURE:
@@ -122,6 +146,120 @@ bool_t xdr_sp_read_ret_t(XDR * xdrs, sp_read_ret_t * objp) {
     return TRUE;
 }
 
+bool_t xdr_sp_extent_t(XDR * xdrs, sp_extent_t * objp) {
+    //register int32_t *buf;
+
+    if (!xdr_sp_uuid_t(xdrs, objp->fid))
+        return FALSE;
+    if (!xdr_uint8_t(xdrs, &objp->tid))
+        return FALSE;
+    if (!xdr_uint32_t(xdrs, &objp->psize))
+        return FALSE;
+    if (!xdr_uint64_t(xdrs, &objp->bid))
+        return FALSE;
+    if (!xdr_uint32_t(xdrs, &objp->nrb))
+        return FALSE;
+    return TRUE;
+}
+
+bool_t xdr_sp_writev_arg_t(XDR * xdrs, sp_writev_arg_t * objp) {
+    //register int32_t *buf;
+
+    if (!xdr_uint16_t(xdrs, &objp->sid))
+        return FALSE;
+    if (!xdr_array
+        (xdrs, (char **) &objp->extents.extents_val,
+         (u_int *) & objp->extents.extents_len, ~0, sizeof (sp_extent_t),
+         (xdrproc_t) xdr_sp_extent_t))
+        return FALSE;
+    if (!xdr_bytes
+        (xdrs, (char **) &objp->bins.bins_val,
+         (u_int *) & objp->bins.bins_len, ~0))
+        return FALSE;
+    if (!xdr_array
+        (xdrs, (char **) &objp->crcs.crcs_val,
+         (u_int *) & objp->crcs.crcs_len, ~0, sizeof (uint32_t),
+         (xdrproc_t) xdr_uint32_t))
+        return FALSE;
+    return TRUE;
+}
+
+bool_t xdr_sp_writev_ret_t(XDR * xdrs, sp_writev_ret_t * objp) {
+    //register int32_t *buf;
+
+    if (!xdr_sp_status_t(xdrs, &objp->status))
+        return FALSE;
+    switch (objp->status) {
+    case SP_SUCCESS:
+        if (!xdr_array
+            (xdrs, (char **) &objp->sp_writev_ret_t_u.errors.errors_val,
+             (u_int *) & objp->sp_writev_ret_t_u.errors.errors_len, ~0,
+             sizeof (int), (xdrproc_t) xdr_int))
+            return FALSE;
+        break;
+    case SP_FAILURE:
+        if (!xdr_int(xdrs, &objp->sp_writev_ret_t_u.error))
+            return FALSE;
+        break;
+    default:
+        break;
+    }
+    return TRUE;
+}
+
+bool_t xdr_sp_readv_arg_t(XDR * xdrs, sp_readv_arg_t * objp) {
+    //register int32_t *buf;
+
+    if (!xdr_uint16_t(xdrs, &objp->sid))
+        return FALSE;
+    if (!xdr_array
+        (xdrs, (char **) &objp->extents.extents_val,
+         (u_int *) & objp->extents.extents_len, ~0, sizeof (sp_extent_t),
+         (xdrproc_t) xdr_sp_extent_t))
+        return FALSE;
+    return TRUE;
+}
+
+bool_t xdr_sp_readv_rsp_t(XDR * xdrs, sp_readv_rsp_t * objp) {
+    //register int32_t *buf;
+
+    if (!xdr_array
+        (xdrs, (char **) &objp->errors.errors_val,
+         (u_int *) & objp->errors.errors_len, ~0, sizeof (int),
+         (xdrproc_t) xdr_int))
+        return FALSE;
+    if (!xdr_bytes
+        (xdrs, (char **) &objp->bins.bins_val,
+         (u_int *) & objp->bins.bins_len, ~0))
+        return FALSE;
+    if (!xdr_array
+        (xdrs, (char **) &objp->crcs.crcs_val,
+         (u_int *) & objp->crcs.crcs_len, ~0, sizeof (uint32_t),
+         (xdrproc_t) xdr_uint32_t))
+        return FALSE;
+    return TRUE;
+}
+
+bool_t xdr_sp_readv_ret_t(XDR * xdrs, sp_readv_ret_t * objp) {
+    //register int32_t *buf;
+
+    if (!xdr_sp_status_t(xdrs, &objp->status))
+        return FALSE;
+    switch (objp->status) {
+    case SP_SUCCESS:
+        if (!xdr_sp_readv_rsp_t(xdrs, &objp->sp_readv_ret_t_u.rsp))
+            return FALSE;
+        break;
+    case SP_FAILURE:
+        if (!xdr_int(xdrs, &objp->sp_readv_ret_t_u.error))
+            return FALSE;
+        break;
+    default:
+        break;
+    }
+    return TRUE;
+}
+
 bool_t xdr_sp_sstat_t(XDR * xdrs, sp_sstat_t * objp) {
     //register int32_t *buf;
 
@@ -17,7 +17,7 @@
  <http://www.gnu.org/licenses/>.
  */
 
-#define _XOPEN_SOURCE 500
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -28,51 +28,495 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/statfs.h>
-#include <glob.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <time.h>
+#include <inttypes.h>
 
 #include "rozofs.h"
 #include "log.h"
 #include "list.h"
 #include "xmalloc.h"
+#include "crc32c.h"
+#include "ioring.h"
 #include "storage.h"
 
-#define STORAGE_CSIZE	32
-#define STORAGE_HSIZE	8
+/*
+ * Open projection files are cached in shards, each one with its own lock,
+ * hash table (about one entry per bucket) and lru list.
+ */
+typedef struct pfshard {
+    pthread_mutex_t lock;
+    htable_t htable;
+    list_t pfiles;              // lru last
+    uint32_t csize;             // counters are read without the lock
+    uint32_t max;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} pfshard_t;
+
+/*
+ * Removes queued by storage_rm_queue: fids are appended to the journal
+ * STORAGE_RMQ_FILE of the root before being acknowledged and removed in
+ * order by a thread. The journal is cut when the queue gets empty and
+ * rewritten when most of its records have been removed.
+ */
+typedef struct rmentry {
+    fid_t fid;
+    list_t list;
+} rmentry_t;
+
+typedef struct rmqueue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    list_t entries;             // first queued first
+    uint64_t depth;             // being removed included
+    uint64_t removed;
+    uint64_t records;           // in the journal
+    uint32_t rate;              // removes per second, 0: no limit
+    int fd;                     // journal
+    int syncs;                  // of the journal in progress
+    int stop;
+    pthread_t thread;
+} rmqueue_t;
+
+/*
+ * Group commit of the durable writes: writers queue their projection file
+ * in the batch being gathered and wait for it to be synced. The thread
+ * closes a batch and starts the writeback of all its files before waiting
+ * for each one, so that their syncs overlap. Files are referenced by their
+ * waiting writers.
+ */
+typedef struct syncer {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        // wakes the thread
+    pthread_cond_t done;        // wakes the writers
+    list_t files;               // of the batch being gathered
+    uint32_t pending;           // writes of the batch being gathered
+    int container;              // the batch wrote to the container
+    uint64_t gen;               // batch being gathered, from 1
+    uint64_t synced;            // last batch synced
+    uint64_t ctfailed;          // last batch the container sync failed
+    uint32_t window;            // usec
+    uint32_t batch;
+    uint64_t writes;
+    uint64_t batches;
+    uint64_t nfiles;
+    uint64_t ndirs;
+    int stop;
+    pthread_t thread;
+} syncer_t;
+
+/*
+ * Scrubber: a thread reads the projection files of the root and the
+ * records of its container, paced to rate bytes per second, and checks
+ * their blocks against their crc32c.
+ */
+typedef struct scrubber {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint64_t rate;
+    uint32_t interval;          // s
+    struct timespec next;       // of the next read
+    int fd;                     // STORAGE_BADBLOCKS_FILE
+    scrubstat_t stat;
+    int stop;
+    pthread_t thread;
+} scrubber_t;
+
+/*
+ * Read-ahead hints: a read starting where the previous one of its file
+ * ended is sequential. The next window of a stream is prefetched when it
+ * comes within half a window of the blocks prefetched so far.
+ */
+typedef struct readahead {
+    uint32_t min;               // window, in bytes
+    uint32_t max;
+    int drop;                   // the blocks read behind
+    rastat_t stat;              // updated atomically
+} readahead_t;
+
+// journal rewrite threshold (records)
+#define STORAGE_RMQ_COMPACT 4096
+
+// most fds registered to a ring
+#define STORAGE_RING_FILES 32768
+
+// aligned buffers of each size kept
+#define STORAGE_POOL_BUFFERS 64
+
+// bytes read at once by the scrubber
+#define STORAGE_SCRUB_CHUNK (1 << 20)
+
+char *storage_fanout_dir(const char *root, int levels, const char *name,
+                         char *path) {
+    int l;
+    char *p;
+    DEBUG_FUNCTION;
+
+    strcpy(path, root);
+    p = path + strlen(path);
+    for (l = 0; l < levels; l++) {
+        *p++ = '/';
+        *p++ = name[2 * l];
+        *p++ = name[2 * l + 1];
+    }
+    *p = 0;
+    return path;
+}
+
+int storage_fanout_mkdirs(const char *root, int levels, const char *name) {
+    int status = -1;
+    char path[PATH_MAX];
+    int l;
+    DEBUG_FUNCTION;
+
+    for (l = 1; l <= levels; l++) {
+        if (mkdir(storage_fanout_dir(root, l, name, path), S_IRWXU) != 0 &&
+            errno != EEXIST)
+            goto out;
+    }
+    status = 0;
+out:
+    return status;
+}
+
+int storage_fanout_read(const char *root, int *levels) {
+    int status = -1;
+    char path[PATH_MAX];
+    FILE *f = 0;
+    DEBUG_FUNCTION;
+
+    sprintf(path, "%s/%s", root, STORAGE_FANOUT_FILE);
+    if (!(f = fopen(path, "r")))
+        goto out;
+    if (fscanf(f, "%d", levels) != 1 || *levels < 0 ||
+        *levels > STORAGE_FANOUT_MAX) {
+        errno = EINVAL;
+        goto out;
+    }
+    status = 0;
+out:
+    if (f)
+        fclose(f);
+    return status;
+}
+
+int storage_fanout_write(const char *root, int levels) {
+    int status = -1;
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    FILE *f = 0;
+    DEBUG_FUNCTION;
+
+    sprintf(path, "%s/%s", root, STORAGE_FANOUT_FILE);
+    sprintf(tmp, "%s/%s.tmp", root, STORAGE_FANOUT_FILE);
+    if (!(f = fopen(tmp, "w")))
+        goto out;
+    if (fprintf(f, "%d\n", levels) < 0 || fflush(f) != 0 ||
+        fsync(fileno(f)) != 0)
+        goto out;
+    if (fclose(f) != 0) {
+        f = 0;
+        goto out;
+    }
+    f = 0;
+    if (rename(tmp, path) != 0)
+        goto out;
+    status = 0;
+out:
+    if (f)
+        fclose(f);
+    return status;
+}
+
+static int storage_stripe_read(const char *root, uint32_t * index,
+                               uint32_t * count) {
+    int status = -1;
+    char path[PATH_MAX];
+    FILE *f = 0;
+    DEBUG_FUNCTION;
+
+    sprintf(path, "%s/%s", root, STORAGE_STRIPE_FILE);
+    if (!(f = fopen(path, "r")))
+        goto out;
+    if (fscanf(f, "%u %u", index, count) != 2 || *index >= *count) {
+        errno = EINVAL;
+        goto out;
+    }
+    status = 0;
+out:
+    if (f)
+        fclose(f);
+    return status;
+}
+
+static int storage_stripe_write(const char *root, uint32_t index,
+                                uint32_t count) {
+    int status = -1;
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    FILE *f = 0;
+    DEBUG_FUNCTION;
+
+    sprintf(path, "%s/%s", root, STORAGE_STRIPE_FILE);
+    sprintf(tmp, "%s/%s.tmp", root, STORAGE_STRIPE_FILE);
+    if (!(f = fopen(tmp, "w")))
+        goto out;
+    if (fprintf(f, "%u %u\n", index, count) < 0 || fflush(f) != 0 ||
+        fsync(fileno(f)) != 0)
+        goto out;
+    if (fclose(f) != 0) {
+        f = 0;
+        goto out;
+    }
+    f = 0;
+    if (rename(tmp, path) != 0)
+        goto out;
+    status = 0;
+out:
+    if (f)
+        fclose(f);
+    return status;
+}
+
+static int storage_align_read(storage_t * st) {
+    int status = -1;
+    char path[PATH_MAX];
+    FILE *f = 0;
+    long align;
+    DEBUG_FUNCTION;
+
+    // roots without are packed
+    st->align = 0;
+    if (snprintf(path, sizeof (path), "%s/%s", st->root,
+                 STORAGE_ALIGN_FILE) >= sizeof (path)) {
+        errno = ENAMETOOLONG;
+        goto out;
+    }
+    if (!(f = fopen(path, "r"))) {
+        status = errno == ENOENT ? 0 : -1;
+        goto out;
+    }
+    if (fscanf(f, "%ld", &align) != 1 || align <= 0 ||
+        (align & (align - 1)) != 0) {
+        errno = EINVAL;
+        goto out;
+    }
+    st->align = align;
+    status = 0;
+out:
+    if (f)
+        fclose(f);
+    return status;
+}
+
+static int storage_align_write(storage_t * st, uint32_t align) {
+    int status = -1;
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    FILE *f = 0;
+    DEBUG_FUNCTION;
+
+    if (snprintf(path, sizeof (path), "%s/%s", st->root,
+                 STORAGE_ALIGN_FILE) >= sizeof (path) ||
+        snprintf(tmp, sizeof (tmp), "%s/%s.tmp", st->root,
+                 STORAGE_ALIGN_FILE) >= sizeof (tmp)) {
+        errno = ENAMETOOLONG;
+        goto out;
+    }
+    if (!(f = fopen(tmp, "w")))
+        goto out;
+    if (fprintf(f, "%u\n", align) < 0 || fflush(f) != 0 ||
+        fsync(fileno(f)) != 0)
+        goto out;
+    if (fclose(f) != 0) {
+        f = 0;
+        goto out;
+    }
+    f = 0;
+    if (rename(tmp, path) != 0)
+        goto out;
+    status = 0;
+out:
+    if (f)
+        fclose(f);
+    return status;
+}
+
+/*
+ * O_DIRECT alignment of the files of a root (0: not supported), asked to
+ * the file system when it tells (on files only), the page size otherwise.
+ */
+static uint32_t storage_dio_align(storage_t * st) {
+    uint32_t align = sysconf(_SC_PAGESIZE);
+#ifdef STATX_DIOALIGN
+    struct statx sx;
+    int fd;
+    DEBUG_FUNCTION;
+
+    if ((fd = openat(st->dirfd, STORAGE_ALIGN_FILE ".tmp", O_RDWR | O_CREAT,
+                     S_IRUSR | S_IWUSR)) < 0)
+        return align;
+    if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &sx) == 0 &&
+        (sx.stx_mask & STATX_DIOALIGN)) {
+        align = sx.stx_dio_offset_align;
+        if (sx.stx_dio_mem_align > align)
+            align = sx.stx_dio_mem_align;
+    }
+    close(fd);
+#endif
+    return align;
+}
+
+/* Whether a root holds nothing but its own (dot) files. */
+static int storage_is_new(const char *root) {
+    DIR *dir;
+    struct dirent *ep;
+    int found = 0;
+    DEBUG_FUNCTION;
+
+    if (!(dir = opendir(root)))
+        return -1;
+    while (!found && (ep = readdir(dir)))
+        found = ep->d_name[0] != '.';
+    closedir(dir);
+    return !found;
+}
+
+/* Whether a flat (legacy) layout root holds projection files. */
+static int storage_has_flat_files(const char *root) {
+    DIR *dir;
+    struct dirent *ep;
+    size_t len;
+    int found = 0;
+    DEBUG_FUNCTION;
+
+    if (!(dir = opendir(root)))
+        return -1;
+    while (!found && (ep = readdir(dir))) {
+        len = strlen(ep->d_name);
+        found = len > 5 && strcmp(ep->d_name + len - 5, ".bins") == 0;
+    }
+    closedir(dir);
+    return found;
+}
 
 static char *storage_map(storage_t * st, fid_t fid, tid_t pid, char *path) {
     char str[37];
     DEBUG_FUNCTION;
 
-    strcpy(path, st->root);
-    strcat(path, "/");
     uuid_unparse(fid, str);
+    storage_fanout_dir(st->root, st->levels, str, path);
+    strcat(path, "/");
     strcat(path, str);
     sprintf(str, "-%d.bins", pid);
     strcat(path, str);
     return path;
 }
 
+/* The crc32c of each projection block is kept aside the bins, in a .crcs
+ * file holding one uint32_t per block. */
+static char *storage_map_crcs(storage_t * st, fid_t fid, tid_t pid,
+                              char *path) {
+    DEBUG_FUNCTION;
+
+    storage_map(st, fid, pid, path);
+    strcpy(path + strlen(path) - strlen("bins"), "crcs");
+    return path;
+}
+
+/*
+ * Requests run concurrently: an entry is referenced while it is used, an
+ * entry evicted or removed while referenced is closed by its last user.
+ */
 typedef struct pfentry {
     fid_t fid;
     tid_t pid;
     int fd;
+    int cfd;                    // checksums
+    struct ioring *ring;        // fd and cfd are registered to
+    int slot;
+    int cslot;
+    int refs;                   // users, protected by shard->lock
+    int cached;                 // still in shard->htable
+    pfshard_t *shard;
     list_t list;
+    uint64_t sgen;              // last batch queued in, protected by
+    uint64_t sfailed;           // syncer->lock, as the last failed sync
+    list_t slist;
+    int created;                // to sync, see storage_open
+    bid_t ranext;               // of a sequential read, protected by
+    bid_t raend;                // shard->lock as the blocks prefetched
+    bid_t radrop;               // and dropped before
+    uint32_t rawin;             // bytes, 0: not a stream
 } pfentry_t;
 
-static int pfentry_initialize(pfentry_t * pfe, const char *path, fid_t fid,
+/*
+ * Open a projection file, creating it and its fan-out directories when
+ * missing. created is raised to 1 when the file is created, to 2 when
+ * fan-out directories are too: their entries are synced with the first
+ * durable write.
+ */
+static int storage_open(storage_t * st, fid_t fid, const char *path,
+                        int flags, int *created) {
+    char str[37];
+    int fd;
+    DEBUG_FUNCTION;
+
+    flags |= O_RDWR;
+    if ((fd = open(path, flags)) >= 0 || errno != ENOENT)
+        return fd;
+    if ((fd = open(path, flags | O_CREAT, S_IFREG | S_IRUSR | S_IWUSR)) >= 0) {
+        if (*created < 1)
+            *created = 1;
+    } else if (errno == ENOENT && st->levels > 0) {
+        uuid_unparse(fid, str);
+        if (storage_fanout_mkdirs(st->root, st->levels, str) == 0 &&
+            (fd = open(path, flags | O_CREAT,
+                       S_IFREG | S_IRUSR | S_IWUSR)) >= 0)
+            *created = 2;
+    }
+    return fd;
+}
+
+static int pfentry_initialize(pfentry_t * pfe, storage_t * st,
+                              const char *path, const char *cpath, fid_t fid,
                               tid_t pid) {
     int status = -1;
     DEBUG_FUNCTION;
 
     uuid_copy(pfe->fid, fid);
     pfe->pid = pid;
-    if ((pfe->fd = open(path, 
-                    O_RDWR | O_CREAT, S_IFREG | S_IRUSR | S_IWUSR)) < 0) {
+    pfe->refs = 0;
+    pfe->cached = 0;
+    pfe->sgen = pfe->sfailed = 0;
+    pfe->created = 0;
+    pfe->ranext = pfe->raend = pfe->radrop = 0;
+    pfe->rawin = 0;
+    if ((pfe->fd = storage_open(st, fid, path, st->direct ? O_DIRECT : 0,
+                                &pfe->created)) < 0) {
         severe("pfentry_initialize failed: open for file %s failed: %s", path,
                strerror(errno));
         goto out;
     }
+    if ((pfe->cfd = storage_open(st, fid, cpath, 0, &pfe->created)) < 0) {
+        severe("pfentry_initialize failed: open for file %s failed: %s",
+               cpath, strerror(errno));
+        close(pfe->fd);
+        goto out;
+    }
+    pfe->ring = st->ring;
+    pfe->slot = pfe->cslot = -1;
+    if (pfe->ring) {
+        pfe->slot = ioring_register(pfe->ring, pfe->fd);
+        pfe->cslot = ioring_register(pfe->ring, pfe->cfd);
+    }
     list_init(&pfe->list);
+    list_init(&pfe->slist);
 
     status = 0;
 out:
@@ -81,8 +525,14 @@ out:
 
 static void pfentry_release(pfentry_t * pfe) {
     DEBUG_FUNCTION;
-    if (pfe)
+    if (pfe) {
+        if (pfe->ring) {
+            ioring_unregister(pfe->ring, pfe->slot);
+            ioring_unregister(pfe->ring, pfe->cslot);
+        }
         close(pfe->fd);
+        close(pfe->cfd);
+    }
 }
 
 static uint32_t pfentry_hash(void *key) {
@@ -108,62 +558,162 @@ static int pfentry_cmp(void *k1, void *k2) {
     }
 }
 
-static void storage_put_pfentry(storage_t * st, pfentry_t * pfe) {
+static pfshard_t *storage_shard(storage_t * st, pfentry_t * key) {
+    // the buckets use the low bits of the hash
+    return st->shards + (pfentry_hash(key) >> 16) % st->nshards;
+}
+
+/* Must be called with sh->lock held. */
+static void storage_put_pfentry(pfshard_t * sh, pfentry_t * pfe) {
     DEBUG_FUNCTION;
-    htable_put(&st->htable, pfe, pfe);
-    list_push_front(&st->pfiles, &pfe->list);
-    st->csize++;
+    htable_put(&sh->htable, pfe, pfe);
+    list_push_front(&sh->pfiles, &pfe->list);
+    pfe->cached = 1;
+    pfe->shard = sh;
+    __atomic_add_fetch(&sh->csize, 1, __ATOMIC_RELAXED);
 }
 
-static void storage_del_pfentry(storage_t * st, pfentry_t * pfe) {
+/* Remove pfe from the cache and close it unless it is in use.
+ * Must be called with sh->lock held. */
+static void storage_del_pfentry(pfshard_t * sh, pfentry_t * pfe) {
     DEBUG_FUNCTION;
-    htable_del(&st->htable, pfe);
+    htable_del(&sh->htable, pfe);
     list_remove(&pfe->list);
-    st->csize--;
+    pfe->cached = 0;
+    __atomic_sub_fetch(&sh->csize, 1, __ATOMIC_RELAXED);
+    if (pfe->refs == 0) {
+        pfentry_release(pfe);
+        free(pfe);
+    }
 }
 
+/* Get a referenced entry for (fid, pid), opening its files when needed. */
 static pfentry_t *storage_find_pfentry(storage_t * st, fid_t fid, tid_t pid) {
     pfentry_t key;
     pfentry_t *pfe = 0;
+    pfentry_t *new = 0;
+    pfshard_t *sh;
     char path[PATH_MAX];
+    char cpath[PATH_MAX];
     DEBUG_FUNCTION;
 
     uuid_copy(key.fid, fid);
     key.pid = pid;
+    sh = storage_shard(st, &key);
 
-    if (!(pfe = htable_get(&st->htable, &key))) {
-
-        pfe = xmalloc(sizeof (pfentry_t));
-
-        if (pfentry_initialize(pfe, storage_map(st, fid, pid, path), fid, pid)
-            != 0) {
-            free(pfe);
-            pfe = 0;
+    pthread_mutex_lock(&sh->lock);
+    if (!(pfe = htable_get(&sh->htable, &key))) {
+        __atomic_add_fetch(&sh->misses, 1, __ATOMIC_RELAXED);
+        // don't hold the lock while opening
+        pthread_mutex_unlock(&sh->lock);
+        new = xmalloc(sizeof (pfentry_t));
+        if (pfentry_initialize(new, st, storage_map(st, fid, pid, path),
+                               storage_map_crcs(st, fid, pid, cpath), fid,
+                               pid) != 0) {
+            free(new);
             warning("storage_find_pfentry failed");
             goto out;
         }
-        // if cache is full delete the tail of the list which should be the lru.
-        if (st->csize == STORAGE_CSIZE) {
-            pfentry_t *lru = list_entry(st->pfiles.prev, pfentry_t, list);
-            pfentry_release(lru);
-            storage_del_pfentry(st, lru);
-            free(lru);
+        pthread_mutex_lock(&sh->lock);
+        // an other request may have opened it meanwhile
+        if (!(pfe = htable_get(&sh->htable, &key))) {
+            // if shard is full delete the tail of the list which should be the lru.
+            if (sh->csize == sh->max) {
+                storage_del_pfentry(sh,
+                                    list_entry(sh->pfiles.prev, pfentry_t,
+                                               list));
+                __atomic_add_fetch(&sh->evictions, 1, __ATOMIC_RELAXED);
+            }
+            pfe = new;
+            new = 0;
+            storage_put_pfentry(sh, pfe);
         }
-        storage_put_pfentry(st, pfe);
     } else {
-        // push the lru.
-        list_remove(&pfe->list);
-        list_push_front(&st->pfiles, &pfe->list);
+        __atomic_add_fetch(&sh->hits, 1, __ATOMIC_RELAXED);
+    }
+    // push the lru.
+    list_remove(&pfe->list);
+    list_push_front(&sh->pfiles, &pfe->list);
+    pfe->refs++;
+    pthread_mutex_unlock(&sh->lock);
+
+    if (new) {
+        pfentry_release(new);
+        free(new);
     }
 out:
     return pfe;
 }
 
-int storage_initialize(storage_t * st, sid_t sid, const char *root) {
+static void storage_unref_pfentry(pfentry_t * pfe) {
+    pfshard_t *sh = pfe->shard;
+    DEBUG_FUNCTION;
+
+    pthread_mutex_lock(&sh->lock);
+    if (--pfe->refs == 0 && !pfe->cached) {
+        pfentry_release(pfe);
+        free(pfe);
+    }
+    pthread_mutex_unlock(&sh->lock);
+}
+
+static void storage_rmq_release(rmqueue_t * q) {
+    list_t *p, *n;
+
+    list_for_each_forward_safe(p, n, &q->entries) {
+        rmentry_t *e = list_entry(p, rmentry_t, list);
+        list_remove(&e->list);
+        free(e);
+    }
+    if (q->fd >= 0)
+        close(q->fd);
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->lock);
+    free(q);
+}
+
+static void storage_scrub_release(scrubber_t * s) {
+    if (s->fd >= 0)
+        close(s->fd);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+static void storage_sync_release(syncer_t * s) {
+    pthread_cond_destroy(&s->done);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+/* Open root as the index-th of the count roots of a storage. */
+static int storage_open_root(storage_t * st, sid_t sid, const char *root,
+                             int levels, uint32_t csize, uint32_t nshards,
+                             uint32_t index, uint32_t count) {
     int status = -1;
     struct stat s;
+    uint32_t i, cindex, ccount;
+    int current;
     DEBUG_FUNCTION;
 
+    st->disks = 0;
+    st->ndisks = 0;
+    st->shards = 0;
+    st->rmq = 0;
+    st->ct = 0;
+    st->ring = 0;
+    st->syncer = 0;
+    st->scrubber = 0;
+    st->bc = 0;
+    st->ra = 0;
+    st->direct = 0;
+    if (levels < 0 || levels > STORAGE_FANOUT_MAX || csize == 0 ||
+        nshards == 0) {
+        errno = EINVAL;
+        goto out;
+    }
+
     if (!realpath(root, st->root))
         goto out;
     // sanity checks
@@ -173,160 +723,1837 @@ int storage_initialize(storage_t * st, sid_t sid, const char *root) {
         errno = ENOTDIR;
         goto out;
     }
+    // the fan-out of a root is recorded in it, roots without are flat
+    // unless they are new
+    if (storage_fanout_read(st->root, &current) != 0) {
+        if (errno != ENOENT)
+            goto out;
+        if ((current = storage_has_flat_files(st->root)) < 0)
+            goto out;
+        current = current ? 0 : levels;
+        if (current == levels && storage_fanout_write(st->root, levels) != 0)
+            goto out;
+    }
+    if (current != levels) {
+        severe("storage %s has a fan-out of %d levels instead of %d,"
+               " it must be migrated with storage_fanout", st->root, current,
+               levels);
+        errno = EINVAL;
+        goto out;
+    }
+    // so is its place among the roots of the storage, roots without were
+    // alone unless they are new
+    if (storage_stripe_read(st->root, &cindex, &ccount) != 0) {
+        if (errno != ENOENT || (current = storage_is_new(st->root)) < 0)
+            goto out;
+        cindex = index;
+        ccount = current ? count : 1;
+        if (count > 1 && ccount == count &&
+            storage_stripe_write(st->root, index, count) != 0)
+            goto out;
+    }
+    if (cindex != index || ccount != count) {
+        severe("storage %s is root %u of %u instead of %u of %u", st->root,
+               cindex + 1, ccount, index + 1, count);
+        errno = EINVAL;
+        goto out;
+    }
+    if (storage_align_read(st) != 0) {
+        severe("can't read block alignment of storage %s: %s", st->root,
+               strerror(errno));
+        goto out;
+    }
+    if ((st->dirfd = open(st->root, O_RDONLY | O_DIRECTORY)) < 0)
+        goto out;
+    if (st->align)
+        bufpool_initialize(&st->pool, st->align, STORAGE_POOL_BUFFERS);
     st->sid = sid;
-    st->csize = 0;
-    htable_initialize(&st->htable, STORAGE_HSIZE, pfentry_hash, pfentry_cmp);
-    list_init(&st->pfiles);
+    st->levels = levels;
+    if (nshards > csize)
+        nshards = csize;
+    st->nshards = nshards;
+    st->shards = xcalloc(nshards, sizeof (pfshard_t));
+    for (i = 0; i < nshards; i++) {
+        pfshard_t *sh = st->shards + i;
+        // the remainder goes to the first shards
+        sh->max = csize / nshards + (i < csize % nshards);
+        if ((errno = pthread_mutex_init(&sh->lock, NULL)) != 0) {
+            int xerrno = errno;
+            st->nshards = i;
+            storage_release(st);
+            errno = xerrno;
+            goto out;
+        }
+        htable_initialize(&sh->htable, sh->max, pfentry_hash, pfentry_cmp);
+        list_init(&sh->pfiles);
+    }
 
     status = 0;
 out:
     return status;
 }
 
-void storage_release(storage_t * st) {
-    list_t *p, *q;
+int storage_initialize(storage_t * st, sid_t sid, const char *root,
+                       int levels, uint32_t csize, uint32_t nshards) {
     DEBUG_FUNCTION;
-
-    list_for_each_forward_safe(p, q, &st->pfiles) {
-        pfentry_t *pfe = list_entry(p, pfentry_t, list);
-        storage_del_pfentry(st, pfe);
-        pfentry_release(pfe);
-        free(pfe);
-    }
-    htable_release(&st->htable);
+    return storage_open_root(st, sid, root, levels, csize, nshards, 0, 1);
 }
 
-int storage_write(storage_t * st, fid_t fid, tid_t pid, bid_t bid, uint32_t n,
-                  size_t len, const bin_t * bins) {
+int storage_initialize_roots(storage_t * st, sid_t sid, const char **roots,
+                             uint32_t nroots, int levels, uint32_t csize,
+                             uint32_t nshards) {
     int status = -1;
-    pfentry_t *pfe = 0;
-    size_t count = 0;
-    size_t nb_write = 0;
-    char path[PATH_MAX];
+    uint32_t i;
     DEBUG_FUNCTION;
 
-    if (!(pfe = storage_find_pfentry(st, fid, pid)))
+    if (nroots == 0 || csize == 0) {
+        errno = EINVAL;
         goto out;
+    }
+    if (nroots == 1)
+        return storage_initialize(st, sid, roots[0], levels, csize, nshards);
 
-    count = n * rozofs_psizes[pid] * sizeof (bin_t);
-    if ((nb_write =
-         pwrite(pfe->fd, bins, len,
-                (off_t) bid * (off_t) rozofs_psizes[pid] *
-                (off_t) sizeof (bin_t))) != count) {
-        severe("storage_write failed: pwrite in file %s failed: %s",
-               storage_map(st, fid, pid, path), strerror(errno));
-        if (nb_write != -1) {
-            severe("pwrite failed: %lu bytes written instead of %lu",
-                   nb_write, count);
-            errno = EIO;
+    memset(st, 0, sizeof (storage_t));
+    st->sid = sid;
+    st->levels = levels;
+    st->dirfd = -1;
+    strncpy(st->root, roots[0], PATH_MAX - 1);
+    st->disks = xcalloc(nroots, sizeof (storage_t));
+    for (i = 0; i < nroots; i++) {
+        if (storage_open_root(st->disks + i, sid, roots[i], levels,
+                              csize / nroots ? csize / nroots : 1, nshards,
+                              i, nroots) != 0) {
+            int xerrno = errno;
+            st->ndisks = i;
+            storage_release(st);
+            errno = xerrno;
+            goto out;
         }
-        goto out;
     }
-
+    st->ndisks = nroots;
     status = 0;
 out:
     return status;
 }
 
-int storage_read(storage_t * st, fid_t fid, tid_t pid, bid_t bid, uint32_t n,
-                 bin_t * bins) {
-    int status = -1;
-    pfentry_t *pfe = 0;
-    size_t count;
-    char path[PATH_MAX];
-    DEBUG_FUNCTION;
-
-    if (!(pfe = storage_find_pfentry(st, fid, pid)))
-        goto out;
+/* Whether root i of st is on the file system of an other one before. */
+static int storage_same_fs(storage_t * st, uint32_t i) {
+    struct stat s, o;
+    uint32_t j;
 
-    count = n * rozofs_psizes[pid] * sizeof (bin_t);
+    if (fstat(st->disks[i].dirfd, &s) != 0)
+        return 0;
+    for (j = 0; j < i; j++)
+        if (fstat(st->disks[j].dirfd, &o) == 0 && o.st_dev == s.st_dev)
+            return 1;
+    return 0;
+}
 
-    if (pread
-        (pfe->fd, bins, count,
-         (off_t) bid * (off_t) rozofs_psizes[pid] * (off_t) sizeof (bin_t)) !=
-        count) {
-        severe("storage_read failed: pread in file %s failed: %s",
-               storage_map(st, fid, pid, path), strerror(errno));
-        goto out;
-    }
+/* The storage of the root holding the projections of fid. */
+static storage_t *storage_disk(storage_t * st, fid_t fid) {
+    uint32_t hash = 0;
+    uint8_t *c;
 
-    status = 0;
-out:
-    return status;
+    if (st->ndisks == 0)
+        return st;
+    for (c = fid; c != fid + 16; c++)
+        hash = *c + (hash << 6) + (hash << 16) - hash;
+    return st->disks + hash % st->ndisks;
 }
 
-int storage_truncate(storage_t * st, fid_t fid, tid_t pid, bid_t bid) {
-    int status = -1;
-    pfentry_t *pfe = 0;
+void storage_release(storage_t * st) {
+    list_t *p, *q;
+    uint32_t i;
     DEBUG_FUNCTION;
 
-    if (!(pfe = storage_find_pfentry(st, fid, pid)))
-        goto out;
-    status =
-        ftruncate(pfe->fd, (bid + 1) * rozofs_psizes[pid] * sizeof (bin_t));
-out:
+    if (st->scrubber) {
+        scrubber_t *s = st->scrubber;
+        pthread_mutex_lock(&s->lock);
+        s->stop = 1;
+        pthread_cond_signal(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+        pthread_join(s->thread, NULL);
+        storage_scrub_release(s);
+        st->scrubber = 0;
+    }
+    if (st->syncer) {
+        syncer_t *s = st->syncer;
+        pthread_mutex_lock(&s->lock);
+        s->stop = 1;
+        pthread_cond_signal(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+        pthread_join(s->thread, NULL);
+        storage_sync_release(s);
+        st->syncer = 0;
+    }
+    if (st->rmq) {
+        rmqueue_t *q = st->rmq;
+        pthread_mutex_lock(&q->lock);
+        q->stop = 1;
+        pthread_cond_signal(&q->cond);
+        pthread_mutex_unlock(&q->lock);
+        pthread_join(q->thread, NULL);
+        storage_rmq_release(q);
+        st->rmq = 0;
+    }
+    if (st->ct) {
+        container_close(st->ct);
+        free(st->ct);
+        st->ct = 0;
+    }
+    if (st->bc) {
+        bcache_release(st->bc);
+        free(st->bc);
+        st->bc = 0;
+    }
+    if (st->ra) {
+        free(st->ra);
+        st->ra = 0;
+    }
+    if (st->disks) {
+        for (i = 0; i < st->ndisks; i++)
+            storage_release(st->disks + i);
+        free(st->disks);
+        st->disks = 0;
+        st->ndisks = 0;
+    }
+    if (!st->shards)
+        return;
+    for (i = 0; i < st->nshards; i++) {
+        pfshard_t *sh = st->shards + i;
+        list_for_each_forward_safe(p, q, &sh->pfiles) {
+            pfentry_t *pfe = list_entry(p, pfentry_t, list);
+            storage_del_pfentry(sh, pfe);
+        }
+        htable_release(&sh->htable);
+        pthread_mutex_destroy(&sh->lock);
+    }
+    free(st->shards);
+    st->shards = 0;
+    st->nshards = 0;
+    if (st->ring) {
+        ioring_destroy(st->ring);
+        st->ring = 0;
+    }
+    if (st->align)
+        bufpool_release(&st->pool);
+    close(st->dirfd);
+}
+
+void storage_cache_stat(storage_t * st, pfcstat_t * cstat) {
+    pfcstat_t d;
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    memset(cstat, 0, sizeof (pfcstat_t));
+    for (i = 0; i < st->ndisks; i++) {
+        storage_cache_stat(st->disks + i, &d);
+        cstat->size += d.size;
+        cstat->max += d.max;
+        cstat->hits += d.hits;
+        cstat->misses += d.misses;
+        cstat->evictions += d.evictions;
+    }
+    for (i = 0; i < st->nshards; i++) {
+        pfshard_t *sh = st->shards + i;
+        cstat->size += __atomic_load_n(&sh->csize, __ATOMIC_RELAXED);
+        cstat->max += sh->max;
+        cstat->hits += __atomic_load_n(&sh->hits, __ATOMIC_RELAXED);
+        cstat->misses += __atomic_load_n(&sh->misses, __ATOMIC_RELAXED);
+        cstat->evictions +=
+            __atomic_load_n(&sh->evictions, __ATOMIC_RELAXED);
+    }
+}
+
+int storage_direct_open(storage_t * st) {
+    int status = -1;
+    int new;
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    if (st->ndisks) {
+        for (i = 0; i < st->ndisks; i++)
+            if (storage_direct_open(st->disks + i) != 0)
+                goto out;
+        status = 0;
+        goto out;
+    }
+
+    if (st->align == 0) {
+        // the slots of a root holding projections can't change
+        if ((new = storage_is_new(st->root)) < 0)
+            goto out;
+        if (!new) {
+            severe("storage %s has packed blocks, O_DIRECT needs a new root",
+                   st->root);
+            errno = EINVAL;
+            goto out;
+        }
+        if ((st->align = storage_dio_align(st)) == 0) {
+            severe("storage %s doesn't support O_DIRECT", st->root);
+            errno = EINVAL;
+            goto out;
+        }
+        if (storage_align_write(st, st->align) != 0) {
+            st->align = 0;
+            goto out;
+        }
+        bufpool_initialize(&st->pool, st->align, STORAGE_POOL_BUFFERS);
+    }
+    st->direct = 1;
+    status = 0;
+out:
+    return status;
+}
+
+/* Bytes of the blocks of psize bins in their file. */
+static size_t storage_slot(storage_t * st, uint32_t psize) {
+    size_t size = psize * sizeof (bin_t);
+
+    return st->align ? (size + st->align - 1) / st->align * st->align : size;
+}
+
+/* Aligned buffer for the slots of size bins bytes in blocks of bsize. */
+static size_t storage_slots_size(size_t size, size_t bsize, size_t slot) {
+    return (size + bsize - 1) / bsize * slot;
+}
+
+/* Copy the size bins bytes to slots (zero padded), returns their size. */
+static size_t storage_pad(void *slots, const void *bins, size_t size,
+                          size_t bsize, size_t slot) {
+    size_t off, len, n = 0;
+
+    for (off = 0; off < size; off += bsize, n++) {
+        len = size - off < bsize ? size - off : bsize;
+        memcpy((char *) slots + n * slot, (const char *) bins + off, len);
+        memset((char *) slots + n * slot + len, 0, slot - len);
+    }
+    return n * slot;
+}
+
+static void storage_unpad(void *bins, const void *slots, uint32_t n,
+                          size_t bsize, size_t slot) {
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+        memcpy((char *) bins + i * bsize, (const char *) slots + i * slot,
+               bsize);
+}
+
+int storage_ct_open(storage_t * st) {
+    int status = -1;
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    if (st->ndisks) {
+        for (i = 0; i < st->ndisks; i++)
+            if (storage_ct_open(st->disks + i) != 0)
+                goto out;
+        status = 0;
+        goto out;
+    }
+
+    st->ct = xmalloc(sizeof (container_t));
+    if (container_open(st->ct, st->dirfd) != 0) {
+        free(st->ct);
+        st->ct = 0;
+        goto out;
+    }
+    status = 0;
+out:
+    return status;
+}
+
+int storage_ct_start(storage_t * st) {
+    int status = -1;
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    for (i = 0; i < st->ndisks; i++)
+        if (storage_ct_start(st->disks + i) != 0)
+            goto out;
+    if (st->ct && container_start(st->ct) != 0)
+        goto out;
+    status = 0;
+out:
+    return status;
+}
+
+int storage_ct_stat(storage_t * st, ctstat_t * cstat) {
+    ctstat_t d;
+    int used = 0;
+    uint32_t i;
+
+    memset(cstat, 0, sizeof (ctstat_t));
+    for (i = 0; i < st->ndisks; i++) {
+        if (!storage_ct_stat(st->disks + i, &d))
+            continue;
+        cstat->projections += d.projections;
+        cstat->segments += d.segments;
+        cstat->size += d.size;
+        cstat->dead += d.dead;
+        cstat->compacted += d.compacted;
+        used = 1;
+    }
+    if (st->ct) {
+        container_stat(st->ct, cstat);
+        used = 1;
+    }
+    return used;
+}
+
+int storage_bc_open(storage_t * st, uint64_t size) {
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    for (i = 0; i < st->ndisks; i++)
+        storage_bc_open(st->disks + i, size / st->ndisks);
+    if (st->ndisks)
+        return 0;
+    st->bc = xmalloc(sizeof (bcache_t));
+    bcache_initialize(st->bc, size, st->nshards);
+    return 0;
+}
+
+int storage_bc_stat(storage_t * st, bcstat_t * bstat) {
+    bcstat_t d;
+    int used = 0;
+    uint32_t i;
+
+    memset(bstat, 0, sizeof (bcstat_t));
+    for (i = 0; i < st->ndisks; i++) {
+        if (!storage_bc_stat(st->disks + i, &d))
+            continue;
+        bstat->size += d.size;
+        bstat->max += d.max;
+        bstat->hits += d.hits;
+        bstat->misses += d.misses;
+        bstat->evictions += d.evictions;
+        used = 1;
+    }
+    if (st->bc) {
+        bcache_stat(st->bc, bstat);
+        used = 1;
+    }
+    return used;
+}
+
+int storage_ra_open(storage_t * st, uint32_t min, uint32_t max, int drop) {
+    int status = -1;
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    if (min == 0 || min > max) {
+        errno = EINVAL;
+        goto out;
+    }
+    if (st->ndisks) {
+        for (i = 0; i < st->ndisks; i++)
+            if (storage_ra_open(st->disks + i, min, max, drop) != 0)
+                goto out;
+        status = 0;
+        goto out;
+    }
+    // the page cache is not used
+    if (st->direct) {
+        errno = EINVAL;
+        goto out;
+    }
+    st->ra = xcalloc(1, sizeof (readahead_t));
+    st->ra->min = min;
+    st->ra->max = max;
+    st->ra->drop = drop;
+    status = 0;
+out:
+    return status;
+}
+
+void storage_ra_stat(storage_t * st, rastat_t * rstat) {
+    rastat_t d;
+    uint32_t i;
+
+    memset(rstat, 0, sizeof (rastat_t));
+    for (i = 0; i < st->ndisks; i++) {
+        storage_ra_stat(st->disks + i, &d);
+        rstat->streams += d.streams;
+        rstat->hits += d.hits;
+        rstat->prefetched += d.prefetched;
+        rstat->dropped += d.dropped;
+    }
+    if (!st->ra)
+        return;
+    rstat->streams = __atomic_load_n(&st->ra->stat.streams, __ATOMIC_RELAXED);
+    rstat->hits = __atomic_load_n(&st->ra->stat.hits, __ATOMIC_RELAXED);
+    rstat->prefetched = __atomic_load_n(&st->ra->stat.prefetched,
+                                        __ATOMIC_RELAXED);
+    rstat->dropped = __atomic_load_n(&st->ra->stat.dropped, __ATOMIC_RELAXED);
+}
+
+/* Give the hints of a read of n blocks from bid in the file of pfe. */
+static void storage_ra(storage_t * st, pfentry_t * pfe, uint32_t psize,
+                       bid_t bid, uint32_t n) {
+    readahead_t *ra = st->ra;
+    off_t slot = storage_slot(st, psize);
+    bid_t end = bid + n;
+    bid_t from = 0, to = 0, dfrom = 0, dto = 0;
+    uint64_t w;
+    int hit = 0;
+
+    pthread_mutex_lock(&pfe->shard->lock);
+    if (bid != pfe->ranext) {
+        pfe->rawin = 0;
+        pfe->raend = pfe->radrop = end;
+    } else {
+        if (pfe->rawin == 0) {
+            pfe->rawin = ra->min;
+            __atomic_add_fetch(&ra->stat.streams, 1, __ATOMIC_RELAXED);
+        } else {
+            hit = end <= pfe->raend;
+        }
+        if (pfe->raend < end)
+            pfe->raend = end;
+        if ((w = pfe->rawin / slot) == 0)
+            w = 1;
+        if (pfe->raend - end <= w / 2) {
+            from = pfe->raend;
+            to = pfe->raend = from + w;
+            pfe->rawin = pfe->rawin < ra->max / 2 ? 2 * pfe->rawin : ra->max;
+        }
+        // the blocks being read are still to be sent
+        if (ra->drop && (bid - pfe->radrop) * slot >= ra->min) {
+            dfrom = pfe->radrop;
+            dto = pfe->radrop = bid;
+        }
+    }
+    pfe->ranext = end;
+    pthread_mutex_unlock(&pfe->shard->lock);
+
+    if (hit)
+        __atomic_add_fetch(&ra->stat.hits, 1, __ATOMIC_RELAXED);
+    if (to > from && posix_fadvise(pfe->fd, from * slot, (to - from) * slot,
+                                   POSIX_FADV_WILLNEED) == 0)
+        __atomic_add_fetch(&ra->stat.prefetched, (to - from) * slot,
+                           __ATOMIC_RELAXED);
+    if (dto > dfrom && posix_fadvise(pfe->fd, dfrom * slot,
+                                     (dto - dfrom) * slot,
+                                     POSIX_FADV_DONTNEED) == 0)
+        __atomic_add_fetch(&ra->stat.dropped, (dto - dfrom) * slot,
+                           __ATOMIC_RELAXED);
+}
+
+int storage_ring_open(storage_t * st, uint32_t entries) {
+    int status = -1;
+    uint32_t nfiles = 0;
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    if (st->ndisks) {
+        for (i = 0; i < st->ndisks; i++)
+            if (storage_ring_open(st->disks + i, entries) != 0)
+                goto out;
+        status = 0;
+        goto out;
+    }
+
+    // room for the descriptors of the cache
+    for (i = 0; i < st->nshards; i++)
+        nfiles += 2 * st->shards[i].max;
+    if (nfiles > STORAGE_RING_FILES)
+        nfiles = STORAGE_RING_FILES;
+    if (!(st->ring = ioring_create(entries, nfiles)))
+        goto out;
+    status = 0;
+out:
+    return status;
+}
+
+/* Run the reads and writes through the ring of st, or one by one. */
+static void storage_rw(storage_t * st, iorw_t * rws, int n) {
+    int i;
+
+    if (st->ring && ioring_rw(st->ring, rws, n) == 0)
+        return;
+    for (i = 0; i < n; i++) {
+        iorw_t *rw = rws + i;
+        rw->res = rw->write ? pwrite(rw->fd, rw->buf, rw->len, rw->off) :
+            pread(rw->fd, rw->buf, rw->len, rw->off);
+        rw->err = errno;
+    }
+}
+
+/*
+ * Wait for the write to the file of pfe (null: to the container) to be
+ * synced, when writes are durable.
+ */
+static int storage_sync(storage_t * st, pfentry_t * pfe) {
+    int status = 0;
+    syncer_t *s = st->syncer;
+    uint64_t gen;
+
+    if (!s)
+        return 0;
+    pthread_mutex_lock(&s->lock);
+    gen = s->gen;
+    if (!pfe) {
+        s->container = 1;
+    } else if (pfe->sgen != gen) {
+        pfe->sgen = gen;
+        list_push_back(&s->files, &pfe->slist);
+    }
+    if (s->pending++ == 0 || s->pending == s->batch)
+        pthread_cond_signal(&s->cond);
+    while (s->synced < gen)
+        pthread_cond_wait(&s->done, &s->lock);
+    // a later failure fails it too
+    if ((pfe ? pfe->sfailed : s->ctfailed) >= gen) {
+        errno = EIO;
+        status = -1;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return status;
+}
+
+// lowest fan-out level (0: the root) whose directory entries a created
+// file changed
+static int storage_created_level(storage_t * st, int created) {
+    return created > 1 ? 0 : st->levels;
+}
+
+static int storage_sync_dir(storage_t * st, fid_t fid, int level) {
+    int status = -1;
+    char str[37];
+    char path[PATH_MAX];
+    int fd = -1;
+
+    uuid_unparse(fid, str);
+    storage_fanout_dir(st->root, level, str, path);
+    if ((fd = open(path, O_RDONLY | O_DIRECTORY)) < 0 || fsync(fd) != 0) {
+        severe("storage %u: can't sync %s: %s", st->sid, path,
+               strerror(errno));
+        goto out;
+    }
+    status = 0;
+out:
+    if (fd >= 0)
+        close(fd);
+    return status;
+}
+
+/* Sync the directory entries of the file of pfe when it was created. */
+static int storage_sync_created(storage_t * st, pfentry_t * pfe) {
+    int created = __atomic_load_n(&pfe->created, __ATOMIC_RELAXED);
+    int l;
+
+    if (!created)
+        return 0;
+    for (l = storage_created_level(st, created); l <= st->levels; l++)
+        if (storage_sync_dir(st, pfe->fid, l) != 0)
+            return -1;
+    return 0;
+}
+
+// projection of the storage the container looks for
+typedef struct ctarg {
+    storage_t *st;
+    fid_t fid;
+    tid_t pid;
+    uint32_t psize;
+} ctarg_t;
+
+static void ctarg_initialize(ctarg_t * a, storage_t * st, fid_t fid,
+                             tid_t pid, uint32_t psize) {
+    a->st = st;
+    uuid_copy(a->fid, fid);
+    a->pid = pid;
+    a->psize = psize;
+}
+
+static int storage_ct_file(void *arg, int create) {
+    ctarg_t *a = (ctarg_t *) arg;
+    pfentry_t *pfe;
+    char path[PATH_MAX];
+
+    if (create) {
+        if (!(pfe = storage_find_pfentry(a->st, a->fid, a->pid)))
+            return -1;
+        storage_unref_pfentry(pfe);
+        return 1;
+    }
+    if (access(storage_map(a->st, a->fid, a->pid, path), F_OK) == 0)
+        return 1;
+    return errno == ENOENT ? 0 : -1;
+}
+
+static int storage_ct_put(void *arg, const void *bins, uint64_t size,
+                          const uint32_t * crcs, uint32_t ncrcs) {
+    int status = -1;
+    ctarg_t *a = (ctarg_t *) arg;
+    storage_t *st = a->st;
+    pfentry_t *pfe = 0;
+    size_t csize = ncrcs * sizeof (uint32_t);
+    size_t bsize = a->psize * sizeof (bin_t);
+    size_t slot = storage_slot(st, a->psize);
+    size_t len = 0;
+    void *slots = 0;
+    char path[PATH_MAX];
+
+    if (!(pfe = storage_find_pfentry(st, a->fid, a->pid)))
+        goto out;
+    if (st->align) {
+        len = storage_slots_size(size, bsize, slot);
+        slots = bufpool_get(&st->pool, len);
+        size = storage_pad(slots, bins, size, bsize, slot);
+        bins = slots;
+    }
+    // the container copy is used until it is removed: sync first
+    if (ftruncate(pfe->fd, size) != 0 ||
+        pwrite(pfe->fd, bins, size, 0) != size ||
+        ftruncate(pfe->cfd, csize) != 0 ||
+        pwrite(pfe->cfd, crcs, csize, 0) != csize ||
+        fdatasync(pfe->fd) != 0 || fdatasync(pfe->cfd) != 0 ||
+        storage_sync_created(st, pfe) != 0) {
+        severe("storage_ct_put failed: write of file %s failed: %s",
+               storage_map(a->st, a->fid, a->pid, path), strerror(errno));
+        if (errno == 0)
+            errno = EIO;
+        goto out;
+    }
+    status = 0;
+out:
+    if (slots)
+        bufpool_put(&st->pool, slots, len);
+    if (pfe)
+        storage_unref_pfentry(pfe);
+    return status;
+}
+
+int storage_write(storage_t * st, fid_t fid, tid_t pid, uint32_t psize,
+                  bid_t bid, uint32_t n, size_t len, const bin_t * bins,
+                  const uint32_t * crcs) {
+    int status = -1;
+    pfentry_t *pfe = 0;
+    size_t count = 0;
+    ssize_t nb_write = 0;
+    uint32_t *none = 0;
+    size_t bsize = psize * sizeof (bin_t);
+    size_t slot;
+    size_t slen = 0;
+    void *slots = 0;
+    char path[PATH_MAX];
+    iorw_t rws[2];
+    ctarg_t a;
+    int in;
+    DEBUG_FUNCTION;
+
+    st = storage_disk(st, fid);
+    slot = storage_slot(st, psize);
+    // small projections may be in the container of the storage
+    ctarg_initialize(&a, st, fid, pid, psize);
+    if (st->ct && (in = container_write(st->ct, fid, pid,
+                                        (uint64_t) bid * psize *
+                                        sizeof (bin_t), len, bins, bid, n,
+                                        crcs, storage_ct_file,
+                                        storage_ct_put, &a)) != 0) {
+        status = in > 0 ? storage_sync(st, 0) : -1;
+        goto out;
+    }
+
+    if (!(pfe = storage_find_pfentry(st, fid, pid)))
+        goto out;
+
+    // without checksums, clear the ones of the previous blocks content
+    if (!crcs)
+        crcs = none = xcalloc(n, sizeof (uint32_t));
+    // padded to their slots
+    if (st->align) {
+        slen = storage_slots_size(len, bsize, slot);
+        slots = bufpool_get(&st->pool, slen);
+        len = storage_pad(slots, bins, len, bsize, slot);
+        bins = slots;
+    }
+    // the bins and the crcs are written together
+    ioring_prep(rws, pfe->fd, pfe->slot, 1, (void *) bins, len,
+                (off_t) bid * (off_t) slot);
+    ioring_prep(rws + 1, pfe->cfd, pfe->cslot, 1, (void *) crcs,
+                n * sizeof (uint32_t), (off_t) bid * (off_t) sizeof (uint32_t));
+    storage_rw(st, rws, 2);
+
+    count = n * slot;
+    if ((nb_write = rws[0].res) != count) {
+        // short: the disk is full
+        errno = nb_write < 0 ? rws[0].err : ENOSPC;
+        severe("storage_write failed: pwrite in file %s failed: %s",
+               storage_map(st, fid, pid, path), strerror(errno));
+        if (nb_write >= 0) {
+            severe("pwrite failed: %zd bytes written instead of %zu",
+                   nb_write, count);
+        }
+        goto out;
+    }
+
+    count = n * sizeof (uint32_t);
+    if ((nb_write = rws[1].res) != count) {
+        errno = nb_write < 0 ? rws[1].err : ENOSPC;
+        severe("storage_write failed: pwrite in file %s failed: %s",
+               storage_map_crcs(st, fid, pid, path), strerror(errno));
+        if (nb_write >= 0) {
+            severe("pwrite failed: %zd bytes written instead of %zu",
+                   nb_write, count);
+        }
+        goto out;
+    }
+
+    status = storage_sync(st, pfe);
+out:
+    // even when failed, the blocks may have been written
+    if (st->bc)
+        bcache_invalidate(st->bc, fid, pid, bid, n);
+    if (none)
+        free(none);
+    if (slots)
+        bufpool_put(&st->pool, slots, slen);
+    if (pfe)
+        storage_unref_pfentry(pfe);
+    return status;
+}
+
+int storage_read(storage_t * st, fid_t fid, tid_t pid, uint32_t psize,
+                 bid_t bid, uint32_t n, bin_t * bins, uint32_t * crcs) {
+    int status = -1;
+    pfentry_t *pfe = 0;
+    size_t count;
+    ssize_t nb_read;
+    size_t bsize = psize * sizeof (bin_t);
+    size_t slot;
+    void *slots = 0;
+    char path[PATH_MAX];
+    iorw_t rws[2];
+    uint64_t gen = 0;
+    int hit = 0;
+    int in;
+    DEBUG_FUNCTION;
+
+    st = storage_disk(st, fid);
+    slot = storage_slot(st, psize);
+    if (st->bc) {
+        if ((hit = bcache_get(st->bc, fid, pid, bid, n, bsize, bins, crcs))) {
+            status = 0;
+            goto out;
+        }
+        gen = bcache_gen(st->bc, fid, pid);
+    }
+    if (st->ct && (in = container_read(st->ct, fid, pid,
+                                       (uint64_t) bid * psize *
+                                       sizeof (bin_t),
+                                       (size_t) n * psize * sizeof (bin_t),
+                                       bins, bid,
+                                       n, crcs)) != 0) {
+        status = in > 0 ? 0 : -1;
+        goto out;
+    }
+
+    if (!(pfe = storage_find_pfentry(st, fid, pid)))
+        goto out;
+
+    // the bins and the crcs are read together, the slots aside
+    count = n * slot;
+    if (st->align)
+        slots = bufpool_get(&st->pool, count);
+    ioring_prep(rws, pfe->fd, pfe->slot, 0, slots ? slots : bins, count,
+                (off_t) bid * (off_t) slot);
+    ioring_prep(rws + 1, pfe->cfd, pfe->cslot, 0, crcs,
+                n * sizeof (uint32_t), (off_t) bid * (off_t) sizeof (uint32_t));
+    storage_rw(st, rws, 2);
+
+    if (rws[0].res != count) {
+        // short: the blocks are not all there
+        errno = rws[0].res < 0 ? rws[0].err : EIO;
+        severe("storage_read failed: pread in file %s failed: %s",
+               storage_map(st, fid, pid, path), strerror(errno));
+        goto out;
+    }
+
+    // blocks written before checksums were stored have none (0)
+    count = n * sizeof (uint32_t);
+    if ((nb_read = rws[1].res) < 0) {
+        errno = rws[1].err;
+        severe("storage_read failed: pread in file %s failed: %s",
+               storage_map_crcs(st, fid, pid, path), strerror(errno));
+        goto out;
+    }
+    memset((char *) crcs + nb_read, 0, count - nb_read);
+    if (slots)
+        storage_unpad(bins, slots, n, bsize, slot);
+    if (st->ra)
+        storage_ra(st, pfe, psize, bid, n);
+
+    status = 0;
+out:
+    if (status == 0 && st->bc && !hit)
+        bcache_put(st->bc, fid, pid, bid, n, bsize, bins, crcs, gen);
+    if (slots)
+        bufpool_put(&st->pool, slots, n * slot);
+    if (pfe)
+        storage_unref_pfentry(pfe);
+    return status;
+}
+
+int storage_read_file(storage_t * st, fid_t fid, tid_t pid, uint32_t psize,
+                      bid_t bid, uint32_t n, uint32_t * crcs, int *fd,
+                      off_t * off, void **file) {
+    int status = -1;
+    pfentry_t *pfe = 0;
+    struct stat s;
+    size_t count;
+    ssize_t nb_read;
+    uint32_t none;
+    char path[PATH_MAX];
+    DEBUG_FUNCTION;
+
+    st = storage_disk(st, fid);
+    // slots are not sent as is
+    if (st->align) {
+        status = 0;
+        goto out;
+    }
+    if (st->ct && (status = container_read(st->ct, fid, pid, 0, 0, &none, 0,
+                                           0, &none)) != 0) {
+        status = status > 0 ? 0 : -1;
+        goto out;
+    }
+    // blocks read before are read through the cache
+    if (st->bc && bcache_wanted(st->bc, fid, pid, bid, n,
+                                psize * sizeof (bin_t))) {
+        status = 0;
+        goto out;
+    }
+
+    if (!(pfe = storage_find_pfentry(st, fid, pid)))
+        goto out;
+
+    // as a read, fails when the bins are not all there
+    *off = (off_t) bid * (off_t) psize * (off_t) sizeof (bin_t);
+    count = (size_t) n * psize * sizeof (bin_t);
+    if (fstat(pfe->fd, &s) != 0) {
+        severe("storage_read_file failed: fstat of file %s failed: %s",
+               storage_map(st, fid, pid, path), strerror(errno));
+        goto out;
+    }
+    if (s.st_size < *off + count) {
+        severe("storage_read_file failed: file %s is too short",
+               storage_map(st, fid, pid, path));
+        errno = EIO;
+        goto out;
+    }
+
+    // blocks written before checksums were stored have none (0)
+    count = n * sizeof (uint32_t);
+    if ((nb_read = pread(pfe->cfd, crcs, count,
+                         (off_t) bid * (off_t) sizeof (uint32_t))) < 0) {
+        severe("storage_read_file failed: pread in file %s failed: %s",
+               storage_map_crcs(st, fid, pid, path), strerror(errno));
+        goto out;
+    }
+    memset((char *) crcs + nb_read, 0, count - nb_read);
+    if (st->ra)
+        storage_ra(st, pfe, psize, bid, n);
+
+    *fd = pfe->fd;
+    *file = pfe;
+    pfe = 0;
+    status = 1;
+out:
+    if (pfe)
+        storage_unref_pfentry(pfe);
+    return status;
+}
+
+void storage_read_done(void *file) {
+    DEBUG_FUNCTION;
+    storage_unref_pfentry((pfentry_t *) file);
+}
+
+int storage_truncate(storage_t * st, fid_t fid, tid_t pid, uint32_t psize,
+                     bid_t bid) {
+    int status = -1;
+    pfentry_t *pfe = 0;
+    ctarg_t a;
+    int in;
+    DEBUG_FUNCTION;
+
+    st = storage_disk(st, fid);
+    ctarg_initialize(&a, st, fid, pid, psize);
+    if (st->ct && (in = container_truncate(st->ct, fid, pid,
+                                           (uint64_t) (bid + 1) * psize *
+                                           sizeof (bin_t), bid + 1,
+                                           storage_ct_file, storage_ct_put,
+                                           &a)) != 0) {
+        status = in > 0 ? storage_sync(st, 0) : -1;
+        goto out;
+    }
+
+    if (!(pfe = storage_find_pfentry(st, fid, pid)))
+        goto out;
+    if (ftruncate(pfe->fd, (bid + 1) * storage_slot(st, psize)) != 0 ||
+        ftruncate(pfe->cfd, (bid + 1) * sizeof (uint32_t)) != 0)
+        goto out;
+    status = storage_sync(st, pfe);
+out:
+    if (st->bc)
+        bcache_invalidate(st->bc, fid, pid, 0, 0);
+    if (pfe)
+        storage_unref_pfentry(pfe);
     return status;
 }
 
 int storage_rm_file(storage_t * st, fid_t fid) {
     int status = -1;
-    char pattern[PATH_MAX];
     char fid_str[37];
-    char **p;
+    char name[PATH_MAX];
+    const char *ext[] = { "bins", "crcs" };
     pfentry_t key;
     pfentry_t *pfe = 0;
-    pid_t pid;
-    size_t cnt;
-    glob_t glob_results;
+    pfshard_t *sh;
+    tid_t pid;
+    int e;
+    DEBUG_FUNCTION;
+
+    st = storage_disk(st, fid);
+    // the files of fid are known: unlink them relative to the root
+    // rather than looking for them in their directory
+    uuid_unparse(fid, fid_str);
+    uuid_copy(key.fid, fid);
+    for (pid = 0; pid < rozofs_forward; pid++) {
+        for (e = 0; e < sizeof (ext) / sizeof (ext[0]); e++) {
+            storage_fanout_dir(".", st->levels, fid_str, name);
+            sprintf(name + strlen(name), "/%s-%u.%s", fid_str, pid, ext[e]);
+            if (unlinkat(st->dirfd, name, 0) == -1 && errno != ENOENT) {
+                severe("storage_rm_file failed: unlink file %s/%s failed:"
+                       " %s", st->root, name, strerror(errno));
+                goto out;
+            }
+        }
+
+        if (st->ct && container_remove(st->ct, fid, pid) < 0) {
+            severe("storage_rm_file failed: remove of %s-%u from container"
+                   " failed: %s", fid_str, pid, strerror(errno));
+            goto out;
+        }
+
+        if (st->bc)
+            bcache_invalidate(st->bc, fid, pid, 0, 0);
+
+        key.pid = pid;
+        sh = storage_shard(st, &key);
+        pthread_mutex_lock(&sh->lock);
+        if ((pfe = htable_get(&sh->htable, &key)))
+            storage_del_pfentry(sh, pfe);
+        pthread_mutex_unlock(&sh->lock);
+    }
+    status = 0;
+out:
+    return status;
+}
+
+static void storage_rmq_push(rmqueue_t * q, fid_t fid) {
+    rmentry_t *e = xmalloc(sizeof (rmentry_t));
+
+    uuid_copy(e->fid, fid);
+    list_init(&e->list);
+    list_push_back(&q->entries, &e->list);
+    q->depth++;
+}
 
+static int storage_rmq_load(storage_t * st, rmqueue_t * q) {
+    int status = -1;
+    fid_t fid;
+    ssize_t n;
     DEBUG_FUNCTION;
 
-    if (chdir(st->root) != 0) {
+    if ((q->fd = openat(st->dirfd, STORAGE_RMQ_FILE,
+                        O_RDWR | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR)) < 0)
         goto out;
+    while ((n = read(q->fd, fid, sizeof (fid_t))) == sizeof (fid_t)) {
+        storage_rmq_push(q, fid);
+        q->records++;
     }
+    if (n < 0)
+        goto out;
+    // a record torn by a crash was not acknowledged
+    if (n > 0 && ftruncate(q->fd, q->records * sizeof (fid_t)) != 0)
+        goto out;
 
-    uuid_unparse(fid, fid_str);
-    strcpy(pattern, fid_str);
-    strcat(pattern, "*");
+    status = 0;
+out:
+    return status;
+}
+
+// called with the queue locked
+static int storage_rmq_compact(storage_t * st, rmqueue_t * q) {
+    int status = -1;
+    int fd = -1;
+    list_t *p;
+    DEBUG_FUNCTION;
+
+    if (q->depth == 0) {
+        if (ftruncate(q->fd, 0) != 0)
+            goto out;
+        q->records = 0;
+        status = 0;
+        goto out;
+    }
 
-    if (glob(pattern, 0, 0, &glob_results) == 0) {
+    if ((fd = openat(st->dirfd, STORAGE_RMQ_FILE ".tmp",
+                     O_RDWR | O_CREAT | O_TRUNC | O_APPEND,
+                     S_IRUSR | S_IWUSR)) < 0)
+        goto out;
+    list_for_each_forward(p, &q->entries) {
+        rmentry_t *e = list_entry(p, rmentry_t, list);
+        if (write(fd, e->fid, sizeof (fid_t)) != sizeof (fid_t))
+            goto error;
+    }
+    if (fdatasync(fd) != 0 || renameat(st->dirfd, STORAGE_RMQ_FILE ".tmp",
+                                       st->dirfd, STORAGE_RMQ_FILE) != 0)
+        goto error;
+    fsync(st->dirfd);
+    close(q->fd);
+    q->fd = fd;
+    q->records = q->depth;
+    status = 0;
+    goto out;
+error:
+    close(fd);
+    unlinkat(st->dirfd, STORAGE_RMQ_FILE ".tmp", 0);
+out:
+    return status;
+}
+
+static void storage_rmq_pace(rmqueue_t * q, struct timespec *next) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (next->tv_sec < now.tv_sec ||
+        (next->tv_sec == now.tv_sec && next->tv_nsec < now.tv_nsec))
+        *next = now;
+    while (!q->stop &&
+           pthread_cond_timedwait(&q->cond, &q->lock, next) != ETIMEDOUT);
+    next->tv_nsec += 1000000000L / q->rate;
+    if (next->tv_nsec >= 1000000000L) {
+        next->tv_sec += next->tv_nsec / 1000000000L;
+        next->tv_nsec %= 1000000000L;
+    }
+}
+
+static void *storage_rmq_thread(void *v) {
+    storage_t *st = (storage_t *) v;
+    rmqueue_t *q = st->rmq;
+    struct timespec next = { 0, 0 };
+    rmentry_t *e;
+    char fid_str[37];
 
-        for (p = glob_results.gl_pathv, cnt = glob_results.gl_pathc; cnt;
-             p++, cnt--) {
+    pthread_mutex_lock(&q->lock);
+    for (;;) {
+        while (!q->stop && list_empty(&q->entries))
+            pthread_cond_wait(&q->cond, &q->lock);
+        if (q->rate)
+            storage_rmq_pace(q, &next);
+        if (q->stop)
+            break;
+        e = list_first_entry(&q->entries, rmentry_t, list);
+        list_remove(&e->list);
+        pthread_mutex_unlock(&q->lock);
 
-            if (unlink(*p) == -1) {
-                severe("storage_rm_file failed: unlink file %s failed: %s",
-                       *p, strerror(errno));
+        // failed removes are not retried, as when done synchronously
+        if (storage_rm_file(st, e->fid) != 0) {
+            uuid_unparse(e->fid, fid_str);
+            severe("storage %u: can't remove %s: %s", st->sid, fid_str,
+                   strerror(errno));
+        }
+        free(e);
+
+        pthread_mutex_lock(&q->lock);
+        q->depth--;
+        q->removed++;
+        if (q->syncs == 0 &&
+            (q->depth == 0 || (q->records > STORAGE_RMQ_COMPACT &&
+                               q->records > 4 * q->depth)) &&
+            storage_rmq_compact(st, q) != 0) {
+            severe("storage %u: can't compact %s: %s", st->sid,
+                   STORAGE_RMQ_FILE, strerror(errno));
+        }
+    }
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+int storage_rmq_start(storage_t * st, uint32_t rate) {
+    int status = -1;
+    rmqueue_t *q;
+    pthread_condattr_t attr;
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    if (st->ndisks) {
+        for (i = 0; i < st->ndisks; i++)
+            if (storage_rmq_start(st->disks + i, rate) != 0)
                 goto out;
+        status = 0;
+        goto out;
+    }
+
+    q = xcalloc(1, sizeof (rmqueue_t));
+    q->fd = -1;
+    q->rate = rate;
+    list_init(&q->entries);
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&q->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (storage_rmq_load(st, q) != 0)
+        goto error;
+    if (q->depth > 0) {
+        info("storage %u: %" PRIu64 " queued removes", st->sid, q->depth);
+    }
+    st->rmq = q;
+    if ((errno = pthread_create(&q->thread, NULL, storage_rmq_thread, st))
+        != 0) {
+        st->rmq = 0;
+        goto error;
+    }
+
+    status = 0;
+    goto out;
+error:
+    storage_rmq_release(q);
+out:
+    return status;
+}
+
+int storage_rm_queue(storage_t * st, fid_t fid) {
+    int status = -1;
+    rmqueue_t *q;
+    tid_t pid;
+    ssize_t n;
+    int fd;
+    DEBUG_FUNCTION;
+
+    st = storage_disk(st, fid);
+    q = st->rmq;
+    if (!q)
+        return storage_rm_file(st, fid);
+    // not to be read until removed
+    for (pid = 0; st->bc && pid < rozofs_forward; pid++)
+        bcache_invalidate(st->bc, fid, pid, 0, 0);
+
+    pthread_mutex_lock(&q->lock);
+    if ((n = write(q->fd, fid, sizeof (fid_t))) != sizeof (fid_t)) {
+        if (n >= 0)
+            errno = ENOSPC;
+        // the journal is cut at the last whole record
+        ftruncate(q->fd, q->records * sizeof (fid_t));
+        pthread_mutex_unlock(&q->lock);
+        goto out;
+    }
+    q->records++;
+    storage_rmq_push(q, fid);
+    pthread_cond_signal(&q->cond);
+    // the journal is not rewritten while synced
+    q->syncs++;
+    fd = q->fd;
+    pthread_mutex_unlock(&q->lock);
+
+    status = fdatasync(fd);
+
+    pthread_mutex_lock(&q->lock);
+    // the queue may have been emptied meanwhile
+    if (--q->syncs == 0 && q->depth == 0)
+        storage_rmq_compact(st, q);
+    pthread_mutex_unlock(&q->lock);
+out:
+    return status;
+}
+
+void storage_rmq_stat(storage_t * st, rmqstat_t * qstat) {
+    rmqueue_t *q = st->rmq;
+    rmqstat_t d;
+    uint32_t i;
+
+    memset(qstat, 0, sizeof (rmqstat_t));
+    for (i = 0; i < st->ndisks; i++) {
+        storage_rmq_stat(st->disks + i, &d);
+        qstat->depth += d.depth;
+        qstat->removed += d.removed;
+    }
+    if (!q)
+        return;
+    pthread_mutex_lock(&q->lock);
+    qstat->depth = q->depth;
+    qstat->removed = q->removed;
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void storage_sync_failed(syncer_t * s, pfentry_t * pfe,
+                                uint64_t gen) {
+    pthread_mutex_lock(&s->lock);
+    pfe->sfailed = gen;
+    pthread_mutex_unlock(&s->lock);
+}
+
+// returns the number of directories synced
+static uint32_t storage_sync_files(storage_t * st, pfentry_t ** files,
+                                   uint32_t n, uint64_t gen) {
+    syncer_t *s = st->syncer;
+    char path[PATH_MAX];
+    uint32_t i, j, dirs = 0;
+    int l;
+
+    for (i = 0; i < n; i++) {
+        sync_file_range(files[i]->fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+        sync_file_range(files[i]->cfd, 0, 0, SYNC_FILE_RANGE_WRITE);
+    }
+    for (i = 0; i < n; i++) {
+        pfentry_t *pfe = files[i];
+        if (fdatasync(pfe->fd) == 0 && fdatasync(pfe->cfd) == 0)
+            continue;
+        severe("storage %u: can't sync %s: %s", st->sid,
+               storage_map(st, pfe->fid, pfe->pid, path), strerror(errno));
+        storage_sync_failed(s, pfe, gen);
+    }
+
+    // then the entries of created files, each directory once: only this
+    // thread writes created and sfailed once the entry is cached
+    for (i = 0; i < n; i++) {
+        pfentry_t *pfe = files[i];
+        if (!pfe->created)
+            continue;
+        for (l = storage_created_level(st, pfe->created); l <= st->levels;
+             l++) {
+            for (j = 0; j < i; j++)
+                if (files[j]->created &&
+                    storage_created_level(st, files[j]->created) <= l &&
+                    memcmp(files[j]->fid, pfe->fid, l) == 0)
+                    break;
+            if (j < i) {
+                if (files[j]->sfailed == gen)
+                    storage_sync_failed(s, pfe, gen);
+                continue;
             }
+            dirs++;
+            if (storage_sync_dir(st, pfe->fid, l) != 0)
+                storage_sync_failed(s, pfe, gen);
+        }
+    }
+    for (i = 0; i < n; i++)
+        if (files[i]->created && files[i]->sfailed != gen)
+            __atomic_store_n(&files[i]->created, 0, __ATOMIC_RELAXED);
+    return dirs;
+}
 
-            if (sscanf(*p, "%36s-%u.*", fid_str, &pid) != 2) {
-                severe
-                    ("storage_rm_file failed: sscanf for file %s failed: %s",
-                     *p, strerror(errno));
-                goto out;
+static void *storage_sync_thread(void *v) {
+    storage_t *st = (storage_t *) v;
+    syncer_t *s = st->syncer;
+    pfentry_t **files = 0;
+    uint32_t n, dirs, max = 0;
+    struct timespec end;
+    uint64_t gen;
+    int container;
+
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (!s->stop && s->pending == 0)
+            pthread_cond_wait(&s->cond, &s->lock);
+        if (s->pending == 0)
+            break;
+        // gather the writes of the window
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        end.tv_nsec += s->window * 1000L;
+        end.tv_sec += end.tv_nsec / 1000000000L;
+        end.tv_nsec %= 1000000000L;
+        while (!s->stop && s->pending < s->batch &&
+               pthread_cond_timedwait(&s->cond, &s->lock, &end) != ETIMEDOUT);
+
+        // writes from now on go to the next batch
+        gen = s->gen++;
+        for (n = 0; !list_empty(&s->files); n++) {
+            pfentry_t *pfe = list_first_entry(&s->files, pfentry_t, slist);
+            list_remove(&pfe->slist);
+            if (n == max) {
+                max = max ? 2 * max : 64;
+                files = xrealloc(files, max * sizeof (pfentry_t *));
             }
+            files[n] = pfe;
+        }
+        container = s->container;
+        s->container = 0;
+        s->writes += s->pending;
+        s->pending = 0;
+        s->batches++;
+        s->nfiles += n;
+        pthread_mutex_unlock(&s->lock);
+
+        dirs = storage_sync_files(st, files, n, gen);
+        if (container && container_sync(st->ct) != 0)
+            container = -1;
+
+        pthread_mutex_lock(&s->lock);
+        if (container < 0)
+            s->ctfailed = gen;
+        s->ndirs += dirs;
+        s->synced = gen;
+        pthread_cond_broadcast(&s->done);
+    }
+    pthread_mutex_unlock(&s->lock);
+    if (files)
+        free(files);
+    return 0;
+}
+
+int storage_sync_start(storage_t * st, uint32_t window, uint32_t batch) {
+    int status = -1;
+    syncer_t *s;
+    pthread_condattr_t attr;
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    if (st->ndisks) {
+        for (i = 0; i < st->ndisks; i++)
+            if (storage_sync_start(st->disks + i, window, batch) != 0)
+                goto out;
+        status = 0;
+        goto out;
+    }
+
+    if (batch == 0) {
+        errno = EINVAL;
+        goto out;
+    }
+    s = xcalloc(1, sizeof (syncer_t));
+    list_init(&s->files);
+    s->gen = 1;
+    s->window = window;
+    s->batch = batch;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&s->done, NULL);
+    st->syncer = s;
+    if ((errno = pthread_create(&s->thread, NULL, storage_sync_thread, st))
+        != 0) {
+        st->syncer = 0;
+        storage_sync_release(s);
+        goto out;
+    }
+    status = 0;
+out:
+    return status;
+}
+
+void storage_sync_stat(storage_t * st, syncstat_t * sstat) {
+    syncer_t *s = st->syncer;
+    syncstat_t d;
+    uint32_t i;
+
+    memset(sstat, 0, sizeof (syncstat_t));
+    for (i = 0; i < st->ndisks; i++) {
+        storage_sync_stat(st->disks + i, &d);
+        sstat->writes += d.writes;
+        sstat->batches += d.batches;
+        sstat->files += d.files;
+        sstat->dirs += d.dirs;
+    }
+    if (!s)
+        return;
+    pthread_mutex_lock(&s->lock);
+    sstat->writes += s->writes;
+    sstat->batches += s->batches;
+    sstat->files += s->nfiles;
+    sstat->dirs += s->ndirs;
+    pthread_mutex_unlock(&s->lock);
+}
+
+// account for bytes read, returns -1 when the scrubber is stopped
+static int storage_scrub_pace(scrubber_t * s, uint64_t bytes) {
+    struct timespec now;
+    uint64_t ns;
+    int stop;
+
+    pthread_mutex_lock(&s->lock);
+    s->stat.bytes += bytes;
+    if (s->rate) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (s->next.tv_sec < now.tv_sec || (s->next.tv_sec == now.tv_sec &&
+                                            s->next.tv_nsec < now.tv_nsec))
+            s->next = now;
+        ns = s->next.tv_nsec + bytes * 1000000000ULL / s->rate;
+        s->next.tv_sec += ns / 1000000000ULL;
+        s->next.tv_nsec = ns % 1000000000ULL;
+        while (!s->stop && pthread_cond_timedwait(&s->cond, &s->lock,
+                                                  &s->next) != ETIMEDOUT);
+    }
+    stop = s->stop;
+    pthread_mutex_unlock(&s->lock);
+    return stop ? -1 : 0;
+}
+
+static void storage_scrub_report(storage_t * st, fid_t fid, tid_t pid,
+                                 bid_t bid, uint64_t n) {
+    scrubber_t *s = st->scrubber;
+    char fid_str[37];
+    char line[80];
+    int len;
+
+    uuid_unparse(fid, fid_str);
+    severe("storage %u: %" PRIu64 " bad blocks from %" PRIu64 " in %s-%u",
+           st->sid, n, bid, fid_str, pid);
+    len = sprintf(line, "%s %u %" PRIu64 " %" PRIu64 "\n", fid_str, pid, bid,
+                  n);
+    if (s->fd >= 0 && write(s->fd, line, len) != len) {
+        severe("storage %u: can't write %s: %s", st->sid,
+               STORAGE_BADBLOCKS_FILE, strerror(errno));
+    }
+    pthread_mutex_lock(&s->lock);
+    s->stat.bad += n;
+    pthread_mutex_unlock(&s->lock);
+}
+
+/*
+ * Whether the slot of a block matches its crc: with aligned slots the
+ * bins size is not known, it ends in the last align bytes of the slot.
+ */
+static int storage_scrub_block(storage_t * st, const char *slot, size_t size,
+                               uint32_t crc) {
+    size_t len;
+    uint32_t c;
+
+    if (!st->align)
+        return crc32c(0, slot, size) == crc;
+    len = size > st->align ? size - st->align + sizeof (bin_t) :
+        sizeof (bin_t);
+    for (c = crc32c(0, slot, len);; len += sizeof (bin_t)) {
+        if (c == crc)
+            return 1;
+        if (len == size)
+            return 0;
+        c = crc32c(c, slot + len, sizeof (bin_t));
+    }
+}
+
+// a block may have been written between the reads of its slot and crc
+static int storage_scrub_recheck(storage_t * st, int fd, int cfd, char *slot,
+                                 size_t size, bid_t bid) {
+    uint32_t crc;
+
+    if (pread(fd, slot, size, bid * size) != size ||
+        pread(cfd, &crc, sizeof (uint32_t), bid * sizeof (uint32_t)) !=
+        sizeof (uint32_t))
+        return 1;
+    return crc == 0 || storage_scrub_block(st, slot, size, crc);
+}
+
+/* Whether the file of (fid, pid) is in the open files cache. */
+static int storage_is_open(storage_t * st, fid_t fid, tid_t pid) {
+    pfentry_t key;
+    pfshard_t *sh;
+    int open;
 
-            uuid_copy(key.fid, fid);
-            key.pid = pid;
-            if ((pfe = htable_get(&st->htable, &key))) {
-                storage_del_pfentry(st, pfe);
-                pfentry_release(pfe);
-                free(pfe);
+    uuid_copy(key.fid, fid);
+    key.pid = pid;
+    sh = storage_shard(st, &key);
+    pthread_mutex_lock(&sh->lock);
+    open = htable_get(&sh->htable, &key) != 0;
+    pthread_mutex_unlock(&sh->lock);
+    return open;
+}
+
+// scrub the projection file name (<fid>-<pid>.bins) of dirfd
+static int storage_scrub_file(storage_t * st, int dirfd, const char *name) {
+    int status = -1;
+    scrubber_t *s = st->scrubber;
+    char cname[NAME_MAX + 1];
+    char fid_str[37];
+    fid_t fid;
+    tid_t pid;
+    int fd = -1, cfd = -1;
+    struct stat bst, cst;
+    uint64_t nblocks, size, bad = 0;
+    bid_t bid;
+    uint32_t n, m, i, *crcs = 0;
+    char *buf = 0;
+    ssize_t len, clen;
+
+    if (strlen(name) < 38 || name[36] != '-') {
+        status = 0;
+        goto out;
+    }
+    memcpy(fid_str, name, 36);
+    fid_str[36] = 0;
+    if (uuid_parse(fid_str, fid) != 0) {
+        status = 0;
+        goto out;
+    }
+    pid = atoi(name + 37);
+    strcpy(cname, name);
+    strcpy(cname + strlen(cname) - strlen("bins"), "crcs");
+    // removed meanwhile
+    if ((fd = openat(dirfd, name, O_RDONLY)) < 0 ||
+        (cfd = openat(dirfd, cname, O_RDONLY)) < 0) {
+        status = errno == ENOENT ? 0 : -1;
+        goto out;
+    }
+    if (fstat(fd, &bst) != 0 || fstat(cfd, &cst) != 0)
+        goto out;
+    // files of blocks without checksums can't be checked
+    nblocks = cst.st_size / sizeof (uint32_t);
+    if (nblocks == 0 || bst.st_size % nblocks != 0 ||
+        (size = bst.st_size / nblocks) > 2 * ROZOFS_BSIZE_MAX) {
+        status = 0;
+        goto out;
+    }
+    n = size < STORAGE_SCRUB_CHUNK ? STORAGE_SCRUB_CHUNK / size : 1;
+    buf = xmalloc(n * size);
+    crcs = xmalloc(n * sizeof (uint32_t));
+    for (bid = 0; bid < nblocks;) {
+        m = nblocks - bid < n ? nblocks - bid : n;
+        if ((len = pread(fd, buf, m * size, bid * size)) < 0 ||
+            (clen = pread(cfd, crcs, m * sizeof (uint32_t),
+                          bid * sizeof (uint32_t))) < 0)
+            goto out;
+        memset((char *) crcs + clen, 0, m * sizeof (uint32_t) - clen);
+        // both may have been truncated meanwhile
+        len /= size;
+        for (i = 0; i < len; i++, bid++) {
+            if (crcs[i] == 0 ||
+                storage_scrub_block(st, buf + i * size, size, crcs[i]) ||
+                storage_scrub_recheck(st, fd, cfd, buf + i * size, size,
+                                      bid)) {
+                if (bad)
+                    storage_scrub_report(st, fid, pid, bid - bad, bad);
+                bad = 0;
+            } else {
+                bad++;
             }
         }
-        globfree(&glob_results);
+        if (len < m || storage_scrub_pace(s, len * size) != 0)
+            break;
     }
+    if (bad)
+        storage_scrub_report(st, fid, pid, bid - bad, bad);
+    // don't keep the pages read unless the file is used
+    if (!storage_is_open(st, fid, pid))
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    pthread_mutex_lock(&s->lock);
+    s->stat.files++;
+    pthread_mutex_unlock(&s->lock);
     status = 0;
 out:
+    if (fd >= 0)
+        close(fd);
+    if (cfd >= 0)
+        close(cfd);
+    if (buf)
+        free(buf);
+    if (crcs)
+        free(crcs);
     return status;
 }
 
+static int storage_scrub_stopped(scrubber_t * s) {
+    int stop;
+
+    pthread_mutex_lock(&s->lock);
+    stop = s->stop;
+    pthread_mutex_unlock(&s->lock);
+    return stop;
+}
+
+// scrub the projection files under dirfd, a fan-out directory of level
+static void storage_scrub_dir(storage_t * st, int dirfd, int level) {
+    DIR *dir;
+    struct dirent *d;
+    size_t len;
+    int fd;
+
+    // a description of its own for readdir
+    if ((fd = openat(dirfd, ".", O_RDONLY | O_DIRECTORY)) < 0)
+        goto error;
+    if (!(dir = fdopendir(fd))) {
+        close(fd);
+        goto error;
+    }
+    while ((d = readdir(dir)) && !storage_scrub_stopped(st->scrubber)) {
+        len = strlen(d->d_name);
+        if (level < st->levels) {
+            if (len != 2 || !isxdigit(d->d_name[0]) ||
+                !isxdigit(d->d_name[1]))
+                continue;
+            if ((fd = openat(dirfd, d->d_name, O_RDONLY | O_DIRECTORY)) < 0)
+                continue;
+            storage_scrub_dir(st, fd, level + 1);
+            close(fd);
+        } else if (len > 5 && strcmp(d->d_name + len - 5, ".bins") == 0 &&
+                   storage_scrub_file(st, dirfd, d->d_name) != 0) {
+            severe("storage %u: can't scrub %s: %s", st->sid, d->d_name,
+                   strerror(errno));
+        }
+    }
+    closedir(dir);
+    return;
+error:
+    severe("storage %u: can't scrub a directory of %s: %s", st->sid,
+           st->root, strerror(errno));
+}
+
+static void storage_scrub_ct(storage_t * st) {
+    scrubber_t *s = st->scrubber;
+    ctkey_t *keys;
+    uint64_t n, i, size;
+    uint32_t ncrcs;
+    int ok;
+
+    n = container_list(st->ct, &keys);
+    for (i = 0; i < n; i++) {
+        // the whole record is checked
+        if ((ok = container_verify(st->ct, keys[i].fid, keys[i].pid, &size,
+                                   &ncrcs)) < 0)
+            continue;
+        if (!ok)
+            storage_scrub_report(st, keys[i].fid, keys[i].pid, 0,
+                                 ncrcs ? ncrcs : 1);
+        pthread_mutex_lock(&s->lock);
+        s->stat.files++;
+        pthread_mutex_unlock(&s->lock);
+        if (storage_scrub_pace(s, size) != 0)
+            break;
+    }
+    free(keys);
+}
+
+// ioprio_set(2) values
+#define STORAGE_IOPRIO_WHO_PROCESS 1
+#define STORAGE_IOPRIO_CLASS_IDLE 3
+#define STORAGE_IOPRIO_CLASS_SHIFT 13
+
+static void *storage_scrub_thread(void *v) {
+    storage_t *st = (storage_t *) v;
+    scrubber_t *s = st->scrubber;
+    struct timespec next;
+
+#ifdef SYS_ioprio_set
+    // its reads are only served when the device is idle
+    if (syscall(SYS_ioprio_set, STORAGE_IOPRIO_WHO_PROCESS, 0,
+                STORAGE_IOPRIO_CLASS_IDLE << STORAGE_IOPRIO_CLASS_SHIFT) !=
+        0) {
+        warning("storage %u: can't make scrub I/O idle: %s", st->sid,
+                strerror(errno));
+    }
+#endif
+    pthread_mutex_lock(&s->lock);
+    while (!s->stop) {
+        pthread_mutex_unlock(&s->lock);
+        clock_gettime(CLOCK_MONOTONIC, &next);
+        next.tv_sec += s->interval;
+        storage_scrub_dir(st, st->dirfd, 0);
+        if (st->ct && !storage_scrub_stopped(s))
+            storage_scrub_ct(st);
+
+        pthread_mutex_lock(&s->lock);
+        if (!s->stop)
+            s->stat.passes++;
+        while (!s->stop &&
+               pthread_cond_timedwait(&s->cond, &s->lock, &next) !=
+               ETIMEDOUT);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+int storage_scrub_start(storage_t * st, uint64_t rate, uint32_t interval) {
+    int status = -1;
+    scrubber_t *s;
+    pthread_condattr_t attr;
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    if (st->ndisks) {
+        for (i = 0; i < st->ndisks; i++)
+            if (storage_scrub_start(st->disks + i, rate, interval) != 0)
+                goto out;
+        status = 0;
+        goto out;
+    }
+
+    s = xcalloc(1, sizeof (scrubber_t));
+    s->rate = rate;
+    s->interval = interval;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if ((s->fd = openat(st->dirfd, STORAGE_BADBLOCKS_FILE,
+                        O_WRONLY | O_CREAT | O_APPEND,
+                        S_IRUSR | S_IWUSR)) < 0) {
+        storage_scrub_release(s);
+        goto out;
+    }
+    st->scrubber = s;
+    if ((errno = pthread_create(&s->thread, NULL, storage_scrub_thread, st))
+        != 0) {
+        st->scrubber = 0;
+        storage_scrub_release(s);
+        goto out;
+    }
+    status = 0;
+out:
+    return status;
+}
+
+void storage_scrub_stat(storage_t * st, scrubstat_t * sstat) {
+    scrubber_t *s = st->scrubber;
+    scrubstat_t d;
+    uint32_t i;
+
+    memset(sstat, 0, sizeof (scrubstat_t));
+    // passes of all the roots
+    for (i = 0; i < st->ndisks; i++) {
+        storage_scrub_stat(st->disks + i, &d);
+        if (i == 0 || d.passes < sstat->passes)
+            sstat->passes = d.passes;
+        sstat->files += d.files;
+        sstat->bytes += d.bytes;
+        sstat->bad += d.bad;
+    }
+    if (!s)
+        return;
+    pthread_mutex_lock(&s->lock);
+    *sstat = s->stat;
+    pthread_mutex_unlock(&s->lock);
+}
+
 int storage_stat(storage_t * st, sstat_t * sstat) {
     int status = -1;
     struct statfs sfs;
+    sstat_t d;
+    uint32_t i;
     DEBUG_FUNCTION;
 
+    // roots may share a file system
+    if (st->ndisks) {
+        memset(sstat, 0, sizeof (sstat_t));
+        for (i = 0; i < st->ndisks; i++) {
+            if (storage_stat(st->disks + i, &d) != 0)
+                goto out;
+            if (storage_same_fs(st, i))
+                continue;
+            sstat->size += d.size;
+            sstat->free += d.free;
+        }
+        status = 0;
+        goto out;
+    }
     if (statfs(st->root, &sfs) == -1)
         goto out;
     sstat->size = (uint64_t) sfs.f_blocks * (uint64_t) sfs.f_bsize;
@@ -26,29 +26,245 @@
 #include "rozofs.h"
 #include "list.h"
 #include "htable.h"
+#include "container.h"
+#include "bufpool.h"
+#include "bcache.h"
+
+// default number of shards of the open projection files cache
+#define STORAGE_SHARDS 16
+
+/*
+ * Projection files are spread in levels of sub-directories named after
+ * the fid bytes: <root>/ab/cd/abcdxxxx-...-<pid>.bins for 2 levels. The
+ * number of levels of a root is kept in its STORAGE_FANOUT_FILE.
+ */
+#define STORAGE_FANOUT_MAX 2
+#define STORAGE_FANOUT_FILE ".fanout"
+
+// journal of the queued removes, in the root
+#define STORAGE_RMQ_FILE ".rmqueue"
+
+/*
+ * Blocks of projection files are packed, or padded to slots aligned on the
+ * size kept in the STORAGE_ALIGN_FILE of the root (set when it is new) so
+ * that they can be read and written with O_DIRECT.
+ */
+#define STORAGE_ALIGN_FILE ".align"
+
+/*
+ * A storage may spread its projections over several roots (disks) by fid:
+ * each root keeps its place among them in its STORAGE_STRIPE_FILE.
+ */
+#define STORAGE_STRIPE_FILE ".stripe"
+
+// bad blocks found by the scrubber: "<fid> <tid> <bid> <count>" lines
+#define STORAGE_BADBLOCKS_FILE ".badblocks"
+
+struct pfshard;
+struct rmqueue;
+struct ioring;
+struct syncer;
+struct scrubber;
+struct readahead;
 
 typedef struct storage {
     sid_t sid;
     char root[PATH_MAX];
-    uint32_t csize;
-    list_t pfiles;
-    htable_t htable;
+    int levels;                 // fan-out
+    uint32_t align;             // of the block slots, 0: packed
+    int direct;                 // O_DIRECT projection files
+    bufpool_t pool;             // aligned buffers, when align
+    int dirfd;                  // root
+    uint32_t nshards;
+    struct pfshard *shards;     // open projection files cache
+    struct rmqueue *rmq;        // removes queue
+    container_t *ct;            // small projections, null if not used
+    struct ioring *ring;        // null: pread and pwrite
+    struct syncer *syncer;      // null: writes are not synced
+    struct scrubber *scrubber;  // null: not scrubbed
+    bcache_t *bc;               // hot blocks, null if not used
+    struct readahead *ra;       // null: no read-ahead hints
+    struct storage *disks;      // roots the projections are spread over,
+    uint32_t ndisks;            // storages of their own (0: root only)
 } storage_t;
 
-int storage_initialize(storage_t * st, sid_t sid, const char *root);
+// open projection files cache statistics
+typedef struct pfcstat {
+    uint32_t size;
+    uint32_t max;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} pfcstat_t;
+
+// removes queue statistics
+typedef struct rmqstat {
+    uint64_t depth;
+    uint64_t removed;
+} rmqstat_t;
+
+// group commit statistics
+typedef struct syncstat {
+    uint64_t writes;
+    uint64_t batches;
+    uint64_t files;             // synced
+    uint64_t dirs;              // synced for the files created
+} syncstat_t;
+
+// scrubber statistics
+typedef struct scrubstat {
+    uint64_t passes;            // done
+    uint64_t files;             // checked, container projections included
+    uint64_t bytes;             // read
+    uint64_t bad;               // blocks found
+} scrubstat_t;
+
+// read-ahead statistics
+typedef struct rastat {
+    uint64_t streams;           // sequential reads started
+    uint64_t hits;              // reads of prefetched blocks
+    uint64_t prefetched;        // bytes
+    uint64_t dropped;           // bytes
+} rastat_t;
+
+/*
+ * root must have a fan-out of levels (new roots get it). Up to csize
+ * projection files (two descriptors each) are kept open, in nshards
+ * independently locked shards.
+ */
+int storage_initialize(storage_t * st, sid_t sid, const char *root,
+                       int levels, uint32_t csize, uint32_t nshards);
+
+/*
+ * Spread the projections of sid over nroots roots (disks), by fid. Each
+ * one is a storage of its own: settings apply to all of them, their
+ * threads and open files cache (of csize files in all) are their own. The
+ * order of the roots can't change once they hold projections.
+ */
+int storage_initialize_roots(storage_t * st, sid_t sid, const char **roots,
+                             uint32_t nroots, int levels, uint32_t csize,
+                             uint32_t nshards);
 
 void storage_release(storage_t * st);
 
-int storage_write(storage_t * st, fid_t fid, tid_t pid, bid_t bid, uint32_t n,
-                  size_t len, const bin_t * bins);
+void storage_cache_stat(storage_t * st, pfcstat_t * cstat);
+
+/*
+ * Read and write the bins of st with O_DIRECT, aligning the block slots
+ * of its root first if it is new. Must be called before any I/O.
+ */
+int storage_direct_open(storage_t * st);
+
+/* Keep the small projections of st in a container (see container.h). */
+int storage_ct_open(storage_t * st);
+
+/* Start the compaction of the containers of st. */
+int storage_ct_start(storage_t * st);
+
+/* Returns 0 when st has no container. */
+int storage_ct_stat(storage_t * st, ctstat_t * cstat);
+
+/*
+ * Keep the blocks read more than once of st in a cache of size bytes (see
+ * bcache.h). Blocks not in it are still sent from their files.
+ */
+int storage_bc_open(storage_t * st, uint64_t size);
+
+/* Returns 0 when st has no block cache. */
+int storage_bc_stat(storage_t * st, bcstat_t * bstat);
 
-int storage_read(storage_t * st, fid_t fid, tid_t pid, bid_t bid, uint32_t n,
-                 bin_t * bins);
+/*
+ * Detect the sequential reads of each projection file of st and prefetch
+ * the next window of their blocks (posix_fadvise WILLNEED), from min bytes
+ * doubling up to max as they go on. When drop, the blocks they have read
+ * are dropped from the page cache (DONTNEED). Fails on O_DIRECT storages.
+ */
+int storage_ra_open(storage_t * st, uint32_t min, uint32_t max, int drop);
+
+void storage_ra_stat(storage_t * st, rastat_t * rstat);
+
+/*
+ * Read and write the projection files of st through an io_uring (see
+ * ioring.h) of entries operations, fails when it is not supported.
+ */
+int storage_ring_open(storage_t * st, uint32_t entries);
+
+/*
+ * psize is the number of bins per block of projection pid: blocks are
+ * stored at bid * psize bins in its file whatever the layout and mode.
+ * crcs hold the crc32c of the n blocks (0: none), stored aside; they may be
+ * null on write, the blocks then have no checksum.
+ */
+int storage_write(storage_t * st, fid_t fid, tid_t pid, uint32_t psize,
+                  bid_t bid, uint32_t n, size_t len, const bin_t * bins,
+                  const uint32_t * crcs);
 
-int storage_truncate(storage_t * st, fid_t fid, tid_t pid, bid_t bid);
+int storage_read(storage_t * st, fid_t fid, tid_t pid, uint32_t psize,
+                 bid_t bid, uint32_t n, bin_t * bins, uint32_t * crcs);
 
+/*
+ * Read the crcs of n blocks as storage_read does, and give the projection
+ * file fd and the offset off of their bins for them to be sent without
+ * copy: the file stays open until storage_read_done(file). Returns 1 then,
+ * 0 when the bins are not stored as is in a file (container, slots): they
+ * are to be read with storage_read, -1 on error.
+ */
+int storage_read_file(storage_t * st, fid_t fid, tid_t pid, uint32_t psize,
+                      bid_t bid, uint32_t n, uint32_t * crcs, int *fd,
+                      off_t * off, void **file);
+
+void storage_read_done(void *file);
+
+int storage_truncate(storage_t * st, fid_t fid, tid_t pid, uint32_t psize,
+                     bid_t bid);
+
+/* Remove the projection files of fid (tids below rozofs_forward). */
 int storage_rm_file(storage_t * st, fid_t fid);
 
+/*
+ * Remove the files queued in the journal of st, then those queued by
+ * storage_rm_queue, from a thread at most rate per second (0: no limit).
+ */
+int storage_rmq_start(storage_t * st, uint32_t rate);
+
+/*
+ * Queue the removal of the projection files of fid: returns once it is
+ * in the journal. Removes at once when the queue is not started.
+ */
+int storage_rm_queue(storage_t * st, fid_t fid);
+
+void storage_rmq_stat(storage_t * st, rmqstat_t * qstat);
+
+/*
+ * Make writes and truncates durable: they return once their files are
+ * synced, with the directory entries of the files they create. The syncs
+ * are grouped by a thread, a batch is synced window usec after its first
+ * write or as soon as it holds batch writes.
+ */
+int storage_sync_start(storage_t * st, uint32_t window, uint32_t batch);
+
+void storage_sync_stat(storage_t * st, syncstat_t * sstat);
+
+/*
+ * Check the blocks of the projections of st against their crc32c from a
+ * thread with an idle I/O priority, reading at most rate bytes per second
+ * (0: no limit), a pass starting every interval seconds. Bad blocks are
+ * logged and appended to the STORAGE_BADBLOCKS_FILE of the root.
+ */
+int storage_scrub_start(storage_t * st, uint64_t rate, uint32_t interval);
+
+void storage_scrub_stat(storage_t * st, scrubstat_t * sstat);
+
+/* Directory of the projection file name (a fid string prefix is enough). */
+char *storage_fanout_dir(const char *root, int levels, const char *name,
+                         char *path);
+
+int storage_fanout_mkdirs(const char *root, int levels, const char *name);
+
+int storage_fanout_read(const char *root, int *levels);
+
+int storage_fanout_write(const char *root, int levels);
+
 int storage_stat(storage_t * st, sstat_t * sstat);
 
 #endif
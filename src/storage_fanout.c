@@ -0,0 +1,169 @@
+/*
+ Copyright (c) 2010 Fizians SAS. <http://www.fizians.com>
+ This file is part of Rozofs.
+
+ Rozofs is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 3 of the License,
+ or (at your option) any later version.
+
+ Rozofs is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see
+ <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Offline migration of a storage root to an other fan-out (directory
+ * levels of projection files, see storage.h). storaged must be stopped.
+ * Files are renamed in place, an interrupted migration can be run again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "storage.h"
+
+static int levels = -1;
+static unsigned long moved = 0;
+
+static int is_fanout_dir(const char *name) {
+    return strlen(name) == 2 && isxdigit(name[0]) && isxdigit(name[1]);
+}
+
+static int is_projection_file(const char *name) {
+    size_t len = strlen(name);
+
+    return len > 42 && name[36] == '-' &&
+        (strcmp(name + len - 5, ".bins") == 0 ||
+         strcmp(name + len - 5, ".crcs") == 0);
+}
+
+/* Move the projection files found under dir (depth levels below root) to
+ * their place in the new layout. */
+static int migrate(const char *root, const char *dir, int depth) {
+    int status = -1;
+    DIR *d = 0;
+    struct dirent *ep;
+    struct stat st;
+    char path[PATH_MAX];
+    char to[PATH_MAX];
+
+    if (!(d = opendir(dir))) {
+        fprintf(stderr, "can't open %s: %s\n", dir, strerror(errno));
+        goto out;
+    }
+    while ((ep = readdir(d))) {
+        sprintf(path, "%s/%s", dir, ep->d_name);
+        if (depth < STORAGE_FANOUT_MAX && is_fanout_dir(ep->d_name)) {
+            if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+                continue;
+            if (migrate(root, path, depth + 1) != 0)
+                goto out;
+            // directories out of the new layout are left empty
+            if (depth + 1 > levels)
+                rmdir(path);
+            continue;
+        }
+        if (!is_projection_file(ep->d_name))
+            continue;
+        storage_fanout_dir(root, levels, ep->d_name, to);
+        if (strcmp(to, dir) == 0)
+            continue;
+        if (storage_fanout_mkdirs(root, levels, ep->d_name) != 0) {
+            fprintf(stderr, "can't create directories for %s: %s\n", path,
+                    strerror(errno));
+            goto out;
+        }
+        strcat(to, "/");
+        strcat(to, ep->d_name);
+        if (rename(path, to) != 0) {
+            fprintf(stderr, "can't move %s to %s: %s\n", path, to,
+                    strerror(errno));
+            goto out;
+        }
+        moved++;
+    }
+    status = 0;
+out:
+    if (d)
+        closedir(d);
+    return status;
+}
+
+static void usage() {
+    printf("Rozofs storage fan-out migration - %s\n", VERSION);
+    printf("Usage: storage_fanout [OPTIONS] ROOT\n\n");
+    printf("\t-h, --help\tprint this message.\n");
+    printf("\t-l, --levels\tdirectory levels to migrate ROOT to (0 to %d).\n",
+           STORAGE_FANOUT_MAX);
+}
+
+int main(int argc, char *argv[]) {
+    int c;
+    int current;
+    char root[PATH_MAX];
+    static struct option long_options[] = {
+        {"help", no_argument, 0, 'h'},
+        {"levels", required_argument, 0, 'l'},
+        {0, 0, 0, 0}
+    };
+
+    while (1) {
+        int option_index = 0;
+        c = getopt_long(argc, argv, "hl:", long_options, &option_index);
+
+        if (c == -1)
+            break;
+
+        switch (c) {
+            case 'h':
+                usage();
+                exit(EXIT_SUCCESS);
+                break;
+            case 'l':
+                levels = atoi(optarg);
+                break;
+            default:
+                usage();
+                exit(EXIT_FAILURE);
+                break;
+        }
+    }
+
+    if (optind != argc - 1 || levels < 0 || levels > STORAGE_FANOUT_MAX) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+    if (!realpath(argv[optind], root)) {
+        fprintf(stderr, "storage_fanout failed: %s: %s\n", argv[optind],
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (storage_fanout_read(root, &current) != 0)
+        current = 0;
+    if (current != levels)
+        printf("migrating %s from %d to %d levels\n", root, current, levels);
+
+    if (migrate(root, root, 0) != 0 || storage_fanout_write(root, levels) != 0) {
+        fprintf(stderr, "storage_fanout failed: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    printf("%lu files moved\n", moved);
+
+    exit(EXIT_SUCCESS);
+}
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <errno.h>
 #include "log.h"
+#include "xmalloc.h"
 #include "sproto.h"
 #include "rpcclt.h"
 #include "storageclt.h"
@@ -38,6 +39,25 @@ int storageclt_initialize(storageclt_t * clt) {
         errno = xerrno;
         goto out;
     }
+    // the port mapper may give the port of another version: storaged
+    // speaking another one is told apart here rather than by its replies
+    if (!sp_null_2(0, clt->rpcclt.client)) {
+        struct rpc_err err;
+        clnt_geterr(clt->rpcclt.client, &err);
+        if (err.re_status == RPC_PROGVERSMISMATCH) {
+            severe("storage server %s speaks versions %lu to %lu of the"
+                   " protocol, not %d", clt->host,
+                   (unsigned long) err.re_vers.low,
+                   (unsigned long) err.re_vers.high, STORAGE_VERSION);
+            errno = EPROTONOSUPPORT;
+        } else {
+            warning("storageclt_initialize failed: no response from storage"
+                    " server: %s", clt->host);
+            errno = EPROTO;
+        }
+        storageclt_release(clt);
+        goto out;
+    }
     status = 0;
 out:
     return status;
@@ -54,7 +74,7 @@ int storageclt_stat(storageclt_t * clt, sstat_t * st) {
     sp_stat_ret_t *ret = 0;
     DEBUG_FUNCTION;
 
-    ret = sp_stat_1(&clt->sid, clt->rpcclt.client);
+    ret = sp_stat_2(&clt->sid, clt->rpcclt.client);
     if (ret == 0) {
         errno = EPROTO;
         goto out;
@@ -72,8 +92,9 @@ out:
     return status;
 }
 
-int storageclt_write(storageclt_t * clt, fid_t fid, tid_t tid, bid_t bid,
-                     uint32_t nrb, const bin_t * bins) {
+int storageclt_write(storageclt_t * clt, fid_t fid, tid_t tid, uint32_t psize,
+                     bid_t bid, uint32_t nrb, const bin_t * bins,
+                     const uint32_t * crcs) {
     int status = -1;
     sp_status_ret_t *ret = 0;
     sp_write_arg_t args;
@@ -82,11 +103,14 @@ int storageclt_write(storageclt_t * clt, fid_t fid, tid_t tid, bid_t bid,
     args.sid = clt->sid;
     memcpy(args.fid, fid, sizeof (uuid_t));
     args.tid = tid;
+    args.psize = psize;
     args.bid = bid;
     args.nrb = nrb;
-    args.bins.bins_len = nrb * rozofs_psizes[tid] * sizeof (bin_t);
+    args.bins.bins_len = nrb * psize * sizeof (bin_t);
     args.bins.bins_val = (char *) bins;
-    ret = sp_write_1(&args, clt->rpcclt.client);
+    args.crcs.crcs_len = crcs ? nrb : 0;
+    args.crcs.crcs_val = (uint32_t *) crcs;
+    ret = sp_write_2(&args, clt->rpcclt.client);
     if (ret == 0) {
         storageclt_release(clt);
         warning
@@ -108,8 +132,8 @@ out:
     return status;
 }
 
-int storageclt_read(storageclt_t * clt, fid_t fid, tid_t tid, bid_t bid,
-                    uint32_t nrb, bin_t * bins) {
+int storageclt_read(storageclt_t * clt, fid_t fid, tid_t tid, uint32_t psize,
+                    bid_t bid, uint32_t nrb, bin_t * bins, uint32_t * crcs) {
     int status = -1;
     sp_read_ret_t *ret = 0;
     sp_read_arg_t args;
@@ -118,9 +142,10 @@ int storageclt_read(storageclt_t * clt, fid_t fid, tid_t tid, bid_t bid,
     args.sid = clt->sid;
     memcpy(args.fid, fid, sizeof (fid_t));
     args.tid = tid;
+    args.psize = psize;
     args.bid = bid;
     args.nrb = nrb;
-    ret = sp_read_1(&args, clt->rpcclt.client);
+    ret = sp_read_2(&args, clt->rpcclt.client);
     if (ret == 0) {
         storageclt_release(clt);
         warning
@@ -135,10 +160,18 @@ int storageclt_read(storageclt_t * clt, fid_t fid, tid_t tid, bid_t bid,
                strerror(errno));
         goto out;
     }
-    // XXX ret->sp_read_ret_t_u.bins.bins_len is coherent
+    // XXX ret->sp_read_ret_t_u.rsp.bins.bins_len is coherent
     // XXX could we avoid memcpy ??
-    memcpy(bins, ret->sp_read_ret_t_u.bins.bins_val,
-           ret->sp_read_ret_t_u.bins.bins_len);
+    memcpy(bins, ret->sp_read_ret_t_u.rsp.bins.bins_val,
+           ret->sp_read_ret_t_u.rsp.bins.bins_len);
+    if (crcs) {
+        // blocks without a stored checksum read as 0
+        memset(crcs, 0, nrb * sizeof (uint32_t));
+        memcpy(crcs, ret->sp_read_ret_t_u.rsp.crcs.crcs_val,
+               (ret->sp_read_ret_t_u.rsp.crcs.crcs_len < nrb ?
+                ret->sp_read_ret_t_u.rsp.crcs.crcs_len : nrb) *
+               sizeof (uint32_t));
+    }
 
     status = 0;
 out:
@@ -147,9 +180,149 @@ out:
     return status;
 }
 
+static void storageclt_extents(storageclt_extent_t * extents, uint32_t n,
+                               sp_extent_t * args) {
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        memcpy(args[i].fid, extents[i].fid, sizeof (fid_t));
+        args[i].tid = extents[i].tid;
+        args[i].psize = extents[i].psize;
+        args[i].bid = extents[i].bid;
+        args[i].nrb = extents[i].nrb;
+    }
+}
+
+int storageclt_readv(storageclt_t * clt, storageclt_extent_t * extents,
+                     uint32_t n) {
+    int status = -1;
+    sp_readv_ret_t *ret = 0;
+    sp_readv_rsp_t *rsp;
+    sp_readv_arg_t args;
+    size_t len, off = 0, coff = 0;
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    args.sid = clt->sid;
+    args.extents.extents_len = n;
+    args.extents.extents_val = xmalloc(n * sizeof (sp_extent_t));
+    storageclt_extents(extents, n, args.extents.extents_val);
+    ret = sp_readv_2(&args, clt->rpcclt.client);
+    if (ret == 0) {
+        storageclt_release(clt);
+        warning("storageclt_readv failed: no response from storage server: %s",
+                clt->host);
+        errno = EPROTO;
+        goto out;
+    }
+    if (ret->status != 0) {
+        errno = ret->sp_readv_ret_t_u.error;
+        severe("storageclt_readv failed: storage read response failure (%s)",
+               strerror(errno));
+        goto out;
+    }
+    // the bins and crcs of the extents read follow each other
+    rsp = &ret->sp_readv_ret_t_u.rsp;
+    if (rsp->errors.errors_len != n) {
+        errno = EPROTO;
+        goto out;
+    }
+    for (i = 0; i < n; i++) {
+        if ((extents[i].error = rsp->errors.errors_val[i]) != 0)
+            continue;
+        len = extents[i].nrb * extents[i].psize * sizeof (bin_t);
+        if (off + len > rsp->bins.bins_len ||
+            coff + extents[i].nrb > rsp->crcs.crcs_len) {
+            errno = EPROTO;
+            goto out;
+        }
+        memcpy(extents[i].bins, rsp->bins.bins_val + off, len);
+        if (extents[i].crcs)
+            memcpy(extents[i].crcs, rsp->crcs.crcs_val + coff,
+                   extents[i].nrb * sizeof (uint32_t));
+        off += len;
+        coff += extents[i].nrb;
+    }
+
+    status = 0;
+out:
+    free(args.extents.extents_val);
+    if (ret)
+        xdr_free((xdrproc_t) xdr_sp_readv_ret_t, (char *) ret);
+    return status;
+}
+
+int storageclt_writev(storageclt_t * clt, storageclt_extent_t * extents,
+                      uint32_t n) {
+    int status = -1;
+    sp_writev_ret_t *ret = 0;
+    sp_writev_arg_t args;
+    size_t len, off = 0, coff = 0;
+    uint32_t i;
+    DEBUG_FUNCTION;
+
+    args.sid = clt->sid;
+    args.extents.extents_len = n;
+    args.extents.extents_val = xmalloc(n * sizeof (sp_extent_t));
+    storageclt_extents(extents, n, args.extents.extents_val);
+    // the bins of all the extents follow each other, so do their crcs
+    // when they all have some
+    args.bins.bins_len = 0;
+    args.crcs.crcs_len = 0;
+    for (i = 0; i < n; i++) {
+        args.bins.bins_len +=
+            extents[i].nrb * extents[i].psize * sizeof (bin_t);
+        args.crcs.crcs_len += extents[i].nrb;
+    }
+    for (i = 0; i < n; i++)
+        if (!extents[i].crcs)
+            args.crcs.crcs_len = 0;
+    args.bins.bins_val = xmalloc(args.bins.bins_len);
+    args.crcs.crcs_val = xmalloc(args.crcs.crcs_len * sizeof (uint32_t));
+    for (i = 0; i < n; i++) {
+        len = extents[i].nrb * extents[i].psize * sizeof (bin_t);
+        memcpy(args.bins.bins_val + off, extents[i].bins, len);
+        off += len;
+        if (args.crcs.crcs_len) {
+            memcpy(args.crcs.crcs_val + coff, extents[i].crcs,
+                   extents[i].nrb * sizeof (uint32_t));
+            coff += extents[i].nrb;
+        }
+    }
+    ret = sp_writev_2(&args, clt->rpcclt.client);
+    if (ret == 0) {
+        storageclt_release(clt);
+        warning("storageclt_writev failed: no response from storage server: %s",
+                clt->host);
+        errno = EPROTO;
+        goto out;
+    }
+    if (ret->status != 0) {
+        errno = ret->sp_writev_ret_t_u.error;
+        severe("storageclt_writev failed: storage write response failure"
+               " (%s)", strerror(errno));
+        goto out;
+    }
+    if (ret->sp_writev_ret_t_u.errors.errors_len != n) {
+        errno = EPROTO;
+        goto out;
+    }
+    for (i = 0; i < n; i++)
+        extents[i].error = ret->sp_writev_ret_t_u.errors.errors_val[i];
+
+    status = 0;
+out:
+    free(args.extents.extents_val);
+    free(args.bins.bins_val);
+    free(args.crcs.crcs_val);
+    if (ret)
+        xdr_free((xdrproc_t) xdr_sp_writev_ret_t, (char *) ret);
+    return status;
+}
 
 // XXX Never used
-int storageclt_truncate(storageclt_t * clt, fid_t fid, tid_t tid, bid_t bid) {
+int storageclt_truncate(storageclt_t * clt, fid_t fid, tid_t tid,
+                        uint32_t psize, bid_t bid) {
     int status = -1;
     sp_status_ret_t *ret = 0;
     sp_truncate_arg_t args;
@@ -158,8 +331,9 @@ int storageclt_truncate(storageclt_t * clt, fid_t fid, tid_t tid, bid_t bid) {
     args.sid = clt->sid;
     memcpy(args.fid, fid, sizeof (fid_t));
     args.tid = tid;
+    args.psize = psize;
     args.bid = bid;
-    ret = sp_truncate_1(&args, clt->rpcclt.client);
+    ret = sp_truncate_2(&args, clt->rpcclt.client);
     if (ret == 0) {
         errno = EPROTO;
         goto out;
@@ -183,7 +357,7 @@ int storageclt_remove(storageclt_t * clt, fid_t fid) {
 
     args.sid = clt->sid;
     memcpy(args.fid, fid, sizeof (fid_t));
-    ret = sp_remove_1(&args, clt->rpcclt.client);
+    ret = sp_remove_2(&args, clt->rpcclt.client);
     if (ret == 0) {
         errno = EPROTO;
         goto out;
@@ -32,19 +32,51 @@ typedef struct storageclt {
     rpcclt_t rpcclt;
 } storageclt_t;
 
+/*
+ * nrb blocks of psize bins from bid of a projection file, for the
+ * vectored calls. error is set by them, 0 when the extent was read or
+ * written.
+ */
+typedef struct storageclt_extent {
+    fid_t fid;
+    tid_t tid;
+    uint32_t psize;
+    bid_t bid;
+    uint32_t nrb;
+    bin_t *bins;
+    uint32_t *crcs;
+    int error;
+} storageclt_extent_t;
+
 int storageclt_initialize(storageclt_t * clt);
 
 void storageclt_release(storageclt_t * clt);
 
 int storageclt_stat(storageclt_t * clt, sstat_t * st);
 
-int storageclt_write(storageclt_t * clt, fid_t fid, tid_t tid, bid_t bid,
-                     uint32_t nrb, const bin_t * bins);
+/*
+ * crcs hold the crc32c of each of the nrb projection blocks, 0 for a block
+ * with no checksum. They may be null.
+ */
+int storageclt_write(storageclt_t * clt, fid_t fid, tid_t tid, uint32_t psize,
+                     bid_t bid, uint32_t nrb, const bin_t * bins,
+                     const uint32_t * crcs);
+
+int storageclt_read(storageclt_t * clt, fid_t fid, tid_t tid, uint32_t psize,
+                    bid_t bid, uint32_t nrb, bin_t * bins, uint32_t * crcs);
+
+/*
+ * Read or write n extents, of several files maybe, in one call. Fails
+ * when the call does. The crcs of the extents written may be null.
+ */
+int storageclt_readv(storageclt_t * clt, storageclt_extent_t * extents,
+                     uint32_t n);
 
-int storageclt_read(storageclt_t * clt, fid_t fid, tid_t tid, bid_t bid,
-                    uint32_t nrb, bin_t * bins);
+int storageclt_writev(storageclt_t * clt, storageclt_extent_t * extents,
+                      uint32_t n);
 
-int storageclt_truncate(storageclt_t * clt, fid_t fid, tid_t tid, bid_t bid);
+int storageclt_truncate(storageclt_t * clt, fid_t fid, tid_t tid,
+                        uint32_t psize, bid_t bid);
 
 int storageclt_remove(storageclt_t * clt, fid_t fid);
 
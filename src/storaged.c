@@ -31,6 +31,9 @@
 #include <unistd.h>
 #include <libintl.h>
 #include <sys/poll.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <netinet/in.h>
 #include <rpc/rpc.h>
 #include <getopt.h>
 #include <rpc/pmap_clnt.h>
@@ -45,12 +48,38 @@
 #include "sproto.h"
 
 #define STORAGED_PID_FILE "storaged.pid"
+// operations in flight in the io_uring of a storage
+#define STORAGED_RING_ENTRIES 256
+// roots of a storage
+#define STORAGED_ROOTS_MAX 64
 
 static char storaged_config_file[PATH_MAX] = STORAGED_DEFAULT_CONFIG;
 static storage_t *storaged_storages = 0;
 static uint16_t storaged_nrstorages = 0;
-extern void storage_program_1(struct svc_req *rqstp, SVCXPRT * ctl_svc);
-static SVCXPRT *storaged_svc = 0;
+static uint32_t storaged_fd_cache_size = 0; // for all storages
+static uint32_t storaged_fd_cache_shards = STORAGE_SHARDS;
+static int storaged_fanout = 0;
+static uint32_t storaged_remove_rate = 1000; // per storage and second
+static int storaged_io_uring = 0;
+static int storaged_durable = 0;
+static uint32_t storaged_sync_window = 0; // usec
+static uint32_t storaged_sync_batch = 64; // writes
+static uint32_t storaged_scrub_rate = 0; // MiB/s, 0: not scrubbed
+static uint32_t storaged_scrub_interval = 7; // days
+static uint32_t storaged_readahead_min = 128; // KiB
+static uint32_t storaged_readahead_max = 0; // KiB, 0: no read-ahead hints
+static int storaged_drop_behind = 0;
+extern void storage_program_2(struct svc_req *rqstp, SVCXPRT * ctl_svc);
+extern int sp_read_2_sendfile(SVCXPRT * xprt, struct svc_req *req,
+        struct rpc_msg *msg);
+extern void sp_release();
+static int storaged_sock = -1;
+// svcfd_create and svc_destroy update the rpc transports table
+static pthread_mutex_t storaged_svc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#ifndef RQCRED_SIZE
+#define RQCRED_SIZE 400
+#endif
 
 storage_t *storaged_lookup(sid_t sid) {
     storage_t *st = 0;
@@ -92,7 +121,8 @@ static int load_layout_conf(struct config_t *config) {
         goto out;
     }
 
-    if (rozofs_initialize(layout) != 0) {
+    // requests carry the size of their projections: only the layout matters
+    if (rozofs_initialize(layout, ROZOFS_BSIZE) != 0) {
         fprintf(stderr, "can't initialise rozofs layout: %s\n",
                 strerror(errno));
         fatal("can't initialise rozofs layout: %s", strerror(errno));
@@ -103,12 +133,163 @@ out:
     return status;
 }
 
+/*
+ * Open projection files cache settings (optional). By default the cache
+ * takes half of the open files limit, the other half is left to client
+ * connections: each cached projection file uses two descriptors.
+ */
+static int load_fd_cache_conf(struct config_t *config) {
+    int status = -1;
+    long int size;
+    long int shards;
+    struct rlimit rl;
+
+    // use all the descriptors allowed
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) != 0)
+            getrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    if (config_lookup_int(config, "fd_cache_size", &size)) {
+        if (size <= 0) {
+            errno = EINVAL;
+            fprintf(stderr, "invalid fd_cache_size: %ld\n", size);
+            severe("invalid fd_cache_size: %ld", size);
+            goto out;
+        }
+        storaged_fd_cache_size = size;
+    } else {
+        storaged_fd_cache_size = rl.rlim_cur == RLIM_INFINITY ?
+                STORAGE_SHARDS * 1024 : rl.rlim_cur / 4;
+    }
+    if (storaged_fd_cache_size * 2 > rl.rlim_cur) {
+        warning("fd_cache_size %u needs more than the %lu open files allowed",
+                storaged_fd_cache_size, (unsigned long) rl.rlim_cur);
+    }
+
+    if (config_lookup_int(config, "fd_cache_shards", &shards)) {
+        if (shards <= 0) {
+            errno = EINVAL;
+            fprintf(stderr, "invalid fd_cache_shards: %ld\n", shards);
+            severe("invalid fd_cache_shards: %ld", shards);
+            goto out;
+        }
+        storaged_fd_cache_shards = shards;
+    }
+
+    status = 0;
+out:
+    return status;
+}
+
 static int load_storages_conf(struct config_t *config) {
 
     int status = -1;
     int i = 0;
+    int r;
+    uint32_t csize;
+    long int fanout;
+    long int rate;
+    long int window;
+    long int batch;
+    long int scrub;
+    long int ra;
     struct config_setting_t *settings = NULL;
 
+    // directory levels of the storages (optional, flat by default)
+    if (config_lookup_int(config, "fanout", &fanout)) {
+        if (fanout < 0 || fanout > STORAGE_FANOUT_MAX) {
+            errno = EINVAL;
+            fprintf(stderr, "invalid fanout: %ld (max: %d)\n", fanout,
+                    STORAGE_FANOUT_MAX);
+            severe("invalid fanout: %ld (max: %d)", fanout,
+                    STORAGE_FANOUT_MAX);
+            goto out;
+        }
+        storaged_fanout = fanout;
+    }
+
+    // removes are queued and done at most remove_rate per second (optional)
+    if (config_lookup_int(config, "remove_rate", &rate)) {
+        if (rate < 0) {
+            errno = EINVAL;
+            fprintf(stderr, "invalid remove_rate: %ld\n", rate);
+            severe("invalid remove_rate: %ld", rate);
+            goto out;
+        }
+        storaged_remove_rate = rate;
+    }
+
+    // reads and writes through io_uring (optional)
+    config_lookup_bool(config, "io_uring", &storaged_io_uring);
+
+    // writes are acknowledged once synced, syncs are grouped (optional)
+    config_lookup_bool(config, "durable", &storaged_durable);
+    if (config_lookup_int(config, "sync_window", &window)) {
+        if (window < 0) {
+            errno = EINVAL;
+            fprintf(stderr, "invalid sync_window: %ld\n", window);
+            severe("invalid sync_window: %ld", window);
+            goto out;
+        }
+        storaged_sync_window = window;
+    }
+    if (config_lookup_int(config, "sync_batch", &batch)) {
+        if (batch <= 0) {
+            errno = EINVAL;
+            fprintf(stderr, "invalid sync_batch: %ld\n", batch);
+            severe("invalid sync_batch: %ld", batch);
+            goto out;
+        }
+        storaged_sync_batch = batch;
+    }
+
+    // blocks are checked against their checksums in the background
+    // (optional)
+    if (config_lookup_int(config, "scrub_rate", &scrub)) {
+        if (scrub < 0) {
+            errno = EINVAL;
+            fprintf(stderr, "invalid scrub_rate: %ld\n", scrub);
+            severe("invalid scrub_rate: %ld", scrub);
+            goto out;
+        }
+        storaged_scrub_rate = scrub;
+    }
+    if (config_lookup_int(config, "scrub_interval", &scrub)) {
+        if (scrub <= 0) {
+            errno = EINVAL;
+            fprintf(stderr, "invalid scrub_interval: %ld\n", scrub);
+            severe("invalid scrub_interval: %ld", scrub);
+            goto out;
+        }
+        storaged_scrub_interval = scrub;
+    }
+
+    // sequential reads are prefetched, their blocks dropped behind them
+    // (optional)
+    if (config_lookup_int(config, "readahead_min", &ra)) {
+        if (ra <= 0) {
+            errno = EINVAL;
+            fprintf(stderr, "invalid readahead_min: %ld\n", ra);
+            severe("invalid readahead_min: %ld", ra);
+            goto out;
+        }
+        storaged_readahead_min = ra;
+    }
+    if (config_lookup_int(config, "readahead_max", &ra)) {
+        if (ra < 0 || (ra > 0 && ra < storaged_readahead_min)) {
+            errno = EINVAL;
+            fprintf(stderr, "invalid readahead_max: %ld (min: %u)\n", ra,
+                    storaged_readahead_min);
+            severe("invalid readahead_max: %ld (min: %u)", ra,
+                    storaged_readahead_min);
+            goto out;
+        }
+        storaged_readahead_max = ra;
+    }
+    config_lookup_bool(config, "drop_behind", &storaged_drop_behind);
+
     if (!(settings = config_lookup(config, "storages"))) {
         errno = ENOKEY;
         fprintf(stderr, "can't locate the storages settings in conf file\n");
@@ -118,11 +299,21 @@ static int load_storages_conf(struct config_t *config) {
 
     storaged_storages =
             xmalloc(config_setting_length(settings) * sizeof (storage_t));
+    // the cache is shared out between storages
+    csize = storaged_fd_cache_size / config_setting_length(settings);
+    if (csize == 0)
+        csize = 1;
 
     for (i = 0; i < config_setting_length(settings); i++) {
         struct config_setting_t *ms = NULL;
+        struct config_setting_t *rs = NULL;
         long int sid;
         const char *root;
+        const char *roots[STORAGED_ROOTS_MAX];
+        int nroots = 0;
+        int containers;
+        int direct;
+        long int bcache;
 
         if (!(ms = config_setting_get_elem(settings, i))) {
             errno = EIO; //XXX
@@ -145,16 +336,42 @@ static int load_storages_conf(struct config_t *config) {
             goto out;
         }
 
-        if (config_setting_lookup_string(ms, "root", &root) == CONFIG_FALSE) {
+        // a root, or roots (disks) projections are spread over
+        if ((rs = config_setting_get_member(ms, "roots")) != NULL) {
+            nroots = config_setting_length(rs);
+            if (nroots == 0 || nroots > STORAGED_ROOTS_MAX) {
+                errno = EINVAL;
+                fprintf(stderr, "invalid number of roots for storage"
+                        " (idx=%d): %d (max: %d)\n", i, nroots,
+                        STORAGED_ROOTS_MAX);
+                severe("invalid number of roots for storage (idx=%d): %d"
+                        " (max: %d)", i, nroots, STORAGED_ROOTS_MAX);
+                goto out;
+            }
+            for (r = 0; r < nroots; r++) {
+                if (!(roots[r] = config_setting_get_string_elem(rs, r))) {
+                    errno = EINVAL;
+                    fprintf(stderr, "invalid root %d for storage (idx=%d)\n",
+                            r, i);
+                    severe("invalid root %d for storage (idx=%d)", r, i);
+                    goto out;
+                }
+            }
+            root = roots[0];
+        } else if (config_setting_lookup_string(ms, "root", &root) ==
+                CONFIG_FALSE) {
             errno = ENOKEY;
             fprintf(stderr, "cant't look up root path for storage (idx=%d)\n",
                     i);
             severe("cant't look up root path for storage (idx=%d)", i);
             goto out;
+        } else {
+            roots[nroots++] = root;
         }
 
-        if (storage_initialize(storaged_storages + i, (uint16_t) sid, root) !=
-                0) {
+        if (storage_initialize_roots(storaged_storages + i, (uint16_t) sid,
+                roots, nroots, storaged_fanout, csize,
+                storaged_fd_cache_shards) != 0) {
             fprintf(stderr,
                     "can't initialize storage (sid:%ld) with path %s: %s\n",
                     sid, root, strerror(errno));
@@ -162,8 +379,50 @@ static int load_storages_conf(struct config_t *config) {
                     root, strerror(errno));
             goto out;
         }
-
         storaged_nrstorages++;
+
+        // bins read and written with O_DIRECT (optional)
+        if (config_setting_lookup_bool(ms, "direct", &direct) ==
+                CONFIG_TRUE && direct &&
+                storage_direct_open(storaged_storages + i) != 0) {
+            fprintf(stderr, "can't use O_DIRECT on storage (sid:%ld): %s\n",
+                    sid, strerror(errno));
+            severe("can't use O_DIRECT on storage (sid:%ld): %s", sid,
+                    strerror(errno));
+            goto out;
+        }
+
+        // small projections in a container (optional)
+        if (config_setting_lookup_bool(ms, "containers", &containers) ==
+                CONFIG_TRUE && containers &&
+                storage_ct_open(storaged_storages + i) != 0) {
+            fprintf(stderr, "can't open container of storage (sid:%ld): %s\n",
+                    sid, strerror(errno));
+            severe("can't open container of storage (sid:%ld): %s", sid,
+                    strerror(errno));
+            goto out;
+        }
+
+        // hot blocks kept in memory, in MiB (optional)
+        if (config_setting_lookup_int(ms, "block_cache", &bcache) ==
+                CONFIG_TRUE && bcache != 0) {
+            if (bcache < 0) {
+                errno = EINVAL;
+                fprintf(stderr, "invalid block cache size for storage"
+                        " (sid:%ld): %ld\n", sid, bcache);
+                severe("invalid block cache size for storage (sid:%ld): %ld",
+                        sid, bcache);
+                goto out;
+            }
+            storage_bc_open(storaged_storages + i, (uint64_t) bcache << 20);
+        }
+
+        if (storaged_readahead_max && storage_ra_open(storaged_storages + i,
+                storaged_readahead_min << 10, storaged_readahead_max << 10,
+                storaged_drop_behind) != 0) {
+            severe("storage (sid:%ld): can't give read-ahead hints: %s", sid,
+                    strerror(errno));
+        }
     }
     status = 0;
 out:
@@ -200,6 +459,10 @@ static int load_conf_file() {
         goto out;
     }
 
+    if (load_fd_cache_conf(&config) != 0) {
+        goto out;
+    }
+
     if (load_storages_conf(&config) != 0) {
         goto out;
     }
@@ -226,64 +489,259 @@ out:
     return status;
 }
 
+/*
+ * Dispatch the requests received on xprt, as svc_getreq does but without
+ * going through the rpc library global state: connections are served by
+ * their own threads. Returns -1 when the connection is closed.
+ */
+static int storaged_getreq(SVCXPRT * xprt) {
+    struct rpc_msg msg;
+    struct svc_req req;
+    char cred[2 * MAX_AUTH_BYTES + RQCRED_SIZE];
+    enum xprt_stat stat;
+    enum auth_stat why;
+
+    msg.rm_call.cb_cred.oa_base = cred;
+    msg.rm_call.cb_verf.oa_base = &cred[MAX_AUTH_BYTES];
+    req.rq_clntcred = &cred[2 * MAX_AUTH_BYTES];
+
+    do {
+        if (SVC_RECV(xprt, &msg)) {
+            req.rq_xprt = xprt;
+            req.rq_prog = msg.rm_call.cb_prog;
+            req.rq_vers = msg.rm_call.cb_vers;
+            req.rq_proc = msg.rm_call.cb_proc;
+            req.rq_cred = msg.rm_call.cb_cred;
+
+            if ((why = _authenticate(&req, &msg)) != AUTH_OK)
+                svcerr_auth(xprt, why);
+            else if (req.rq_prog != STORAGE_PROGRAM)
+                svcerr_noprog(xprt);
+            else if (req.rq_vers != STORAGE_VERSION)
+                svcerr_progvers(xprt, STORAGE_VERSION, STORAGE_VERSION);
+            else if (req.rq_proc == SP_READ) {
+                // bins are sent from their file
+                if (sp_read_2_sendfile(xprt, &req, &msg) != 0)
+                    return -1;
+            } else
+                storage_program_2(&req, xprt);
+        }
+        stat = SVC_STAT(xprt);
+    } while (stat == XPRT_MOREREQS);
+
+    return stat == XPRT_DIED ? -1 : 0;
+}
+
+/* Serve one client connection until it is closed: a slow disk access only
+ * delays the requests of this connection. */
+static void *storaged_connection(void *v) {
+    int sock = (int) (intptr_t) v;
+    struct pollfd pfd;
+    SVCXPRT *xprt;
+    DEBUG_FUNCTION;
+
+    pthread_mutex_lock(&storaged_svc_lock);
+    xprt = svcfd_create(sock, ROZOFS_RPC_BUFFER_SIZE, ROZOFS_RPC_BUFFER_SIZE);
+    pthread_mutex_unlock(&storaged_svc_lock);
+    if (!xprt) {
+        severe("can't create connection transport.");
+        close(sock);
+        return 0;
+    }
+
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    for (;;) {
+        // requests are only received when some are pending: the transport
+        // would drop a connection idle for too long otherwise
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            severe("poll failed: %s", strerror(errno));
+            break;
+        }
+        if (storaged_getreq(xprt) != 0)
+            break;
+    }
+
+    pthread_mutex_lock(&storaged_svc_lock);
+    svc_destroy(xprt);
+    pthread_mutex_unlock(&storaged_svc_lock);
+    // the last replies of the thread
+    sp_release();
+    return 0;
+}
+
 static void on_start() {
     int sock;
     int one = 1;
+    struct sockaddr_in addr;
+    socklen_t len = sizeof (addr);
+    pthread_attr_t attr;
+    pthread_t thread;
+    storage_t *st;
     DEBUG_FUNCTION;
 
-    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-
-    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (char *) &one, sizeof (int));
-    setsockopt(sock, SOL_TCP, TCP_DEFER_ACCEPT, (char *) &one, sizeof (int));
-    setsockopt(sock, SOL_TCP, TCP_NODELAY, (char *) &one, sizeof (int));
+    // threads don't survive the daemon fork: start them here
+    for (st = storaged_storages; st != storaged_storages + storaged_nrstorages;
+            st++) {
+        if (storage_rmq_start(st, storaged_remove_rate) != 0) {
+            severe("storage %u: can't start removes queue: %s,"
+                    " removes are done synchronously", st->sid,
+                    strerror(errno));
+        }
+        if (storage_ct_start(st) != 0) {
+            severe("storage %u: can't start container compaction: %s",
+                    st->sid, strerror(errno));
+        }
+        if (storaged_io_uring &&
+                storage_ring_open(st, STORAGED_RING_ENTRIES) != 0) {
+            severe("storage %u: can't use io_uring: %s,"
+                    " pread and pwrite are used", st->sid, strerror(errno));
+        }
+        if (storaged_durable && storage_sync_start(st, storaged_sync_window,
+                storaged_sync_batch) != 0) {
+            severe("storage %u: can't start syncs: %s, writes are not"
+                    " durable", st->sid, strerror(errno));
+        }
+        if (storaged_scrub_rate && storage_scrub_start(st,
+                (uint64_t) storaged_scrub_rate << 20,
+                storaged_scrub_interval * 86400) != 0) {
+            severe("storage %u: can't start scrubber: %s", st->sid,
+                    strerror(errno));
+        }
+    }
 
-    // SET NONBLOCK
-    int value = 1;
-    int oldflags = fcntl(sock, F_GETFL, 0);
-    /* If reading the flags failed, return error indication now. */
-    if (oldflags < 0) {
+    if ((storaged_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+        fatal("can't create socket: %s", strerror(errno));
         return;
     }
-    /* Set just the flag we want to set. */
-    if (value != 0) {
-        oldflags |= O_NONBLOCK;
-    } else {
-        oldflags &= ~O_NONBLOCK;
-    }
-    /* Store modified flag word in the descriptor. */
-    fcntl(sock, F_SETFL, oldflags);
 
-    if ((storaged_svc =
-            svctcp_create(sock, ROZOFS_RPC_BUFFER_SIZE,
-            ROZOFS_RPC_BUFFER_SIZE)) == NULL) {
-        fatal("can't create service.");
+    setsockopt(storaged_sock, SOL_SOCKET, SO_REUSEADDR, (char *) &one,
+            sizeof (int));
+    setsockopt(storaged_sock, SOL_TCP, TCP_DEFER_ACCEPT, (char *) &one,
+            sizeof (int));
+    setsockopt(storaged_sock, SOL_TCP, TCP_NODELAY, (char *) &one,
+            sizeof (int));
+
+    memset(&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    if (bindresvport(storaged_sock, &addr) != 0) {
+        addr.sin_port = 0;
+        if (bind(storaged_sock, (struct sockaddr *) &addr, sizeof (addr))
+                != 0) {
+            fatal("can't bind socket: %s", strerror(errno));
+            return;
+        }
+    }
+    if (getsockname(storaged_sock, (struct sockaddr *) &addr, &len) != 0 ||
+            listen(storaged_sock, SOMAXCONN) != 0) {
+        fatal("can't listen: %s", strerror(errno));
         return;
     }
 
     pmap_unset(STORAGE_PROGRAM, STORAGE_VERSION); // in case !
 
-    if (!svc_register
-            (storaged_svc, STORAGE_PROGRAM, STORAGE_VERSION, storage_program_1,
-            IPPROTO_TCP)) {
+    if (!pmap_set(STORAGE_PROGRAM, STORAGE_VERSION, IPPROTO_TCP,
+            ntohs(addr.sin_port))) {
         fatal("can't register service : %s", strerror(errno));
         return;
     }
 
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
     info("running.");
-    svc_run();
+    // one thread per client connection
+    for (;;) {
+        if ((sock = accept(storaged_sock, NULL, NULL)) < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno == EBADF || errno == EINVAL) // stopped
+                break;
+            severe("accept failed: %s", strerror(errno));
+            continue;
+        }
+        setsockopt(sock, SOL_TCP, TCP_NODELAY, (char *) &one, sizeof (int));
+        if ((errno = pthread_create(&thread, &attr, storaged_connection,
+                (void *) (intptr_t) sock)) != 0) {
+            severe("can't create connection thread: %s", strerror(errno));
+            close(sock);
+        }
+    }
+    pthread_attr_destroy(&attr);
+}
+
+static void on_hup() {
+    storage_t *st;
+    pfcstat_t cstat;
+    rmqstat_t qstat;
+    ctstat_t ctstat;
+    syncstat_t sstat;
+    scrubstat_t bstat;
+    bcstat_t hstat;
+    rastat_t rstat;
+    DEBUG_FUNCTION;
+
+    for (st = storaged_storages; st != storaged_storages + storaged_nrstorages;
+            st++) {
+        storage_cache_stat(st, &cstat);
+        info("storage %u: %u/%u open files, %" PRIu64 " hits, %" PRIu64
+                " misses, %" PRIu64 " evictions", st->sid, cstat.size,
+                cstat.max, cstat.hits, cstat.misses, cstat.evictions);
+        storage_rmq_stat(st, &qstat);
+        info("storage %u: %" PRIu64 " queued removes, %" PRIu64 " removed",
+                st->sid, qstat.depth, qstat.removed);
+        if (storage_ct_stat(st, &ctstat)) {
+            info("storage %u: %" PRIu64 " projections in %u container"
+                    " segments, %" PRIu64 "/%" PRIu64 " bytes dead, %" PRIu64
+                    " compacted", st->sid, ctstat.projections,
+                    ctstat.segments, ctstat.dead, ctstat.size,
+                    ctstat.compacted);
+        }
+        if (storage_bc_stat(st, &hstat)) {
+            info("storage %u: %" PRIu64 "/%" PRIu64 " bytes of cached blocks,"
+                    " %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hits), %"
+                    PRIu64 " evictions", st->sid, hstat.size, hstat.max,
+                    hstat.hits, hstat.misses, hstat.hits + hstat.misses ?
+                    100.0 * hstat.hits / (hstat.hits + hstat.misses) : 0.0,
+                    hstat.evictions);
+        }
+        if (storaged_readahead_max) {
+            storage_ra_stat(st, &rstat);
+            info("storage %u: %" PRIu64 " read streams, %" PRIu64
+                    " prefetch hits, %" PRIu64 " bytes prefetched, %" PRIu64
+                    " dropped", st->sid, rstat.streams, rstat.hits,
+                    rstat.prefetched, rstat.dropped);
+        }
+        if (storaged_durable) {
+            storage_sync_stat(st, &sstat);
+            info("storage %u: %" PRIu64 " durable writes in %" PRIu64
+                    " batches, %" PRIu64 " files and %" PRIu64
+                    " directories synced", st->sid, sstat.writes,
+                    sstat.batches, sstat.files, sstat.dirs);
+        }
+        if (storaged_scrub_rate) {
+            storage_scrub_stat(st, &bstat);
+            info("storage %u: %" PRIu64 " scrub passes, %" PRIu64
+                    " files and %" PRIu64 " bytes checked, %" PRIu64
+                    " bad blocks", st->sid, bstat.passes, bstat.files,
+                    bstat.bytes, bstat.bad);
+        }
+    }
 }
 
 static void on_stop() {
     DEBUG_FUNCTION;
 
-    svc_exit();
-    svc_unregister(STORAGE_PROGRAM, STORAGE_VERSION);
-    pmap_unset(STORAGE_PROGRAM, STORAGE_VERSION);
-    if (storaged_svc) {
-        svc_destroy(storaged_svc);
-        storaged_svc = NULL;
+    if (storaged_sock >= 0) {
+        shutdown(storaged_sock, SHUT_RDWR);
+        close(storaged_sock);
+        storaged_sock = -1;
     }
-    storaged_release();
+    pmap_unset(STORAGE_PROGRAM, STORAGE_VERSION);
+    // connection threads may still be using the storages: they are left
+    // to the process exit
     rozofs_release();
     info("stopped.");
     closelog();
@@ -340,12 +798,13 @@ int main(int argc, char *argv[]) {
 
     if (storaged_initialize() != 0) {
         fprintf(stderr, "storaged start failed\n");
+        storaged_release();
         exit(EXIT_FAILURE);
     }
 
     openlog("storaged", LOG_PID, LOG_DAEMON);
 
-    daemon_start(STORAGED_PID_FILE, on_start, on_stop, NULL);
+    daemon_start(STORAGED_PID_FILE, on_start, on_stop, on_hup);
 
     exit(0);
 }
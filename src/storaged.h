@@ -19,5 +19,16 @@
 
 #include <uuid/uuid.h>
 #include "storage.h"
+#include "sproto.h"
+
+// bins of a call at most: the projections of a client buffer (8 MiB at
+// most) with room to spare
+#define STORAGED_BINS_MAX (16 * 1024 * 1024)
 
 storage_t *storaged_lookup(sid_t sid);
+
+/*
+ * Number of the extents of a vectored call from e following each other
+ * in the same projection file: they are read or written at once.
+ */
+uint32_t sp_extents_run(const sp_extent_t * e, uint32_t n);
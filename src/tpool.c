@@ -0,0 +1,308 @@
+/*
+  Copyright (c) 2010 Fizians SAS. <http://www.fizians.com>
+  This file is part of Rozofs.
+
+  Rozofs is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3 of the License,
+  or (at your option) any later version.
+
+  Rozofs is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "log.h"
+#include "xmalloc.h"
+#include "rozofs.h"
+#include "crc32c.h"
+#include "tpool.h"
+
+// chunks are a multiple of the widest inverse kernel lanes
+#define TPOOL_CHUNK_ALIGN 4
+
+typedef struct tpool_job {
+    int inverse;
+    pxl_t *support;
+    int rows;
+    int cols;
+    int np;
+    const projection_t *projections;
+    uint32_t **crcs;            // per projection block checksums, or 0
+    int n;
+    int chunk;                  // blocks per chunk
+    int nchunks;
+    int next;                   // next chunk to run
+    int done;                   // chunks finished
+} tpool_job_t;
+
+typedef struct tpool_thread {
+    pthread_t thread;
+    int index;
+    uint64_t blocks;            // since last report
+    uint64_t busy;              // usec, since last report
+} tpool_thread_t;
+
+static struct tpool {
+    int nthreads;
+    tpool_thread_t *threads;    // threads[0] accounts for the callers
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    pthread_mutex_t submit;     // one job at a time
+    tpool_job_t *job;
+    int stop;
+    struct timeval since;       // last report
+} tpool = {
+    .nthreads = 0,
+    .threads = 0,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .submit = PTHREAD_MUTEX_INITIALIZER,
+    .job = 0,
+    .stop = 0
+};
+
+static uint64_t tpool_usec(const struct timeval *from, const struct timeval *to) {
+    return (to->tv_sec - from->tv_sec) * 1000000LL +
+        (to->tv_usec - from->tv_usec);
+}
+
+/* Must be called with tpool.lock held. */
+static void tpool_report() {
+    struct timeval now;
+    uint64_t elapse;
+    int i;
+
+    gettimeofday(&now, NULL);
+    elapse = tpool_usec(&tpool.since, &now);
+    if (elapse == 0)
+        return;
+    for (i = 0; i < tpool.nthreads; i++) {
+        tpool_thread_t *t = tpool.threads + i;
+        info("transform thread %d: %" PRIu64 " blocks, %.1f%% busy", i,
+             t->blocks, 100.0 * t->busy / elapse);
+        t->blocks = t->busy = 0;
+    }
+    tpool.since = now;
+}
+
+/* Forward blocks [b, b + n) one at a time, checksumming each projection
+ * block right after it is transformed, while its bins are still in cache. */
+static void tpool_forward_crcs(const pxl_t * support, int rows, int cols,
+                               int np, const projection_t * projections,
+                               uint32_t ** crcs, int b, int n) {
+    projection_t block[np];
+    int i;
+
+    for (; n > 0; b++, n--) {
+        for (i = 0; i < np; i++) {
+            block[i] = projections[i];
+            block[i].bins += b * block[i].size;
+        }
+        rozofs_transform->forward(support + b * rows * cols, rows, cols, np,
+                                  block, 1);
+        for (i = 0; i < np; i++)
+            crcs[i][b] = crc32c(0, block[i].bins,
+                                block[i].size * sizeof (bin_t));
+    }
+}
+
+/* Run chunk c of job, called without tpool.lock held. */
+static uint64_t tpool_run(tpool_job_t * job, int c, int *blocks) {
+    projection_t projections[job->np];
+    struct timeval tic, toc;
+    int b = c * job->chunk;
+    int i;
+
+    *blocks = job->n - b < job->chunk ? job->n - b : job->chunk;
+    for (i = 0; i < job->np; i++) {
+        projections[i] = job->projections[i];
+        projections[i].bins += b * projections[i].size;
+    }
+
+    gettimeofday(&tic, NULL);
+    if (job->inverse)
+        rozofs_transform->inverse(job->support + b * job->rows * job->cols,
+                                  job->rows, job->cols, job->np, projections,
+                                  *blocks);
+    else if (job->crcs)
+        tpool_forward_crcs(job->support, job->rows, job->cols, job->np,
+                           job->projections, job->crcs, b, *blocks);
+    else
+        rozofs_transform->forward(job->support + b * job->rows * job->cols,
+                                  job->rows, job->cols, job->np, projections,
+                                  *blocks);
+    gettimeofday(&toc, NULL);
+
+    return tpool_usec(&tic, &toc);
+}
+
+/* Run chunks of the current job while there are some left.
+ * Must be called with tpool.lock held. */
+static void tpool_work(tpool_thread_t * t) {
+    tpool_job_t *job = tpool.job;
+
+    while (job->next < job->nchunks) {
+        int c = job->next++;
+        int blocks;
+        uint64_t busy;
+
+        pthread_mutex_unlock(&tpool.lock);
+        busy = tpool_run(job, c, &blocks);
+        pthread_mutex_lock(&tpool.lock);
+
+        t->blocks += blocks;
+        t->busy += busy;
+        if (++job->done == job->nchunks)
+            pthread_cond_broadcast(&tpool.done);
+    }
+}
+
+static void *tpool_thread(void *v) {
+    tpool_thread_t *t = (tpool_thread_t *) v;
+
+    pthread_mutex_lock(&tpool.lock);
+    for (;;) {
+        while (!tpool.stop &&
+               (!tpool.job || tpool.job->next == tpool.job->nchunks))
+            pthread_cond_wait(&tpool.work, &tpool.lock);
+        if (tpool.stop)
+            break;
+        tpool_work(t);
+    }
+    pthread_mutex_unlock(&tpool.lock);
+
+    return 0;
+}
+
+int tpool_initialize(int nthreads) {
+    int status = -1;
+    int i;
+    DEBUG_FUNCTION;
+
+    if (nthreads < 1 || nthreads > TPOOL_MAX_THREADS) {
+        errno = EINVAL;
+        goto out;
+    }
+
+    tpool.threads = xcalloc(nthreads, sizeof (tpool_thread_t));
+    tpool.stop = 0;
+    gettimeofday(&tpool.since, NULL);
+    tpool.nthreads = 1;
+    for (i = 1; i < nthreads; i++) {
+        tpool.threads[i].index = i;
+        if ((errno = pthread_create(&tpool.threads[i].thread, NULL,
+                                    tpool_thread, tpool.threads + i)) != 0) {
+            severe("can't create transform thread: %s", strerror(errno));
+            tpool_release();
+            goto out;
+        }
+        tpool.nthreads++;
+    }
+
+    status = 0;
+out:
+    return status;
+}
+
+void tpool_release() {
+    int i;
+    DEBUG_FUNCTION;
+
+    if (!tpool.threads)
+        return;
+
+    pthread_mutex_lock(&tpool.lock);
+    tpool.stop = 1;
+    pthread_cond_broadcast(&tpool.work);
+    tpool_report();
+    pthread_mutex_unlock(&tpool.lock);
+
+    for (i = 1; i < tpool.nthreads; i++)
+        pthread_join(tpool.threads[i].thread, NULL);
+
+    free(tpool.threads);
+    tpool.threads = 0;
+    tpool.nthreads = 0;
+}
+
+static void tpool_submit(int inverse, pxl_t * support, int rows, int cols,
+                         int np, const projection_t * projections,
+                         uint32_t ** crcs, int n) {
+    tpool_job_t job;
+    struct timeval now;
+    int chunk;
+
+    chunk = (n + tpool.nthreads - 1) / tpool.nthreads;
+    chunk = (chunk + TPOOL_CHUNK_ALIGN - 1) & ~(TPOOL_CHUNK_ALIGN - 1);
+
+    job.inverse = inverse;
+    job.support = support;
+    job.rows = rows;
+    job.cols = cols;
+    job.np = np;
+    job.projections = projections;
+    job.crcs = crcs;
+    job.n = n;
+    job.chunk = chunk;
+    job.nchunks = (n + chunk - 1) / chunk;
+    job.next = 0;
+    job.done = 0;
+
+    pthread_mutex_lock(&tpool.submit);
+    pthread_mutex_lock(&tpool.lock);
+    tpool.job = &job;
+    pthread_cond_broadcast(&tpool.work);
+    // the caller takes its share rather than waiting idle
+    tpool_work(tpool.threads);
+    while (job.done < job.nchunks)
+        pthread_cond_wait(&tpool.done, &tpool.lock);
+    tpool.job = 0;
+
+    gettimeofday(&now, NULL);
+    if (now.tv_sec - tpool.since.tv_sec >= TPOOL_REPORT_INTERVAL)
+        tpool_report();
+    pthread_mutex_unlock(&tpool.lock);
+    pthread_mutex_unlock(&tpool.submit);
+}
+
+void tpool_forward(const pxl_t * support, int rows, int cols, int np,
+                   projection_t * projections, uint32_t ** crcs, int n) {
+    DEBUG_FUNCTION;
+
+    if (tpool.nthreads < 2 || n <= TPOOL_CHUNK_ALIGN) {
+        if (crcs)
+            tpool_forward_crcs(support, rows, cols, np, projections, crcs, 0,
+                               n);
+        else
+            rozofs_transform->forward(support, rows, cols, np, projections,
+                                      n);
+        return;
+    }
+    tpool_submit(0, (pxl_t *) support, rows, cols, np, projections, crcs, n);
+}
+
+void tpool_inverse(pxl_t * support, int rows, int cols, int np,
+                   const projection_t * projections, int n) {
+    DEBUG_FUNCTION;
+
+    if (tpool.nthreads < 2 || n <= TPOOL_CHUNK_ALIGN) {
+        rozofs_transform->inverse(support, rows, cols, np, projections, n);
+        return;
+    }
+    tpool_submit(1, support, rows, cols, np, projections, 0, n);
+}
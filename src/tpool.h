@@ -0,0 +1,53 @@
+/*
+  Copyright (c) 2010 Fizians SAS. <http://www.fizians.com>
+  This file is part of Rozofs.
+
+  Rozofs is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published
+  by the Free Software Foundation; either version 3 of the License,
+  or (at your option) any later version.
+
+  Rozofs is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see
+  <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TPOOL_H
+#define _TPOOL_H
+
+#include "transform.h"
+
+/*
+ * Transform thread pool: the blocks of a rozofs_transform forward or inverse
+ * call are split in chunks, run by the pool threads and by the calling
+ * thread.
+ */
+
+#define TPOOL_MAX_THREADS 64
+
+// seconds between two logs of the threads utilization
+#define TPOOL_REPORT_INTERVAL 60
+
+/*
+ * nthreads counts the calling thread: 1 transforms inline.
+ */
+int tpool_initialize(int nthreads);
+
+void tpool_release();
+
+/*
+ * When crcs is not null, crcs[i][b] receives the crc32c of the bins of block
+ * b of projection i.
+ */
+void tpool_forward(const pxl_t * support, int rows, int cols, int np,
+                   projection_t * projections, uint32_t ** crcs, int n);
+
+void tpool_inverse(pxl_t * support, int rows, int cols, int np,
+                   const projection_t * projections, int n);
+
+#endif
@@ -21,58 +21,238 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
-#include <math.h>
 
 #include "log.h"
 #include "xmalloc.h"
 #include "transform.h"
 
-void transform_forward(const bin_t * support, int rows, int cols, int np,
-                       projection_t * projections) {
-    int *offsets;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRANSFORM_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*forward_kernel_t) (const pxl_t * support, int rows, int cols,
+                                  int np, const projection_t * projections,
+                                  bin_t ** bases, const pxl_t * next);
+
+static const char *kernel_names[] = { "scalar", "sse2", "avx2" };
+
+/*
+ * Every kernel makes a single pass over the support: each row is read once
+ * and xored into the bins of all projections at its row offset.
+ * bases[i] points to the bin of projection i receiving pixel (0, 0).
+ * next is the support of the following block, prefetched on the way.
+ */
+static void forward_scalar(const pxl_t * support, int rows, int cols, int np,
+                           const projection_t * projections, bin_t ** bases,
+                           const pxl_t * next) {
     int i, l, k;
-    DEBUG_FUNCTION;
 
-    offsets = xcalloc(np, sizeof (int));
-    for (i = 0; i < np; i++) {
-        offsets[i] =
-            projections[i].angle.p <
-            0 ? (rows - 1) * projections[i].angle.p : 0;
-        memset(projections[i].bins, 0, projections[i].size * sizeof (bin_t));
+    for (i = 0; i < np; i++)
+        memcpy(bases[i], support, cols * sizeof (pxl_t));
+    for (k = 0; k < cols; k += 8)
+        __builtin_prefetch(next + k);
+
+    for (l = 1; l < rows; l++) {
+        const pxl_t *ppix = support + l * cols;
+        for (k = 0; k < cols; k += 8)
+            __builtin_prefetch(next + l * cols + k);
+        for (i = 0; i < np; i++) {
+            bin_t *pbin = bases[i] + l * projections[i].angle.p;
+            for (k = 0; k < cols; k += 8) {
+                pbin[k] ^= ppix[k];
+                pbin[k + 1] ^= ppix[k + 1];
+                pbin[k + 2] ^= ppix[k + 2];
+                pbin[k + 3] ^= ppix[k + 3];
+                pbin[k + 4] ^= ppix[k + 4];
+                pbin[k + 5] ^= ppix[k + 5];
+                pbin[k + 6] ^= ppix[k + 6];
+                pbin[k + 7] ^= ppix[k + 7];
+            }
+        }
+    }
+}
+
+#ifdef TRANSFORM_X86
+__attribute__ ((target("sse2")))
+static void forward_sse2(const pxl_t * support, int rows, int cols, int np,
+                         const projection_t * projections, bin_t ** bases,
+                         const pxl_t * next) {
+    bin_t *rbins[np];
+    int i, l, k;
+
+    for (k = 0; k < cols; k += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (support + k));
+        __m128i b = _mm_loadu_si128((const __m128i *) (support + k + 2));
+        __m128i c = _mm_loadu_si128((const __m128i *) (support + k + 4));
+        __m128i d = _mm_loadu_si128((const __m128i *) (support + k + 6));
+        __builtin_prefetch(next + k);
+        for (i = 0; i < np; i++) {
+            __m128i *pbin = (__m128i *) (bases[i] + k);
+            _mm_storeu_si128(pbin, a);
+            _mm_storeu_si128(pbin + 1, b);
+            _mm_storeu_si128(pbin + 2, c);
+            _mm_storeu_si128(pbin + 3, d);
+        }
+    }
+
+    for (l = 1; l < rows; l++) {
+        const pxl_t *ppix = support + l * cols;
+        for (i = 0; i < np; i++)
+            rbins[i] = bases[i] + l * projections[i].angle.p;
+        for (k = 0; k < cols; k += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i *) (ppix + k));
+            __m128i b = _mm_loadu_si128((const __m128i *) (ppix + k + 2));
+            __m128i c = _mm_loadu_si128((const __m128i *) (ppix + k + 4));
+            __m128i d = _mm_loadu_si128((const __m128i *) (ppix + k + 6));
+            __builtin_prefetch(next + l * cols + k);
+            for (i = 0; i < np; i++) {
+                __m128i *pbin = (__m128i *) (rbins[i] + k);
+                _mm_storeu_si128(pbin,
+                                 _mm_xor_si128(_mm_loadu_si128(pbin), a));
+                _mm_storeu_si128(pbin + 1,
+                                 _mm_xor_si128(_mm_loadu_si128(pbin + 1), b));
+                _mm_storeu_si128(pbin + 2,
+                                 _mm_xor_si128(_mm_loadu_si128(pbin + 2), c));
+                _mm_storeu_si128(pbin + 3,
+                                 _mm_xor_si128(_mm_loadu_si128(pbin + 3), d));
+            }
+        }
+    }
+}
+
+__attribute__ ((target("avx2")))
+static void forward_avx2(const pxl_t * support, int rows, int cols, int np,
+                         const projection_t * projections, bin_t ** bases,
+                         const pxl_t * next) {
+    bin_t *rbins[np];
+    int i, l, k;
+
+    for (k = 0; k < cols; k += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (support + k));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (support + k + 4));
+        __builtin_prefetch(next + k);
+        for (i = 0; i < np; i++) {
+            __m256i *pbin = (__m256i *) (bases[i] + k);
+            _mm256_storeu_si256(pbin, a);
+            _mm256_storeu_si256(pbin + 1, b);
+        }
     }
 
+    for (l = 1; l < rows; l++) {
+        const pxl_t *ppix = support + l * cols;
+        for (i = 0; i < np; i++)
+            rbins[i] = bases[i] + l * projections[i].angle.p;
+        for (k = 0; k < cols; k += 8) {
+            __m256i a = _mm256_loadu_si256((const __m256i *) (ppix + k));
+            __m256i b = _mm256_loadu_si256((const __m256i *) (ppix + k + 4));
+            __builtin_prefetch(next + l * cols + k);
+            for (i = 0; i < np; i++) {
+                __m256i *pbin = (__m256i *) (rbins[i] + k);
+                _mm256_storeu_si256(pbin,
+                                    _mm256_xor_si256(_mm256_loadu_si256
+                                                     (pbin), a));
+                _mm256_storeu_si256(pbin + 1,
+                                    _mm256_xor_si256(_mm256_loadu_si256
+                                                     (pbin + 1), b));
+            }
+        }
+    }
+}
+#endif
+
+static forward_kernel_t forward_kernels[] = {
+    forward_scalar,
+#ifdef TRANSFORM_X86
+    forward_sse2,
+    forward_avx2
+#else
+    0,
+    0
+#endif
+};
+
+// selected kernel, -1 until first use (read by the transform threads)
+static int kernel = -1;
+
+int transform_kernel_supported(transform_kernel_t k) {
+    switch (k) {
+    case TRANSFORM_SCALAR:
+        return 1;
+#ifdef TRANSFORM_X86
+    case TRANSFORM_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case TRANSFORM_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return 0;
+    }
+}
+
+const char *transform_kernel_name(transform_kernel_t k) {
+    return k >= TRANSFORM_SCALAR && k <= TRANSFORM_AVX2 ?
+        kernel_names[k] : "unknown";
+}
+
+transform_kernel_t transform_get_kernel() {
+    int k = __atomic_load_n(&kernel, __ATOMIC_RELAXED);
+
+    if (k < 0) {
+        // pick the widest kernel this cpu can run
+        for (k = TRANSFORM_AVX2; k > TRANSFORM_SCALAR; k--)
+            if (transform_kernel_supported(k))
+                break;
+        __atomic_store_n(&kernel, k, __ATOMIC_RELAXED);
+        DEBUG("transform kernel: %s", kernel_names[k]);
+    }
+    return k;
+}
+
+int transform_set_kernel(transform_kernel_t k) {
+    if (!transform_kernel_supported(k)) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    __atomic_store_n(&kernel, k, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void transform_forward_n(const pxl_t * support, int rows, int cols, int np,
+                         projection_t * projections, int n) {
+    bin_t *bases[np];
+    forward_kernel_t kernel;
+    int i, b;
+    DEBUG_FUNCTION;
+
     assert(cols % 8 == 0);
+    kernel = forward_kernels[transform_get_kernel()];
     for (i = 0; i < np; i++) {
         projection_t *p = projections + i;
-        const pxl_t *ppix = support;
-        bin_t *pbin;            // = p->bins - offsets[i];
-        for (l = 0; l < rows; l++) {
-            pbin = p->bins + l * p->angle.p - offsets[i];
-            for (k = cols / 8; k > 0; k--) {
-                pbin[0] ^= ppix[0];
-                pbin[1] ^= ppix[1];
-                pbin[2] ^= ppix[2];
-                pbin[3] ^= ppix[3];
-                pbin[4] ^= ppix[4];
-                pbin[5] ^= ppix[5];
-                pbin[6] ^= ppix[6];
-                pbin[7] ^= ppix[7];
-                pbin += 8;
-                ppix += 8;
-            }
-        }
+        // negative angles start (rows - 1) * |p| bins further
+        bases[i] = p->bins - (p->angle.p < 0 ? (rows - 1) * p->angle.p : 0);
     }
 
-    if (offsets)
-        free(offsets);
+    for (b = 0; b < n; b++) {
+        const pxl_t *block = support + b * rows * cols;
+        for (i = 0; i < np; i++) {
+            bin_t *pbins = projections[i].bins + b * projections[i].size;
+            bin_t *end = pbins + projections[i].size;
+            // the kernels store the first row, only clear the bins around it
+            memset(pbins, 0, (bases[i] - pbins) * sizeof (bin_t));
+            memset(bases[i] + cols, 0,
+                   (end - bases[i] - cols) * sizeof (bin_t));
+        }
+        kernel(block, rows, cols, np, projections, bases,
+               b + 1 < n ? block + rows * cols : block);
+        for (i = 0; i < np; i++)
+            bases[i] += projections[i].size;
+    }
 }
 
-static int compare_slope(const void *e1, const void *e2) {
-    projection_t *p1 = (projection_t *) e1;
-    projection_t *p2 = (projection_t *) e2;
-    double a = (double) p1->angle.p / (double) p1->angle.q;
-    double b = (double) p2->angle.p / (double) p2->angle.q;
-    return (a < b) ? 1 : (a > b) ? -1 : 0;
+void transform_forward(const pxl_t * support, int rows, int cols, int np,
+                       projection_t * projections) {
+    transform_forward_n(support, rows, cols, np, projections, 1);
 }
 
 static inline int max(int a, int b) {
@@ -83,153 +263,846 @@ static inline int min(int a, int b) {
     return a < b ? a : b;
 }
 
-void transform_inverse(pxl_t * support, int rows, int cols, int np,
-                       projection_t * projections) {
-    int s_minus, s_plus, s, i, rdv, k, l;
-    double tmp;
-    int *k_offsets, *offsets;
+/*
+ * Everything transform_inverse() needs for a given geometry and set of
+ * angles: which projection rebuilds which row, the column offsets and the
+ * loop bounds. Plans are built on first use and never released, there is
+ * at most C(forward, inverse) of them per layout.
+ */
+typedef struct inverse_plan {
+    int rows;
+    int cols;
+    int np;
+    angle_t *angles;            // key, in the caller's order
+    int *perms;                 // row l is rebuilt from projections[perms[l]]
+    int *offsets;               // bin of projections[perms[l]] for pixel (l, 0)
+    int *k_offsets;             // column of row l rebuilt at step 0
+    int *order;                 // rows order within a step
+    int *deps;                  // other pixels of the bin, see inverse_pixel
+    int pad;
+    int stride;
+    int k_first;                // first step
+    int k_all;                  // first step where every row is in the support
+    int k_end_all;              // last step where every row is in the support
+    int k_last;                 // last step
+    struct inverse_plan *next;
+} inverse_plan_t;
+
+#define INVERSE_PLAN_HSIZE 64
+
+static inverse_plan_t *inverse_plans[INVERSE_PLAN_HSIZE];
+
+static uint32_t inverse_plan_hash(int rows, int cols, int np,
+                                  const projection_t * projections) {
+    uint32_t hash = rows + (cols << 8) + (np << 24);
+    int i;
+
+    for (i = 0; i < np; i++)
+        hash = (projections[i].angle.p * 31 + projections[i].angle.q) +
+            (hash << 6) + (hash << 16) - hash;
+    return hash;
+}
+
+static int inverse_plan_cmp(const inverse_plan_t * plan, int rows, int cols,
+                            int np, const projection_t * projections) {
+    int i;
+
+    if (plan->rows != rows || plan->cols != cols || plan->np != np)
+        return 1;
+    for (i = 0; i < np; i++) {
+        if (plan->angles[i].p != projections[i].angle.p ||
+            plan->angles[i].q != projections[i].angle.q)
+            return 1;
+    }
+    return 0;
+}
+
+static inverse_plan_t *inverse_plan_build(int rows, int cols, int np,
+                                          const projection_t * projections) {
+    inverse_plan_t *plan;
+    int s_minus, s_plus, i, j, rdv, l, m;
+    DEBUG_FUNCTION;
 
-    k_offsets = xcalloc(np, sizeof (int));
-    offsets = xcalloc(np, sizeof (int));
+    plan = xmalloc(sizeof (inverse_plan_t));
+    plan->rows = rows;
+    plan->cols = cols;
+    plan->np = np;
+    plan->angles = xmalloc(np * sizeof (angle_t));
+    plan->perms = xmalloc(np * sizeof (int));
+    plan->offsets = xmalloc(rows * sizeof (int));
+    plan->k_offsets = xmalloc(rows * sizeof (int));
+    plan->order = xmalloc(rows * sizeof (int));
+    plan->deps = xmalloc(rows * (rows - 1) * sizeof (int));
+    plan->next = 0;
 
-    qsort((void *) projections, np, sizeof (projection_t), compare_slope);
+    // sort projections by decreasing slope (q > 0: compare p1 * q2, p2 * q1)
     for (i = 0; i < np; i++) {
-        offsets[i] =
-            projections[i].angle.p <
-            0 ? (rows - 1) * projections[i].angle.p : 0;
+        plan->angles[i] = projections[i].angle;
+        for (j = i; j > 0; j--) {
+            const angle_t *a = &projections[plan->perms[j - 1]].angle;
+            if (a->p * projections[i].angle.q >= projections[i].angle.p * a->q)
+                break;
+            plan->perms[j] = plan->perms[j - 1];
+        }
+        plan->perms[j] = i;
     }
 
-    // compute s_minus, s_plus, and finally s
-    s_minus = s_plus = s = 0;
+    plan->pad = 0;
+    for (l = 0; l < rows; l++) {
+        const angle_t *a = &plan->angles[plan->perms[l]];
+        assert(a->q == 1);
+        plan->offsets[l] = l * a->p - (a->p < 0 ? (rows - 1) * a->p : 0);
+        plan->pad = max(plan->pad, (rows - 1) * abs(a->p));
+    }
+#define angle(l) plan->angles[plan->perms[l]].p
+
+    // compute s_minus, s_plus
+    s_minus = s_plus = 0;
     for (i = 1; i < rows - 1; i++) {
-        s_minus += max(0, -projections[i].angle.p);
-        s_plus += max(0, projections[i].angle.p);
+        s_minus += max(0, -angle(i));
+        s_plus += max(0, angle(i));
     }
-    s = s_minus - s_plus;
 
-    // compute the rendez-vous row rdv
-    tmp = pow(((double) projections[0].angle.p - 0.5 * (double) s), 2);
-    rdv = 0;
-    // XXX
+    // the rendez-vous row
     rdv = rows - 1;
-    /*
-       for (i = 0; i < rows; i++) {
-       double tmpi =
-       pow(((double) projections[i].angle.p - 0.5 * (double) s), 2);
-       //XXX
-       if (tmpi = tmp) {
-       tmp = tmpi;
-       rdv = i;
-       }
-       }
-     */
 
     // Determine the initial image column offset for each projection
-    k_offsets[rdv] =
-        max(max(0, -projections[rdv].angle.p) + s_minus,
-            max(0, projections[rdv].angle.p) + s_plus);
+    plan->k_offsets[rdv] =
+        max(max(0, -angle(rdv)) + s_minus, max(0, angle(rdv)) + s_plus);
     for (i = rdv + 1; i < rows; i++) {
-        k_offsets[i] = k_offsets[i - 1] + projections[i - 1].angle.p;
+        plan->k_offsets[i] = plan->k_offsets[i - 1] + angle(i - 1);
     }
     for (i = rdv - 1; i >= 0; i--) {
-        k_offsets[i] = k_offsets[i + 1] + projections[i + 1].angle.p;
-    }
-
-    // Reconstruct
-    // While all projections aren't needed (avoid if statement in general case)
-    for (k = -max(k_offsets[0], k_offsets[rows - 1]); k < 0; k++) {
-        for (l = 0; l < rdv; l++) {
-            if (k + k_offsets[l] >= 0) {
-                projection_t *p = projections + l;
-                bin_t bin =
-                    projections[l].bins[(k + k_offsets[l]) * p->angle.q +
-                                        l * p->angle.p - offsets[l]];
-                support[l * cols + k + k_offsets[l]] = bin;
-                for (i = 0; i < rows; i++) {
-                    projection_t *updated = projections + i;
-                    updated->bins[(k + k_offsets[l]) * updated->angle.q +
-                                  l * updated->angle.p - offsets[i]] ^= bin;
-                }
-            }
+        plan->k_offsets[i] = plan->k_offsets[i + 1] + angle(i + 1);
+    }
+
+    // rows are rebuilt from the edges to the rendez-vous row at each step
+    i = 0;
+    for (l = 0; l < rdv; l++)
+        plan->order[i++] = l;
+    for (l = rows - 1; l >= rdv; l--)
+        plan->order[i++] = l;
+
+    // steps where some rows are outside the support, then where all rows
+    // are reconstructed, then the tail.
+    plan->k_first = plan->k_all = -plan->k_offsets[0];
+    plan->k_end_all = plan->k_last = cols - plan->k_offsets[0];
+    for (l = 1; l < rows; l++) {
+        plan->k_first = min(plan->k_first, -plan->k_offsets[l]);
+        plan->k_all = max(plan->k_all, -plan->k_offsets[l]);
+        plan->k_end_all = min(plan->k_end_all, cols - plan->k_offsets[l]);
+        plan->k_last = max(plan->k_last, cols - plan->k_offsets[l]);
+    }
+
+    plan->stride = cols + 2 * plan->pad;
+    for (l = 0, i = 0; l < rows; l++) {
+        // position of pixel (m, c + (l - m) * p) relative to column c
+        for (m = 0; m < rows; m++) {
+            if (m != l)
+                plan->deps[i++] = m * plan->stride + (l - m) * angle(l);
         }
-        for (l = rows - 1; l >= rdv; l--) {
-            if (k + k_offsets[l] >= 0) {
-                projection_t *p = projections + l;
-                bin_t bin =
-                    projections[l].bins[(k + k_offsets[l]) * p->angle.q +
-                                        l * p->angle.p - offsets[l]];
-                support[l * cols + k + k_offsets[l]] = bin;
-                for (i = 0; i < rows; i++) {
-                    projection_t *updated = projections + i;
-                    updated->bins[(k + k_offsets[l]) * updated->angle.q +
-                                  l * updated->angle.p - offsets[i]] ^= bin;
-                }
-            }
+    }
+#undef angle
+
+    return plan;
+}
+
+static const inverse_plan_t *inverse_plan_get(int rows, int cols, int np,
+                                              const projection_t *
+                                              projections) {
+    inverse_plan_t **bucket, *plan, *head;
+
+    bucket = inverse_plans +
+        inverse_plan_hash(rows, cols, np, projections) % INVERSE_PLAN_HSIZE;
+    for (plan = __atomic_load_n(bucket, __ATOMIC_ACQUIRE); plan;
+         plan = plan->next) {
+        if (inverse_plan_cmp(plan, rows, cols, np, projections) == 0)
+            return plan;
+    }
+
+    // lock free push, a plan built twice by concurrent callers is harmless
+    plan = inverse_plan_build(rows, cols, np, projections);
+    do {
+        head = *bucket;
+        plan->next = head;
+    } while (!__sync_bool_compare_and_swap(bucket, head, plan));
+
+    return plan;
+}
+
+/*
+ * Pixel (l, c) is read from the bin of projection l it falls in, once every
+ * other pixel of that bin is known: pixel (m, c + (l - m) * p) of each other
+ * row m, or nothing when that column is outside the support.
+ * Rather than xoring each reconstructed pixel back into all the projections,
+ * the other pixels of the bin are gathered from the rows already rebuilt
+ * into a zero padded image, so the projections are only read.
+ */
+static inline void inverse_pixel(pxl_t * image, const inverse_plan_t * plan,
+                                 int rows, const bin_t ** pbins, int l,
+                                 int c) {
+    const int *dep = plan->deps + l * (rows - 1);
+    pxl_t pixel = pbins[l][c];
+    int m;
+
+    for (m = 0; m < rows - 1; m++)
+        pixel ^= image[c + dep[m]];
+    image[l * plan->stride + c] = pixel;
+}
+
+/*
+ * Walk the reconstruction path of plan, calling PIXEL(l, c) for every pixel.
+ * The bounds are only checked on the first and last steps, where some rows
+ * are outside the support. rows is plan->rows, a constant in layout kernels.
+ */
+#define INVERSE_STEPS(plan, rows, PIXEL) do {                               \
+    int _k, _i;                                                             \
+    for (_k = (plan)->k_first; _k < (plan)->k_all; _k++) {                  \
+        for (_i = 0; _i < (rows); _i++) {                                   \
+            int _l = (plan)->order[_i];                                     \
+            int _c = _k + (plan)->k_offsets[_l];                            \
+            if (_c >= 0 && _c < (plan)->cols)                               \
+                PIXEL(_l, _c);                                              \
+        }                                                                   \
+    }                                                                       \
+    for (; _k < (plan)->k_end_all; _k++) {                                  \
+        for (_i = 0; _i < (rows); _i++) {                                   \
+            int _l = (plan)->order[_i];                                     \
+            PIXEL(_l, _k + (plan)->k_offsets[_l]);                          \
+        }                                                                   \
+    }                                                                       \
+    for (; _k < (plan)->k_last; _k++) {                                     \
+        for (_i = 0; _i < (rows); _i++) {                                   \
+            int _l = (plan)->order[_i];                                     \
+            int _c = _k + (plan)->k_offsets[_l];                            \
+            if (_c >= 0 && _c < (plan)->cols)                               \
+                PIXEL(_l, _c);                                              \
+        }                                                                   \
+    }                                                                       \
+} while (0)
+
+/*
+ * Per thread scratch for the padded images, grown on demand: it would not
+ * fit on the stack for large blocks.
+ */
+static __thread pxl_t *scratch = 0;
+static __thread size_t scratch_size = 0;
+
+static pxl_t *inverse_scratch(size_t size) {
+    if (size > scratch_size) {
+        free(scratch);
+        scratch = xmalloc(size * sizeof (pxl_t));
+        scratch_size = size;
+    }
+    return scratch;
+}
+
+/*
+ * Inverse kernels are written once as always inlined bodies taking rows,
+ * instantiated with plan->rows for the generic transform and with a constant
+ * for the layout ones (see TRANSFORM_LAYOUT below).
+ */
+#define INLINE static inline __attribute__ ((always_inline))
+
+INLINE void inverse_scalar_body(pxl_t * support, const inverse_plan_t * plan,
+                                int rows, const projection_t * projections,
+                                int block) {
+    const int cols = plan->cols;
+    const bin_t *pbins[rows];
+    pxl_t *image, *origin;
+    int l;
+
+    for (l = 0; l < rows; l++) {
+        const projection_t *p = projections + plan->perms[l];
+        pbins[l] = p->bins + block * p->size + plan->offsets[l];
+    }
+
+    // zero padded image, pixels outside the support read as 0
+    image = inverse_scratch(rows * plan->stride);
+    origin = image + plan->pad;
+    for (l = 0; l < rows; l++) {
+        memset(image + l * plan->stride, 0, plan->pad * sizeof (pxl_t));
+        memset(origin + l * plan->stride + cols, 0,
+               plan->pad * sizeof (pxl_t));
+    }
+
+#define PIXEL(l, c) inverse_pixel(origin, plan, rows, pbins, l, c)
+    INVERSE_STEPS(plan, rows, PIXEL);
+#undef PIXEL
+
+    for (l = 0; l < rows; l++)
+        memcpy(support + l * cols, origin + l * plan->stride,
+               cols * sizeof (pxl_t));
+}
+
+static void inverse_scalar(pxl_t * support, const inverse_plan_t * plan,
+                           const projection_t * projections, int block) {
+    inverse_scalar_body(support, plan, plan->rows, projections, block);
+}
+
+/*
+ * The path has a step dependency on the previous column for any set of
+ * angles, so a single block can not be vectorized. The lanes kernels rebuild
+ * W blocks in lockstep instead: pixel (l, c) of block j is at
+ * [(l * stride + c) * W + j] of an interleaved image, and the bins are
+ * interleaved the same way beforehand.
+ */
+static pxl_t *inverse_interleave(const inverse_plan_t * plan,
+                                 const projection_t * projections, int block,
+                                 int w, pxl_t ** origin) {
+    const int rows = plan->rows;
+    const int cols = plan->cols;
+    pxl_t *image, *ibins;
+    int l, c, j;
+
+    image = inverse_scratch((rows * plan->stride + rows * cols) * w);
+    ibins = image + rows * plan->stride * w;
+    *origin = image + plan->pad * w;
+    for (l = 0; l < rows; l++) {
+        memset(image + l * plan->stride * w, 0,
+               plan->pad * w * sizeof (pxl_t));
+        memset(*origin + (l * plan->stride + cols) * w, 0,
+               plan->pad * w * sizeof (pxl_t));
+    }
+
+    for (j = 0; j < w; j++) {
+        for (l = 0; l < rows; l++) {
+            const projection_t *p = projections + plan->perms[l];
+            const bin_t *pbins = p->bins + (block + j) * p->size +
+                plan->offsets[l];
+            pxl_t *ib = ibins + l * cols * w + j;
+            for (c = 0; c < cols; c++)
+                ib[c * w] = pbins[c];
         }
     }
+    return ibins;
+}
 
-    // scan the reconstruction path while every projections are used
-    for (k = 0; k < cols - max(k_offsets[0], k_offsets[rows - 1]); k++) {
-        for (l = 0; l < rdv; l++) {
-            projection_t *p = projections + l;
-            bin_t bin =
-                projections[l].bins[(k + k_offsets[l]) * p->angle.q +
-                                    l * p->angle.p - offsets[l]];
-            support[l * cols + k + k_offsets[l]] = bin;
-            for (i = 0; i < rows; i++) {
-                projection_t *updated = projections + i;
-                updated->bins[(k + k_offsets[l]) * updated->angle.q +
-                              l * updated->angle.p - offsets[i]] ^= bin;
-            }
+static void inverse_deinterleave(pxl_t * support, const inverse_plan_t * plan,
+                                 const pxl_t * origin, int w) {
+    const int rows = plan->rows;
+    const int cols = plan->cols;
+    int l, c, j;
+
+    for (j = 0; j < w; j++) {
+        pxl_t *block = support + j * rows * cols;
+        for (l = 0; l < rows; l++) {
+            const pxl_t *row = origin + l * plan->stride * w + j;
+            for (c = 0; c < cols; c++)
+                block[l * cols + c] = row[c * w];
         }
-        for (l = rows - 1; l >= rdv; l--) {
-            projection_t *p = projections + l;
-            bin_t bin =
-                projections[l].bins[(k + k_offsets[l]) * p->angle.q +
-                                    l * p->angle.p - offsets[l]];
-            support[l * cols + k + k_offsets[l]] = bin;
-            for (i = 0; i < rows; i++) {
-                projection_t *updated = projections + i;
-                updated->bins[(k + k_offsets[l]) * updated->angle.q +
-                              l * updated->angle.p - offsets[i]] ^= bin;
-            }
+    }
+}
+
+#ifdef TRANSFORM_X86
+__attribute__ ((target("sse2")))
+INLINE void inverse_sse2_body(pxl_t * support, const inverse_plan_t * plan,
+                              int rows, const projection_t * projections,
+                              int block) {
+    const int n = rows - 1;
+    pxl_t *origin;
+    const pxl_t *ibins;
+
+    ibins = inverse_interleave(plan, projections, block, 2, &origin);
+
+#define PIXEL(l, c) do {                                                    \
+    const int *dep = plan->deps + (l) * n;                                  \
+    __m128i pixel = _mm_loadu_si128((const __m128i *)                       \
+                                    (ibins + ((l) * plan->cols + (c)) * 2));\
+    int m;                                                                  \
+    for (m = 0; m < n; m++)                                                 \
+        pixel = _mm_xor_si128(pixel, _mm_loadu_si128((const __m128i *)      \
+                              (origin + ((c) + dep[m]) * 2)));              \
+    _mm_storeu_si128((__m128i *) (origin + ((l) * plan->stride + (c)) * 2), \
+                     pixel);                                                \
+} while (0)
+    INVERSE_STEPS(plan, rows, PIXEL);
+#undef PIXEL
+
+    inverse_deinterleave(support, plan, origin, 2);
+}
+
+__attribute__ ((target("sse2")))
+static void inverse_sse2(pxl_t * support, const inverse_plan_t * plan,
+                         const projection_t * projections, int block) {
+    inverse_sse2_body(support, plan, plan->rows, projections, block);
+}
+
+__attribute__ ((target("avx2")))
+INLINE void inverse_avx2_body(pxl_t * support, const inverse_plan_t * plan,
+                              int rows, const projection_t * projections,
+                              int block) {
+    const int n = rows - 1;
+    pxl_t *origin;
+    const pxl_t *ibins;
+
+    ibins = inverse_interleave(plan, projections, block, 4, &origin);
+
+#define PIXEL(l, c) do {                                                    \
+    const int *dep = plan->deps + (l) * n;                                  \
+    __m256i pixel = _mm256_loadu_si256((const __m256i *)                    \
+                                    (ibins + ((l) * plan->cols + (c)) * 4));\
+    int m;                                                                  \
+    for (m = 0; m < n; m++)                                                 \
+        pixel = _mm256_xor_si256(pixel, _mm256_loadu_si256((const __m256i *)\
+                                 (origin + ((c) + dep[m]) * 4)));           \
+    _mm256_storeu_si256((__m256i *)                                         \
+                        (origin + ((l) * plan->stride + (c)) * 4), pixel);  \
+} while (0)
+    INVERSE_STEPS(plan, rows, PIXEL);
+#undef PIXEL
+
+    inverse_deinterleave(support, plan, origin, 4);
+}
+
+__attribute__ ((target("avx2")))
+static void inverse_avx2(pxl_t * support, const inverse_plan_t * plan,
+                         const projection_t * projections, int block) {
+    inverse_avx2_body(support, plan, plan->rows, projections, block);
+}
+#endif
+
+typedef void (*inverse_kernel_t) (pxl_t * support,
+                                  const inverse_plan_t * plan,
+                                  const projection_t * projections,
+                                  int block);
+
+typedef struct inverse_lanes {
+    inverse_kernel_t kernel;
+    int lanes;                  // blocks rebuilt per call
+} inverse_lanes_t;
+
+static const inverse_lanes_t inverse_kernels[] = {
+    {inverse_scalar, 1},
+#ifdef TRANSFORM_X86
+    {inverse_sse2, 2},
+    {inverse_avx2, 4}
+#else
+    {0, 0},
+    {0, 0}
+#endif
+};
+
+static void inverse_blocks(const inverse_lanes_t * kernels, pxl_t * support,
+                           int rows, int cols, int np,
+                           const projection_t * projections, int n) {
+    const inverse_plan_t *plan;
+    int k, b = 0;
+
+    plan = inverse_plan_get(rows, cols, np, projections);
+
+    // as many blocks as possible through the widest kernel, then narrower
+    for (k = transform_get_kernel(); k >= 0; k--) {
+        int lanes = kernels[k].lanes;
+        for (; b + lanes <= n; b += lanes)
+            kernels[k].kernel(support + b * rows * cols, plan, projections,
+                              b);
+    }
+}
+
+void transform_inverse_n(pxl_t * support, int rows, int cols, int np,
+                         const projection_t * projections, int n) {
+    DEBUG_FUNCTION;
+
+    inverse_blocks(inverse_kernels, support, rows, cols, np, projections, n);
+}
+
+void transform_inverse(pxl_t * support, int rows, int cols, int np,
+                       const projection_t * projections) {
+    transform_inverse_n(support, rows, cols, np, projections, 1);
+}
+
+/*
+ * Layout kernels.
+ *
+ * rozofs only transforms blocks of rows = inverse and np = forward
+ * projections of angles p = i - np / 2, q = 1 for its three layouts. The
+ * kernels below are instantiated for each of them by TRANSFORM_LAYOUT so
+ * rows, np and the angles are constants: loops over rows and projections
+ * are unrolled and the row offsets folded. Other geometries fall back to
+ * the generic transform.
+ *
+ * Forward layout kernels compute each bin at once from the pixels falling
+ * in it, rather than xoring every row into the bins: bins are written once
+ * and never read. Only the first and last (rows - 1) * |p| bins of a
+ * projection miss some rows and need bound checks.
+ */
+typedef void (*forward_layout_t) (const pxl_t * support, int cols,
+                                  bin_t ** bins, const pxl_t * next);
+
+// pixel (l, c) falls in bin c + l * p + shift
+INLINE int forward_shift(int rows, int p) {
+    return p < 0 ? -(rows - 1) * p : 0;
+}
+
+/*
+ * Bins [e, cols) get a pixel from every row and are computed by the kernels
+ * below, the row pointers being shifted so that bin b reads rp[l][b]. The
+ * edges, out of it, are cleared then xored with the part of each row that
+ * falls in them.
+ */
+#define FORWARD_LAYOUT_EDGES(rows, cols, p, rp, bins, e) do {              \
+    int _l, _b;                                                             \
+    memset(bins, 0, e * sizeof (bin_t));                                    \
+    memset(bins + max(e, cols), 0, (e + cols - max(e, cols)) *              \
+           sizeof (bin_t));                                                 \
+    for (_l = 0; _l < rows; _l++) {                                         \
+        int _off = _l * p + forward_shift(rows, p);                         \
+        for (_b = _off; _b < min(e, _off + cols); _b++)                     \
+            bins[_b] ^= rp[_l][_b];                                         \
+        for (_b = max(e, cols); _b < _off + cols; _b++)                     \
+            bins[_b] ^= rp[_l][_b];                                         \
+    }                                                                       \
+} while (0)
+
+INLINE void forward_layout_scalar(const pxl_t * support, int rows, int cols,
+                                  int p, bin_t * bins, const pxl_t * next) {
+    const int e = abs(p) * (rows - 1);
+    const pxl_t *rp[rows];
+    int b, l;
+
+    for (l = 0; l < rows; l++)
+        rp[l] = support + l * (cols - p) - forward_shift(rows, p);
+    for (b = e; b < cols; b++) {
+        bin_t bin = rp[0][b];
+        if (next && (b & 7) == 0) {
+            for (l = 0; l < rows; l++)
+                __builtin_prefetch(next + l * cols + b);
+        }
+        for (l = 1; l < rows; l++)
+            bin ^= rp[l][b];
+        bins[b] = bin;
+    }
+    FORWARD_LAYOUT_EDGES(rows, cols, p, rp, bins, e);
+}
+
+#ifdef TRANSFORM_X86
+__attribute__ ((target("sse2")))
+INLINE void forward_layout_sse2(const pxl_t * support, int rows, int cols,
+                                int p, bin_t * bins, const pxl_t * next) {
+    const int e = abs(p) * (rows - 1);
+    const pxl_t *rp[rows];
+    int b, l;
+
+    for (l = 0; l < rows; l++)
+        rp[l] = support + l * (cols - p) - forward_shift(rows, p);
+    for (b = e; b + 4 <= cols; b += 4) {
+        __m128i lo = _mm_loadu_si128((const __m128i *) (rp[0] + b));
+        __m128i hi = _mm_loadu_si128((const __m128i *) (rp[0] + b + 2));
+        if (next && (b & 4) == 0) {
+            for (l = 0; l < rows; l++)
+                __builtin_prefetch(next + l * cols + b);
+        }
+        for (l = 1; l < rows; l++) {
+            lo = _mm_xor_si128(lo, _mm_loadu_si128((const __m128i *)
+                                                   (rp[l] + b)));
+            hi = _mm_xor_si128(hi, _mm_loadu_si128((const __m128i *)
+                                                   (rp[l] + b + 2)));
+        }
+        _mm_storeu_si128((__m128i *) (bins + b), lo);
+        _mm_storeu_si128((__m128i *) (bins + b + 2), hi);
+    }
+    for (; b < cols; b++) {
+        bin_t bin = rp[0][b];
+        for (l = 1; l < rows; l++)
+            bin ^= rp[l][b];
+        bins[b] = bin;
+    }
+    FORWARD_LAYOUT_EDGES(rows, cols, p, rp, bins, e);
+}
+
+__attribute__ ((target("avx2")))
+INLINE void forward_layout_avx2(const pxl_t * support, int rows, int cols,
+                                int p, bin_t * bins, const pxl_t * next) {
+    const int e = abs(p) * (rows - 1);
+    const pxl_t *rp[rows];
+    int b, l;
+
+    for (l = 0; l < rows; l++)
+        rp[l] = support + l * (cols - p) - forward_shift(rows, p);
+    for (b = e; b + 8 <= cols; b += 8) {
+        __m256i lo = _mm256_loadu_si256((const __m256i *) (rp[0] + b));
+        __m256i hi = _mm256_loadu_si256((const __m256i *) (rp[0] + b + 4));
+        if (next) {
+            for (l = 0; l < rows; l++)
+                __builtin_prefetch(next + l * cols + b);
+        }
+        for (l = 1; l < rows; l++) {
+            lo = _mm256_xor_si256(lo, _mm256_loadu_si256((const __m256i *)
+                                                         (rp[l] + b)));
+            hi = _mm256_xor_si256(hi, _mm256_loadu_si256((const __m256i *)
+                                                         (rp[l] + b + 4)));
         }
+        _mm256_storeu_si256((__m256i *) (bins + b), lo);
+        _mm256_storeu_si256((__m256i *) (bins + b + 4), hi);
     }
+    for (; b < cols; b++) {
+        bin_t bin = rp[0][b];
+        for (l = 1; l < rows; l++)
+            bin ^= rp[l][b];
+        bins[b] = bin;
+    }
+    FORWARD_LAYOUT_EDGES(rows, cols, p, rp, bins, e);
+}
+#endif
+
+static void forward_layout_blocks(const forward_layout_t * kernels,
+                                  int lrows, int lnp, const pxl_t * support,
+                                  int rows, int cols, int np,
+                                  projection_t * projections, int n) {
+    bin_t *bins[np];
+    forward_layout_t kernel;
+    int i, b;
+
+    for (i = 0; i < np && rows == lrows && np == lnp; i++) {
+        const projection_t *p = projections + i;
+        if (p->angle.p != i - np / 2 || p->angle.q != 1 ||
+            p->size != abs(p->angle.p) * (rows - 1) + cols)
+            break;
+    }
+    if (rows != lrows || np != lnp || i < np) {
+        transform_forward_n(support, rows, cols, np, projections, n);
+        return;
+    }
+
+    kernel = kernels[transform_get_kernel()];
+    for (b = 0; b < n; b++) {
+        const pxl_t *block = support + b * rows * cols;
+        for (i = 0; i < np; i++)
+            bins[i] = projections[i].bins + b * projections[i].size;
+        kernel(block, cols, bins, b + 1 < n ? block + rows * cols : 0);
+    }
+}
 
-    // finished the work
-    for (k = cols - max(k_offsets[0], k_offsets[rows - 1]); k < cols; k++) {
-        for (l = 0; l < rdv; l++) {
-            if (k + k_offsets[l] < cols) {
-                projection_t *p = projections + l;
-                bin_t bin =
-                    projections[l].bins[(k + k_offsets[l]) * p->angle.q +
-                                        l * p->angle.p - offsets[l]];
-                support[l * cols + k + k_offsets[l]] = bin;
-                for (i = 0; i < rows; i++) {
-                    projection_t *updated = projections + i;
-                    updated->bins[(k + k_offsets[l]) * updated->angle.q +
-                                  l * updated->angle.p - offsets[i]] ^= bin;
-                }
+#ifdef TRANSFORM_X86
+#define TRANSFORM_LAYOUT_X86(ROWS, NP)                                      \
+__attribute__ ((target("sse2")))                                            \
+static void forward_sse2_##ROWS(const pxl_t * support, int cols,            \
+                                bin_t ** bins, const pxl_t * next) {        \
+    int i;                                                                  \
+    for (i = 0; i < NP; i++)                                                \
+        forward_layout_sse2(support, ROWS, cols, i - NP / 2, bins[i],       \
+                            i == 0 ? next : 0);                             \
+}                                                                           \
+__attribute__ ((target("avx2")))                                            \
+static void forward_avx2_##ROWS(const pxl_t * support, int cols,            \
+                                bin_t ** bins, const pxl_t * next) {        \
+    int i;                                                                  \
+    for (i = 0; i < NP; i++)                                                \
+        forward_layout_avx2(support, ROWS, cols, i - NP / 2, bins[i],       \
+                            i == 0 ? next : 0);                             \
+}                                                                           \
+__attribute__ ((target("sse2")))                                            \
+static void inverse_sse2_##ROWS(pxl_t * support,                            \
+                                const inverse_plan_t * plan,                \
+                                const projection_t * projections,           \
+                                int block) {                                \
+    inverse_sse2_body(support, plan, ROWS, projections, block);             \
+}                                                                           \
+__attribute__ ((target("avx2")))                                            \
+static void inverse_avx2_##ROWS(pxl_t * support,                            \
+                                const inverse_plan_t * plan,                \
+                                const projection_t * projections,           \
+                                int block) {                                \
+    inverse_avx2_body(support, plan, ROWS, projections, block);             \
+}
+#define FORWARD_LAYOUT_X86(ROWS) forward_sse2_##ROWS, forward_avx2_##ROWS
+#define INVERSE_LAYOUT_X86(ROWS) {inverse_sse2_##ROWS, 2}, {inverse_avx2_##ROWS, 4}
+#else
+#define TRANSFORM_LAYOUT_X86(ROWS, NP)
+#define FORWARD_LAYOUT_X86(ROWS) 0, 0
+#define INVERSE_LAYOUT_X86(ROWS) {0, 0}, {0, 0}
+#endif
+
+#define TRANSFORM_LAYOUT(ROWS, NP)                                          \
+static void forward_scalar_##ROWS(const pxl_t * support, int cols,          \
+                                  bin_t ** bins, const pxl_t * next) {      \
+    int i;                                                                  \
+    for (i = 0; i < NP; i++)                                                \
+        forward_layout_scalar(support, ROWS, cols, i - NP / 2, bins[i],     \
+                              i == 0 ? next : 0);                           \
+}                                                                           \
+static void inverse_scalar_##ROWS(pxl_t * support,                          \
+                                  const inverse_plan_t * plan,              \
+                                  const projection_t * projections,         \
+                                  int block) {                              \
+    inverse_scalar_body(support, plan, ROWS, projections, block);           \
+}                                                                           \
+TRANSFORM_LAYOUT_X86(ROWS, NP)                                              \
+static const forward_layout_t forward_layout_##ROWS[] = {                   \
+    forward_scalar_##ROWS, FORWARD_LAYOUT_X86(ROWS)                         \
+};                                                                          \
+static const inverse_lanes_t inverse_layout_##ROWS[] = {                    \
+    {inverse_scalar_##ROWS, 1}, INVERSE_LAYOUT_X86(ROWS)                    \
+};                                                                          \
+static void transform_forward_##ROWS(const pxl_t * support, int rows,       \
+                                     int cols, int np,                      \
+                                     projection_t * projections, int n) {   \
+    DEBUG_FUNCTION;                                                         \
+    forward_layout_blocks(forward_layout_##ROWS, ROWS, NP, support, rows,   \
+                          cols, np, projections, n);                        \
+}                                                                           \
+static void transform_inverse_##ROWS(pxl_t * support, int rows, int cols,   \
+                                     int np,                                \
+                                     const projection_t * projections,      \
+                                     int n) {                               \
+    DEBUG_FUNCTION;                                                         \
+    inverse_blocks(rows == ROWS ? inverse_layout_##ROWS : inverse_kernels,  \
+                   support, rows, cols, np, projections, n);                \
+}                                                                           \
+static const transform_ops_t transform_ops_##ROWS = {                       \
+    transform_forward_##ROWS, transform_inverse_##ROWS                      \
+};
+
+TRANSFORM_LAYOUT(2, 3)
+TRANSFORM_LAYOUT(4, 6)
+TRANSFORM_LAYOUT(8, 12)
+
+static const transform_ops_t transform_ops_generic = {
+    transform_forward_n, transform_inverse_n
+};
+
+const transform_ops_t *transform_get_ops(int rows, int np) {
+    if (rows == 2 && np == 3)
+        return &transform_ops_2;
+    if (rows == 4 && np == 6)
+        return &transform_ops_4;
+    if (rows == 8 && np == 12)
+        return &transform_ops_8;
+    return &transform_ops_generic;
+}
+
+/*
+ * Rows inverse.
+ *
+ * In systematic mode the rows of a block are stored as they are, only the
+ * parity is made of projections: lost rows are rebuilt from as many
+ * projections. The known rows are first xored out of a copy of the bins,
+ * leaving in each bin the pixels of the lost rows only. A bin left with a
+ * single unknown pixel gives it away and the pixel is xored out of the
+ * other projections, until every pixel is known.
+ */
+int transform_inverse_rows_n(pxl_t * support, int rows, int cols, int nlost,
+                             const int *lost, const projection_t * projections,
+                             int n) {
+    int status = -1;
+    int offsets[nlost + 1];
+    int shifts[nlost];
+    int islost[rows];
+    bin_t *res = 0;
+    int *counts = 0;
+    int *refs = 0;
+    int *queue = 0;
+    uint8_t *known = 0;
+    int i, j, k, l, c, b;
+    DEBUG_FUNCTION;
+
+    if (nlost <= 0 || nlost > rows) {
+        errno = EINVAL;
+        goto out;
+    }
+
+    memset(islost, 0, sizeof (islost));
+    offsets[0] = 0;
+    for (i = 0; i < nlost; i++) {
+        assert(projections[i].angle.q == 1);
+        islost[lost[i]] = 1;
+        shifts[i] = forward_shift(rows, projections[i].angle.p);
+        offsets[i + 1] = offsets[i] + projections[i].size;
+    }
+
+    res = xmalloc(offsets[nlost] * sizeof (bin_t));
+    counts = xmalloc(offsets[nlost] * sizeof (int));
+    refs = xcalloc(offsets[nlost], sizeof (int));
+    queue = xmalloc(offsets[nlost] * sizeof (int));
+    known = xmalloc(nlost * cols);
+
+    // number of unknown pixels in each bin, the same for every block
+    for (i = 0; i < nlost; i++) {
+        for (j = 0; j < nlost; j++) {
+            int *r = refs + offsets[i] + lost[j] * projections[i].angle.p +
+                shifts[i];
+            for (c = 0; c < cols; c++)
+                r[c]++;
+        }
+    }
+
+    for (k = 0; k < n; k++) {
+        pxl_t *block = support + k * rows * cols;
+        int head = 0, tail = 0, found = 0;
+
+        for (i = 0; i < nlost; i++) {
+            memcpy(res + offsets[i], projections[i].bins +
+                   k * projections[i].size,
+                   projections[i].size * sizeof (bin_t));
+            for (l = 0; l < rows; l++) {
+                bin_t *r;
+                const pxl_t *ppix = block + l * cols;
+                if (islost[l])
+                    continue;
+                r = res + offsets[i] + l * projections[i].angle.p + shifts[i];
+                for (c = 0; c < cols; c++)
+                    r[c] ^= ppix[c];
             }
         }
-        for (l = rows - 1; l >= rdv; l--) {
-            if (k + k_offsets[l] < cols) {
-                projection_t *p = projections + l;
-                bin_t bin =
-                    projections[l].bins[(k + k_offsets[l]) * p->angle.q +
-                                        l * p->angle.p - offsets[l]];
-                support[l * cols + k + k_offsets[l]] = bin;
-                for (i = 0; i < rows; i++) {
-                    projection_t *updated = projections + i;
-                    updated->bins[(k + k_offsets[l]) * updated->angle.q +
-                                  l * updated->angle.p - offsets[i]] ^= bin;
-                }
+        memcpy(counts, refs, offsets[nlost] * sizeof (int));
+        memset(known, 0, nlost * cols);
+        for (b = 0; b < offsets[nlost]; b++)
+            if (counts[b] == 1)
+                queue[tail++] = b;
+
+        // each bin reaches a count of one at most once: queue can't overflow
+        while (head < tail) {
+            pxl_t pixel;
+            b = queue[head++];
+            if (counts[b] != 1)
+                continue;
+            for (i = 0; b >= offsets[i + 1]; i++);
+            for (j = 0; j < nlost; j++) {
+                c = b - offsets[i] - lost[j] * projections[i].angle.p -
+                    shifts[i];
+                if (c >= 0 && c < cols && !known[j * cols + c])
+                    break;
+            }
+            assert(j < nlost);
+            pixel = res[b];
+            block[lost[j] * cols + c] = pixel;
+            known[j * cols + c] = 1;
+            found++;
+            for (i = 0; i < nlost; i++) {
+                int pb = offsets[i] + c + lost[j] * projections[i].angle.p +
+                    shifts[i];
+                res[pb] ^= pixel;
+                if (--counts[pb] == 1)
+                    queue[tail++] = pb;
             }
         }
+
+        if (found != nlost * cols) {
+            warning("transform_inverse_rows_n failed: %d rows can't be"
+                    " rebuilt from these projections", nlost);
+            errno = EINVAL;
+            goto out;
+        }
     }
 
-    if (offsets)
-        free(offsets);
-    if (k_offsets)
-        free(k_offsets);
+    status = 0;
+out:
+    if (res)
+        free(res);
+    if (counts)
+        free(counts);
+    if (refs)
+        free(refs);
+    if (queue)
+        free(queue);
+    if (known)
+        free(known);
+    return status;
+}
+
+int transform_inverse_rows(pxl_t * support, int rows, int cols, int nlost,
+                           const int *lost, const projection_t * projections) {
+    return transform_inverse_rows_n(support, rows, cols, nlost, lost,
+                                    projections, 1);
 }
@@ -36,9 +36,57 @@ typedef struct projection {
     bin_t *bins;
 } projection_t;
 
+typedef enum transform_kernel {
+    TRANSFORM_SCALAR, TRANSFORM_SSE2, TRANSFORM_AVX2
+} transform_kernel_t;
+
+int transform_kernel_supported(transform_kernel_t kernel);
+
+const char *transform_kernel_name(transform_kernel_t kernel);
+
+transform_kernel_t transform_get_kernel();
+
+int transform_set_kernel(transform_kernel_t kernel);
+
 void transform_forward(const pxl_t * support, int rows, int cols, int np,
                        projection_t * projections);
 void transform_inverse(pxl_t * support, int rows, int cols, int np,
-                       projection_t * projections);
+                       const projection_t * projections);
+
+/*
+ * Transform n consecutive blocks in one call: block j is the support at
+ * support + j * rows * cols and its projection i is the bins at
+ * projections[i].bins + j * projections[i].size.
+ */
+void transform_forward_n(const pxl_t * support, int rows, int cols, int np,
+                         projection_t * projections, int n);
+void transform_inverse_n(pxl_t * support, int rows, int cols, int np,
+                         const projection_t * projections, int n);
+
+typedef struct transform_ops {
+    void (*forward) (const pxl_t * support, int rows, int cols, int np,
+                     projection_t * projections, int n);
+    void (*inverse) (pxl_t * support, int rows, int cols, int np,
+                     const projection_t * projections, int n);
+} transform_ops_t;
+
+/*
+ * Kernels unrolled for rows and np projections of angles p = i - np / 2,
+ * q = 1 (the rozofs layouts), or transform_forward_n/transform_inverse_n
+ * when there is none. Both fall back to the generic transform for other
+ * geometries.
+ */
+const transform_ops_t *transform_get_ops(int rows, int np);
+
+/*
+ * Rebuild the nlost rows of support listed in lost from nlost projections,
+ * the other rows holding their pixels (systematic mode). Returns 0 on
+ * success, -1 with errno set to EINVAL if they can't be rebuilt.
+ */
+int transform_inverse_rows(pxl_t * support, int rows, int cols, int nlost,
+                           const int *lost, const projection_t * projections);
+int transform_inverse_rows_n(pxl_t * support, int rows, int cols, int nlost,
+                             const int *lost, const projection_t * projections,
+                             int n);
 
 #endif
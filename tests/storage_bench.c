@@ -0,0 +1,163 @@
+#define _XOPEN_SOURCE 500
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <uuid/uuid.h>
+
+#include "xmalloc.h"
+#include "rozofs.h"
+#include "storage.h"
+
+/*
+ * Storage fan-out benchmark: creates, opens and removes n projection files
+ * in a fresh root for each fan-out and reports the per file latencies.
+ * The open files cache holds a single entry so that every access opens.
+ */
+
+#define BENCH_FILES 100000
+
+static double bench_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int bench_cmp(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_report(const char *op, int levels, double *lat, int n) {
+    double sum = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+        sum += lat[i];
+    qsort(lat, n, sizeof (double), bench_cmp);
+    printf("%-6d %-6s %10.1f %10.1f %10.1f %10.1f\n", levels, op, sum / n,
+           lat[n / 2], lat[n * 99 / 100], lat[n - 1]);
+}
+
+static int bench_unlink(const char *path, const struct stat *sb, int flag,
+                        struct FTW *ftw) {
+    return remove(path);
+}
+
+static int bench(const char *dir, int levels, int n) {
+    int status = -1;
+    char root[PATH_MAX];
+    storage_t st;
+    fid_t *fids = 0;
+    double *lat = 0;
+    int i, j;
+
+    sprintf(root, "%s/storage_bench.%d.%d", dir, getpid(), levels);
+    if (mkdir(root, S_IRWXU) != 0) {
+        perror(root);
+        return -1;
+    }
+    if (storage_initialize(&st, 0, root, levels, 1, 1) != 0) {
+        perror("storage_initialize");
+        goto out;
+    }
+    fids = xmalloc(n * sizeof (fid_t));
+    lat = xmalloc(n * sizeof (double));
+    for (i = 0; i < n; i++)
+        uuid_generate(fids[i]);
+
+    for (i = 0; i < n; i++) {
+        double t = bench_now();
+        if (storage_read(&st, fids[i], 0, 1, 0, 0, 0, 0) != 0) {
+            perror("create");
+            goto release;
+        }
+        lat[i] = bench_now() - t;
+    }
+    bench_report("create", levels, lat, n);
+
+    for (i = 0; i < n; i++) {
+        double t;
+        j = rand() % n;
+        t = bench_now();
+        if (storage_read(&st, fids[j], 0, 1, 0, 0, 0, 0) != 0) {
+            perror("open");
+            goto release;
+        }
+        lat[i] = bench_now() - t;
+    }
+    bench_report("open", levels, lat, n);
+
+    for (i = 0; i < n; i++) {
+        double t = bench_now();
+        if (storage_rm_file(&st, fids[i]) != 0) {
+            perror("rm");
+            goto release;
+        }
+        lat[i] = bench_now() - t;
+    }
+    bench_report("rm", levels, lat, n);
+
+    status = 0;
+release:
+    storage_release(&st);
+out:
+    nftw(root, bench_unlink, 16, FTW_DEPTH | FTW_PHYS);
+    if (fids)
+        free(fids);
+    if (lat)
+        free(lat);
+    return status;
+}
+
+static void usage() {
+    printf("Usage: storage_bench [-n files] [-l levels] [dir]\n\n");
+    printf("\t-n\tprojection files per fan-out (default: %d).\n",
+           BENCH_FILES);
+    printf("\t-l\tfan-out to run (default: 0 to %d).\n", STORAGE_FANOUT_MAX);
+    printf("\tdir\twhere the storage roots are made (default: /tmp).\n");
+}
+
+int main(int argc, char **argv) {
+    int n = BENCH_FILES;
+    int levels = -1;
+    const char *dir = "/tmp";
+    int c, l;
+
+    while ((c = getopt(argc, argv, "hn:l:")) != -1) {
+        switch (c) {
+        case 'n':
+            n = atoi(optarg);
+            break;
+        case 'l':
+            levels = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(c == 'h' ? 0 : -1);
+        }
+    }
+    if (optind < argc)
+        dir = argv[optind];
+    if (n <= 0 || levels > STORAGE_FANOUT_MAX) {
+        usage();
+        exit(-1);
+    }
+
+    // removes look for the projections of the layout
+    rozofs_initialize(LAYOUT_2_3_4, ROZOFS_BSIZE);
+    printf("%-6s %-6s %10s %10s %10s %10s\n", "levels", "op", "mean(us)",
+           "p50(us)", "p99(us)", "max(us)");
+    for (l = 0; l <= STORAGE_FANOUT_MAX; l++) {
+        if (levels >= 0 && l != levels)
+            continue;
+        if (bench(dir, l, n) != 0)
+            exit(-1);
+    }
+    exit(0);
+}
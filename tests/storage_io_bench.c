@@ -0,0 +1,212 @@
+#define _XOPEN_SOURCE 500
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <uuid/uuid.h>
+
+#include "xmalloc.h"
+#include "rozofs.h"
+#include "storage.h"
+
+/*
+ * Storage I/O benchmark: threads read (and write) random blocks of
+ * projection files for some seconds, with pread and pwrite then through an
+ * io_uring, and the IOPS of both are reported. The page cache may be
+ * dropped before each run (as root) to measure device reads.
+ */
+
+#define BENCH_THREADS 16
+#define BENCH_SECONDS 5
+#define BENCH_FILES 64
+#define BENCH_BLOCKS 1024
+#define BENCH_RING 256
+
+static storage_t st;
+static fid_t *fids;
+static int nfiles = BENCH_FILES;
+static int nblocks = BENCH_BLOCKS;
+static int wratio = 0;          // percent of writes
+static int drop = 0;            // the page cache before runs
+static uint32_t psize;
+static double deadline;
+
+static double bench_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench_unlink(const char *path, const struct stat *sb, int flag,
+                        struct FTW *ftw) {
+    return remove(path);
+}
+
+static void *bench_thread(void *v) {
+    uint64_t *ops = (uint64_t *) v;
+    unsigned int seed = (unsigned int) (uintptr_t) v;
+    bin_t *bins = xmalloc(psize * sizeof (bin_t));
+    uint32_t crc;
+    int f, b;
+
+    memset(bins, 1, psize * sizeof (bin_t));
+    while (bench_now() < deadline) {
+        // a batch between clock reads
+        int i;
+        for (i = 0; i < 64; i++) {
+            f = rand_r(&seed) % nfiles;
+            b = rand_r(&seed) % nblocks;
+            if (rand_r(&seed) % 100 < wratio) {
+                crc = b;
+                if (storage_write(&st, fids[f], 0, psize, b, 1,
+                                  psize * sizeof (bin_t), bins, &crc) != 0) {
+                    perror("storage_write");
+                    exit(-1);
+                }
+            } else if (storage_read(&st, fids[f], 0, psize, b, 1, bins,
+                                    &crc) != 0) {
+                perror("storage_read");
+                exit(-1);
+            }
+        }
+        *ops += i;
+    }
+    free(bins);
+    return 0;
+}
+
+static void bench_drop() {
+    FILE *f;
+
+    sync();
+    if (!(f = fopen("/proc/sys/vm/drop_caches", "w")) ||
+        fputs("3\n", f) < 0 || fclose(f) != 0) {
+        perror("drop_caches");
+        exit(-1);
+    }
+}
+
+static double bench(int nthreads, int seconds) {
+    pthread_t *threads = xmalloc(nthreads * sizeof (pthread_t));
+    uint64_t *ops = xcalloc(nthreads * 8, sizeof (uint64_t));
+    uint64_t total = 0;
+    double start;
+    int i;
+
+    if (drop)
+        bench_drop();
+    start = bench_now();
+    deadline = start + seconds;
+    // counters a cache line apart
+    for (i = 0; i < nthreads; i++)
+        pthread_create(threads + i, NULL, bench_thread, ops + i * 8);
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+        total += ops[i * 8];
+    }
+    free(threads);
+    free(ops);
+    return total / (bench_now() - start);
+}
+
+static void usage() {
+    printf("Usage: storage_io_bench [-t threads] [-s seconds] [-f files]"
+           " [-b blocks] [-w writes] [-d] [dir]\n\n");
+    printf("\t-t\tthreads (default: %d).\n", BENCH_THREADS);
+    printf("\t-s\tseconds per run (default: %d).\n", BENCH_SECONDS);
+    printf("\t-f\tprojection files (default: %d).\n", BENCH_FILES);
+    printf("\t-b\tblocks per file (default: %d).\n", BENCH_BLOCKS);
+    printf("\t-w\tpercent of writes (default: 0).\n");
+    printf("\t-d\tdrop the page cache before each run (root only).\n");
+    printf("\tdir\twhere the storage root is made (default: /tmp).\n");
+}
+
+int main(int argc, char **argv) {
+    int nthreads = BENCH_THREADS;
+    int seconds = BENCH_SECONDS;
+    const char *dir = "/tmp";
+    char root[PATH_MAX];
+    bin_t *bins;
+    double pio, rio;
+    int c, i, b;
+
+    while ((c = getopt(argc, argv, "ht:s:f:b:w:d")) != -1) {
+        switch (c) {
+        case 't':
+            nthreads = atoi(optarg);
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'f':
+            nfiles = atoi(optarg);
+            break;
+        case 'b':
+            nblocks = atoi(optarg);
+            break;
+        case 'w':
+            wratio = atoi(optarg);
+            break;
+        case 'd':
+            drop = 1;
+            break;
+        default:
+            usage();
+            exit(c == 'h' ? 0 : -1);
+        }
+    }
+    if (optind < argc)
+        dir = argv[optind];
+    if (nthreads <= 0 || seconds <= 0 || nfiles <= 0 || nblocks <= 0) {
+        usage();
+        exit(-1);
+    }
+
+    rozofs_initialize(LAYOUT_2_3_4, ROZOFS_BSIZE);
+    psize = rozofs_psizes[0];
+    sprintf(root, "%s/storage_io_bench.%d", dir, getpid());
+    if (mkdir(root, S_IRWXU) != 0) {
+        perror(root);
+        exit(-1);
+    }
+    if (storage_initialize(&st, 0, root, 1, nfiles, STORAGE_SHARDS) != 0) {
+        perror("storage_initialize");
+        exit(-1);
+    }
+    fids = xmalloc(nfiles * sizeof (fid_t));
+    bins = xcalloc(psize, sizeof (bin_t));
+    for (i = 0; i < nfiles; i++) {
+        uuid_generate(fids[i]);
+        for (b = 0; b < nblocks; b++) {
+            if (storage_write(&st, fids[i], 0, psize, b, 1,
+                              psize * sizeof (bin_t), bins, 0) != 0) {
+                perror("storage_write");
+                exit(-1);
+            }
+        }
+    }
+    free(bins);
+
+    printf("%d threads, %d%% writes of %lu bytes blocks\n", nthreads, wratio,
+           (unsigned long) (psize * sizeof (bin_t)));
+    pio = bench(nthreads, seconds);
+    printf("%-10s %12.0f IOPS\n", "pread", pio);
+    if (storage_ring_open(&st, BENCH_RING) != 0) {
+        printf("%-10s %12s (%s)\n", "io_uring", "-", strerror(errno));
+    } else {
+        rio = bench(nthreads, seconds);
+        printf("%-10s %12.0f IOPS (%+.1f%%)\n", "io_uring", rio,
+               (rio / pio - 1) * 100);
+    }
+
+    storage_release(&st);
+    nftw(root, bench_unlink, 16, FTW_DEPTH | FTW_PHYS);
+    free(fids);
+    exit(0);
+}
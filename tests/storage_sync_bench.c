@@ -0,0 +1,236 @@
+#define _XOPEN_SOURCE 500
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <uuid/uuid.h>
+
+#include "xmalloc.h"
+#include "rozofs.h"
+#include "storage.h"
+
+/*
+ * Durable writes benchmark: threads write random blocks of projection
+ * files for some seconds, without syncs then with syncs grouped over
+ * windows of increasing length, and the throughput and latencies of the
+ * writes are reported for each.
+ */
+
+#define BENCH_THREADS 16
+#define BENCH_SECONDS 5
+#define BENCH_FILES 64
+#define BENCH_BLOCKS 1024
+#define BENCH_BATCH 64
+// latencies kept per thread
+#define BENCH_SAMPLES (1 << 20)
+
+static storage_t st;
+static char root[PATH_MAX];
+static fid_t *fids;
+static int nfiles = BENCH_FILES;
+static int nblocks = BENCH_BLOCKS;
+static uint32_t psize;
+static double deadline;
+
+typedef struct bench_thread {
+    pthread_t thread;
+    unsigned int seed;
+    uint64_t ops;
+    double *lats;
+} bench_thread_t;
+
+static double bench_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench_unlink(const char *path, const struct stat *sb, int flag,
+                        struct FTW *ftw) {
+    return remove(path);
+}
+
+static int bench_cmp(const void *a, const void *b) {
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+
+    return da < db ? -1 : da > db;
+}
+
+static void *bench_thread(void *v) {
+    bench_thread_t *t = (bench_thread_t *) v;
+    bin_t *bins = xmalloc(psize * sizeof (bin_t));
+    uint32_t crc;
+    double start, now = 0;
+    int f, b;
+
+    memset(bins, 1, psize * sizeof (bin_t));
+    while (now < deadline) {
+        f = rand_r(&t->seed) % nfiles;
+        b = rand_r(&t->seed) % nblocks;
+        crc = b;
+        start = bench_now();
+        if (storage_write(&st, fids[f], 0, psize, b, 1,
+                          psize * sizeof (bin_t), bins, &crc) != 0) {
+            perror("storage_write");
+            exit(-1);
+        }
+        now = bench_now();
+        if (t->ops < BENCH_SAMPLES)
+            t->lats[t->ops] = now - start;
+        t->ops++;
+    }
+    free(bins);
+    return 0;
+}
+
+/* Run with syncs grouped over window usec (-1: no syncs). */
+static void bench(const char *name, int nthreads, int seconds, int window,
+                  int batch) {
+    bench_thread_t *threads = xcalloc(nthreads, sizeof (bench_thread_t));
+    double *lats = 0;
+    uint64_t total = 0, n = 0, k;
+    double start, elapsed, sum = 0;
+    syncstat_t sstat;
+    int i;
+
+    if (storage_initialize(&st, 0, root, 1, nfiles, STORAGE_SHARDS) != 0) {
+        perror("storage_initialize");
+        exit(-1);
+    }
+    if (window >= 0 && storage_sync_start(&st, window, batch) != 0) {
+        perror("storage_sync_start");
+        exit(-1);
+    }
+    start = bench_now();
+    deadline = start + seconds;
+    for (i = 0; i < nthreads; i++) {
+        threads[i].seed = i + 1;
+        threads[i].lats = xmalloc(BENCH_SAMPLES * sizeof (double));
+        pthread_create(&threads[i].thread, NULL, bench_thread, threads + i);
+    }
+    for (i = 0; i < nthreads; i++)
+        pthread_join(threads[i].thread, NULL);
+    elapsed = bench_now() - start;
+    storage_sync_stat(&st, &sstat);
+    storage_release(&st);
+
+    for (i = 0; i < nthreads; i++) {
+        k = threads[i].ops < BENCH_SAMPLES ? threads[i].ops : BENCH_SAMPLES;
+        lats = xrealloc(lats, (n + k) * sizeof (double));
+        memcpy(lats + n, threads[i].lats, k * sizeof (double));
+        n += k;
+        total += threads[i].ops;
+        free(threads[i].lats);
+    }
+    for (k = 0; k < n; k++)
+        sum += lats[k];
+    qsort(lats, n, sizeof (double), bench_cmp);
+    printf("%-10s %10.0f writes/s %9.1f %9.1f %9.1f us", name,
+           total / elapsed, sum / n * 1e6, lats[n / 2] * 1e6,
+           lats[n * 99 / 100] * 1e6);
+    if (sstat.batches > 0)
+        printf(" %6.1f writes/batch", (double) sstat.writes / sstat.batches);
+    printf("\n");
+    free(lats);
+    free(threads);
+}
+
+static void usage() {
+    printf("Usage: storage_sync_bench [-t threads] [-s seconds] [-f files]"
+           " [-b blocks] [-B batch] [dir]\n\n");
+    printf("\t-t\tthreads (default: %d).\n", BENCH_THREADS);
+    printf("\t-s\tseconds per run (default: %d).\n", BENCH_SECONDS);
+    printf("\t-f\tprojection files (default: %d).\n", BENCH_FILES);
+    printf("\t-b\tblocks per file (default: %d).\n", BENCH_BLOCKS);
+    printf("\t-B\twrites per batch at most (default: %d).\n", BENCH_BATCH);
+    printf("\tdir\twhere the storage root is made (default: /tmp).\n");
+}
+
+int main(int argc, char **argv) {
+    int nthreads = BENCH_THREADS;
+    int seconds = BENCH_SECONDS;
+    int batch = BENCH_BATCH;
+    const char *dir = "/tmp";
+    int windows[] = { 0, 100, 500, 1000, 5000 };
+    char name[32];
+    bin_t *bins;
+    int c, i, b;
+
+    while ((c = getopt(argc, argv, "ht:s:f:b:B:")) != -1) {
+        switch (c) {
+        case 't':
+            nthreads = atoi(optarg);
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'f':
+            nfiles = atoi(optarg);
+            break;
+        case 'b':
+            nblocks = atoi(optarg);
+            break;
+        case 'B':
+            batch = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(c == 'h' ? 0 : -1);
+        }
+    }
+    if (optind < argc)
+        dir = argv[optind];
+    if (nthreads <= 0 || seconds <= 0 || nfiles <= 0 || nblocks <= 0 ||
+        batch <= 0) {
+        usage();
+        exit(-1);
+    }
+
+    rozofs_initialize(LAYOUT_2_3_4, ROZOFS_BSIZE);
+    psize = rozofs_psizes[0];
+    sprintf(root, "%s/storage_sync_bench.%d", dir, getpid());
+    if (mkdir(root, S_IRWXU) != 0) {
+        perror(root);
+        exit(-1);
+    }
+    if (storage_initialize(&st, 0, root, 1, nfiles, STORAGE_SHARDS) != 0) {
+        perror("storage_initialize");
+        exit(-1);
+    }
+    fids = xmalloc(nfiles * sizeof (fid_t));
+    bins = xcalloc(psize, sizeof (bin_t));
+    for (i = 0; i < nfiles; i++) {
+        uuid_generate(fids[i]);
+        for (b = 0; b < nblocks; b++) {
+            if (storage_write(&st, fids[i], 0, psize, b, 1,
+                              psize * sizeof (bin_t), bins, 0) != 0) {
+                perror("storage_write");
+                exit(-1);
+            }
+        }
+    }
+    free(bins);
+    storage_release(&st);
+    sync();
+
+    printf("%d threads, %lu bytes blocks, batches of %d writes at most\n",
+           nthreads, (unsigned long) (psize * sizeof (bin_t)), batch);
+    printf("%-10s %19s %9s %9s %9s\n", "window", "", "mean", "median",
+           "p99");
+    bench("no sync", nthreads, seconds, -1, batch);
+    for (i = 0; i < sizeof (windows) / sizeof (int); i++) {
+        sprintf(name, "%d us", windows[i]);
+        bench(name, nthreads, seconds, windows[i], batch);
+    }
+
+    nftw(root, bench_unlink, 16, FTW_DEPTH | FTW_PHYS);
+    free(fids);
+    exit(0);
+}
@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "container.h"
+
+#define TEST_ROOT "/tmp/test_container"
+
+int test_container_rw(void);
+int test_container_reopen(void);
+int test_container_move(void);
+int test_container_compact(void);
+
+static int rootfd;
+
+/* projection files: none exist, put ones are counted */
+static int moved;
+
+static int test_file(void *arg, int create) {
+    return create ? 1 : 0;
+}
+
+static int test_put(void *arg, const void *bins, uint64_t size,
+                    const uint32_t * crcs, uint32_t ncrcs) {
+    moved++;
+    return 0;
+}
+
+static int test_check(container_t * ct, fid_t fid, tid_t pid, uint8_t c,
+                      size_t size, uint32_t crc) {
+    uint8_t buf[1024];
+    uint32_t crcs[2];
+    size_t i;
+
+    if (container_read(ct, fid, pid, 0, size, buf, 0, 2, crcs) != 1)
+        return -1;
+    for (i = 0; i < size; i++)
+        if (buf[i] != c)
+            return -1;
+    return crcs[0] == crc && crcs[1] == 0 ? 0 : -1;
+}
+
+int test_container_rw(void) {
+    container_t ct;
+    fid_t fid;
+    uint8_t buf[512];
+    uint32_t crc = 7;
+
+    if (container_open(&ct, rootfd) != 0)
+        return -1;
+    uuid_generate(fid);
+    memset(buf, 1, sizeof (buf));
+    if (container_write(&ct, fid, 0, 0, sizeof (buf), buf, 0, 1, &crc,
+                        test_file, test_put, 0) != 1)
+        return -1;
+    if (test_check(&ct, fid, 0, 1, sizeof (buf), 7) != 0)
+        return -1;
+    // beyond the bins
+    if (container_read(&ct, fid, 0, 256, sizeof (buf), buf, 0, 1, &crc) !=
+        -1)
+        return -1;
+    // other tid
+    if (container_read(&ct, fid, 1, 0, sizeof (buf), buf, 0, 1, &crc) != 0)
+        return -1;
+    if (container_truncate(&ct, fid, 0, 128, 1, test_file, test_put, 0) !=
+        1 || test_check(&ct, fid, 0, 1, 128, 7) != 0)
+        return -1;
+    if (container_remove(&ct, fid, 0) != 1 ||
+        container_read(&ct, fid, 0, 0, 128, buf, 0, 1, &crc) != 0)
+        return -1;
+    container_close(&ct);
+    return 0;
+}
+
+int test_container_reopen(void) {
+    container_t ct;
+    fid_t fids[64];
+    uint8_t buf[256];
+    uint32_t crc;
+    int i, pass, fd;
+
+    if (container_open(&ct, rootfd) != 0)
+        return -1;
+    for (i = 0; i < 64; i++) {
+        uuid_generate(fids[i]);
+        memset(buf, i, sizeof (buf));
+        crc = i;
+        if (container_write(&ct, fids[i], 0, 0, sizeof (buf), buf, 0, 1,
+                            &crc, test_file, test_put, 0) != 1)
+            return -1;
+    }
+    for (i = 0; i < 64; i += 2)
+        if (container_remove(&ct, fids[i], 0) != 1)
+            return -1;
+    container_close(&ct);
+
+    // from the index then from the segments, a partial record at the end
+    for (pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            unlinkat(rootfd, CONTAINER_DIR "/" CONTAINER_INDEX, 0);
+            if ((fd = openat(rootfd, CONTAINER_DIR "/00000001",
+                             O_WRONLY | O_APPEND)) < 0)
+                return -1;
+            if (write(fd, buf, 17) != 17)
+                return -1;
+            close(fd);
+        }
+        if (container_open(&ct, rootfd) != 0)
+            return -1;
+        for (i = 0; i < 64; i++) {
+            if (i % 2 == 0 && container_read(&ct, fids[i], 0, 0, 1, buf, 0,
+                                              1, &crc) != 0)
+                return -1;
+            if (i % 2 == 1 && test_check(&ct, fids[i], 0, i, 256, i) != 0)
+                return -1;
+        }
+        container_close(&ct);
+    }
+    return 0;
+}
+
+int test_container_move(void) {
+    container_t ct;
+    fid_t fid;
+    uint8_t buf[1024];
+
+    if (container_open(&ct, rootfd) != 0)
+        return -1;
+    uuid_generate(fid);
+    memset(buf, 3, sizeof (buf));
+    if (container_write(&ct, fid, 2, 0, sizeof (buf), buf, 0, 1, 0,
+                        test_file, test_put, 0) != 1)
+        return -1;
+    // grows too large: moved to its file
+    moved = 0;
+    if (container_write(&ct, fid, 2, CONTAINER_MAX, sizeof (buf), buf, 0, 1,
+                        0, test_file, test_put, 0) != 0 || moved != 1)
+        return -1;
+    if (container_read(&ct, fid, 2, 0, sizeof (buf), buf, 0, 1,
+                       (uint32_t *) buf) != 0)
+        return -1;
+    // too large to start with
+    uuid_generate(fid);
+    if (container_truncate(&ct, fid, 0, CONTAINER_MAX + 1, 1, test_file,
+                           test_put, 0) != 0)
+        return -1;
+    container_close(&ct);
+    return 0;
+}
+
+int test_container_compact(void) {
+    container_t ct;
+    ctstat_t cst;
+    fid_t fids[16];
+    uint8_t *buf;
+    uint32_t crc;
+    size_t size = CONTAINER_MAX;
+    int i, j;
+
+    buf = malloc(size);
+    if (container_open(&ct, rootfd) != 0 || container_start(&ct) != 0)
+        return -1;
+    for (i = 0; i < 16; i++)
+        uuid_generate(fids[i]);
+    // rewrite the projections until segments are mostly dead
+    for (j = 0; j < 3 * CONTAINER_SEGMENT_SIZE / (16 * size); j++) {
+        for (i = 0; i < 16; i++) {
+            memset(buf, i + j, 1024);
+            crc = i + j;
+            if (container_write(&ct, fids[i], 0, 0, size, buf, 0, 1, &crc,
+                                test_file, test_put, 0) != 1)
+                return -1;
+        }
+    }
+    for (i = 0; i < 100; i++) {
+        container_stat(&ct, &cst);
+        if (cst.compacted > 0)
+            break;
+        usleep(10000);
+    }
+    if (cst.compacted == 0 || cst.projections < 16)
+        return -1;
+    j--;
+    for (i = 0; i < 16; i++)
+        if (test_check(&ct, fids[i], 0, i + j, 1024, i + j) != 0)
+            return -1;
+    container_close(&ct);
+
+    // compacted segments are gone from the index
+    if (container_open(&ct, rootfd) != 0)
+        return -1;
+    for (i = 0; i < 16; i++)
+        if (test_check(&ct, fids[i], 0, i + j, 1024, i + j) != 0)
+            return -1;
+    container_close(&ct);
+    free(buf);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+
+    if (system("rm -rf " TEST_ROOT) != 0 || mkdir(TEST_ROOT, S_IRWXU) != 0 ||
+        (rootfd = open(TEST_ROOT, O_RDONLY)) < 0) {
+        perror("failed to create " TEST_ROOT);
+        exit(-1);
+    }
+
+    if (test_container_rw() != 0) {
+        fprintf(stderr, "Failed to test read and write\n");
+        exit(-1);
+    }
+
+    if (test_container_reopen() != 0) {
+        fprintf(stderr, "Failed to test reopen\n");
+        exit(-1);
+    }
+
+    if (test_container_move() != 0) {
+        fprintf(stderr, "Failed to test move\n");
+        exit(-1);
+    }
+
+    if (test_container_compact() != 0) {
+        fprintf(stderr, "Failed to test compaction\n");
+        exit(-1);
+    }
+
+    close(rootfd);
+    exit(0);
+}
@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "crc32c.h"
+
+int test_crc32c_vectors(void);
+int test_crc32c_split(void);
+
+/* bit at a time reference */
+static uint32_t crc32c_ref(uint32_t crc, const uint8_t * p, size_t len) {
+    int k;
+
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        for (k = 0; k < 8; k++)
+            crc = crc & 1 ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+    }
+    return ~crc;
+}
+
+int test_crc32c_vectors(void) {
+    uint8_t buf[32];
+
+    if (crc32c(0, "123456789", 9) != 0xe3069283)
+        return -1;
+    memset(buf, 0, sizeof (buf));
+    if (crc32c(0, buf, sizeof (buf)) != 0x8a9136aa)
+        return -1;
+    memset(buf, 0xff, sizeof (buf));
+    if (crc32c(0, buf, sizeof (buf)) != 0x62a8ab43)
+        return -1;
+    return 0;
+}
+
+int test_crc32c_split(void) {
+    uint8_t buf[4096 + 7];
+    size_t off, len;
+    int i;
+
+    for (i = 0; i < sizeof (buf); i++)
+        buf[i] = rand();
+    // unaligned starts, odd lengths and incremental updates
+    for (off = 0; off < 8; off++) {
+        for (len = 0; len < 300; len += 13) {
+            uint32_t crc = crc32c_ref(0, buf + off, len);
+            if (crc32c(0, buf + off, len) != crc)
+                return -1;
+            if (crc32c(crc32c(0, buf + off, len / 3), buf + off + len / 3,
+                       len - len / 3) != crc)
+                return -1;
+        }
+    }
+    if (crc32c(0, buf, sizeof (buf)) != crc32c_ref(0, buf, sizeof (buf)))
+        return -1;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+
+    if (test_crc32c_vectors() != 0) {
+        fprintf(stderr, "Failed to test vectors\n");
+        exit(-1);
+    }
+
+    if (test_crc32c_split() != 0) {
+        fprintf(stderr, "Failed to test split\n");
+        exit(-1);
+    }
+
+    exit(0);
+}
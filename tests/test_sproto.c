@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "rozofs.h"
+#include "xmalloc.h"
+#include "storage.h"
+#include "storaged.h"
+#include "sproto.h"
+
+#define TEST_ROOT "/tmp/test_sproto"
+
+int test_sproto_runs(void);
+int test_sproto_writev(void);
+int test_sproto_readv(void);
+
+extern void sp_release();
+
+static storage_t st;
+static fid_t fids[2];
+static uint32_t psize;
+
+// the vectored calls are served from st
+storage_t *storaged_lookup(sid_t sid) {
+    if (sid != st.sid) {
+        errno = EINVAL;
+        return 0;
+    }
+    return &st;
+}
+
+static void test_extent(sp_extent_t * e, int f, bid_t bid, uint32_t nrb) {
+    memcpy(e->fid, fids[f], sizeof (fid_t));
+    e->tid = 0;
+    e->psize = psize;
+    e->bid = bid;
+    e->nrb = nrb;
+}
+
+int test_sproto_runs(void) {
+    sp_extent_t e[6];
+
+    test_extent(e, 0, 0, 2);
+    test_extent(e + 1, 0, 2, 1);
+    test_extent(e + 2, 0, 3, 4);
+    // a hole
+    test_extent(e + 3, 0, 8, 1);
+    // other file, other projection
+    test_extent(e + 4, 1, 9, 1);
+    test_extent(e + 5, 1, 10, 1);
+    e[5].tid = 1;
+
+    if (sp_extents_run(e, 6) != 3 || sp_extents_run(e + 3, 3) != 1 ||
+        sp_extents_run(e + 4, 2) != 1 || sp_extents_run(e + 5, 1) != 1)
+        return -1;
+    return 0;
+}
+
+int test_sproto_writev(void) {
+    sp_writev_arg_t args;
+    sp_writev_ret_t *ret;
+    sp_extent_t e[4];
+    uint32_t crcs[5] = { 0 };
+    size_t bsize = psize * sizeof (bin_t);
+    int i;
+
+    // blocks 0 to 2 of fids[0] in two extents, block 0 of fids[1]
+    test_extent(e, 0, 0, 2);
+    test_extent(e + 1, 0, 2, 1);
+    test_extent(e + 2, 1, 0, 1);
+    // an invalid one
+    test_extent(e + 3, 1, 1, 1);
+    e[3].psize = 0;
+    args.sid = st.sid;
+    args.extents.extents_len = 4;
+    args.extents.extents_val = e;
+    args.bins.bins_len = 4 * bsize;
+    args.bins.bins_val = xmalloc(4 * bsize);
+    for (i = 0; i < 4; i++) {
+        memset(args.bins.bins_val + i * bsize, i + 1, bsize);
+        crcs[i] = i + 1;
+    }
+    args.crcs.crcs_len = 5;
+    args.crcs.crcs_val = crcs;
+
+    // fails the call
+    ret = sp_writev_2_svc(&args, 0);
+    if (ret->status != SP_FAILURE || ret->sp_writev_ret_t_u.error != EINVAL)
+        return -1;
+
+    args.extents.extents_len = 3;
+    args.crcs.crcs_len = 4;
+    ret = sp_writev_2_svc(&args, 0);
+    if (ret->status != SP_SUCCESS ||
+        ret->sp_writev_ret_t_u.errors.errors_len != 3)
+        return -1;
+    for (i = 0; i < 3; i++)
+        if (ret->sp_writev_ret_t_u.errors.errors_val[i] != 0)
+            return -1;
+
+    // bins not matching the extents
+    args.bins.bins_len--;
+    if (sp_writev_2_svc(&args, 0)->status != SP_FAILURE)
+        return -1;
+    free(args.bins.bins_val);
+    return 0;
+}
+
+int test_sproto_readv(void) {
+    sp_readv_arg_t args;
+    sp_readv_ret_t *ret;
+    sp_readv_rsp_t *rsp;
+    sp_extent_t e[4];
+    size_t bsize = psize * sizeof (bin_t);
+    char *bins;
+    int expected[4] = { 1, 2, 3, 4 };
+    int i, j;
+
+    // blocks 0 and 1, then 2 and 3 of fids[0]: block 3 is not there and
+    // fails alone, block 0 of fids[1]
+    test_extent(e, 0, 0, 2);
+    test_extent(e + 1, 0, 2, 1);
+    test_extent(e + 2, 0, 3, 1);
+    test_extent(e + 3, 1, 0, 1);
+    args.sid = st.sid;
+    args.extents.extents_len = 4;
+    args.extents.extents_val = e;
+
+    ret = sp_readv_2_svc(&args, 0);
+    rsp = &ret->sp_readv_ret_t_u.rsp;
+    if (ret->status != SP_SUCCESS || rsp->errors.errors_len != 4 ||
+        rsp->errors.errors_val[0] != 0 || rsp->errors.errors_val[1] != 0 ||
+        rsp->errors.errors_val[2] == 0 || rsp->errors.errors_val[3] != 0)
+        return -1;
+    // those of the failed extent are left out
+    if (rsp->bins.bins_len != 4 * bsize || rsp->crcs.crcs_len != 4)
+        return -1;
+    for (i = 0; i < 4; i++) {
+        bins = rsp->bins.bins_val + i * bsize;
+        for (j = 0; j < bsize; j++)
+            if (bins[j] != expected[i])
+                return -1;
+        if (rsp->crcs.crcs_val[i] != expected[i])
+            return -1;
+    }
+
+    // an invalid extent fails the call
+    e[3].psize = 0;
+    if (sp_readv_2_svc(&args, 0)->status != SP_FAILURE)
+        return -1;
+    e[3].psize = psize;
+
+    // more than a call may read
+    e[0].nrb = STORAGED_BINS_MAX / bsize + 1;
+    if (sp_readv_2_svc(&args, 0)->status != SP_FAILURE)
+        return -1;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+
+    if (system("rm -rf " TEST_ROOT) != 0 || mkdir(TEST_ROOT, S_IRWXU) != 0) {
+        perror("failed to create " TEST_ROOT);
+        exit(-1);
+    }
+    rozofs_initialize(LAYOUT_2_3_4, ROZOFS_BSIZE);
+    psize = rozofs_psizes[0];
+    if (storage_initialize(&st, 1, TEST_ROOT, 0, 32, STORAGE_SHARDS) != 0) {
+        perror("failed to initialize storage");
+        exit(-1);
+    }
+    uuid_generate(fids[0]);
+    uuid_generate(fids[1]);
+
+    if (test_sproto_runs() != 0) {
+        fprintf(stderr, "Failed to test extents runs\n");
+        exit(-1);
+    }
+
+    if (test_sproto_writev() != 0) {
+        fprintf(stderr, "Failed to test vectored writes\n");
+        exit(-1);
+    }
+
+    if (test_sproto_readv() != 0) {
+        fprintf(stderr, "Failed to test vectored reads\n");
+        exit(-1);
+    }
+
+    sp_release();
+    storage_release(&st);
+    rozofs_release();
+    exit(0);
+}
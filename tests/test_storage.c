@@ -1,21 +1,56 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
 #include "rozofs.h"
 #include "xmalloc.h"
 #include "transform.h"
+#include "crc32c.h"
 #include "storage.h"
 
 int main(int argc, char **argv) {
     storage_t st;
     sid_t sid = 0;
     sstat_t sst;
+    pfcstat_t cst;
+    rmqstat_t qst;
+    syncstat_t yst;
+    scrubstat_t bst;
+    fid_t cfid;
+    char fid_str[37];
+    const char *roots[3] = { "/tmp/test_storage_roots/a",
+        "/tmp/test_storage_roots/b", "/tmp/test_storage_roots/c"
+    };
+    fid_t fids[64];
+    sstat_t rsst;
+    bcstat_t hst;
+    rastat_t rst;
+    uint64_t hits;
+    void *file;
+    off_t off;
+    FILE *f;
+    struct rlimit rl;
+    rlim_t fsize;
+    int fd;
+    char c;
+    char path[PATH_MAX];
+    int i;
     fid_t fid;
     bin_t *bins;
+    bin_t *rbins;
+    uint32_t crcs[2] = { 1, 2 };
+    uint32_t rcrcs[2];
+    size_t len;
 
-    rozofs_initialize(LAYOUT_2_3_4);
-    storage_initialize(&st, sid, "/tmp");
+    rozofs_initialize(LAYOUT_2_3_4, ROZOFS_BSIZE);
+    storage_initialize(&st, sid, "/tmp", 0, 32, STORAGE_SHARDS);
 
     if (storage_stat(&st, &sst) != 0) {
         perror("failed to stat storage");
@@ -27,22 +62,418 @@ int main(int argc, char **argv) {
     // Write some bins (15 prj)
     bins = xmalloc(rozofs_psizes[0] * 15);
 /*
-    if (storage_write(&st, fid, 0, 10, 15, bins) != 0) {
+    if (storage_write(&st, fid, 0, rozofs_psizes[0], 10, 15, bins, 0) != 0) {
         perror("failed to write bins");
         exit(-1);
     }
 */
 
-    if (storage_truncate(&st, fid, 0, 10) != 0) {
+    if (storage_truncate(&st, fid, 0, rozofs_psizes[0], 10) != 0) {
         perror("failed to truncate pfile");
         exit(-1);
     }
 
+    if (storage_truncate(&st, fid, 0, rozofs_psizes[0], 10) != 0) {
+        perror("failed to truncate pfile");
+        exit(-1);
+    }
+
+    // the pfile was opened once then found in the cache
+    storage_cache_stat(&st, &cst);
+    if (cst.size != 1 || cst.misses != 1 || cst.hits != 1) {
+        fprintf(stderr, "unexpected cache stats\n");
+        exit(-1);
+    }
+
     if (storage_rm_file(&st, fid) != 0) {
         perror("failed to remove pfile");
         exit(-1);
     }
 
+    // queued removes are done by the queue thread
+    if (storage_rmq_start(&st, 0) != 0) {
+        perror("failed to start removes queue");
+        exit(-1);
+    }
+    if (storage_truncate(&st, fid, 0, rozofs_psizes[0], 10) != 0) {
+        perror("failed to truncate pfile");
+        exit(-1);
+    }
+    if (storage_rm_queue(&st, fid) != 0) {
+        perror("failed to queue pfile remove");
+        exit(-1);
+    }
+    for (i = 0; i < 100; i++) {
+        storage_rmq_stat(&st, &qst);
+        if (qst.depth == 0)
+            break;
+        usleep(10000);
+    }
+    uuid_unparse(fid, path + sprintf(path, "/tmp/"));
+    strcat(path, "-0.bins");
+    if (qst.depth != 0 || qst.removed != 1 || access(path, F_OK) == 0) {
+        fprintf(stderr, "queued remove not done\n");
+        exit(-1);
+    }
+
+    // the same through io_uring when it is supported
+    if (storage_ring_open(&st, 16) != 0) {
+        printf("no io_uring: %s\n", strerror(errno));
+    } else {
+        len = 2 * rozofs_psizes[0] * sizeof (bin_t);
+        free(bins);
+        bins = xmalloc(len);
+        rbins = xmalloc(len);
+        memset(bins, 7, len);
+        uuid_generate(fid);
+        if (storage_write(&st, fid, 0, rozofs_psizes[0], 3, 2, len, bins,
+                          crcs) != 0 ||
+            storage_read(&st, fid, 0, rozofs_psizes[0], 3, 2, rbins,
+                         rcrcs) != 0) {
+            perror("failed to write and read through io_uring");
+            exit(-1);
+        }
+        if (memcmp(bins, rbins, len) != 0 || rcrcs[0] != 1 || rcrcs[1] != 2) {
+            fprintf(stderr, "unexpected bins read through io_uring\n");
+            exit(-1);
+        }
+        storage_rm_file(&st, fid);
+        free(rbins);
+    }
+
+    // a root holding projections keeps its packed blocks
+    if (storage_direct_open(&st) == 0) {
+        fprintf(stderr, "O_DIRECT on a used root\n");
+        exit(-1);
+    }
+    free(bins);
+    storage_release(&st);
+
+    // blocks of a new root aligned for O_DIRECT
+    if (system("rm -rf /tmp/test_storage_direct") != 0 ||
+        mkdir("/tmp/test_storage_direct", S_IRWXU) != 0 ||
+        storage_initialize(&st, sid, "/tmp/test_storage_direct", 1, 32,
+                           STORAGE_SHARDS) != 0 ||
+        storage_direct_open(&st) != 0) {
+        perror("failed to open storage with O_DIRECT");
+        exit(-1);
+    }
+    len = 2 * rozofs_psizes[0] * sizeof (bin_t);
+    bins = xmalloc(len);
+    rbins = xmalloc(len);
+    memset(bins, 9, len);
+    uuid_generate(fid);
+    if (storage_write(&st, fid, 0, rozofs_psizes[0], 1, 2, len, bins,
+                      crcs) != 0 ||
+        storage_read(&st, fid, 0, rozofs_psizes[0], 1, 2, rbins, rcrcs) != 0) {
+        perror("failed to write and read with O_DIRECT");
+        exit(-1);
+    }
+    if (memcmp(bins, rbins, len) != 0 || rcrcs[0] != 1 || rcrcs[1] != 2) {
+        fprintf(stderr, "unexpected bins read with O_DIRECT\n");
+        exit(-1);
+    }
+    // the alignment is kept
+    storage_release(&st);
+    if (storage_initialize(&st, sid, "/tmp/test_storage_direct", 1, 32,
+                           STORAGE_SHARDS) != 0 || st.align == 0 ||
+        storage_read(&st, fid, 0, rozofs_psizes[0], 1, 2, rbins, rcrcs) != 0
+        || memcmp(bins, rbins, len) != 0) {
+        fprintf(stderr, "unexpected bins read from aligned slots\n");
+        exit(-1);
+    }
+    storage_release(&st);
+
+    // durable writes, in files and in the container
+    if (system("rm -rf /tmp/test_storage_durable") != 0 ||
+        mkdir("/tmp/test_storage_durable", S_IRWXU) != 0 ||
+        storage_initialize(&st, sid, "/tmp/test_storage_durable", 1, 32,
+                           STORAGE_SHARDS) != 0 ||
+        storage_ct_open(&st) != 0 || storage_sync_start(&st, 100, 4) != 0) {
+        perror("failed to open storage with durable writes");
+        exit(-1);
+    }
+    uuid_generate(fid);
+    if (storage_write(&st, fid, 0, rozofs_psizes[0], 0, 2, len, bins,
+                      crcs) != 0 ||
+        storage_truncate(&st, fid, 0, rozofs_psizes[0], 1) != 0 ||
+        storage_write(&st, fid, 0, rozofs_psizes[0], CONTAINER_MAX /
+                      (rozofs_psizes[0] * sizeof (bin_t)), 2, len, bins,
+                      crcs) != 0 ||
+        storage_read(&st, fid, 0, rozofs_psizes[0], 0, 2, rbins, rcrcs) != 0
+        || memcmp(bins, rbins, len) != 0) {
+        perror("failed to write durably");
+        exit(-1);
+    }
+    storage_sync_stat(&st, &yst);
+    // the root and the fan-out directory of the created file
+    if (yst.writes != 3 || yst.batches == 0 || yst.files != 1 ||
+        yst.dirs != 2) {
+        fprintf(stderr, "unexpected sync stats\n");
+        exit(-1);
+    }
+    storage_release(&st);
+
+    // writes past the file size limit are short then fail
+    if (system("rm -rf /tmp/test_storage_full") != 0 ||
+        mkdir("/tmp/test_storage_full", S_IRWXU) != 0 ||
+        storage_initialize(&st, sid, "/tmp/test_storage_full", 1, 32,
+                           STORAGE_SHARDS) != 0 ||
+        getrlimit(RLIMIT_FSIZE, &rl) != 0) {
+        perror("failed to open storage");
+        exit(-1);
+    }
+    signal(SIGXFSZ, SIG_IGN);
+    fsize = rl.rlim_cur;
+    rl.rlim_cur = len / 2;
+    uuid_generate(fid);
+    errno = 0;
+    if (setrlimit(RLIMIT_FSIZE, &rl) != 0 ||
+        storage_write(&st, fid, 0, rozofs_psizes[0], 0, 2, len, bins,
+                      crcs) == 0 || errno != ENOSPC) {
+        fprintf(stderr, "unexpected short write\n");
+        exit(-1);
+    }
+    errno = 0;
+    if (storage_write(&st, fid, 0, rozofs_psizes[0], 2, 2, len, bins,
+                      crcs) == 0 || errno != EFBIG) {
+        fprintf(stderr, "unexpected failed write\n");
+        exit(-1);
+    }
+    rl.rlim_cur = fsize;
+    if (setrlimit(RLIMIT_FSIZE, &rl) != 0) {
+        perror("failed to restore the file size limit");
+        exit(-1);
+    }
+    signal(SIGXFSZ, SIG_DFL);
     storage_release(&st);
+
+    // corrupted blocks are found by the scrubber, in files and containers
+    if (system("rm -rf /tmp/test_storage_scrub") != 0 ||
+        mkdir("/tmp/test_storage_scrub", S_IRWXU) != 0 ||
+        storage_initialize(&st, sid, "/tmp/test_storage_scrub", 1, 32,
+                           STORAGE_SHARDS) != 0 || storage_ct_open(&st) != 0) {
+        perror("failed to open storage to scrub");
+        exit(-1);
+    }
+    uuid_generate(fid);
+    uuid_generate(cfid);
+    i = CONTAINER_MAX / (rozofs_psizes[0] * sizeof (bin_t));
+    crcs[0] = crc32c(0, bins, len / 2);
+    crcs[1] = crc32c(0, (char *) bins + len / 2, len / 2);
+    if (storage_write(&st, fid, 0, rozofs_psizes[0], i, 2, len, bins,
+                      crcs) != 0 ||
+        storage_write(&st, cfid, 0, rozofs_psizes[0], 0, 2, len, bins,
+                      crcs) != 0) {
+        perror("failed to write blocks to scrub");
+        exit(-1);
+    }
+    uuid_unparse(fid, fid_str);
+    storage_fanout_dir("/tmp/test_storage_scrub", 1, fid_str, path);
+    sprintf(path + strlen(path), "/%s-0.bins", fid_str);
+    c = 0;
+    if ((fd = open(path, O_WRONLY)) < 0 ||
+        pwrite(fd, &c, 1, (i + 1) * rozofs_psizes[0] * sizeof (bin_t)) != 1
+        || close(fd) != 0 ||
+        (fd = open("/tmp/test_storage_scrub/.containers/00000001",
+                   O_WRONLY)) < 0 || pwrite(fd, &c, 1, 64) != 1 ||
+        close(fd) != 0) {
+        perror("failed to corrupt blocks");
+        exit(-1);
+    }
+    if (storage_scrub_start(&st, 0, 3600) != 0) {
+        perror("failed to start scrubber");
+        exit(-1);
+    }
+    for (i = 0; i < 100; i++) {
+        storage_scrub_stat(&st, &bst);
+        if (bst.passes > 0)
+            break;
+        usleep(10000);
+    }
+    if (bst.passes != 1 || bst.files != 2 || bst.bad != 3) {
+        fprintf(stderr, "unexpected scrub stats\n");
+        exit(-1);
+    }
+    storage_release(&st);
+    i = 0;
+    if ((f = fopen("/tmp/test_storage_scrub/" STORAGE_BADBLOCKS_FILE, "r"))) {
+        while (fgets(path, sizeof (path), f))
+            i++;
+        fclose(f);
+    }
+    if (i != 2) {
+        fprintf(stderr, "bad blocks not reported\n");
+        exit(-1);
+    }
+
+    // projections spread over roots
+    if (system("rm -rf /tmp/test_storage_roots") != 0 ||
+        mkdir("/tmp/test_storage_roots", S_IRWXU) != 0 ||
+        mkdir(roots[0], S_IRWXU) != 0 || mkdir(roots[1], S_IRWXU) != 0 ||
+        mkdir(roots[2], S_IRWXU) != 0 ||
+        storage_initialize_roots(&st, sid, roots, 3, 1, 32,
+                                 STORAGE_SHARDS) != 0) {
+        perror("failed to open storage of several roots");
+        exit(-1);
+    }
+    for (i = 0; i < 64; i++) {
+        uuid_generate(fids[i]);
+        memset(bins, i, len);
+        if (storage_write(&st, fids[i], 1, rozofs_psizes[0], 0, 2, len, bins,
+                          crcs) != 0) {
+            perror("failed to write to storage of several roots");
+            exit(-1);
+        }
+    }
+    for (i = 0; i < 64; i++) {
+        memset(bins, i, len);
+        if (storage_read(&st, fids[i], 1, rozofs_psizes[0], 0, 2, rbins,
+                         rcrcs) != 0 || memcmp(bins, rbins, len) != 0) {
+            fprintf(stderr, "unexpected bins read from several roots\n");
+            exit(-1);
+        }
+    }
+    // each root holds some, the file system is counted once
+    for (i = 0; i < 3; i++) {
+        sprintf(path, "find %s -name '*.bins' | grep -q .", roots[i]);
+        if (system(path) != 0) {
+            fprintf(stderr, "root %s unused\n", roots[i]);
+            exit(-1);
+        }
+    }
+    if (storage_stat(&st, &sst) != 0 ||
+        storage_stat(st.disks, &rsst) != 0 || sst.size != rsst.size) {
+        fprintf(stderr, "unexpected stat of several roots\n");
+        exit(-1);
+    }
+    for (i = 0; i < 64; i++)
+        storage_rm_file(&st, fids[i]);
+    storage_release(&st);
+    // their order is kept
+    roots[0] = "/tmp/test_storage_roots/b";
+    roots[1] = "/tmp/test_storage_roots/a";
+    if (storage_initialize_roots(&st, sid, roots, 3, 1, 32,
+                                 STORAGE_SHARDS) == 0) {
+        fprintf(stderr, "roots reordered\n");
+        exit(-1);
+    }
+
+    // blocks read twice are read from the cache until written
+    if (system("rm -rf /tmp/test_storage_cache") != 0 ||
+        mkdir("/tmp/test_storage_cache", S_IRWXU) != 0 ||
+        storage_initialize(&st, sid, "/tmp/test_storage_cache", 1, 32,
+                           STORAGE_SHARDS) != 0 ||
+        storage_bc_open(&st, 1 << 20) != 0) {
+        perror("failed to open storage with a block cache");
+        exit(-1);
+    }
+    uuid_generate(fid);
+    memset(bins, 1, len);
+    if (storage_write(&st, fid, 1, rozofs_psizes[0], 0, 2, len, bins,
+                      crcs) != 0) {
+        perror("failed to write blocks to cache");
+        exit(-1);
+    }
+    if (storage_read_file(&st, fid, 1, rozofs_psizes[0], 0, 2, rcrcs, &fd,
+                          &off, &file) != 1) {
+        fprintf(stderr, "blocks read once not sent from their file\n");
+        exit(-1);
+    }
+    storage_read_done(file);
+    for (i = 0; i < 2; i++) {
+        memset(rbins, 0, len);
+        if (storage_read_file(&st, fid, 1, rozofs_psizes[0], 0, 2, rcrcs,
+                              &fd, &off, &file) != 0 ||
+            storage_read(&st, fid, 1, rozofs_psizes[0], 0, 2, rbins,
+                         rcrcs) != 0 || memcmp(bins, rbins, len) != 0 ||
+            memcmp(crcs, rcrcs, sizeof (crcs)) != 0) {
+            fprintf(stderr, "unexpected blocks read through cache\n");
+            exit(-1);
+        }
+    }
+    if (!storage_bc_stat(&st, &hst) || hst.hits != 2 || hst.misses != 4 ||
+        hst.size == 0) {
+        fprintf(stderr, "unexpected block cache stats\n");
+        exit(-1);
+    }
+    memset(bins, 2, len);
+    if (storage_write(&st, fid, 1, rozofs_psizes[0], 0, 2, len, bins,
+                      crcs) != 0 ||
+        storage_read(&st, fid, 1, rozofs_psizes[0], 0, 2, rbins,
+                     rcrcs) != 0 || memcmp(bins, rbins, len) != 0) {
+        fprintf(stderr, "stale blocks read from cache\n");
+        exit(-1);
+    }
+    // a scan doesn't evict hot blocks
+    storage_read(&st, fid, 1, rozofs_psizes[0], 0, 2, rbins, rcrcs);
+    for (i = 0; i < 64; i++) {
+        uuid_generate(fids[i]);
+        if (storage_write(&st, fids[i], 1, rozofs_psizes[0], 0, 2, len, bins,
+                          crcs) != 0 ||
+            storage_read(&st, fids[i], 1, rozofs_psizes[0], 0, 2, rbins,
+                         rcrcs) != 0) {
+            perror("failed to scan blocks");
+            exit(-1);
+        }
+    }
+    storage_bc_stat(&st, &hst);
+    hits = hst.hits;
+    if (storage_read(&st, fid, 1, rozofs_psizes[0], 0, 2, rbins,
+                     rcrcs) != 0 || memcmp(bins, rbins, len) != 0 ||
+        !storage_bc_stat(&st, &hst) || hst.hits != hits + 2 ||
+        hst.evictions != 0) {
+        fprintf(stderr, "hot blocks evicted by a scan\n");
+        exit(-1);
+    }
+    // nor are removed ones kept
+    storage_rm_file(&st, fid);
+    if (!storage_bc_stat(&st, &hst) || hst.size != 0) {
+        fprintf(stderr, "removed blocks kept in cache\n");
+        exit(-1);
+    }
+    for (i = 0; i < 64; i++)
+        storage_rm_file(&st, fids[i]);
+    storage_release(&st);
+
+    // sequential reads are prefetched and dropped behind
+    if (storage_initialize(&st, sid, "/tmp/test_storage_cache", 1, 32,
+                           STORAGE_SHARDS) != 0 ||
+        storage_ra_open(&st, 4 * len, 16 * len, 1) != 0) {
+        perror("failed to open storage with read-ahead");
+        exit(-1);
+    }
+    uuid_generate(fid);
+    for (i = 0; i < 64; i += 2) {
+        if (storage_write(&st, fid, 0, rozofs_psizes[0], i, 2, len, bins,
+                          crcs) != 0) {
+            perror("failed to write blocks to read ahead");
+            exit(-1);
+        }
+    }
+    for (i = 0; i < 64; i += 2) {
+        if (storage_read(&st, fid, 0, rozofs_psizes[0], i, 2, rbins,
+                         rcrcs) != 0) {
+            perror("failed to read blocks ahead");
+            exit(-1);
+        }
+        // out of sequence: a new stream
+        if (i == 32 && storage_read(&st, fid, 0, rozofs_psizes[0], 0, 2,
+                                    rbins, rcrcs) != 0) {
+            perror("failed to read blocks");
+            exit(-1);
+        }
+    }
+    storage_ra_stat(&st, &rst);
+    if (rst.streams != 2 || rst.hits == 0 || rst.prefetched == 0 ||
+        rst.dropped == 0) {
+        fprintf(stderr, "unexpected read-ahead stats\n");
+        exit(-1);
+    }
+    storage_rm_file(&st, fid);
+    storage_release(&st);
+
+    free(bins);
+    free(rbins);
     exit(0);
 }
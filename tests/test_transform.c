@@ -19,6 +19,9 @@ int test_transform_initialize(void);
 int test_transform_release(void);
 int test_transform_forward(void);
 int test_transform_inverse(void);
+int test_transform_inverse_n(void);
+int test_transform_layouts(void);
+int test_transform_inverse_rows(void);
 
 int test_transform_initialize(void) {
     int status;
@@ -94,16 +97,23 @@ int test_transform_release(void) {
 }
 
 int test_transform_forward(void) {
-    int status;
+    int status = 0;
+    transform_kernel_t k;
 
-    memcpy(support, ref_support, 24 * sizeof (pxl_t));
-    transform_forward(support, 3, 8, 3, projections);
-    status = -!(memcmp(projections[0].bins, ref_p0_bins, 10 * sizeof (bin_t))
-                == 0 &&
-                memcmp(projections[1].bins, ref_p1_bins, 8 * sizeof (bin_t))
-                == 0 &&
-                memcmp(projections[2].bins, ref_p2_bins, 10 * sizeof (bin_t))
-                == 0);
+    // every kernel the cpu supports must give the reference projections
+    for (k = TRANSFORM_SCALAR; k <= TRANSFORM_AVX2 && status == 0; k++) {
+        if (transform_set_kernel(k) != 0)
+            continue;
+        memcpy(support, ref_support, 24 * sizeof (pxl_t));
+        transform_forward(support, 3, 8, 3, projections);
+        status =
+            -!(memcmp(projections[0].bins, ref_p0_bins, 10 * sizeof (bin_t))
+               == 0 &&
+               memcmp(projections[1].bins, ref_p1_bins, 8 * sizeof (bin_t))
+               == 0 &&
+               memcmp(projections[2].bins, ref_p2_bins, 10 * sizeof (bin_t))
+               == 0);
+    }
 
     return status;
 }
@@ -122,6 +132,195 @@ int test_transform_inverse(void) {
     return status;
 }
 
+#define NBLOCKS 7
+
+int test_transform_inverse_n(void) {
+    int status = -1;
+    pxl_t *blocks = NULL;
+    projection_t batch[3];
+    transform_kernel_t k;
+    int i, j;
+
+    for (i = 0; i < 3; i++) {
+        batch[i] = projections[i];
+        batch[i].bins = NULL;
+    }
+    if ((blocks = malloc(NBLOCKS * 24 * sizeof (pxl_t))) == NULL)
+        goto out;
+    for (i = 0; i < 3; i++) {
+        if ((batch[i].bins = malloc(NBLOCKS * batch[i].size *
+                                    sizeof (bin_t))) == NULL)
+            goto out;
+    }
+
+    // block j is the reference support xored with j
+    for (j = 0; j < NBLOCKS; j++) {
+        for (i = 0; i < 24; i++)
+            blocks[j * 24 + i] = ref_support[i] ^ j;
+    }
+    transform_forward_n(blocks, 3, 8, 3, batch, NBLOCKS);
+
+    // lanes kernels take the blocks by groups, the rest is done one by one
+    status = 0;
+    for (k = TRANSFORM_SCALAR; k <= TRANSFORM_AVX2 && status == 0; k++) {
+        if (transform_set_kernel(k) != 0)
+            continue;
+        memset(blocks, 0, NBLOCKS * 24 * sizeof (pxl_t));
+        transform_inverse_n(blocks, 3, 8, 3, batch, NBLOCKS);
+        for (j = 0; j < NBLOCKS; j++) {
+            for (i = 0; i < 24; i++) {
+                if (blocks[j * 24 + i] != (ref_support[i] ^ j))
+                    status = -1;
+            }
+        }
+    }
+
+out:
+    for (i = 0; i < 3; i++) {
+        if (batch[i].bins != NULL)
+            free(batch[i].bins);
+    }
+    if (blocks != NULL)
+        free(blocks);
+    return status;
+}
+
+/*
+ * The layout kernels must match the generic transform, with the edges of
+ * the projections larger (cols = 32) or smaller (cols = 128) than cols.
+ */
+int test_transform_layouts(void) {
+    int status = -1;
+    int rows, np, cols, i;
+    pxl_t *block = NULL;
+    bin_t *bins = NULL;
+    projection_t ref[12], lay[12];
+
+    for (rows = 2; rows <= 8; rows *= 2) {
+        np = rows + rows / 2;
+        for (cols = 32; cols <= 128; cols *= 4) {
+            const transform_ops_t *ops = transform_get_ops(rows, np);
+            int size = 0;
+
+            block = malloc(2 * rows * cols * sizeof (pxl_t));
+            for (i = 0; i < np; i++)
+                size += abs(i - np / 2) * (rows - 1) + cols;
+            bins = malloc(2 * size * sizeof (bin_t));
+            if (block == NULL || bins == NULL)
+                goto out;
+
+            for (i = 0, size = 0; i < np; i++) {
+                ref[i].angle.p = i - np / 2;
+                ref[i].angle.q = 1;
+                ref[i].size = abs(i - np / 2) * (rows - 1) + cols;
+                ref[i].bins = bins + size;
+                lay[i] = ref[i];
+                lay[i].bins = bins + size + ref[i].size;
+                size += 2 * ref[i].size;
+            }
+            for (i = 0; i < rows * cols; i++)
+                block[i] = random();
+
+            transform_forward_n(block, rows, cols, np, ref, 1);
+            ops->forward(block, rows, cols, np, lay, 1);
+            for (i = 0; i < np; i++) {
+                if (memcmp(ref[i].bins, lay[i].bins,
+                           ref[i].size * sizeof (bin_t)) != 0)
+                    goto out;
+            }
+
+            // rebuild from the last rows projections
+            ops->inverse(block + rows * cols, rows, cols, rows,
+                         lay + np - rows, 1);
+            if (memcmp(block, block + rows * cols,
+                       rows * cols * sizeof (pxl_t)) != 0)
+                goto out;
+
+            free(block);
+            free(bins);
+            block = NULL;
+            bins = NULL;
+        }
+    }
+    status = 0;
+out:
+    if (block != NULL)
+        free(block);
+    if (bins != NULL)
+        free(bins);
+    return status;
+}
+
+/*
+ * Systematic mode: every set of lost rows must be rebuilt from any as many
+ * parity projections (np = rows / 2 of angles p = i - np / 2).
+ */
+int test_transform_inverse_rows(void) {
+    int status = -1;
+    int rows, np, cols = 32, i, l;
+    unsigned lmask, pmask;
+    pxl_t *block = NULL;
+    bin_t *bins = NULL;
+    projection_t parity[4], used[4];
+
+    for (rows = 2; rows <= 8; rows *= 2) {
+        np = rows / 2;
+        block = malloc(2 * rows * cols * sizeof (pxl_t));
+        bins = malloc(np * (2 * (rows - 1) + cols) * sizeof (bin_t));
+        if (block == NULL || bins == NULL)
+            goto out;
+
+        for (i = 0; i < np; i++) {
+            parity[i].angle.p = i - np / 2;
+            parity[i].angle.q = 1;
+            parity[i].size = abs(i - np / 2) * (rows - 1) + cols;
+            parity[i].bins = bins + i * (2 * (rows - 1) + cols);
+        }
+        for (i = 0; i < rows * cols; i++)
+            block[i] = random();
+        transform_forward(block, rows, cols, np, parity);
+
+        for (lmask = 1; lmask < (1u << rows); lmask++) {
+            int lost[8], nlost = 0;
+            for (l = 0; l < rows; l++)
+                if (lmask & (1u << l))
+                    lost[nlost++] = l;
+            if (nlost > np)
+                continue;
+            for (pmask = 1; pmask < (1u << np); pmask++) {
+                if (__builtin_popcount(pmask) != nlost)
+                    continue;
+                for (i = 0, l = 0; i < np; i++)
+                    if (pmask & (1u << i))
+                        used[l++] = parity[i];
+                memcpy(block + rows * cols, block,
+                       rows * cols * sizeof (pxl_t));
+                for (l = 0; l < nlost; l++)
+                    memset(block + rows * cols + lost[l] * cols, 0,
+                           cols * sizeof (pxl_t));
+                if (transform_inverse_rows(block + rows * cols, rows, cols,
+                                           nlost, lost, used) != 0)
+                    goto out;
+                if (memcmp(block, block + rows * cols,
+                           rows * cols * sizeof (pxl_t)) != 0)
+                    goto out;
+            }
+        }
+
+        free(block);
+        free(bins);
+        block = NULL;
+        bins = NULL;
+    }
+    status = 0;
+out:
+    if (block != NULL)
+        free(block);
+    if (bins != NULL)
+        free(bins);
+    return status;
+}
+
 int main(int argc, char **argv) {
 
     if (test_transform_initialize() != 0) {
@@ -142,6 +341,24 @@ int main(int argc, char **argv) {
         exit(-1);
     }
 
+    if (test_transform_inverse_n() != 0) {
+        perror("Failed to test inverse_n");
+        test_transform_release();
+        exit(-1);
+    }
+
+    if (test_transform_layouts() != 0) {
+        perror("Failed to test layouts");
+        test_transform_release();
+        exit(-1);
+    }
+
+    if (test_transform_inverse_rows() != 0) {
+        perror("Failed to test inverse_rows");
+        test_transform_release();
+        exit(-1);
+    }
+
     test_transform_release();
     exit(0);
 }
@@ -25,7 +25,7 @@ int main(int argc, char **argv) {
         };
 
         // Initialize rozofs
-        rozofs_initialize(LAYOUT_4_6_8);
+        rozofs_initialize(LAYOUT_4_6_8, ROZOFS_BSIZE);
 
         // Initialize volume
         if (volume_initialize() != 0) {
@@ -0,0 +1,413 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BENCH_TSC
+#endif
+
+#include "xmalloc.h"
+#include "transform.h"
+
+/*
+ * Transform benchmark: sweeps the rozofs layouts, block sizes, kernels,
+ * storage modes and erasure patterns (which inverse of the forward chunks
+ * survive), and reports throughput, cycles per byte and per block latency
+ * percentiles as text, CSV or JSON so that runs can be compared over time.
+ *
+ * Every call transforms a batch of blocks (-B): latencies are the call
+ * time divided by the batch, use -B 1 for the latency of single blocks.
+ * Inverse results are checked against the original blocks before being
+ * timed.
+ */
+
+#define BENCH_LOOPS 32          // timed calls per measure
+#define BENCH_BATCH 16          // blocks per call
+#define BENCH_FORWARD_MAX 12
+
+typedef enum bench_format {
+    FORMAT_TEXT, FORMAT_CSV, FORMAT_JSON
+} bench_format_t;
+
+typedef enum bench_mode {
+    BENCH_MOJETTE, BENCH_SYSTEMATIC
+} bench_mode_t;
+
+static const char *mode_names[] = { "mojette", "systematic" };
+
+static const struct {
+    int inverse;
+    int forward;
+} layouts[] = { {2, 3}, {4, 6}, {8, 12} };
+
+static const int bsizes[] = { 4096, 8192, 16384, 65536 };
+
+#define NLAYOUTS (sizeof (layouts) / sizeof (layouts[0]))
+#define NBSIZES (sizeof (bsizes) / sizeof (bsizes[0]))
+
+// one layout, block size and mode: blocks, their chunks and the survivors
+typedef struct bench {
+    bench_mode_t mode;
+    int rows;
+    int cols;
+    int forward;
+    int n;                      // blocks per call
+    const transform_ops_t *ops;
+    pxl_t *support;             // the blocks
+    pxl_t *output;              // the blocks rebuilt
+    projection_t chunks[BENCH_FORWARD_MAX];
+    // survivors of the current erasure pattern
+    int nsurvivors;
+    projection_t survivors[BENCH_FORWARD_MAX];
+    int tids[BENCH_FORWARD_MAX];
+} bench_t;
+
+typedef struct bench_result {
+    double gbps;
+    double cpb;                 // cycles per byte
+    double p50;                 // per block latency (us)
+    double p99;
+} bench_result_t;
+
+static bench_format_t format = FORMAT_TEXT;
+static int nresults = 0;
+
+static inline uint64_t bench_cycles() {
+#ifdef BENCH_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static inline double bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int bench_initialize(bench_t * b, bench_mode_t mode, int rows,
+                            int forward, int bsize, int n) {
+    int i, size;
+
+    // the kernels handle rows of 8 pixels
+    if (bsize <= 0 || bsize % (rows * 8 * sizeof (pxl_t)) != 0)
+        return -1;
+    b->mode = mode;
+    b->rows = rows;
+    b->cols = bsize / sizeof (pxl_t) / rows;
+    b->forward = forward;
+    b->n = n;
+    b->ops = transform_get_ops(rows, forward);
+
+    b->support = xmalloc(n * bsize);
+    b->output = xmalloc(n * bsize);
+    for (i = 0; i < n * rows * b->cols; i++)
+        b->support[i] = ((pxl_t) random() << 32) ^ random();
+
+    for (i = 0; i < forward; i++) {
+        projection_t *p = b->chunks + i;
+        if (mode == BENCH_MOJETTE) {
+            p->angle.p = i - forward / 2;
+            p->angle.q = 1;
+        } else if (i < rows) {
+            // data chunk: row i of the blocks
+            p->angle.p = 0;
+            p->angle.q = 0;
+        } else {
+            p->angle.p = i - rows - (forward - rows) / 2;
+            p->angle.q = 1;
+        }
+        size = abs(p->angle.p) * (rows - 1) + b->cols;
+        p->size = size;
+        p->bins = xmalloc(n * size * sizeof (bin_t));
+    }
+    return 0;
+}
+
+static void bench_release(bench_t * b) {
+    int i;
+
+    for (i = 0; i < b->forward; i++)
+        free(b->chunks[i].bins);
+    free(b->support);
+    free(b->output);
+}
+
+static void bench_forward(bench_t * b) {
+    int i, j;
+
+    if (b->mode == BENCH_MOJETTE) {
+        b->ops->forward(b->support, b->rows, b->cols, b->forward, b->chunks,
+                        b->n);
+        return;
+    }
+    for (i = 0; i < b->rows; i++)
+        for (j = 0; j < b->n; j++)
+            memcpy(b->chunks[i].bins + j * b->cols,
+                   b->support + (j * b->rows + i) * b->cols,
+                   b->cols * sizeof (pxl_t));
+    b->ops->forward(b->support, b->rows, b->cols, b->forward - b->rows,
+                    b->chunks + b->rows, b->n);
+}
+
+static void bench_inverse(bench_t * b) {
+    int lost[BENCH_FORWARD_MAX];
+    int received[BENCH_FORWARD_MAX];
+    projection_t parity[BENCH_FORWARD_MAX];
+    int i, j, nlost = 0, np = 0;
+
+    if (b->mode == BENCH_MOJETTE) {
+        b->ops->inverse(b->output, b->rows, b->cols, b->rows, b->survivors,
+                        b->n);
+        return;
+    }
+    memset(received, 0, sizeof (received));
+    for (i = 0; i < b->nsurvivors; i++) {
+        if (b->tids[i] >= b->rows) {
+            parity[np++] = b->survivors[i];
+            continue;
+        }
+        received[b->tids[i]] = 1;
+        for (j = 0; j < b->n; j++)
+            memcpy(b->output + (j * b->rows + b->tids[i]) * b->cols,
+                   b->survivors[i].bins + j * b->cols,
+                   b->cols * sizeof (pxl_t));
+    }
+    if (np == 0)
+        return;
+    for (i = 0; i < b->rows; i++)
+        if (!received[i])
+            lost[nlost++] = i;
+    if (transform_inverse_rows_n(b->output, b->rows, b->cols, nlost, lost,
+                                 parity, b->n) != 0)
+        memset(b->output, 0, b->n * b->rows * b->cols * sizeof (pxl_t));
+}
+
+static int bench_cmp(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_measure(bench_t * b, void (*run) (bench_t *), int loops,
+                          bench_result_t * r) {
+    double *samples = xmalloc(loops * sizeof (double));
+    double total = 0;
+    uint64_t cycles = 0;
+    size_t bytes = (size_t) loops * b->n * b->rows * b->cols * sizeof (pxl_t);
+    int i;
+
+    run(b);                     // warm up caches and plans
+    for (i = 0; i < loops; i++) {
+        double t = bench_now();
+        uint64_t c = bench_cycles();
+        run(b);
+        cycles += bench_cycles() - c;
+        samples[i] = bench_now() - t;
+        total += samples[i];
+    }
+    qsort(samples, loops, sizeof (double), bench_cmp);
+    r->gbps = total > 0 ? bytes / total / 1e9 : 0;
+    r->cpb = (double) cycles / bytes;
+    r->p50 = samples[loops / 2] / b->n * 1e6;
+    r->p99 = samples[(loops * 99) / 100] / b->n * 1e6;
+    free(samples);
+}
+
+static void bench_print(const bench_t * b, const char *op,
+                        const char *pattern, const bench_result_t * r) {
+    const char *kernel = transform_kernel_name(transform_get_kernel());
+    int bsize = b->rows * b->cols * sizeof (pxl_t);
+
+    switch (format) {
+    case FORMAT_CSV:
+        if (nresults == 0)
+            printf("mode,kernel,layout,bsize,op,survivors,gbps,"
+                   "cycles_per_byte,p50_us,p99_us\n");
+        printf("%s,%s,%d/%d,%d,%s,%s,%.3f,%.3f,%.3f,%.3f\n",
+               mode_names[b->mode], kernel, b->rows, b->forward, bsize, op,
+               pattern, r->gbps, r->cpb, r->p50, r->p99);
+        break;
+    case FORMAT_JSON:
+        printf("%s\n  {\"mode\": \"%s\", \"kernel\": \"%s\", "
+               "\"layout\": \"%d/%d\", \"bsize\": %d, \"op\": \"%s\", "
+               "\"survivors\": \"%s\", \"gbps\": %.3f, "
+               "\"cycles_per_byte\": %.3f, \"p50_us\": %.3f, "
+               "\"p99_us\": %.3f}", nresults == 0 ? "[" : ",",
+               mode_names[b->mode], kernel, b->rows, b->forward, bsize, op,
+               pattern, r->gbps, r->cpb, r->p50, r->p99);
+        break;
+    default:
+        if (nresults == 0)
+            printf("%-10s %-6s %-6s %6s %-7s %-12s %8s %7s %9s %9s\n",
+                   "mode", "kernel", "layout", "bsize", "op", "survivors",
+                   "GB/s", "c/B", "p50(us)", "p99(us)");
+        printf("%-10s %-6s %2d/%-3d %6d %-7s %-12s %8.2f %7.2f %9.2f %9.2f\n",
+               mode_names[b->mode], kernel, b->rows, b->forward, bsize, op,
+               pattern, r->gbps, r->cpb, r->p50, r->p99);
+        break;
+    }
+    nresults++;
+}
+
+// measure forward, then inverse for every pattern of survivors
+static int bench_layout(bench_t * b, int loops, int maxpatterns) {
+    bench_result_t r;
+    char pattern[BENCH_FORWARD_MAX + 1];
+    unsigned mask;
+    int i, npatterns = 0;
+
+    memset(pattern, '1', b->forward);
+    pattern[b->forward] = 0;
+    bench_measure(b, bench_forward, loops, &r);
+    bench_print(b, "forward", pattern, &r);
+
+    for (mask = 0; mask < (1u << b->forward); mask++) {
+        if (__builtin_popcount(mask) != b->rows)
+            continue;
+        if (maxpatterns > 0 && npatterns++ == maxpatterns)
+            break;
+        b->nsurvivors = 0;
+        for (i = 0; i < b->forward; i++) {
+            pattern[i] = mask & (1u << i) ? '1' : '0';
+            if (mask & (1u << i)) {
+                b->tids[b->nsurvivors] = i;
+                b->survivors[b->nsurvivors++] = b->chunks[i];
+            }
+        }
+        memset(b->output, 0, b->n * b->rows * b->cols * sizeof (pxl_t));
+        bench_inverse(b);
+        if (memcmp(b->output, b->support,
+                   b->n * b->rows * b->cols * sizeof (pxl_t)) != 0) {
+            fprintf(stderr, "inverse %s (%s, %d/%d, survivors %s) failed\n",
+                    transform_kernel_name(transform_get_kernel()),
+                    mode_names[b->mode], b->rows, b->forward, pattern);
+            return -1;
+        }
+        bench_measure(b, bench_inverse, loops, &r);
+        bench_print(b, "inverse", pattern, &r);
+    }
+    return 0;
+}
+
+static void usage(const char *name) {
+    printf("usage: %s [-l layout] [-s bsize] [-k kernel] [-m mode] "
+           "[-n loops] [-B batch] [-p patterns] [-f text|csv|json]\n", name);
+    printf("  -l layout   0 (2/3), 1 (4/6) or 2 (8/12), all by default\n");
+    printf("  -s bsize    block size in bytes, 4096 to 65536 by default\n");
+    printf("  -k kernel   scalar, sse2 or avx2, all supported by default\n");
+    printf("  -m mode     mojette or systematic, both by default\n");
+    printf("  -n loops    timed calls per measure (default: %d)\n",
+           BENCH_LOOPS);
+    printf("  -B batch    blocks per call (default: %d)\n", BENCH_BATCH);
+    printf("  -p patterns erasure patterns per layout (default: all)\n");
+    printf("  -f format   output format (default: text)\n");
+}
+
+int main(int argc, char **argv) {
+    int layout = -1, bsize = 0, kernel = -1, mode = -1;
+    int loops = BENCH_LOOPS, batch = BENCH_BATCH, maxpatterns = 0;
+    int l, s, k, m, c, status = 0;
+
+    while ((c = getopt(argc, argv, "l:s:k:m:n:B:p:f:h")) != -1) {
+        switch (c) {
+        case 'l':
+            layout = atoi(optarg);
+            if (layout < 0 || layout >= NLAYOUTS) {
+                fprintf(stderr, "invalid layout: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's':
+            bsize = atoi(optarg);
+            break;
+        case 'k':
+            for (kernel = TRANSFORM_AVX2; kernel >= 0; kernel--)
+                if (strcmp(optarg, transform_kernel_name(kernel)) == 0)
+                    break;
+            if (kernel < 0) {
+                fprintf(stderr, "unknown kernel: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'm':
+            if (strcmp(optarg, "mojette") == 0) {
+                mode = BENCH_MOJETTE;
+            } else if (strcmp(optarg, "systematic") == 0) {
+                mode = BENCH_SYSTEMATIC;
+            } else {
+                fprintf(stderr, "unknown mode: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'n':
+            loops = atoi(optarg);
+            break;
+        case 'B':
+            batch = atoi(optarg);
+            break;
+        case 'p':
+            maxpatterns = atoi(optarg);
+            break;
+        case 'f':
+            if (strcmp(optarg, "csv") == 0) {
+                format = FORMAT_CSV;
+            } else if (strcmp(optarg, "json") == 0) {
+                format = FORMAT_JSON;
+            } else if (strcmp(optarg, "text") == 0) {
+                format = FORMAT_TEXT;
+            } else {
+                fprintf(stderr, "unknown format: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (loops <= 0 || batch <= 0) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    srandom(0x20100);
+    for (k = TRANSFORM_SCALAR; k <= TRANSFORM_AVX2; k++) {
+        if ((kernel >= 0 && k != kernel) || transform_set_kernel(k) != 0)
+            continue;
+        for (m = BENCH_MOJETTE; m <= BENCH_SYSTEMATIC; m++) {
+            if (mode >= 0 && m != mode)
+                continue;
+            for (l = 0; l < NLAYOUTS; l++) {
+                if (layout >= 0 && l != layout)
+                    continue;
+                for (s = 0; s < NBSIZES; s++) {
+                    bench_t b;
+                    int size = bsize > 0 ? bsize : bsizes[s];
+                    if (bsize > 0 && s > 0)
+                        break;
+                    if (bench_initialize(&b, m, layouts[l].inverse,
+                                         layouts[l].forward, size,
+                                         batch) != 0) {
+                        fprintf(stderr, "block size %d not supported by "
+                                "layout %d/%d\n", size, layouts[l].inverse,
+                                layouts[l].forward);
+                        continue;
+                    }
+                    if (bench_layout(&b, loops, maxpatterns) != 0)
+                        status = 1;
+                    bench_release(&b);
+                }
+            }
+        }
+    }
+    if (format == FORMAT_JSON)
+        printf("%s\n", nresults == 0 ? "[]" : "\n]");
+
+    exit(status == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
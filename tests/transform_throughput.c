@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <sys/time.h>
 
 #include "xmalloc.h"
 #include "transform.h"
@@ -10,6 +11,7 @@
 #define BSIZE 8192              //BYTES
 #define FORWARD 6
 #define INVERSE	4
+#define BATCH 16                // blocks per transform_*_n call
 
 int timeval_subtract(struct timeval *result, struct timeval *t2,
                      struct timeval *t1) {
@@ -40,14 +42,16 @@ int main(int argc, char **argv) {
     struct timeval tic;
     struct timeval toc;
     struct timeval elapse;
+    transform_kernel_t k;
+    long usec, scalar_usec = 0, scalar_usec_n = 0;
 
     if (argc < 2) {
         printf("%s : nr loop\n", argv[0]);
         return -1;
     }
     nrloop = atoi(argv[1]);
-    support = xmalloc(BSIZE);
-    memset(support, 1, BSIZE);
+    support = xmalloc(BSIZE * BATCH);
+    memset(support, 1, BSIZE * BATCH);
     projections = xmalloc(FORWARD * sizeof (projection_t));
     for (mp = 0; mp < FORWARD; mp++) {
         projections[mp].angle.p = mp - FORWARD / 2;
@@ -55,24 +59,70 @@ int main(int argc, char **argv) {
         projections[mp].size =
             abs(mp - FORWARD / 2) * (INVERSE - 1) +
             (BSIZE / sizeof (pxl_t) / INVERSE - 1) + 1;
-        projections[mp].bins = xmalloc(projections[mp].size * sizeof (bin_t));
+        projections[mp].bins =
+            xmalloc(projections[mp].size * sizeof (bin_t) * BATCH);
     }
 
-    gettimeofday(&tic, NULL);
-    for (done = 0; done < nrloop; done++)
-        transform_forward(support, INVERSE, BSIZE / INVERSE / sizeof (pxl_t),
-                          FORWARD, projections);
-    gettimeofday(&toc, NULL);
-    timeval_subtract(&elapse, &toc, &tic);
-    printf("Forward: %ld.%06ld\n", elapse.tv_sec, elapse.tv_usec);
+    for (k = TRANSFORM_SCALAR; k <= TRANSFORM_AVX2; k++) {
+        if (transform_set_kernel(k) != 0) {
+            printf("Forward (%s): not supported\n", transform_kernel_name(k));
+            continue;
+        }
+        gettimeofday(&tic, NULL);
+        for (done = 0; done < nrloop; done++)
+            transform_forward(support, INVERSE,
+                              BSIZE / INVERSE / sizeof (pxl_t), FORWARD,
+                              projections);
+        gettimeofday(&toc, NULL);
+        timeval_subtract(&elapse, &toc, &tic);
+        usec = elapse.tv_sec * 1000000L + elapse.tv_usec;
+        if (k == TRANSFORM_SCALAR)
+            scalar_usec = usec;
+        printf("Forward (%s): %ld.%06ld (speedup: %.2f)\n",
+               transform_kernel_name(k), elapse.tv_sec, elapse.tv_usec,
+               usec > 0 ? (double) scalar_usec / usec : 0.0);
 
-    gettimeofday(&tic, NULL);
-    for (done = 0; done < nrloop; done++)
-        transform_inverse(support, INVERSE, BSIZE / INVERSE / sizeof (pxl_t),
-                          INVERSE, projections);
-    gettimeofday(&toc, NULL);
-    timeval_subtract(&elapse, &toc, &tic);
-    printf("Inverse: %ld.%06ld\n", elapse.tv_sec, elapse.tv_usec);
+        gettimeofday(&tic, NULL);
+        for (done = 0; done < nrloop; done += BATCH)
+            transform_forward_n(support, INVERSE,
+                                BSIZE / INVERSE / sizeof (pxl_t), FORWARD,
+                                projections, BATCH);
+        gettimeofday(&toc, NULL);
+        timeval_subtract(&elapse, &toc, &tic);
+        printf("Forward x%d (%s): %ld.%06ld\n", BATCH,
+               transform_kernel_name(k), elapse.tv_sec, elapse.tv_usec);
+    }
+
+    for (k = TRANSFORM_SCALAR; k <= TRANSFORM_AVX2; k++) {
+        if (transform_set_kernel(k) != 0) {
+            printf("Inverse (%s): not supported\n", transform_kernel_name(k));
+            continue;
+        }
+        gettimeofday(&tic, NULL);
+        for (done = 0; done < nrloop; done++)
+            transform_inverse(support, INVERSE,
+                              BSIZE / INVERSE / sizeof (pxl_t), INVERSE,
+                              projections);
+        gettimeofday(&toc, NULL);
+        timeval_subtract(&elapse, &toc, &tic);
+        printf("Inverse (%s): %ld.%06ld\n", transform_kernel_name(k),
+               elapse.tv_sec, elapse.tv_usec);
+
+        // single blocks always go through the scalar path, batches use lanes
+        gettimeofday(&tic, NULL);
+        for (done = 0; done < nrloop; done += BATCH)
+            transform_inverse_n(support, INVERSE,
+                                BSIZE / INVERSE / sizeof (pxl_t), INVERSE,
+                                projections, BATCH);
+        gettimeofday(&toc, NULL);
+        timeval_subtract(&elapse, &toc, &tic);
+        usec = elapse.tv_sec * 1000000L + elapse.tv_usec;
+        if (k == TRANSFORM_SCALAR)
+            scalar_usec_n = usec;
+        printf("Inverse x%d (%s): %ld.%06ld (speedup: %.2f)\n", BATCH,
+               transform_kernel_name(k), elapse.tv_sec, elapse.tv_usec,
+               usec > 0 ? (double) scalar_usec_n / usec : 0.0);
+    }
 
     return 0;
 }